@@ -0,0 +1,308 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "custom_engine/fusion_compiler.h"
+
+#include <glog/logging.h>
+
+#include <functional>
+#include <list>
+#include <utility>
+
+#include "paddle/fluid/pir/dialect/kernel/ir/kernel_type.h"
+#include "paddle/fluid/pir/dialect/operator/ir/op_attribute.h"
+#include "paddle/fluid/pir/dialect/operator/utils/utils.h"
+#include "paddle/phi/core/enforce.h"
+#include "paddle/pir/include/core/builtin_attribute.h"
+#include "paddle/pir/include/core/builtin_op.h"
+#include "paddle/pir/include/core/builtin_type.h"
+#include "paddle/pir/include/dialect/control_flow/ir/cf_op.h"
+
+namespace custom_engine {
+namespace {
+
+using Value = FusionProgram::Value;
+using LowerFunc = std::function<Value(
+    FusionProgram*, const pir::Operation*, const std::vector<Value>&)>;
+
+struct FusableOp {
+  size_t num_inputs;
+  LowerFunc lower;
+};
+
+float FloatAttr(const pir::Operation* op, const char* name, float dflt) {
+  if (!op->HasAttribute(name)) return dflt;
+  return op->attribute<pir::FloatAttribute>(name).data();
+}
+
+bool BoolAttr(const pir::Operation* op, const char* name, bool dflt) {
+  if (!op->HasAttribute(name)) return dflt;
+  return op->attribute<pir::BoolAttribute>(name).data();
+}
+
+FusableOp UnaryOp(FusionOpcode opcode) {
+  return {1, [opcode](FusionProgram* p, const pir::Operation*,
+                      const std::vector<Value>& in) {
+            return p->Unary(opcode, in[0]);
+          }};
+}
+
+FusableOp BinaryOp(FusionOpcode opcode) {
+  return {2, [opcode](FusionProgram* p, const pir::Operation*,
+                      const std::vector<Value>& in) {
+            return p->Binary(opcode, in[0], in[1]);
+          }};
+}
+
+// pd_op.scale carries its scale as a second operand fed by a full op, which
+// is loaded like any other input and broadcast.
+Value LowerScale(FusionProgram* p,
+                 const pir::Operation* op,
+                 const std::vector<Value>& in) {
+  float bias = FloatAttr(op, "bias", 0.f);
+  Value x = in[0];
+  if (in.size() == 1) {
+    float scale = FloatAttr(op, "scale", 1.f);
+    return BoolAttr(op, "bias_after_scale", true)
+               ? p->Unary(FusionOpcode::kScale, x, scale, bias)
+               : p->Unary(FusionOpcode::kScale, x, scale, bias * scale);
+  }
+  if (BoolAttr(op, "bias_after_scale", true)) {
+    x = p->Binary(FusionOpcode::kMul, x, in[1]);
+    return bias == 0.f ? x : p->Unary(FusionOpcode::kScale, x, 1.f, bias);
+  }
+  if (bias != 0.f) x = p->Unary(FusionOpcode::kScale, x, 1.f, bias);
+  return p->Binary(FusionOpcode::kMul, x, in[1]);
+}
+
+const std::unordered_map<std::string, FusableOp>& FusableOps() {
+  static const auto* ops = new std::unordered_map<std::string, FusableOp>{
+      {"pd_op.add", BinaryOp(FusionOpcode::kAdd)},
+      {"pd_op.subtract", BinaryOp(FusionOpcode::kSub)},
+      {"pd_op.multiply", BinaryOp(FusionOpcode::kMul)},
+      {"pd_op.divide", BinaryOp(FusionOpcode::kDiv)},
+      {"pd_op.maximum", BinaryOp(FusionOpcode::kMax)},
+      {"pd_op.minimum", BinaryOp(FusionOpcode::kMin)},
+      {"pd_op.elementwise_pow", BinaryOp(FusionOpcode::kPow)},
+      {"pd_op.abs", UnaryOp(FusionOpcode::kAbs)},
+      {"pd_op.exp", UnaryOp(FusionOpcode::kExp)},
+      {"pd_op.log", UnaryOp(FusionOpcode::kLog)},
+      {"pd_op.sqrt", UnaryOp(FusionOpcode::kSqrt)},
+      {"pd_op.rsqrt", UnaryOp(FusionOpcode::kRsqrt)},
+      {"pd_op.square", UnaryOp(FusionOpcode::kSquare)},
+      {"pd_op.reciprocal", UnaryOp(FusionOpcode::kReciprocal)},
+      {"pd_op.relu", UnaryOp(FusionOpcode::kRelu)},
+      {"pd_op.sigmoid", UnaryOp(FusionOpcode::kSigmoid)},
+      {"pd_op.tanh", UnaryOp(FusionOpcode::kTanh)},
+      {"pd_op.silu", UnaryOp(FusionOpcode::kSilu)},
+      {"pd_op.gelu",
+       {1,
+        [](FusionProgram* p,
+           const pir::Operation* op,
+           const std::vector<Value>& in) {
+          return p->Unary(BoolAttr(op, "approximate", false)
+                              ? FusionOpcode::kGeluTanh
+                              : FusionOpcode::kGelu,
+                          in[0]);
+        }}},
+      {"pd_op.leaky_relu",
+       {1,
+        [](FusionProgram* p,
+           const pir::Operation* op,
+           const std::vector<Value>& in) {
+          return p->Unary(FusionOpcode::kLeakyRelu,
+                          in[0],
+                          FloatAttr(op, "negative_slope", 0.02f));
+        }}},
+      {"pd_op.scale", {2, LowerScale}},
+      // The rounding to the result dtype is added for every op by the
+      // compiler, which is all a float cast needs.
+      {"pd_op.cast",
+       {1,
+        [](FusionProgram*,
+           const pir::Operation*,
+           const std::vector<Value>& in) { return in[0]; }}},
+  };
+  return *ops;
+}
+
+std::string OpName(const pir::Operation* op) {
+  if (op->HasAttribute("op_name")) {
+    return op->attribute<pir::StrAttribute>("op_name").AsString();
+  }
+  return op->name();
+}
+
+// dtype and rank of a dense tensor value, before or after kernel lowering.
+bool DenseTensorInfo(pir::Value value, phi::DataType* dtype, int* rank) {
+  if (!value || !value.type()) return false;
+  pir::Type type = value.type();
+  if (auto dense = type.dyn_cast<pir::DenseTensorType>()) {
+    *dtype = paddle::dialect::TransToPhiDataType(dense.dtype());
+    *rank = dense.dims().size();
+    return true;
+  }
+  if (auto allocated =
+          type.dyn_cast<paddle::dialect::AllocatedDenseTensorType>()) {
+    *dtype = paddle::dialect::TransToPhiDataType(allocated.dtype());
+    *rank = allocated.dims().size();
+    return true;
+  }
+  return false;
+}
+
+bool IsFusableValue(pir::Value value) {
+  phi::DataType dtype;
+  int rank;
+  FusionDType fusion_dtype;
+  return DenseTensorInfo(value, &dtype, &rank) &&
+         ToFusionDType(dtype, &fusion_dtype);
+}
+
+}  // namespace
+
+bool IsFusableOp(const pir::Operation* op) {
+  auto it = FusableOps().find(OpName(op));
+  if (it == FusableOps().end()) return false;
+  size_t num_inputs = op->num_operands();
+  bool scale_without_tensor = it->first == "pd_op.scale" && num_inputs == 1;
+  if (num_inputs != it->second.num_inputs && !scale_without_tensor) {
+    return false;
+  }
+  if (op->num_results() != 1 || !IsFusableValue(op->result(0))) return false;
+  for (size_t i = 0; i < num_inputs; ++i) {
+    if (!IsFusableValue(op->operand_source(i))) return false;
+  }
+  if (it->first == "pd_op.scale" && num_inputs == 2) {
+    // The scale tensor broadcasts as [1], which would turn a 0-D x into
+    // a [1] result.
+    phi::DataType dtype;
+    int rank;
+    DenseTensorInfo(op->operand_source(0), &dtype, &rank);
+    if (rank == 0) return false;
+  }
+  return true;
+}
+
+FusionEngineCompiler::FusionEngineCompiler(
+    pir::Operation* op,
+    const std::vector<pir::Value>& engine_inputs,
+    const std::vector<pir::Value>& engine_outputs,
+    const std::unordered_map<pir::Value, std::vector<phi::DenseTensor*>>&
+        engine_value_to_tensors,
+    const std::string& engine_key)
+    : op_(op),
+      engine_inputs_(engine_inputs),
+      engine_outputs_(engine_outputs),
+      engine_value_to_tensors_(engine_value_to_tensors),
+      engine_key_(engine_key) {}
+
+phi::DenseTensor* FusionEngineCompiler::TensorOf(pir::Value value) const {
+  auto it = engine_value_to_tensors_.find(value);
+  PADDLE_ENFORCE_EQ(it != engine_value_to_tensors_.end() &&
+                        it->second.size() == 1,
+                    true,
+                    phi::errors::PreconditionNotMet(
+                        "%s: value is not bound to exactly one tensor.",
+                        engine_key_));
+  return it->second.at(0);
+}
+
+void FusionEngineCompiler::Compile(FusionEngine* engine) {
+  PADDLE_ENFORCE_NOT_NULL(
+      engine, phi::errors::InvalidArgument("FusionEngine is not allocated."));
+  pir::Region& region = op_->region(0);
+  PADDLE_ENFORCE_EQ(
+      region.empty(),
+      false,
+      phi::errors::Unavailable(
+          "Required CustomEngineOp's region must not be empty."));
+  pir::Block* block = &region.front();
+
+  FusionProgram program;
+  std::unordered_map<const phi::DenseTensor*, Value> values;
+  std::vector<const phi::DenseTensor*> inputs;
+  for (size_t i = 0; i < engine_inputs_.size(); ++i) {
+    auto* tensor = TensorOf(engine_inputs_[i]);
+    inputs.push_back(tensor);
+    values[tensor] = program.Load(i);
+  }
+  auto value_of = [&](pir::Value value) {
+    auto it = values.find(TensorOf(value));
+    PADDLE_ENFORCE_EQ(it != values.end(),
+                      true,
+                      phi::errors::PreconditionNotMet(
+                          "%s: operand is used before it is defined.",
+                          engine_key_));
+    return it->second;
+  };
+
+  std::vector<phi::DataType> output_dtypes;
+  std::list<pir::Operation*> ops = block->ops();
+  for (const auto* op : ops) {
+    if (op->isa<pir::YieldOp>()) {
+      PADDLE_ENFORCE_EQ(op->num_operands(),
+                        engine_outputs_.size(),
+                        phi::errors::PreconditionNotMet(
+                            "%s: expect %zu outputs, but yield has %zu.",
+                            engine_key_,
+                            engine_outputs_.size(),
+                            op->num_operands()));
+      for (size_t i = 0; i < op->num_operands(); ++i) {
+        phi::DataType dtype;
+        int rank;
+        DenseTensorInfo(op->operand_source(i), &dtype, &rank);
+        output_dtypes.push_back(dtype);
+        program.Store(i, value_of(op->operand_source(i)));
+      }
+      continue;
+    }
+
+    std::string op_name = OpName(op);
+    PADDLE_ENFORCE_EQ(IsFusableOp(op),
+                      true,
+                      phi::errors::Unimplemented(
+                          "%s: %s can not be fused.", engine_key_, op_name));
+    std::vector<Value> args;
+    for (size_t i = 0; i < op->num_operands(); ++i) {
+      args.push_back(value_of(op->operand_source(i)));
+    }
+    Value out = FusableOps().at(op_name).lower(&program, op, args);
+
+    // Round to the result dtype after every op so reduced precision groups
+    // produce what the unfused kernels would.
+    phi::DataType dtype;
+    int rank;
+    FusionDType fusion_dtype;
+    DenseTensorInfo(op->result(0), &dtype, &rank);
+    ToFusionDType(dtype, &fusion_dtype);
+    if (fusion_dtype != FusionDType::kFloat32) {
+      out = program.Cast(out, fusion_dtype);
+    }
+    values[TensorOf(op->result(0))] = out;
+  }
+  program.Finalize();
+  VLOG(3) << "Compiled " << engine_key_ << " with " << program.num_registers()
+          << " registers:\n"
+          << program.ToString();
+
+  std::vector<phi::DenseTensor*> outputs;
+  for (const auto& value : engine_outputs_) {
+    outputs.push_back(TensorOf(value));
+  }
+  engine->Init(
+      engine_key_, std::move(program), inputs, outputs, output_dtypes);
+}
+
+}  // namespace custom_engine
@@ -0,0 +1,58 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "custom_engine/fusion_engine.h"
+#include "paddle/phi/core/dense_tensor.h"
+#include "paddle/pir/include/core/operation.h"
+
+namespace custom_engine {
+
+// True if op is an elementwise op the fusion engine can lower: one of the
+// supported pd_op ops (or a kernel op lowered from one) whose tensors are
+// all float32, float16 or bfloat16 dense tensors.
+bool IsFusableOp(const pir::Operation* op);
+
+// Lowers the block of a CustomEngineOp into a FusionProgram. Values are
+// matched to engine inputs and outputs through the tensors the executor
+// bound to them, the same way the GCU engine compiler does.
+class FusionEngineCompiler {
+ public:
+  FusionEngineCompiler(
+      pir::Operation* op,
+      const std::vector<pir::Value>& engine_inputs,
+      const std::vector<pir::Value>& engine_outputs,
+      const std::unordered_map<pir::Value, std::vector<phi::DenseTensor*>>&
+          engine_value_to_tensors,
+      const std::string& engine_key);
+
+  void Compile(FusionEngine* engine);
+
+ private:
+  phi::DenseTensor* TensorOf(pir::Value value) const;
+
+  pir::Operation* op_;  // Not owned
+  std::vector<pir::Value> engine_inputs_;
+  std::vector<pir::Value> engine_outputs_;
+  std::unordered_map<pir::Value, std::vector<phi::DenseTensor*>>
+      engine_value_to_tensors_;
+  std::string engine_key_;
+};
+
+}  // namespace custom_engine
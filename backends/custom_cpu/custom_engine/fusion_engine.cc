@@ -0,0 +1,88 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "custom_engine/fusion_engine.h"
+
+#include <glog/logging.h>
+
+#include <utility>
+
+#include "paddle/common/ddim.h"
+#include "paddle/phi/core/enforce.h"
+
+namespace custom_engine {
+
+bool ToFusionDType(phi::DataType dtype, FusionDType* out) {
+  switch (dtype) {
+    case phi::DataType::FLOAT32:
+      *out = FusionDType::kFloat32;
+      return true;
+    case phi::DataType::FLOAT16:
+      *out = FusionDType::kFloat16;
+      return true;
+    case phi::DataType::BFLOAT16:
+      *out = FusionDType::kBFloat16;
+      return true;
+    default:
+      return false;
+  }
+}
+
+void FusionEngine::Init(const std::string& engine_key,
+                        FusionProgram program,
+                        const std::vector<const phi::DenseTensor*>& inputs,
+                        const std::vector<phi::DenseTensor*>& outputs,
+                        const std::vector<phi::DataType>& output_dtypes) {
+  engine_key_ = engine_key;
+  program_ = std::move(program);
+  inputs_ = inputs;
+  outputs_ = outputs;
+  output_dtypes_ = output_dtypes;
+}
+
+void FusionEngine::Run(const phi::DeviceContext& dev_ctx) {
+  VLOG(3) << "=== FusionEngine Run " << engine_key_ << " ===";
+  std::vector<std::vector<int64_t>> input_dims;
+  std::vector<FusionProgram::ConstBuffer> in_buffers;
+  for (const auto* tensor : inputs_) {
+    FusionDType dtype;
+    PADDLE_ENFORCE_EQ(ToFusionDType(tensor->dtype(), &dtype),
+                      true,
+                      phi::errors::InvalidArgument(
+                          "%s: unsupported input dtype %s.",
+                          engine_key_,
+                          phi::DataTypeToString(tensor->dtype())));
+    input_dims.push_back(common::vectorize(tensor->dims()));
+    in_buffers.push_back({tensor->data(), dtype, input_dims.back()});
+  }
+
+  std::vector<std::vector<int64_t>> output_dims;
+  std::string error;
+  PADDLE_ENFORCE_EQ(
+      program_.InferShapes(input_dims, &output_dims, &error),
+      true,
+      phi::errors::InvalidArgument("%s: %s", engine_key_, error));
+
+  std::vector<FusionProgram::MutableBuffer> out_buffers;
+  for (size_t i = 0; i < outputs_.size(); ++i) {
+    FusionDType dtype;
+    ToFusionDType(output_dtypes_[i], &dtype);
+    outputs_[i]->Resize(common::make_ddim(output_dims[i]));
+    void* data = dev_ctx.Alloc(outputs_[i], output_dtypes_[i]);
+    out_buffers.push_back({data, dtype, output_dims[i]});
+  }
+  program_.Run(in_buffers, out_buffers);
+}
+
+}  // namespace custom_engine
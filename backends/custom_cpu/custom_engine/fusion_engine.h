@@ -0,0 +1,52 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "custom_engine/fusion_program.h"
+#include "paddle/phi/core/dense_tensor.h"
+#include "paddle/phi/core/device_context.h"
+
+namespace custom_engine {
+
+// One compiled fused group, owned by its CustomEngineInstruction.
+class FusionEngine {
+ public:
+  FusionEngine() = default;
+
+  void Init(const std::string& engine_key,
+            FusionProgram program,
+            const std::vector<const phi::DenseTensor*>& inputs,
+            const std::vector<phi::DenseTensor*>& outputs,
+            const std::vector<phi::DataType>& output_dtypes);
+
+  // Shapes are taken from the bound inputs on every run.
+  void Run(const phi::DeviceContext& dev_ctx);
+
+ private:
+  std::string engine_key_;
+  FusionProgram program_;
+  std::vector<const phi::DenseTensor*> inputs_;
+  std::vector<phi::DenseTensor*> outputs_;
+  std::vector<phi::DataType> output_dtypes_;
+};
+
+// Storage type of a phi dtype; returns false for types the engine does
+// not handle.
+bool ToFusionDType(phi::DataType dtype, FusionDType* out);
+
+}  // namespace custom_engine
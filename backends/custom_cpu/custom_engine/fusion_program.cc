@@ -0,0 +1,630 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "custom_engine/fusion_program.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace custom_engine {
+namespace {
+
+// Elements per chunk; registers are num_registers * kChunk floats.
+constexpr int64_t kChunk = 1024;
+// Below this many elements the group runs on the calling thread.
+constexpr int64_t kParallelThreshold = 64 * 1024;
+
+uint16_t FloatToHalf(float f) {
+  uint32_t x;
+  memcpy(&x, &f, sizeof(x));
+  uint32_t sign = (x >> 16) & 0x8000;
+  uint32_t mant = x & 0x7fffff;
+  int32_t exp = (x >> 23) & 0xff;
+  if (exp == 0xff) return sign | 0x7c00 | (mant ? 0x200 : 0);
+  int32_t e = exp - 127 + 15;
+  if (e >= 0x1f) return sign | 0x7c00;
+  if (e <= 0) {
+    if (e < -10) return sign;
+    mant |= 0x800000;
+    uint32_t shift = 14 - e;
+    uint32_t half = mant >> shift;
+    uint32_t rem = mant & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    if (rem > halfway || (rem == halfway && (half & 1))) ++half;
+    return sign | half;
+  }
+  uint32_t half = sign | (e << 10) | (mant >> 13);
+  uint32_t rem = mant & 0x1fff;
+  // A carry out of the mantissa correctly bumps the exponent.
+  if (rem > 0x1000 || (rem == 0x1000 && (half & 1))) ++half;
+  return half;
+}
+
+float HalfToFloat(uint16_t h) {
+  uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+  uint32_t exp = (h >> 10) & 0x1f;
+  uint32_t mant = h & 0x3ff;
+  uint32_t x;
+  if (exp == 0) {
+    if (mant == 0) {
+      x = sign;
+    } else {
+      exp = 127 - 15 + 1;
+      while (!(mant & 0x400)) {
+        mant <<= 1;
+        --exp;
+      }
+      x = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+    }
+  } else if (exp == 0x1f) {
+    x = sign | 0x7f800000 | (mant << 13);
+  } else {
+    x = sign | ((exp + 127 - 15) << 23) | (mant << 13);
+  }
+  float f;
+  memcpy(&f, &x, sizeof(f));
+  return f;
+}
+
+uint16_t FloatToBFloat16(float f) {
+  uint32_t x;
+  memcpy(&x, &f, sizeof(x));
+  if (std::isnan(f)) return (x >> 16) | 0x40;
+  return (x + 0x7fff + ((x >> 16) & 1)) >> 16;
+}
+
+float BFloat16ToFloat(uint16_t h) {
+  uint32_t x = static_cast<uint32_t>(h) << 16;
+  float f;
+  memcpy(&f, &x, sizeof(f));
+  return f;
+}
+
+bool Broadcast(const std::vector<int64_t>& a,
+               const std::vector<int64_t>& b,
+               std::vector<int64_t>* out) {
+  size_t rank = std::max(a.size(), b.size());
+  out->assign(rank, 1);
+  for (size_t i = 0; i < rank; ++i) {
+    int64_t da = i < rank - a.size() ? 1 : a[i - (rank - a.size())];
+    int64_t db = i < rank - b.size() ? 1 : b[i - (rank - b.size())];
+    if (da != db && da != 1 && db != 1) return false;
+    (*out)[i] = da == 1 ? db : da;
+  }
+  return true;
+}
+
+std::string DimsToString(const std::vector<int64_t>& dims) {
+  std::ostringstream os;
+  os << "[";
+  for (size_t i = 0; i < dims.size(); ++i) {
+    os << (i ? ", " : "") << dims[i];
+  }
+  os << "]";
+  return os.str();
+}
+
+int64_t Numel(const std::vector<int64_t>& dims) {
+  int64_t n = 1;
+  for (auto d : dims) n *= d;
+  return n;
+}
+
+// How a tensor is addressed from the iteration space.
+struct Access {
+  enum Kind { kContiguous, kScalar, kStrided };
+  char* data;
+  FusionDType dtype;
+  Kind kind;
+  // Strides aligned to the iteration space, 0 on broadcast axes.
+  std::vector<int64_t> strides;
+};
+
+Access MakeAccess(const void* data,
+                  FusionDType dtype,
+                  const std::vector<int64_t>& dims,
+                  const std::vector<int64_t>& full) {
+  Access access;
+  access.data = static_cast<char*>(const_cast<void*>(data));
+  access.dtype = dtype;
+  if (dims == full || Numel(dims) == Numel(full)) {
+    access.kind = Access::kContiguous;
+  } else if (Numel(dims) == 1) {
+    access.kind = Access::kScalar;
+  } else {
+    access.kind = Access::kStrided;
+    size_t offset = full.size() - dims.size();
+    access.strides.assign(full.size(), 0);
+    int64_t stride = 1;
+    for (size_t i = dims.size(); i > 0; --i) {
+      if (dims[i - 1] != 1) access.strides[offset + i - 1] = stride;
+      stride *= dims[i - 1];
+    }
+  }
+  return access;
+}
+
+// Offsets of the elements [start, start + count) of the iteration space.
+void StridedOffsets(const Access& access,
+                    const std::vector<int64_t>& full,
+                    int64_t start,
+                    int64_t count,
+                    int64_t* offsets) {
+  const size_t rank = full.size();
+  int64_t index[16];
+  int64_t offset = 0;
+  int64_t rest = start;
+  for (size_t i = rank; i > 0; --i) {
+    index[i - 1] = rest % full[i - 1];
+    rest /= full[i - 1];
+    offset += index[i - 1] * access.strides[i - 1];
+  }
+  for (int64_t n = 0; n < count; ++n) {
+    offsets[n] = offset;
+    for (size_t i = rank; i > 0; --i) {
+      offset += access.strides[i - 1];
+      if (++index[i - 1] < full[i - 1]) break;
+      offset -= index[i - 1] * access.strides[i - 1];
+      index[i - 1] = 0;
+    }
+  }
+}
+
+float LoadElement(const char* data, FusionDType dtype, int64_t i) {
+  switch (dtype) {
+    case FusionDType::kFloat16:
+      return HalfToFloat(reinterpret_cast<const uint16_t*>(data)[i]);
+    case FusionDType::kBFloat16:
+      return BFloat16ToFloat(reinterpret_cast<const uint16_t*>(data)[i]);
+    default:
+      return reinterpret_cast<const float*>(data)[i];
+  }
+}
+
+void StoreElement(char* data, FusionDType dtype, int64_t i, float v) {
+  switch (dtype) {
+    case FusionDType::kFloat16:
+      reinterpret_cast<uint16_t*>(data)[i] = FloatToHalf(v);
+      break;
+    case FusionDType::kBFloat16:
+      reinterpret_cast<uint16_t*>(data)[i] = FloatToBFloat16(v);
+      break;
+    default:
+      reinterpret_cast<float*>(data)[i] = v;
+  }
+}
+
+void LoadChunk(const Access& access,
+               const std::vector<int64_t>& full,
+               int64_t start,
+               int64_t count,
+               int64_t* offsets,
+               float* dst) {
+  if (access.kind == Access::kContiguous) {
+    if (access.dtype == FusionDType::kFloat32) {
+      memcpy(dst,
+             reinterpret_cast<const float*>(access.data) + start,
+             count * sizeof(float));
+    } else {
+      for (int64_t n = 0; n < count; ++n) {
+        dst[n] = LoadElement(access.data, access.dtype, start + n);
+      }
+    }
+  } else if (access.kind == Access::kScalar) {
+    std::fill(dst, dst + count, LoadElement(access.data, access.dtype, 0));
+  } else {
+    StridedOffsets(access, full, start, count, offsets);
+    for (int64_t n = 0; n < count; ++n) {
+      dst[n] = LoadElement(access.data, access.dtype, offsets[n]);
+    }
+  }
+}
+
+void StoreChunk(const Access& access,
+                const std::vector<int64_t>& full,
+                int64_t start,
+                int64_t count,
+                int64_t* offsets,
+                const float* src) {
+  if (access.kind == Access::kContiguous) {
+    for (int64_t n = 0; n < count; ++n) {
+      StoreElement(access.data, access.dtype, start + n, src[n]);
+    }
+  } else if (access.kind == Access::kScalar) {
+    StoreElement(access.data, access.dtype, 0, src[0]);
+  } else {
+    // Broadcast elements are written once per copy, all with equal values.
+    StridedOffsets(access, full, start, count, offsets);
+    for (int64_t n = 0; n < count; ++n) {
+      StoreElement(access.data, access.dtype, offsets[n], src[n]);
+    }
+  }
+}
+
+float RoundTo(FusionDType dtype, float v) {
+  switch (dtype) {
+    case FusionDType::kFloat16:
+      return HalfToFloat(FloatToHalf(v));
+    case FusionDType::kBFloat16:
+      return BFloat16ToFloat(FloatToBFloat16(v));
+    default:
+      return v;
+  }
+}
+
+template <typename F>
+inline void UnaryLoop(const float* a, float* out, int64_t n, F f) {
+  for (int64_t i = 0; i < n; ++i) out[i] = f(a[i]);
+}
+
+template <typename F>
+inline void BinaryLoop(
+    const float* a, const float* b, float* out, int64_t n, F f) {
+  for (int64_t i = 0; i < n; ++i) out[i] = f(a[i], b[i]);
+}
+
+void Compute(const FusionProgram::Instr& instr,
+             const float* a,
+             const float* b,
+             float* out,
+             int64_t n) {
+  const float imm0 = instr.imm0;
+  const float imm1 = instr.imm1;
+  switch (instr.op) {
+    case FusionOpcode::kCast: {
+      auto dtype = static_cast<FusionDType>(instr.arg);
+      UnaryLoop(a, out, n, [dtype](float x) { return RoundTo(dtype, x); });
+      break;
+    }
+    case FusionOpcode::kAdd:
+      BinaryLoop(a, b, out, n, [](float x, float y) { return x + y; });
+      break;
+    case FusionOpcode::kSub:
+      BinaryLoop(a, b, out, n, [](float x, float y) { return x - y; });
+      break;
+    case FusionOpcode::kMul:
+      BinaryLoop(a, b, out, n, [](float x, float y) { return x * y; });
+      break;
+    case FusionOpcode::kDiv:
+      BinaryLoop(a, b, out, n, [](float x, float y) { return x / y; });
+      break;
+    case FusionOpcode::kMax:
+      BinaryLoop(
+          a, b, out, n, [](float x, float y) { return std::max(x, y); });
+      break;
+    case FusionOpcode::kMin:
+      BinaryLoop(
+          a, b, out, n, [](float x, float y) { return std::min(x, y); });
+      break;
+    case FusionOpcode::kPow:
+      BinaryLoop(
+          a, b, out, n, [](float x, float y) { return std::pow(x, y); });
+      break;
+    case FusionOpcode::kNeg:
+      UnaryLoop(a, out, n, [](float x) { return -x; });
+      break;
+    case FusionOpcode::kAbs:
+      UnaryLoop(a, out, n, [](float x) { return std::fabs(x); });
+      break;
+    case FusionOpcode::kExp:
+      UnaryLoop(a, out, n, [](float x) { return std::exp(x); });
+      break;
+    case FusionOpcode::kLog:
+      UnaryLoop(a, out, n, [](float x) { return std::log(x); });
+      break;
+    case FusionOpcode::kSqrt:
+      UnaryLoop(a, out, n, [](float x) { return std::sqrt(x); });
+      break;
+    case FusionOpcode::kRsqrt:
+      UnaryLoop(a, out, n, [](float x) { return 1.f / std::sqrt(x); });
+      break;
+    case FusionOpcode::kSquare:
+      UnaryLoop(a, out, n, [](float x) { return x * x; });
+      break;
+    case FusionOpcode::kReciprocal:
+      UnaryLoop(a, out, n, [](float x) { return 1.f / x; });
+      break;
+    case FusionOpcode::kRelu:
+      UnaryLoop(a, out, n, [](float x) { return x > 0.f ? x : 0.f; });
+      break;
+    case FusionOpcode::kSigmoid:
+      UnaryLoop(a, out, n, [](float x) { return 1.f / (1.f + std::exp(-x)); });
+      break;
+    case FusionOpcode::kTanh:
+      UnaryLoop(a, out, n, [](float x) { return std::tanh(x); });
+      break;
+    case FusionOpcode::kSilu:
+      UnaryLoop(a, out, n, [](float x) { return x / (1.f + std::exp(-x)); });
+      break;
+    case FusionOpcode::kGelu:
+      UnaryLoop(a, out, n, [](float x) {
+        return 0.5f * x * (1.f + std::erf(x * static_cast<float>(M_SQRT1_2)));
+      });
+      break;
+    case FusionOpcode::kGeluTanh:
+      UnaryLoop(a, out, n, [](float x) {
+        const float k = 0.7978845608028654f;  // sqrt(2 / pi)
+        return 0.5f * x * (1.f + std::tanh(k * (x + 0.044715f * x * x * x)));
+      });
+      break;
+    case FusionOpcode::kScale:
+      UnaryLoop(a, out, n, [=](float x) { return x * imm0 + imm1; });
+      break;
+    case FusionOpcode::kLeakyRelu:
+      UnaryLoop(a, out, n, [=](float x) { return x > 0.f ? x : x * imm0; });
+      break;
+    default:
+      throw std::logic_error(std::string("unexpected fusion opcode ") +
+                             FusionOpcodeName(instr.op));
+  }
+}
+
+}  // namespace
+
+const char* FusionOpcodeName(FusionOpcode op) {
+  static const char* names[] = {
+      "load",    "store",  "cast",      "add",        "sub",   "mul",
+      "div",     "max",    "min",       "pow",        "neg",   "abs",
+      "exp",     "log",    "sqrt",      "rsqrt",      "square", "reciprocal",
+      "relu",    "sigmoid", "tanh",     "silu",       "gelu",  "gelu_tanh",
+      "scale",   "leaky_relu"};
+  return names[static_cast<int>(op)];
+}
+
+FusionProgram::Value FusionProgram::Load(int32_t input) {
+  Instr instr;
+  instr.op = FusionOpcode::kLoad;
+  instr.arg = input;
+  instrs_.push_back(instr);
+  num_inputs_ = std::max(num_inputs_, input + 1);
+  return instrs_.size() - 1;
+}
+
+FusionProgram::Value FusionProgram::Unary(FusionOpcode op,
+                                          Value a,
+                                          float imm0,
+                                          float imm1) {
+  Instr instr;
+  instr.op = op;
+  instr.a = a;
+  instr.imm0 = imm0;
+  instr.imm1 = imm1;
+  instrs_.push_back(instr);
+  return instrs_.size() - 1;
+}
+
+FusionProgram::Value FusionProgram::Binary(FusionOpcode op, Value a, Value b) {
+  Instr instr;
+  instr.op = op;
+  instr.a = a;
+  instr.b = b;
+  instrs_.push_back(instr);
+  return instrs_.size() - 1;
+}
+
+FusionProgram::Value FusionProgram::Cast(Value a, FusionDType dtype) {
+  Instr instr;
+  instr.op = FusionOpcode::kCast;
+  instr.a = a;
+  instr.arg = static_cast<int32_t>(dtype);
+  instrs_.push_back(instr);
+  return instrs_.size() - 1;
+}
+
+void FusionProgram::Store(int32_t output, Value a) {
+  Instr instr;
+  instr.op = FusionOpcode::kStore;
+  instr.a = a;
+  instr.arg = output;
+  instrs_.push_back(instr);
+  num_outputs_ = std::max(num_outputs_, output + 1);
+}
+
+void FusionProgram::Finalize() {
+  std::vector<size_t> last_use(instrs_.size(), 0);
+  for (size_t i = 0; i < instrs_.size(); ++i) {
+    last_use[i] = i;
+    if (instrs_[i].a >= 0) last_use[instrs_[i].a] = i;
+    if (instrs_[i].b >= 0) last_use[instrs_[i].b] = i;
+  }
+
+  std::vector<int32_t> free_regs;
+  std::vector<int32_t> reg_of(instrs_.size(), -1);
+  num_registers_ = 0;
+  for (size_t i = 0; i < instrs_.size(); ++i) {
+    auto& instr = instrs_[i];
+    if (instr.a >= 0) instr.a_reg = reg_of[instr.a];
+    if (instr.b >= 0) instr.b_reg = reg_of[instr.b];
+    // Operands dying here hand their register to the result; every op
+    // reads element i before writing it, so in place is safe.
+    for (Value v : {instr.a, instr.b}) {
+      if (v >= 0 && last_use[v] == i && reg_of[v] >= 0) {
+        free_regs.push_back(reg_of[v]);
+        reg_of[v] = -1;
+      }
+    }
+    if (instr.op == FusionOpcode::kStore) continue;
+    if (free_regs.empty()) {
+      reg_of[i] = num_registers_++;
+    } else {
+      reg_of[i] = free_regs.back();
+      free_regs.pop_back();
+    }
+    instr.dst_reg = reg_of[i];
+    if (last_use[i] == i) {
+      free_regs.push_back(reg_of[i]);
+      reg_of[i] = -1;
+    }
+  }
+}
+
+bool FusionProgram::ValueDims(
+    const std::vector<std::vector<int64_t>>& input_dims,
+    std::vector<std::vector<int64_t>>* value_dims,
+    std::string* error) const {
+  value_dims->assign(instrs_.size(), {});
+  for (size_t i = 0; i < instrs_.size(); ++i) {
+    const auto& instr = instrs_[i];
+    auto& dims = (*value_dims)[i];
+    if (instr.op == FusionOpcode::kLoad) {
+      if (instr.arg >= static_cast<int32_t>(input_dims.size())) {
+        *error = "missing shape of input " + std::to_string(instr.arg);
+        return false;
+      }
+      dims = input_dims[instr.arg];
+    } else if (instr.b >= 0) {
+      const auto& a = (*value_dims)[instr.a];
+      const auto& b = (*value_dims)[instr.b];
+      if (!Broadcast(a, b, &dims)) {
+        *error = std::string(FusionOpcodeName(instr.op)) + ": shapes " +
+                 DimsToString(a) + " and " + DimsToString(b) +
+                 " do not broadcast";
+        return false;
+      }
+    } else {
+      dims = (*value_dims)[instr.a];
+    }
+  }
+  return true;
+}
+
+bool FusionProgram::InferShapes(
+    const std::vector<std::vector<int64_t>>& input_dims,
+    std::vector<std::vector<int64_t>>* output_dims,
+    std::string* error) const {
+  std::vector<std::vector<int64_t>> value_dims;
+  if (!ValueDims(input_dims, &value_dims, error)) return false;
+  output_dims->assign(num_outputs_, {});
+  for (const auto& instr : instrs_) {
+    if (instr.op == FusionOpcode::kStore) {
+      (*output_dims)[instr.arg] = value_dims[instr.a];
+    }
+  }
+  return true;
+}
+
+void FusionProgram::Run(const std::vector<ConstBuffer>& inputs,
+                        const std::vector<MutableBuffer>& outputs) const {
+  std::vector<std::vector<int64_t>> input_dims;
+  for (const auto& input : inputs) input_dims.push_back(input.dims);
+  std::vector<std::vector<int64_t>> value_dims;
+  std::string error;
+  if (!ValueDims(input_dims, &value_dims, &error)) {
+    throw std::invalid_argument(error);
+  }
+
+  // Every value broadcasts into the final one of its chain, so this is the
+  // broadcast of the stored shapes plus any dead values.
+  std::vector<int64_t> full;
+  for (const auto& dims : value_dims) {
+    std::vector<int64_t> merged;
+    if (!Broadcast(full, dims, &merged)) {
+      throw std::invalid_argument("fused values do not broadcast");
+    }
+    full.swap(merged);
+  }
+  if (full.size() > 16) {
+    throw std::invalid_argument("fused tensors support at most rank 16");
+  }
+  const int64_t numel = Numel(full);
+  if (numel == 0) return;
+
+  std::vector<Access> access(instrs_.size());
+  bool strided_store = false;
+  for (size_t i = 0; i < instrs_.size(); ++i) {
+    const auto& instr = instrs_[i];
+    if (instr.op == FusionOpcode::kLoad) {
+      const auto& in = inputs[instr.arg];
+      access[i] = MakeAccess(in.data, in.dtype, in.dims, full);
+    } else if (instr.op == FusionOpcode::kStore) {
+      const auto& out = outputs[instr.arg];
+      access[i] = MakeAccess(out.data, out.dtype, out.dims, full);
+      strided_store |= access[i].kind != Access::kContiguous;
+    }
+  }
+
+  const int64_t num_chunks = (numel + kChunk - 1) / kChunk;
+  auto run_chunks = [&](int64_t begin, int64_t end) {
+    std::vector<float> regs(std::max(num_registers_, 1) * kChunk);
+    std::vector<int64_t> offsets(kChunk);
+    for (int64_t c = begin; c < end; ++c) {
+      const int64_t start = c * kChunk;
+      const int64_t count = std::min(kChunk, numel - start);
+      for (size_t i = 0; i < instrs_.size(); ++i) {
+        const auto& instr = instrs_[i];
+        float* dst = instr.dst_reg >= 0 ? &regs[instr.dst_reg * kChunk]
+                                        : nullptr;
+        const float* a =
+            instr.a_reg >= 0 ? &regs[instr.a_reg * kChunk] : nullptr;
+        const float* b =
+            instr.b_reg >= 0 ? &regs[instr.b_reg * kChunk] : nullptr;
+        if (instr.op == FusionOpcode::kLoad) {
+          LoadChunk(access[i], full, start, count, offsets.data(), dst);
+        } else if (instr.op == FusionOpcode::kStore) {
+          StoreChunk(access[i], full, start, count, offsets.data(), a);
+        } else {
+          Compute(instr, a, b, dst, count);
+        }
+      }
+    }
+  };
+
+  if (strided_store || numel < kParallelThreshold) {
+    run_chunks(0, num_chunks);
+    return;
+  }
+#pragma omp parallel
+  {
+#ifdef _OPENMP
+    int64_t threads = omp_get_num_threads();
+    int64_t tid = omp_get_thread_num();
+#else
+    int64_t threads = 1;
+    int64_t tid = 0;
+#endif
+    int64_t per_thread = (num_chunks + threads - 1) / threads;
+    int64_t begin = std::min(num_chunks, tid * per_thread);
+    int64_t end = std::min(num_chunks, begin + per_thread);
+    run_chunks(begin, end);
+  }
+}
+
+std::string FusionProgram::ToString() const {
+  std::ostringstream os;
+  for (size_t i = 0; i < instrs_.size(); ++i) {
+    const auto& instr = instrs_[i];
+    os << "%" << i << " = " << FusionOpcodeName(instr.op);
+    if (instr.op == FusionOpcode::kLoad || instr.op == FusionOpcode::kStore ||
+        instr.op == FusionOpcode::kCast) {
+      os << "[" << instr.arg << "]";
+    }
+    if (instr.a >= 0) os << " %" << instr.a;
+    if (instr.b >= 0) os << " %" << instr.b;
+    if (instr.op == FusionOpcode::kScale ||
+        instr.op == FusionOpcode::kLeakyRelu) {
+      os << " (" << instr.imm0 << ", " << instr.imm1 << ")";
+    }
+    os << "  ; r" << instr.dst_reg << "\n";
+  }
+  return os.str();
+}
+
+}  // namespace custom_engine
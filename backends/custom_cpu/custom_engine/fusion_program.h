@@ -0,0 +1,134 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace custom_engine {
+
+// Storage types of fused tensors. Arithmetic always runs in float.
+enum class FusionDType : uint8_t { kFloat32, kFloat16, kBFloat16 };
+
+enum class FusionOpcode : uint8_t {
+  kLoad,   // input[arg], broadcast to the iteration space
+  kStore,  // output[arg] = a
+  kCast,   // a rounded through the FusionDType in arg
+  kAdd,
+  kSub,
+  kMul,
+  kDiv,
+  kMax,
+  kMin,
+  kPow,
+  kNeg,
+  kAbs,
+  kExp,
+  kLog,
+  kSqrt,
+  kRsqrt,
+  kSquare,
+  kReciprocal,
+  kRelu,
+  kSigmoid,
+  kTanh,
+  kSilu,
+  kGelu,      // erf form
+  kGeluTanh,  // tanh approximation
+  kScale,     // a * imm0 + imm1
+  kLeakyRelu  // a > 0 ? a : a * imm0
+};
+
+const char* FusionOpcodeName(FusionOpcode op);
+
+// A fused elementwise group compiled to a flat list of instructions.
+//
+// Every instruction defines one value, identified by its index. Values are
+// computed over the whole iteration space, the broadcast of all stored
+// values' shapes, which is walked in chunks: each instruction runs over one
+// chunk before the next starts, so a chain of N ops reads its inputs and
+// writes its outputs once instead of N times, while intermediates stay in
+// chunk sized registers that fit in cache. Registers are reused once a
+// value is dead (see Finalize).
+//
+// Shapes are bound at Run time, so one program serves all input shapes.
+class FusionProgram {
+ public:
+  using Value = int32_t;
+
+  struct Instr {
+    FusionOpcode op;
+    Value a = -1;
+    Value b = -1;
+    int32_t arg = 0;
+    float imm0 = 0.f;
+    float imm1 = 0.f;
+    // Registers assigned by Finalize.
+    int32_t dst_reg = -1;
+    int32_t a_reg = -1;
+    int32_t b_reg = -1;
+  };
+
+  struct ConstBuffer {
+    const void* data;
+    FusionDType dtype;
+    std::vector<int64_t> dims;
+  };
+
+  struct MutableBuffer {
+    void* data;
+    FusionDType dtype;
+    std::vector<int64_t> dims;
+  };
+
+  Value Load(int32_t input);
+  Value Unary(FusionOpcode op, Value a, float imm0 = 0.f, float imm1 = 0.f);
+  Value Binary(FusionOpcode op, Value a, Value b);
+  Value Cast(Value a, FusionDType dtype);
+  void Store(int32_t output, Value a);
+
+  // Assigns registers; must be called once all instructions are emitted.
+  void Finalize();
+
+  int32_t num_inputs() const { return num_inputs_; }
+  int32_t num_outputs() const { return num_outputs_; }
+  int32_t num_registers() const { return num_registers_; }
+  const std::vector<Instr>& instrs() const { return instrs_; }
+
+  // Output shapes for the given input shapes. Returns false and fills error
+  // if the shapes do not broadcast.
+  bool InferShapes(const std::vector<std::vector<int64_t>>& input_dims,
+                   std::vector<std::vector<int64_t>>* output_dims,
+                   std::string* error) const;
+
+  // outputs must have the shapes returned by InferShapes.
+  void Run(const std::vector<ConstBuffer>& inputs,
+           const std::vector<MutableBuffer>& outputs) const;
+
+  std::string ToString() const;
+
+ private:
+  bool ValueDims(const std::vector<std::vector<int64_t>>& input_dims,
+                 std::vector<std::vector<int64_t>>* value_dims,
+                 std::string* error) const;
+
+  std::vector<Instr> instrs_;
+  int32_t num_inputs_ = 0;
+  int32_t num_outputs_ = 0;
+  int32_t num_registers_ = 0;
+};
+
+}  // namespace custom_engine
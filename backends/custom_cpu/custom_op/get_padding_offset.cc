@@ -0,0 +1,128 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <vector>
+
+#include "custom_op/varlen_utils.h"
+#include "paddle/extension.h"
+
+// custom_cpu device memory is host memory, so every output is computed in
+// place without staging copies. The token count comes from the prefix sum of
+// seq_len rather than from token_num.
+std::vector<paddle::Tensor> GetPaddingOffsetV2(
+    const paddle::Tensor& input_ids,
+    const paddle::Tensor& cum_offsets,
+    const paddle::Tensor& token_num,
+    const paddle::Tensor& seq_len) {
+  PD_CHECK(seq_len.dtype() == paddle::DataType::INT32,
+           "seq_len must be int32.");
+  std::vector<int64_t> input_ids_shape = input_ids.shape();
+  const int64_t bsz = input_ids_shape[0];
+  const int64_t max_seq_len = input_ids_shape[1];
+  auto place = input_ids.place();
+
+  auto cu_seqlens_q =
+      paddle::empty({bsz + 1}, paddle::DataType::INT32, place);
+  const int64_t token_num_data = varlen::ComputeCuSeqlens(
+      seq_len.data<int32_t>(), bsz, max_seq_len, cu_seqlens_q.data<int32_t>());
+  const int32_t* cu_seqlens = cu_seqlens_q.data<int32_t>();
+
+  auto x_remove_padding =
+      paddle::empty({token_num_data}, input_ids.dtype(), place);
+  auto cum_offsets_out = paddle::empty({bsz}, paddle::DataType::INT32, place);
+  auto padding_offset =
+      paddle::empty({token_num_data}, paddle::DataType::INT32, place);
+
+  varlen::ComputeCumOffsets(
+      cu_seqlens, bsz, max_seq_len, cum_offsets_out.data<int32_t>());
+  varlen::ComputePaddingOffset(
+      cu_seqlens, bsz, max_seq_len, padding_offset.data<int32_t>());
+  varlen::RemovePadding(input_ids.data(),
+                        cu_seqlens,
+                        bsz,
+                        max_seq_len,
+                        phi::SizeOf(input_ids.dtype()),
+                        x_remove_padding.data());
+
+  auto cu_seqlens_k = cu_seqlens_q.copy_to(place, true);
+  return {x_remove_padding,
+          cum_offsets_out,
+          padding_offset,
+          cu_seqlens_q,
+          cu_seqlens_k};
+}
+
+std::vector<paddle::Tensor> GetPaddingOffset(const paddle::Tensor& input_ids,
+                                             const paddle::Tensor& cum_offsets,
+                                             const paddle::Tensor& token_num,
+                                             const paddle::Tensor& seq_len) {
+  auto outs = GetPaddingOffsetV2(input_ids, cum_offsets, token_num, seq_len);
+  return {outs[0], outs[1], outs[2]};
+}
+
+std::vector<std::vector<int64_t>> GetPaddingOffsetInferShape(
+    const std::vector<int64_t>& input_ids_shape,
+    const std::vector<int64_t>& cum_offsets_shape,
+    const std::vector<int64_t>& token_num_shape,
+    const std::vector<int64_t>& seq_len_shape) {
+  int64_t bsz = input_ids_shape[0];
+  return {{-1}, {bsz}, {-1}};
+}
+
+std::vector<paddle::DataType> GetPaddingOffsetInferDtype(
+    const paddle::DataType& input_ids_dtype,
+    const paddle::DataType& cum_offsets_dtype,
+    const paddle::DataType& token_num_dtype,
+    const paddle::DataType& seq_len_dtype) {
+  return {input_ids_dtype, seq_len_dtype, seq_len_dtype};
+}
+
+std::vector<std::vector<int64_t>> GetPaddingOffsetV2InferShape(
+    const std::vector<int64_t>& input_ids_shape,
+    const std::vector<int64_t>& cum_offsets_shape,
+    const std::vector<int64_t>& token_num_shape,
+    const std::vector<int64_t>& seq_len_shape) {
+  int64_t bsz = seq_len_shape[0];
+  return {{-1}, {bsz}, {-1}, {bsz + 1}, {bsz + 1}};
+}
+
+std::vector<paddle::DataType> GetPaddingOffsetV2InferDtype(
+    const paddle::DataType& input_ids_dtype,
+    const paddle::DataType& cum_offsets_dtype,
+    const paddle::DataType& token_num_dtype,
+    const paddle::DataType& seq_len_dtype) {
+  return {input_ids_dtype,
+          seq_len_dtype,
+          seq_len_dtype,
+          seq_len_dtype,
+          seq_len_dtype};
+}
+
+PD_BUILD_OP(get_padding_offset)
+    .Inputs({"input_ids", "cum_offsets", "token_num", "seq_len"})
+    .Outputs({"x_remove_padding", "cum_offsets_out", "padding_offset"})
+    .SetKernelFn(PD_KERNEL(GetPaddingOffset))
+    .SetInferShapeFn(PD_INFER_SHAPE(GetPaddingOffsetInferShape))
+    .SetInferDtypeFn(PD_INFER_DTYPE(GetPaddingOffsetInferDtype));
+
+PD_BUILD_OP(get_padding_offset_v2)
+    .Inputs({"input_ids", "cum_offsets", "token_num", "seq_len"})
+    .Outputs({"x_remove_padding",
+              "cum_offsets_out",
+              "padding_offset",
+              "cu_seqlens_q",
+              "cu_seqlens_k"})
+    .SetKernelFn(PD_KERNEL(GetPaddingOffsetV2))
+    .SetInferShapeFn(PD_INFER_SHAPE(GetPaddingOffsetV2InferShape))
+    .SetInferDtypeFn(PD_INFER_DTYPE(GetPaddingOffsetV2InferDtype));
@@ -0,0 +1,157 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <glog/logging.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "custom_op/param_file.h"
+#include "paddle/extension.h"
+#include "paddle/phi/core/allocator.h"
+#include "paddle/phi/core/dense_tensor.h"
+#include "runtime/copy.h"
+#include "runtime/mapped_file.h"
+
+namespace {
+
+// Points a tensor into a MappedFile, keeping the mapping alive for as long
+// as the tensor (or anything sharing its holder) exists.
+class MappedParamAllocation : public phi::Allocation {
+ public:
+  MappedParamAllocation(std::shared_ptr<custom_cpu::MappedFile> file,
+                        void* ptr,
+                        size_t size,
+                        const phi::Place& place)
+      : phi::Allocation(ptr, size, place), file_(std::move(file)) {}
+
+ private:
+  std::shared_ptr<custom_cpu::MappedFile> file_;
+};
+
+paddle::DataType ToDataType(int32_t type) {
+  switch (type) {
+    case param_file::kBool:
+      return paddle::DataType::BOOL;
+    case param_file::kInt16:
+      return paddle::DataType::INT16;
+    case param_file::kInt32:
+      return paddle::DataType::INT32;
+    case param_file::kInt64:
+      return paddle::DataType::INT64;
+    case param_file::kFloat16:
+      return paddle::DataType::FLOAT16;
+    case param_file::kFloat32:
+      return paddle::DataType::FLOAT32;
+    case param_file::kFloat64:
+      return paddle::DataType::FLOAT64;
+    case param_file::kUInt8:
+      return paddle::DataType::UINT8;
+    case param_file::kInt8:
+      return paddle::DataType::INT8;
+    case param_file::kBFloat16:
+      return paddle::DataType::BFLOAT16;
+    case param_file::kComplex64:
+      return paddle::DataType::COMPLEX64;
+    case param_file::kComplex128:
+      return paddle::DataType::COMPLEX128;
+    default:
+      return paddle::DataType::UNDEFINED;
+  }
+}
+
+}  // namespace
+
+// Loads a combined parameter file (as written by save_combine) into params,
+// in file order, without reading it: every parameter whose data is suitably
+// aligned in the file is backed directly by a private mapping of the file.
+// Pages come from the page cache on first touch and are shared by every
+// process serving the same model; a kernel writing a parameter copies only
+// the pages it writes. Misaligned parameters are copied into regular device
+// memory (tools/align_params.py rewrites a file so that none are).
+//
+// params may be uninitialized; initialized ones must match the file in
+// shape and dtype, and their previous memory is released.
+void MmapLoadCombine(const std::vector<paddle::Tensor>& params,
+                     const std::string& file_path) {
+  std::string error;
+  auto file = custom_cpu::MappedFile::Open(file_path, &error);
+  PD_CHECK(file != nullptr, "mmap_load_combine: ", error);
+  std::vector<param_file::ParamRecord> records;
+  PD_CHECK(param_file::ParseCombinedParams(
+               file->data(), file->size(), &records, &error),
+           "mmap_load_combine: malformed ",
+           file_path,
+           ", ",
+           error);
+  PD_CHECK(records.size() == params.size(),
+           "mmap_load_combine: ",
+           file_path,
+           " holds ",
+           records.size(),
+           " parameters but ",
+           params.size(),
+           " were given.");
+
+  size_t num_copied = 0;
+  for (size_t i = 0; i < params.size(); ++i) {
+    const auto& record = records[i];
+    auto dense = std::dynamic_pointer_cast<phi::DenseTensor>(params[i].impl());
+    PD_CHECK(dense != nullptr,
+             "mmap_load_combine: parameter ",
+             i,
+             " is not a DenseTensor.");
+    const paddle::DataType dtype = ToDataType(record.data_type);
+    phi::Place place = phi::CustomPlace("custom_cpu", 0);
+    if (params[i].initialized()) {
+      PD_CHECK(params[i].dtype() == dtype && params[i].shape() == record.dims,
+               "mmap_load_combine: parameter ",
+               i,
+               " does not match the dtype or shape saved in ",
+               file_path);
+      place = params[i].place();
+    }
+    phi::DenseTensorMeta meta(dtype, phi::make_ddim(record.dims));
+
+    char* data = file->data() + record.offset;
+    const size_t element_size = param_file::ProtoDataTypeSize(record.data_type);
+    if (record.offset % element_size == 0) {
+      auto holder = std::make_shared<MappedParamAllocation>(
+          file, data, record.bytes, place);
+      dense->ShareDataWith(phi::DenseTensor(holder, meta));
+      continue;
+    }
+    // Kernels may assume element aligned pointers, so misaligned data
+    // cannot be adopted.
+    auto copy = paddle::empty(record.dims, dtype, place);
+    custom_cpu::Copy(copy.data(), data, record.bytes);
+    dense->ShareDataWith(*static_cast<phi::DenseTensor*>(copy.impl().get()));
+    ++num_copied;
+  }
+  if (num_copied > 0) {
+    LOG(WARNING) << "mmap_load_combine: " << num_copied << " of "
+                 << params.size() << " parameters in " << file_path
+                 << " are not aligned and were copied; rewrite the file with "
+                    "tools/align_params.py to map them all.";
+  }
+}
+
+PD_BUILD_OP(mmap_load_combine)
+    .Inputs({paddle::Vec("params")})
+    .Outputs({paddle::Vec("params_out")})
+    .Attrs({"file_path: std::string"})
+    .SetInplaceMap({{paddle::Vec("params"), paddle::Vec("params_out")}})
+    .SetKernelFn(PD_KERNEL(MmapLoadCombine));
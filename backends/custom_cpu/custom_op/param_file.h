@@ -0,0 +1,238 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Reader for the combined parameter files written by save_combine (the
+// .pdiparams of an inference model). The file is the concatenation of one
+// record per parameter:
+//
+//   uint32 version (0)
+//   uint64 lod_level, then per level: uint64 byte size, size_t offsets
+//   uint32 version (0)
+//   int32  desc_size, then a TensorDesc protobuf of desc_size bytes
+//   raw tensor data, numel * sizeof(dtype) bytes
+//
+// Only the record layout is parsed here; the data stays where it is so that
+// callers can point tensors into a mapping of the file.
+namespace param_file {
+
+// proto::VarType::Type values of framework.proto.
+enum ProtoDataType : int32_t {
+  kBool = 0,
+  kInt16 = 1,
+  kInt32 = 2,
+  kInt64 = 3,
+  kFloat16 = 4,
+  kFloat32 = 5,
+  kFloat64 = 6,
+  kUInt8 = 20,
+  kInt8 = 21,
+  kBFloat16 = 22,
+  kComplex64 = 23,
+  kComplex128 = 24,
+};
+
+// Bytes per element, or 0 for types parameters cannot have.
+inline size_t ProtoDataTypeSize(int32_t type) {
+  switch (type) {
+    case kBool:
+    case kUInt8:
+    case kInt8:
+      return 1;
+    case kInt16:
+    case kFloat16:
+    case kBFloat16:
+      return 2;
+    case kInt32:
+    case kFloat32:
+      return 4;
+    case kInt64:
+    case kFloat64:
+    case kComplex64:
+      return 8;
+    case kComplex128:
+      return 16;
+    default:
+      return 0;
+  }
+}
+
+struct ParamRecord {
+  int32_t data_type = -1;
+  std::vector<int64_t> dims;
+  // Offset and length of the tensor data in the file.
+  size_t offset = 0;
+  size_t bytes = 0;
+};
+
+namespace detail {
+
+class Reader {
+ public:
+  Reader(const char* data, size_t size) : data_(data), size_(size) {}
+
+  size_t pos() const { return pos_; }
+
+  size_t remaining() const { return size_ - pos_; }
+
+  template <typename T>
+  bool Read(T* value) {
+    if (remaining() < sizeof(T)) return false;
+    memcpy(value, data_ + pos_, sizeof(T));
+    pos_ += sizeof(T);
+    return true;
+  }
+
+  bool Skip(uint64_t bytes) {
+    if (remaining() < bytes) return false;
+    pos_ += bytes;
+    return true;
+  }
+
+  bool ReadVarint(uint64_t* value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (pos_ >= size_) return false;
+      auto byte = static_cast<uint8_t>(data_[pos_++]);
+      result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) {
+        *value = result;
+        return true;
+      }
+    }
+    return false;
+  }
+
+ private:
+  const char* data_;
+  size_t size_;
+  size_t pos_ = 0;
+};
+
+// Decodes `message TensorDesc { required Type data_type = 1; repeated int64
+// dims = 2; }`, accepting packed and unpacked dims and skipping unknown
+// fields (writers may pad the message with one to align the data).
+inline bool ParseTensorDesc(const char* data,
+                            size_t size,
+                            ParamRecord* record) {
+  Reader reader(data, size);
+  bool has_type = false;
+  while (reader.remaining() > 0) {
+    uint64_t key = 0;
+    if (!reader.ReadVarint(&key)) return false;
+    const uint64_t field = key >> 3;
+    const uint64_t wire_type = key & 7;
+    uint64_t value = 0;
+    if (field == 1 && wire_type == 0) {
+      if (!reader.ReadVarint(&value)) return false;
+      record->data_type = static_cast<int32_t>(value);
+      has_type = true;
+    } else if (field == 2 && wire_type == 0) {
+      if (!reader.ReadVarint(&value)) return false;
+      record->dims.push_back(static_cast<int64_t>(value));
+    } else if (field == 2 && wire_type == 2) {
+      uint64_t length = 0;
+      if (!reader.ReadVarint(&length) || length > reader.remaining()) {
+        return false;
+      }
+      const size_t end = reader.pos() + length;
+      while (reader.pos() < end) {
+        if (!reader.ReadVarint(&value)) return false;
+        record->dims.push_back(static_cast<int64_t>(value));
+      }
+      if (reader.pos() != end) return false;
+    } else if (wire_type == 0) {
+      if (!reader.ReadVarint(&value)) return false;
+    } else if (wire_type == 1) {
+      if (!reader.Skip(8)) return false;
+    } else if (wire_type == 2) {
+      if (!reader.ReadVarint(&value) || !reader.Skip(value)) return false;
+    } else if (wire_type == 5) {
+      if (!reader.Skip(4)) return false;
+    } else {
+      return false;
+    }
+  }
+  return has_type;
+}
+
+}  // namespace detail
+
+// Parses every record of a combined parameter file held in memory. Returns
+// false and describes the problem in *error if the file is malformed or
+// truncated.
+inline bool ParseCombinedParams(const char* data,
+                                size_t size,
+                                std::vector<ParamRecord>* records,
+                                std::string* error) {
+  detail::Reader reader(data, size);
+  while (reader.remaining() > 0) {
+    const size_t index = records->size();
+    auto fail = [&](const char* what) {
+      *error = "parameter " + std::to_string(index) + " at offset " +
+               std::to_string(reader.pos()) + ": " + what;
+      return false;
+    };
+    uint32_t version = 0;
+    if (!reader.Read(&version)) return fail("truncated version");
+    if (version != 0) return fail("unsupported version");
+    uint64_t lod_level = 0;
+    if (!reader.Read(&lod_level)) return fail("truncated lod");
+    for (uint64_t i = 0; i < lod_level; ++i) {
+      uint64_t lod_bytes = 0;
+      if (!reader.Read(&lod_bytes) || !reader.Skip(lod_bytes)) {
+        return fail("truncated lod");
+      }
+    }
+    if (!reader.Read(&version)) return fail("truncated tensor version");
+    if (version != 0) return fail("unsupported tensor version");
+    int32_t desc_size = 0;
+    if (!reader.Read(&desc_size) || desc_size < 0 ||
+        static_cast<size_t>(desc_size) > reader.remaining()) {
+      return fail("truncated tensor desc");
+    }
+    ParamRecord record;
+    if (!detail::ParseTensorDesc(data + reader.pos(), desc_size, &record)) {
+      return fail("malformed tensor desc");
+    }
+    reader.Skip(desc_size);
+    const size_t element_size = ProtoDataTypeSize(record.data_type);
+    if (element_size == 0) return fail("unsupported data type");
+    uint64_t numel = 1;
+    for (int64_t dim : record.dims) {
+      if (dim < 0) return fail("negative dim");
+      if (dim != 0 && numel > UINT64_MAX / static_cast<uint64_t>(dim)) {
+        return fail("tensor too large");
+      }
+      numel *= static_cast<uint64_t>(dim);
+    }
+    if (numel > reader.remaining() / element_size) {
+      return fail("truncated tensor data");
+    }
+    record.offset = reader.pos();
+    record.bytes = numel * element_size;
+    reader.Skip(record.bytes);
+    records->push_back(std::move(record));
+  }
+  return true;
+}
+
+}  // namespace param_file
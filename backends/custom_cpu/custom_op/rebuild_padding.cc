@@ -0,0 +1,68 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <vector>
+
+#include "custom_op/varlen_utils.h"
+#include "paddle/extension.h"
+
+std::vector<paddle::Tensor> RebuildPadding(const paddle::Tensor& tmp_out,
+                                           const paddle::Tensor& padding_offset,
+                                           const paddle::Tensor& seq_lens,
+                                           const paddle::Tensor& input_ids) {
+  PD_CHECK(seq_lens.dtype() == paddle::DataType::INT32,
+           "seq_lens must be int32.");
+  const int64_t dim_embed = tmp_out.shape().back();
+  const int64_t bsz = seq_lens.shape()[0];
+
+  const int64_t max_seq_len = input_ids.shape()[1];
+  std::vector<int32_t> cu_seqlens(bsz + 1);
+  const int64_t token_num = varlen::ComputeCuSeqlens(
+      seq_lens.data<int32_t>(), bsz, max_seq_len, cu_seqlens.data());
+  PD_CHECK(token_num <= tmp_out.shape()[0],
+           "seq_lens hold more tokens than tmp_out has rows.");
+
+  auto out = paddle::empty({bsz, dim_embed}, tmp_out.dtype(), tmp_out.place());
+  varlen::GatherLastToken(tmp_out.data(),
+                          cu_seqlens.data(),
+                          bsz,
+                          dim_embed * phi::SizeOf(tmp_out.dtype()),
+                          out.data());
+  return {out};
+}
+
+std::vector<std::vector<int64_t>> RebuildPaddingInferShape(
+    const std::vector<int64_t>& tmp_out_shape,
+    const std::vector<int64_t>& padding_offset_shape,
+    const std::vector<int64_t>& seq_lens_shape,
+    const std::vector<int64_t>& input_ids_shape) {
+  int64_t bsz = seq_lens_shape[0];
+  int64_t dim_embed = tmp_out_shape.back();
+  return {{bsz, dim_embed}};
+}
+
+std::vector<paddle::DataType> RebuildPaddingInferDtype(
+    const paddle::DataType& tmp_out_dtype,
+    const paddle::DataType& padding_offset_dtype,
+    const paddle::DataType& seq_lens_dtype,
+    const paddle::DataType& input_ids_dtype) {
+  return {tmp_out_dtype};
+}
+
+PD_BUILD_OP(rebuild_padding)
+    .Inputs({"tmp_out", "padding_offset", "seq_lens", "input_ids"})
+    .Outputs({"out"})
+    .SetKernelFn(PD_KERNEL(RebuildPadding))
+    .SetInferShapeFn(PD_INFER_SHAPE(RebuildPaddingInferShape))
+    .SetInferDtypeFn(PD_INFER_DTYPE(RebuildPaddingInferDtype));
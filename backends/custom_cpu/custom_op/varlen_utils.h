@@ -0,0 +1,116 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+// Host implementation of varlen packing/unpacking used by the padding ops,
+// which are also the host reference for the NPU llama_infer ones. A batch of
+// padded sequences [bsz, max_seq_len, ...] is packed into [token_num, ...]
+// where token_num = sum(seq_lens). All offsets are derived from seq_lens, so
+// the token count never has to be read back from the device.
+namespace varlen {
+
+// cu_seqlens[bi] is the packed index of the first token of sequence bi,
+// cu_seqlens[bsz] is the total number of tokens, which is also returned.
+// Lengths are clamped to [0, max_seq_len], so no sequence reads past its
+// padded row.
+template <typename SeqT>
+inline int64_t ComputeCuSeqlens(const SeqT* seq_lens,
+                                int64_t bsz,
+                                int64_t max_seq_len,
+                                int32_t* cu_seqlens) {
+  int64_t total = 0;
+  cu_seqlens[0] = 0;
+  for (int64_t bi = 0; bi < bsz; ++bi) {
+    const int64_t len = static_cast<int64_t>(seq_lens[bi]);
+    total += std::min(std::max<int64_t>(len, 0), max_seq_len);
+    cu_seqlens[bi + 1] = static_cast<int32_t>(total);
+  }
+  return total;
+}
+
+// cum_offsets[bi] is the number of padding slots before sequence bi, i.e. the
+// exclusive prefix sum of (max_seq_len - seq_len).
+inline void ComputeCumOffsets(const int32_t* cu_seqlens,
+                              int64_t bsz,
+                              int64_t max_seq_len,
+                              int32_t* cum_offsets) {
+  for (int64_t bi = 0; bi < bsz; ++bi) {
+    cum_offsets[bi] = static_cast<int32_t>(bi * max_seq_len - cu_seqlens[bi]);
+  }
+}
+
+// padding_offset[t] maps packed token t back to its padded position:
+// padded_index = t + padding_offset[t].
+inline void ComputePaddingOffset(const int32_t* cu_seqlens,
+                                 int64_t bsz,
+                                 int64_t max_seq_len,
+                                 int32_t* padding_offset) {
+#pragma omp parallel for schedule(static)
+  for (int64_t bi = 0; bi < bsz; ++bi) {
+    const int32_t offset =
+        static_cast<int32_t>(bi * max_seq_len - cu_seqlens[bi]);
+    for (int32_t t = cu_seqlens[bi]; t < cu_seqlens[bi + 1]; ++t) {
+      padding_offset[t] = offset;
+    }
+  }
+}
+
+// Gathers the valid rows of a padded [bsz, max_seq_len, row_bytes] buffer
+// into a packed [token_num, row_bytes] buffer. cu_seqlens must come from
+// ComputeCuSeqlens with the same max_seq_len.
+inline void RemovePadding(const void* padded,
+                          const int32_t* cu_seqlens,
+                          int64_t bsz,
+                          int64_t max_seq_len,
+                          int64_t row_bytes,
+                          void* packed) {
+  const char* src = static_cast<const char*>(padded);
+  char* dst = static_cast<char*>(packed);
+#pragma omp parallel for schedule(static)
+  for (int64_t bi = 0; bi < bsz; ++bi) {
+    const int64_t len = cu_seqlens[bi + 1] - cu_seqlens[bi];
+    std::memcpy(dst + cu_seqlens[bi] * row_bytes,
+                src + bi * max_seq_len * row_bytes,
+                len * row_bytes);
+  }
+}
+
+// Copies the last valid row of every sequence from a packed
+// [token_num, row_bytes] buffer into [bsz, row_bytes]. Sequences without
+// tokens get a zero row.
+inline void GatherLastToken(const void* packed,
+                            const int32_t* cu_seqlens,
+                            int64_t bsz,
+                            int64_t row_bytes,
+                            void* out) {
+  const char* src = static_cast<const char*>(packed);
+  char* dst = static_cast<char*>(out);
+#pragma omp parallel for schedule(static)
+  for (int64_t bi = 0; bi < bsz; ++bi) {
+    if (cu_seqlens[bi + 1] == cu_seqlens[bi]) {
+      std::memset(dst + bi * row_bytes, 0, row_bytes);
+    } else {
+      std::memcpy(dst + bi * row_bytes,
+                  src + (cu_seqlens[bi + 1] - 1) * row_bytes,
+                  row_bytes);
+    }
+  }
+}
+
+}  // namespace varlen
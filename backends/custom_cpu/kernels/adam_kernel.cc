@@ -0,0 +1,127 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "kernels/phi_funcs.h"
+#include "paddle/phi/capi/all.h"
+
+namespace custom_kernel {
+
+template <typename T>
+void CopyIfNotInplace(const phi::Context& dev_ctx,
+                      const phi::DenseTensor& src,
+                      phi::DenseTensor* dst) {
+  if (dst == nullptr) return;
+  auto dst_data = dev_ctx.template Alloc<T>(dst);
+  if (dst_data != src.data<T>()) {
+    std::memcpy(dst_data, src.data<T>(), src.numel() * sizeof(T));
+  }
+}
+
+// Dense Adam, and AMSGrad with amsgrad. lazy_mode only applies to
+// SelectedRows gradients, which plugin kernels do not receive.
+template <typename T>
+void AdamDenseKernel(const phi::Context& dev_ctx,
+                     const phi::DenseTensor& param,
+                     const phi::DenseTensor& grad,
+                     const phi::DenseTensor& learning_rate,
+                     const phi::DenseTensor& moment1,
+                     const phi::DenseTensor& moment2,
+                     const paddle::optional<phi::DenseTensor>& moment2_max,
+                     const phi::DenseTensor& beta1_pow,
+                     const phi::DenseTensor& beta2_pow,
+                     const paddle::optional<phi::DenseTensor>& master_param,
+                     const paddle::optional<phi::DenseTensor>& skip_update,
+                     const phi::Scalar& beta1,
+                     const phi::Scalar& beta2,
+                     const phi::Scalar& epsilon,
+                     bool lazy_mode,
+                     int64_t min_row_size_to_use_multithread,
+                     bool multi_precision,
+                     bool use_global_beta_pow,
+                     bool amsgrad,
+                     phi::DenseTensor* param_out,
+                     phi::DenseTensor* moment1_out,
+                     phi::DenseTensor* moment2_out,
+                     phi::DenseTensor* moment2_max_out,
+                     phi::DenseTensor* beta1_pow_out,
+                     phi::DenseTensor* beta2_pow_out,
+                     phi::DenseTensor* master_param_out) {
+  KernelStats stats(KERNEL_COUNTERS("adam"),
+                    {&param, &grad, &moment1, &moment2},
+                    {param_out, moment1_out, moment2_out});
+  PD_CHECK(!amsgrad || moment2_max,
+           "adam with amsgrad needs the moment2_max input.");
+  if (skip_update && skip_update->data<bool>()[0]) {
+    CopyIfNotInplace<T>(dev_ctx, param, param_out);
+    CopyIfNotInplace<T>(dev_ctx, moment1, moment1_out);
+    CopyIfNotInplace<T>(dev_ctx, moment2, moment2_out);
+    if (amsgrad) CopyIfNotInplace<T>(dev_ctx, *moment2_max, moment2_max_out);
+    if (!use_global_beta_pow) {
+      CopyIfNotInplace<T>(dev_ctx, beta1_pow, beta1_pow_out);
+      CopyIfNotInplace<T>(dev_ctx, beta2_pow, beta2_pow_out);
+    }
+    return;
+  }
+
+  const T b1 = beta1.to<T>();
+  const T b2 = beta2.to<T>();
+  const T b1_pow = beta1_pow.data<T>()[0];
+  const T b2_pow = beta2_pow.data<T>()[0];
+  const T eps = epsilon.to<T>() * std::sqrt(1 - b2_pow);
+  const T lr =
+      learning_rate.data<T>()[0] * std::sqrt(1 - b2_pow) / (1 - b1_pow);
+
+  const T* p = param.data<T>();
+  const T* g = grad.data<T>();
+  const T* m1 = moment1.data<T>();
+  const T* m2 = moment2.data<T>();
+  const T* m2_max = amsgrad ? moment2_max->data<T>() : nullptr;
+  T* p_out = dev_ctx.template Alloc<T>(param_out);
+  T* m1_out = dev_ctx.template Alloc<T>(moment1_out);
+  T* m2_out = dev_ctx.template Alloc<T>(moment2_out);
+  T* m2_max_out =
+      amsgrad ? dev_ctx.template Alloc<T>(moment2_max_out) : nullptr;
+  const int64_t numel = param.numel();
+#pragma omp parallel for schedule(static)
+  for (int64_t i = 0; i < numel; ++i) {
+    T mom1 = b1 * m1[i] + (1 - b1) * g[i];
+    T mom2 = b2 * m2[i] + (1 - b2) * g[i] * g[i];
+    T denom = mom2;
+    if (m2_max != nullptr) {
+      denom = std::max(m2_max[i], mom2);
+      m2_max_out[i] = denom;
+    }
+    m1_out[i] = mom1;
+    m2_out[i] = mom2;
+    p_out[i] = p[i] - lr * (mom1 / (std::sqrt(denom) + eps));
+  }
+
+  if (!use_global_beta_pow) {
+    dev_ctx.template Alloc<T>(beta1_pow_out)[0] = b1_pow * b1;
+    dev_ctx.template Alloc<T>(beta2_pow_out)[0] = b2_pow * b2;
+  }
+}
+
+}  // namespace custom_kernel
+
+PD_BUILD_PHI_KERNEL(adam,
+                    custom_cpu,
+                    ALL_LAYOUT,
+                    custom_kernel::AdamDenseKernel,
+                    float,
+                    double) {}
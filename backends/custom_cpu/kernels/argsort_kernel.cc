@@ -83,6 +83,7 @@ void ArgsortKernel(const phi::Context& dev_ctx,
                    bool stable,
                    phi::DenseTensor* output,
                    phi::DenseTensor* indices) {
+  KernelStats stats(KERNEL_COUNTERS("argsort"), {&input}, {output, indices});
   auto in_dims = input.dims();
   auto rank = in_dims.size();
   axis = (axis < 0) ? (in_dims.size() + axis) : axis;
@@ -136,6 +137,7 @@ void ArgsortKernel(const phi::Context& dev_ctx,
     phi::DenseTensor trans_inp;
     trans_inp.Resize(trans_dims);
     dev_ctx.template Alloc<T>(&trans_inp);
+    RecordTemporary(trans_inp);
     // Do transpose
     TransposeKernel<T>(dev_ctx, input, trans, &trans_inp);
 
@@ -146,10 +148,12 @@ void ArgsortKernel(const phi::Context& dev_ctx,
     phi::DenseTensor tmp_out;
     tmp_out.Resize(trans_dims);
     T* t_out = dev_ctx.template Alloc<T>(&tmp_out);
+    RecordTemporary(tmp_out);
 
     phi::DenseTensor tmp_indices;
     tmp_indices.Resize(trans_dims);
     auto* t_ind = dev_ctx.template Alloc<int64_t>(&tmp_indices);
+    RecordTemporary(tmp_indices);
 
     FullSort<T, int64_t>(input_height,
                          input_width,
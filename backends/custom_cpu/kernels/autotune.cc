@@ -0,0 +1,328 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "kernels/autotune.h"
+
+#include <glog/logging.h>
+#include <unistd.h>
+
+#include <cctype>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+namespace custom_kernel {
+namespace autotune {
+
+namespace {
+
+constexpr int kCacheVersion = 1;
+
+std::string DefaultCachePath() {
+  const char* path = std::getenv("CUSTOM_CPU_AUTOTUNE_CACHE");
+  if (path != nullptr) return path;
+  const char* home = std::getenv("HOME");
+  if (home == nullptr || *home == '\0') return "";
+  return std::string(home) + "/.cache/paddle-custom-cpu/autotune.json";
+}
+
+// The cache file only holds objects of strings (plus the version number),
+// so a small reader for that subset of JSON is enough.
+struct JsonNode {
+  bool is_object = false;
+  std::string value;
+  std::map<std::string, JsonNode> members;
+};
+
+class JsonReader {
+ public:
+  explicit JsonReader(const std::string& text) : text_(text) {}
+
+  bool Parse(JsonNode* node) {
+    if (!ParseValue(node)) return false;
+    SkipSpace();
+    return pos_ == text_.size();
+  }
+
+ private:
+  void SkipSpace() {
+    while (pos_ < text_.size() && isspace(text_[pos_])) ++pos_;
+  }
+
+  bool ParseValue(JsonNode* node) {
+    SkipSpace();
+    if (pos_ >= text_.size()) return false;
+    if (text_[pos_] == '{') return ParseObject(node);
+    if (text_[pos_] == '"') return ParseString(&node->value);
+    size_t begin = pos_;
+    while (pos_ < text_.size() &&
+           (isdigit(text_[pos_]) || text_[pos_] == '-')) {
+      ++pos_;
+    }
+    node->value = text_.substr(begin, pos_ - begin);
+    return pos_ > begin;
+  }
+
+  bool ParseObject(JsonNode* node) {
+    node->is_object = true;
+    ++pos_;  // '{'
+    SkipSpace();
+    if (pos_ < text_.size() && text_[pos_] == '}') {
+      ++pos_;
+      return true;
+    }
+    while (true) {
+      std::string key;
+      SkipSpace();
+      if (!ParseString(&key)) return false;
+      SkipSpace();
+      if (pos_ >= text_.size() || text_[pos_++] != ':') return false;
+      if (!ParseValue(&node->members[key])) return false;
+      SkipSpace();
+      if (pos_ >= text_.size()) return false;
+      char c = text_[pos_++];
+      if (c == '}') return true;
+      if (c != ',') return false;
+    }
+  }
+
+  bool ParseString(std::string* out) {
+    if (pos_ >= text_.size() || text_[pos_] != '"') return false;
+    ++pos_;
+    out->clear();
+    while (pos_ < text_.size()) {
+      char c = text_[pos_++];
+      if (c == '"') return true;
+      if (c != '\\') {
+        out->push_back(c);
+        continue;
+      }
+      if (pos_ >= text_.size()) return false;
+      char e = text_[pos_++];
+      switch (e) {
+        case 'n':
+          out->push_back('\n');
+          break;
+        case 't':
+          out->push_back('\t');
+          break;
+        case 'u':
+          // Never written by Save; keep a placeholder for hand edits.
+          if (pos_ + 4 > text_.size()) return false;
+          pos_ += 4;
+          out->push_back('?');
+          break;
+        default:
+          out->push_back(e);
+          break;
+      }
+    }
+    return false;
+  }
+
+  const std::string& text_;
+  size_t pos_ = 0;
+};
+
+std::string Quote(const std::string& s) {
+  std::string out = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      out.push_back('\\');
+      out.push_back(c);
+    } else if (c == '\n') {
+      out += "\\n";
+    } else if (c == '\t') {
+      out += "\\t";
+    } else if (static_cast<unsigned char>(c) >= 0x20) {
+      out.push_back(c);
+    }
+  }
+  out.push_back('"');
+  return out;
+}
+
+bool ReadCacheFile(const std::string& path, JsonNode* tables) {
+  std::ifstream in(path);
+  if (!in) return false;
+  std::stringstream buffer;
+  buffer << in.rdbuf();
+  JsonNode root;
+  if (!JsonReader(buffer.str()).Parse(&root) || !root.is_object) {
+    LOG(WARNING) << "Ignoring malformed autotune cache " << path;
+    return false;
+  }
+  auto version = root.members.find("version");
+  if (version == root.members.end() ||
+      version->second.value != std::to_string(kCacheVersion)) {
+    return false;
+  }
+  auto found = root.members.find("tables");
+  if (found == root.members.end() || !found->second.is_object) return false;
+  *tables = found->second;
+  return true;
+}
+
+}  // namespace
+
+std::string ShapeClass(std::initializer_list<int64_t> dims) {
+  std::string shape_class;
+  for (int64_t dim : dims) {
+    int64_t bucket = 1;
+    while (bucket < dim) bucket <<= 1;
+    if (!shape_class.empty()) shape_class.push_back('x');
+    shape_class += std::to_string(bucket);
+  }
+  return shape_class;
+}
+
+bool AutotuneEnabled() {
+  static const bool enabled = [] {
+    const char* value = std::getenv("CUSTOM_CPU_AUTOTUNE");
+    return value == nullptr || std::string(value) != "0";
+  }();
+  return enabled;
+}
+
+TuningCache& TuningCache::Instance() {
+  static TuningCache cache(DefaultCachePath());
+  return cache;
+}
+
+TuningCache::TuningCache(std::string path) : path_(std::move(path)) {
+  Load();
+}
+
+const std::string& TuningCache::CpuSignature() {
+  static const std::string signature = [] {
+    std::string model;
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    std::string implementer, part;
+    while (std::getline(cpuinfo, line)) {
+      auto colon = line.find(':');
+      if (colon == std::string::npos || colon == 0) continue;
+      auto name_end = line.find_last_not_of(" \t", colon - 1);
+      std::string name = line.substr(0, name_end + 1);
+      auto value_begin = line.find_first_not_of(" \t", colon + 1);
+      std::string value =
+          value_begin == std::string::npos ? "" : line.substr(value_begin);
+      if (name == "model name" && model.empty()) {
+        model = value;
+      } else if (name == "CPU implementer" && implementer.empty()) {
+        implementer = value;
+      } else if (name == "CPU part" && part.empty()) {
+        part = value;
+      }
+    }
+    // Arm cores report an implementer and part number instead of a name.
+    if (model.empty() && !implementer.empty()) {
+      model = "arm " + implementer + " " + part;
+    }
+    if (model.empty()) model = "unknown";
+    return model + " / " + std::to_string(std::thread::hardware_concurrency());
+  }();
+  return signature;
+}
+
+bool TuningCache::Lookup(const std::string& key, std::string* variant) const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto it = entries_.find(key);
+  if (it == entries_.end()) return false;
+  *variant = it->second;
+  return true;
+}
+
+void TuningCache::Store(const std::string& key, const std::string& variant) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  entries_[key] = variant;
+  Save();
+}
+
+size_t TuningCache::size() const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  return entries_.size();
+}
+
+void TuningCache::Load() {
+  if (path_.empty()) return;
+  JsonNode tables;
+  if (!ReadCacheFile(path_, &tables)) return;
+  auto table = tables.members.find(CpuSignature());
+  if (table == tables.members.end()) return;
+  for (const auto& entry : table->second.members) {
+    if (!entry.second.is_object) entries_[entry.first] = entry.second.value;
+  }
+  VLOG(3) << "Loaded " << entries_.size() << " autotune results from "
+          << path_;
+}
+
+void TuningCache::Save() const {
+  if (path_.empty()) return;
+  // Re-read the file so tables of other CPUs, and results stored meanwhile
+  // by other processes on this one, are kept.
+  JsonNode tables;
+  ReadCacheFile(path_, &tables);
+  auto& table = tables.members[CpuSignature()];
+  table.is_object = true;
+  for (const auto& entry : entries_) {
+    table.members[entry.first].value = entry.second;
+  }
+
+  std::ostringstream out;
+  out << "{\n  \"version\": " << kCacheVersion << ",\n  \"tables\": {";
+  bool first_table = true;
+  for (const auto& t : tables.members) {
+    if (!t.second.is_object) continue;
+    out << (first_table ? "\n" : ",\n") << "    " << Quote(t.first) << ": {";
+    bool first_entry = true;
+    for (const auto& entry : t.second.members) {
+      out << (first_entry ? "\n" : ",\n") << "      " << Quote(entry.first)
+          << ": " << Quote(entry.second.value);
+      first_entry = false;
+    }
+    out << "\n    }";
+    first_table = false;
+  }
+  out << "\n  }\n}\n";
+
+  // Write a temporary file and rename it, so readers never see a partial
+  // file.
+  std::error_code ec;
+  std::filesystem::path path(path_);
+  if (path.has_parent_path()) {
+    std::filesystem::create_directories(path.parent_path(), ec);
+  }
+  std::string tmp = path_ + ".tmp." + std::to_string(getpid());
+  {
+    std::ofstream file(tmp, std::ios::trunc);
+    file << out.str();
+    if (!file) {
+      LOG(WARNING) << "Could not write autotune cache " << tmp;
+      return;
+    }
+  }
+  std::filesystem::rename(tmp, path, ec);
+  if (ec) {
+    LOG(WARNING) << "Could not write autotune cache " << path_ << ": "
+                 << ec.message();
+    std::filesystem::remove(tmp, ec);
+  }
+}
+
+}  // namespace autotune
+}  // namespace custom_kernel
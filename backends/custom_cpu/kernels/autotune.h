@@ -0,0 +1,169 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace custom_kernel {
+namespace autotune {
+
+// Shapes that round to the same powers of two share a tuning result, so a
+// model with dynamic batch sizes tunes a handful of keys, not one per batch.
+std::string ShapeClass(std::initializer_list<int64_t> dims);
+
+// Whether to time variants at all, from CUSTOM_CPU_AUTOTUNE (default on).
+// When off every kernel runs its first, reference variant.
+bool AutotuneEnabled();
+
+// Winners of past tuning runs, keyed by "<kernel>|<dtype>|<shape class>"
+// and holding the variant name.
+//
+// Results are persisted to a JSON file (CUSTOM_CPU_AUTOTUNE_CACHE, default
+// $HOME/.cache/paddle-custom-cpu/autotune.json; set it empty to keep results
+// in memory only). The file holds one table per CPU signature, so a home
+// directory shared across machines of different generations keeps a result
+// set for each of them; only the table matching this host is loaded.
+class TuningCache {
+ public:
+  static TuningCache& Instance();
+
+  explicit TuningCache(std::string path);
+
+  bool Lookup(const std::string& key, std::string* variant) const;
+
+  // Records a result and rewrites the cache file with it.
+  void Store(const std::string& key, const std::string& variant);
+
+  size_t size() const;
+
+  // CPU model and logical core count, e.g. "Intel(R) Xeon(R) ... / 112".
+  static const std::string& CpuSignature();
+
+ private:
+  void Load();
+  void Save() const;
+
+  const std::string path_;
+  mutable std::mutex mutex_;
+  std::map<std::string, std::string> entries_;
+};
+
+// A kernel with several interchangeable implementations.
+//
+// The first call for a (dtype, shape class) pair runs every variant on the
+// real arguments, keeps the fastest and records it in the TuningCache;
+// later calls, in this process or after a restart, dispatch straight to it.
+// Every variant must fully overwrite its outputs and leave its inputs alone,
+// since the variants run back to back on the same arguments while tuning.
+template <typename... Args>
+class TunedKernel {
+ public:
+  using Variant = std::pair<std::string, std::function<void(Args...)>>;
+
+  TunedKernel(std::string name, std::vector<Variant> variants)
+      : name_(std::move(name)), variants_(std::move(variants)) {}
+
+  void operator()(const char* dtype,
+                  const std::string& shape_class,
+                  Args... args) {
+    if (variants_.size() == 1 || !AutotuneEnabled()) {
+      variants_.front().second(args...);
+      return;
+    }
+    std::string key = name_ + "|" + dtype + "|" + shape_class;
+    {
+      std::shared_lock<std::shared_mutex> guard(mutex_);
+      auto it = chosen_.find(key);
+      if (it != chosen_.end()) {
+        variants_[it->second].second(args...);
+        return;
+      }
+    }
+    size_t index = 0;
+    std::string cached;
+    if (TuningCache::Instance().Lookup(key, &cached) &&
+        FindVariant(cached, &index)) {
+      variants_[index].second(args...);
+    } else {
+      index = Tune(args...);
+      TuningCache::Instance().Store(key, variants_[index].first);
+    }
+    std::unique_lock<std::shared_mutex> guard(mutex_);
+    chosen_.emplace(key, index);
+  }
+
+  const std::string& name() const { return name_; }
+
+ private:
+  bool FindVariant(const std::string& variant_name, size_t* index) const {
+    for (size_t i = 0; i < variants_.size(); ++i) {
+      if (variants_[i].first == variant_name) {
+        *index = i;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Runs each variant a few times (fewer when it is slow) and returns the
+  // index with the lowest time. The winner runs last, so the outputs left
+  // behind are its own.
+  size_t Tune(Args... args) {
+    using Clock = std::chrono::steady_clock;
+    constexpr int kMaxRuns = 3;
+    constexpr double kBudgetSeconds = 0.05;
+    size_t best = 0;
+    double best_time = std::numeric_limits<double>::max();
+    for (size_t i = 0; i < variants_.size(); ++i) {
+      double fastest = std::numeric_limits<double>::max();
+      double spent = 0;
+      for (int run = 0; run < kMaxRuns && spent < kBudgetSeconds; ++run) {
+        auto begin = Clock::now();
+        variants_[i].second(args...);
+        double seconds =
+            std::chrono::duration<double>(Clock::now() - begin).count();
+        fastest = std::min(fastest, seconds);
+        spent += seconds;
+      }
+      if (fastest < best_time) {
+        best_time = fastest;
+        best = i;
+      }
+    }
+    if (best != variants_.size() - 1) variants_[best].second(args...);
+    return best;
+  }
+
+  const std::string name_;
+  const std::vector<Variant> variants_;
+  std::shared_mutex mutex_;
+  std::unordered_map<std::string, size_t> chosen_;
+};
+
+}  // namespace autotune
+}  // namespace custom_kernel
@@ -0,0 +1,334 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "kernels/phi_funcs.h"
+#include "paddle/phi/capi/all.h"
+
+namespace custom_kernel {
+
+// x viewed as [outer, channels, inner]: NCHW puts the spatial dims in inner,
+// NHWC (and a 2-D [N, C] input) in outer.
+struct NormShape {
+  int64_t outer, channels, inner;
+
+  // Elements per channel.
+  int64_t count() const { return outer * inner; }
+};
+
+NormShape MakeNormShape(const std::vector<int64_t>& dims,
+                        const std::string& data_layout) {
+  PD_CHECK(dims.size() >= 2 && dims.size() <= 5,
+           "batch_norm expects a 2-D to 5-D input, but received %d-D.",
+           dims.size());
+  NormShape s;
+  const bool channel_last = data_layout == "NHWC" || data_layout == "NDHWC";
+  const size_t axis = channel_last ? dims.size() - 1 : 1;
+  s.channels = dims[axis];
+  s.outer = phi::product(std::vector<int64_t>(dims.cbegin(),
+                                              dims.cbegin() + axis));
+  s.inner = phi::product(std::vector<int64_t>(dims.cbegin() + axis + 1,
+                                              dims.cend()));
+  return s;
+}
+
+// Visits every element of channel c with f(index).
+template <typename F>
+inline void ForEachInChannel(const NormShape& s, int64_t c, F&& f) {
+  for (int64_t o = 0; o < s.outer; ++o) {
+    const int64_t base = (o * s.channels + c) * s.inner;
+    for (int64_t i = 0; i < s.inner; ++i) f(base + i);
+  }
+}
+
+// Runs f(c, offset, n) over runs of n elements of channel c covering x: one
+// task per [inner] row, or, when inner is 1 as in NHWC, one per pixel so a
+// task is not a single element.
+template <typename F>
+void ForEachRun(const NormShape& s, F&& f) {
+  if (s.inner == 1) {
+#pragma omp parallel for schedule(static)
+    for (int64_t o = 0; o < s.outer; ++o) {
+      for (int64_t c = 0; c < s.channels; ++c) f(c, o * s.channels + c, 1);
+    }
+    return;
+  }
+  const int64_t num_tasks = s.outer * s.channels;
+#pragma omp parallel for schedule(static)
+  for (int64_t task = 0; task < num_tasks; ++task) {
+    f(task % s.channels, task * s.inner, s.inner);
+  }
+}
+
+// Batch mean and biased variance of each channel, in two passes so large
+// means do not cancel the variance.
+template <typename T>
+void ChannelStats(const NormShape& s, const T* x, T* mean, T* var) {
+#pragma omp parallel for schedule(static)
+  for (int64_t c = 0; c < s.channels; ++c) {
+    double sum = 0;
+    ForEachInChannel(s, c, [&](int64_t i) { sum += x[i]; });
+    const double m = sum / s.count();
+    double sq = 0;
+    ForEachInChannel(s, c, [&](int64_t i) {
+      const double d = x[i] - m;
+      sq += d * d;
+    });
+    mean[c] = static_cast<T>(m);
+    var[c] = static_cast<T>(sq / s.count());
+  }
+}
+
+// y = (x - mean) * inv_std * scale + bias, as one multiply-add per element.
+template <typename T>
+void Normalize(const NormShape& s,
+               const T* x,
+               const T* mean,
+               const T* inv_std,
+               const T* scale,
+               const T* bias,
+               T* y) {
+  std::vector<T> a(s.channels), b(s.channels);
+  for (int64_t c = 0; c < s.channels; ++c) {
+    a[c] = inv_std[c] * (scale ? scale[c] : static_cast<T>(1));
+    b[c] = (bias ? bias[c] : static_cast<T>(0)) - mean[c] * a[c];
+  }
+  ForEachRun(s, [&](int64_t c, int64_t offset, int64_t n) {
+    for (int64_t i = offset; i < offset + n; ++i) y[i] = x[i] * a[c] + b[c];
+  });
+}
+
+template <typename T>
+void InvStd(const T* variance, int64_t n, float epsilon, T* inv_std) {
+  for (int64_t c = 0; c < n; ++c) {
+    inv_std[c] = static_cast<T>(1) / std::sqrt(variance[c] + epsilon);
+  }
+}
+
+template <typename T>
+void BatchNormKernel(const phi::Context& dev_ctx,
+                     const phi::DenseTensor& x,
+                     const phi::DenseTensor& mean,
+                     const phi::DenseTensor& variance,
+                     const paddle::optional<phi::DenseTensor>& scale,
+                     const paddle::optional<phi::DenseTensor>& bias,
+                     bool is_test,
+                     float momentum,
+                     float epsilon,
+                     const std::string& data_layout,
+                     bool use_global_stats,
+                     bool trainable_statistics,
+                     phi::DenseTensor* y,
+                     phi::DenseTensor* mean_out,
+                     phi::DenseTensor* variance_out,
+                     phi::DenseTensor* saved_mean,
+                     phi::DenseTensor* saved_variance,
+                     phi::DenseTensor* reserve_space) {
+  KernelStats stats(
+      KERNEL_COUNTERS("batch_norm"),
+      {&x, &mean, &variance, scale.get_ptr(), bias.get_ptr()},
+      {y, mean_out, variance_out, saved_mean});
+  auto s = MakeNormShape(x.dims(), data_layout);
+  const bool global_stats =
+      use_global_stats || (is_test && !trainable_statistics);
+  auto y_data = dev_ctx.template Alloc<T>(y);
+  auto mean_out_data = dev_ctx.template Alloc<T>(mean_out);
+  auto variance_out_data = dev_ctx.template Alloc<T>(variance_out);
+  auto saved_mean_data = dev_ctx.template Alloc<T>(saved_mean);
+  auto saved_inv_std = dev_ctx.template Alloc<T>(saved_variance);
+  const T* running_mean = mean.data<T>();
+  const T* running_var = variance.data<T>();
+  const T* scale_data = scale ? scale->data<T>() : nullptr;
+  const T* bias_data = bias ? bias->data<T>() : nullptr;
+
+  if (global_stats) {
+    std::copy_n(running_mean, s.channels, saved_mean_data);
+    InvStd(running_var, s.channels, epsilon, saved_inv_std);
+    if (mean_out_data != running_mean) {
+      std::copy_n(running_mean, s.channels, mean_out_data);
+    }
+    if (variance_out_data != running_var) {
+      std::copy_n(running_var, s.channels, variance_out_data);
+    }
+  } else {
+    std::vector<T> batch_var(s.channels);
+    ChannelStats(s, x.data<T>(), saved_mean_data, batch_var.data());
+    InvStd(batch_var.data(), s.channels, epsilon, saved_inv_std);
+    // Running statistics track the biased batch variance, as in Paddle's
+    // CPU kernel. mean_out may alias mean.
+    for (int64_t c = 0; c < s.channels; ++c) {
+      mean_out_data[c] =
+          running_mean[c] * momentum + saved_mean_data[c] * (1 - momentum);
+      variance_out_data[c] =
+          running_var[c] * momentum + batch_var[c] * (1 - momentum);
+    }
+  }
+  if (x.numel() == 0) return;
+  Normalize(s,
+            x.data<T>(),
+            saved_mean_data,
+            saved_inv_std,
+            scale_data,
+            bias_data,
+            y_data);
+}
+
+template <typename T>
+void BatchNormInferKernel(const phi::Context& dev_ctx,
+                          const phi::DenseTensor& x,
+                          const phi::DenseTensor& mean,
+                          const phi::DenseTensor& variance,
+                          const phi::DenseTensor& scale,
+                          const phi::DenseTensor& bias,
+                          float momentum,
+                          float epsilon,
+                          const std::string& data_layout,
+                          phi::DenseTensor* y,
+                          phi::DenseTensor* mean_out,
+                          phi::DenseTensor* variance_out) {
+  KernelStats stats(KERNEL_COUNTERS("batch_norm_infer"),
+                    {&x, &mean, &variance, &scale, &bias},
+                    {y});
+  auto s = MakeNormShape(x.dims(), data_layout);
+  auto y_data = dev_ctx.template Alloc<T>(y);
+  if (mean_out) {
+    auto data = dev_ctx.template Alloc<T>(mean_out);
+    if (data != mean.data<T>()) {
+      std::copy_n(mean.data<T>(), s.channels, data);
+    }
+  }
+  if (variance_out) {
+    auto data = dev_ctx.template Alloc<T>(variance_out);
+    if (data != variance.data<T>()) {
+      std::copy_n(variance.data<T>(), s.channels, data);
+    }
+  }
+  if (x.numel() == 0) return;
+  std::vector<T> inv_std(s.channels);
+  InvStd(variance.data<T>(), s.channels, epsilon, inv_std.data());
+  Normalize(s,
+            x.data<T>(),
+            mean.data<T>(),
+            inv_std.data(),
+            scale.data<T>(),
+            bias.data<T>(),
+            y_data);
+}
+
+template <typename T>
+void BatchNormGradKernel(
+    const phi::Context& dev_ctx,
+    const phi::DenseTensor& x,
+    const paddle::optional<phi::DenseTensor>& scale,
+    const paddle::optional<phi::DenseTensor>& bias,
+    const paddle::optional<phi::DenseTensor>& mean_out,
+    const paddle::optional<phi::DenseTensor>& variance_out,
+    const phi::DenseTensor& saved_mean,
+    const phi::DenseTensor& saved_variance,
+    const paddle::optional<phi::DenseTensor>& reserve_space,
+    const phi::DenseTensor& y_grad,
+    float momentum,
+    float epsilon,
+    const std::string& data_layout,
+    bool is_test,
+    bool use_global_stats,
+    bool trainable_statistics,
+    phi::DenseTensor* x_grad,
+    phi::DenseTensor* scale_grad,
+    phi::DenseTensor* bias_grad) {
+  KernelStats stats(KERNEL_COUNTERS("batch_norm_grad"),
+                    {&x, scale.get_ptr(), &saved_mean, &y_grad},
+                    {x_grad, scale_grad, bias_grad});
+  auto s = MakeNormShape(x.dims(), data_layout);
+  const bool global_stats = use_global_stats || is_test;
+  std::vector<T> mean(s.channels), inv_std(s.channels);
+  if (global_stats) {
+    PD_CHECK(mean_out && variance_out,
+             "batch_norm_grad with global statistics needs the running mean "
+             "and variance.");
+    std::copy_n(mean_out->data<T>(), s.channels, mean.data());
+    InvStd(variance_out->data<T>(), s.channels, epsilon, inv_std.data());
+  } else {
+    std::copy_n(saved_mean.data<T>(), s.channels, mean.data());
+    std::copy_n(saved_variance.data<T>(), s.channels, inv_std.data());
+  }
+  const T* x_data = x.data<T>();
+  const T* dy = y_grad.data<T>();
+  const T* scale_data = scale ? scale->data<T>() : nullptr;
+
+  // Per channel sum(dy) and sum(dy * x_hat), the bias and scale grads.
+  std::vector<T> dbias(s.channels), dscale(s.channels);
+#pragma omp parallel for schedule(static)
+  for (int64_t c = 0; c < s.channels; ++c) {
+    double sum_dy = 0, sum_dy_xhat = 0;
+    ForEachInChannel(s, c, [&](int64_t i) {
+      sum_dy += dy[i];
+      sum_dy_xhat += dy[i] * (x_data[i] - mean[c]);
+    });
+    dbias[c] = static_cast<T>(sum_dy);
+    dscale[c] = static_cast<T>(sum_dy_xhat) * inv_std[c];
+  }
+  if (scale_grad) {
+    std::copy_n(
+        dscale.data(), s.channels, dev_ctx.template Alloc<T>(scale_grad));
+  }
+  if (bias_grad) {
+    std::copy_n(dbias.data(), s.channels, dev_ctx.template Alloc<T>(bias_grad));
+  }
+  if (!x_grad) return;
+
+  auto dx = dev_ctx.template Alloc<T>(x_grad);
+  const T inv_count = static_cast<T>(1) / std::max<int64_t>(s.count(), 1);
+  ForEachRun(s, [&](int64_t c, int64_t offset, int64_t n) {
+    const T k = (scale_data ? scale_data[c] : static_cast<T>(1)) * inv_std[c];
+    if (global_stats) {
+      for (int64_t i = offset; i < offset + n; ++i) dx[i] = dy[i] * k;
+      return;
+    }
+    // dx = k * (dy - mean(dy) - x_hat * mean(dy * x_hat))
+    const T dy_mean = dbias[c] * inv_count;
+    const T xhat_coef = dscale[c] * inv_count;
+    for (int64_t i = offset; i < offset + n; ++i) {
+      const T x_hat = (x_data[i] - mean[c]) * inv_std[c];
+      dx[i] = k * (dy[i] - dy_mean - x_hat * xhat_coef);
+    }
+  });
+}
+
+}  // namespace custom_kernel
+
+PD_BUILD_PHI_KERNEL(batch_norm,
+                    custom_cpu,
+                    ALL_LAYOUT,
+                    custom_kernel::BatchNormKernel,
+                    float,
+                    double) {}
+
+PD_BUILD_PHI_KERNEL(batch_norm_infer,
+                    custom_cpu,
+                    ALL_LAYOUT,
+                    custom_kernel::BatchNormInferKernel,
+                    float,
+                    double) {}
+
+PD_BUILD_PHI_KERNEL(batch_norm_grad,
+                    custom_cpu,
+                    ALL_LAYOUT,
+                    custom_kernel::BatchNormGradKernel,
+                    float,
+                    double) {}
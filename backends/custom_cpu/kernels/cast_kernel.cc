@@ -22,6 +22,7 @@ void CastKernel(const phi::Context& dev_ctx,
                 const phi::DenseTensor& x,
                 phi::DataType out_dtype,
                 phi::DenseTensor* out) {
+  KernelStats stats(KERNEL_COUNTERS("cast"), {&x}, {out});
   auto x_data = x.data<T>();
   out->Resize(x.dims());
   auto numel = x.numel();
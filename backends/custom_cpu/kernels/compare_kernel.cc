@@ -25,6 +25,7 @@ void NotEqualRawKernel(const phi::Context& dev_ctx,
                        const phi::DenseTensor& y,
                        int axis,
                        phi::DenseTensor* out) {
+  KernelStats stats(KERNEL_COUNTERS("not_equal"), {&x, &y}, {out});
   auto x_dims = x.dims();
   auto y_dims = y.dims();
   auto dst_dims = phi::BroadcastDims(axis, x_dims, y_dims);
@@ -61,6 +62,7 @@ void EqualRawKernel(const phi::Context& dev_ctx,
                     const phi::DenseTensor& y,
                     int axis,
                     phi::DenseTensor* out) {
+  KernelStats stats(KERNEL_COUNTERS("equal"), {&x, &y}, {out});
   auto x_dims = x.dims();
   auto y_dims = y.dims();
   auto dst_dims = phi::BroadcastDims(axis, x_dims, y_dims);
@@ -97,6 +99,7 @@ void LessThanRawKernel(const phi::Context& dev_ctx,
                        const phi::DenseTensor& y,
                        int axis,
                        phi::DenseTensor* out) {
+  KernelStats stats(KERNEL_COUNTERS("less_than"), {&x, &y}, {out});
   auto x_dims = x.dims();
   auto y_dims = y.dims();
   auto dst_dims = phi::BroadcastDims(axis, x_dims, y_dims);
@@ -127,6 +130,7 @@ void LessEqualRawKernel(const phi::Context& dev_ctx,
                         const phi::DenseTensor& y,
                         int axis,
                         phi::DenseTensor* out) {
+  KernelStats stats(KERNEL_COUNTERS("less_equal"), {&x, &y}, {out});
   auto x_dims = x.dims();
   auto y_dims = y.dims();
   auto dst_dims = phi::BroadcastDims(axis, x_dims, y_dims);
@@ -157,6 +161,7 @@ void GreaterThanRawKernel(const phi::Context& dev_ctx,
                           const phi::DenseTensor& y,
                           int axis,
                           phi::DenseTensor* out) {
+  KernelStats stats(KERNEL_COUNTERS("greater_than"), {&x, &y}, {out});
   auto x_dims = x.dims();
   auto y_dims = y.dims();
   auto dst_dims = phi::BroadcastDims(axis, x_dims, y_dims);
@@ -187,6 +192,7 @@ void GreaterEqualRawKernel(const phi::Context& dev_ctx,
                            const phi::DenseTensor& y,
                            int axis,
                            phi::DenseTensor* out) {
+  KernelStats stats(KERNEL_COUNTERS("greater_equal"), {&x, &y}, {out});
   auto x_dims = x.dims();
   auto y_dims = y.dims();
   auto dst_dims = phi::BroadcastDims(axis, x_dims, y_dims);
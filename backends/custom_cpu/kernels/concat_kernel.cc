@@ -22,6 +22,8 @@ void ConcatKernel(const phi::Context& dev_ctx,
                   const std::vector<const phi::DenseTensor*>& x,
                   const phi::Scalar& axis_scalar,
                   phi::DenseTensor* out) {
+  KernelStats stats(KERNEL_COUNTERS("concat"), {}, {out});
+  stats.Read(x);
   int64_t axis = axis_scalar.to<int64_t>();
   if (axis < 0) {
     axis = axis + x[0]->dims().size();
@@ -21,6 +21,7 @@ template <typename T>
 void ContiguousKernel(const phi::Context& dev_ctx,
                       const phi::DenseTensor& input,
                       phi::DenseTensor* out) {
+  KernelStats stats(KERNEL_COUNTERS("contiguous"), {&input}, {out});
   out->set_strides(phi::CalcStrides(input.dims()));
   out->set_offset(0);
 
@@ -0,0 +1,942 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "kernels/autotune.h"
+#include "kernels/phi_funcs.h"
+#include "paddle/phi/capi/all.h"
+
+namespace custom_kernel {
+
+// Geometry of a 2-D convolution. Input and output are NCHW, or NHWC when
+// channel_last; the filter is [out_c, in_c / groups, k_h, k_w] either way.
+struct ConvShape {
+  int64_t batch, in_c, in_h, in_w;
+  int64_t out_c, out_h, out_w;
+  int64_t k_h, k_w;
+  int64_t stride_h, stride_w;
+  // Top and left padding; bottom and right follow from out_h and out_w.
+  int64_t pad_h, pad_w;
+  int64_t dilation_h, dilation_w;
+  int64_t groups;
+  bool channel_last;
+
+  int64_t in_c_per_group() const { return in_c / groups; }
+  int64_t out_c_per_group() const { return out_c / groups; }
+  // Filter elements per output channel.
+  int64_t filter_size() const { return in_c / groups * k_h * k_w; }
+  bool depthwise() const { return in_c == groups; }
+};
+
+ConvShape MakeConvShape(const std::vector<int64_t>& in_dims,
+                        const std::vector<int64_t>& filter_dims,
+                        const std::vector<int64_t>& out_dims,
+                        const std::vector<int>& strides,
+                        const std::vector<int>& paddings_in,
+                        const std::string& padding_algorithm,
+                        const std::vector<int>& dilations_in,
+                        int groups,
+                        const std::string& data_format) {
+  PD_CHECK(in_dims.size() == 4 && filter_dims.size() == 4,
+           "conv2d expects 4-D input and filter, but received %d-D and %d-D.",
+           in_dims.size(),
+           filter_dims.size());
+  ConvShape s;
+  s.channel_last = data_format == "NHWC";
+  s.batch = in_dims[0];
+  s.in_c = s.channel_last ? in_dims[3] : in_dims[1];
+  s.in_h = s.channel_last ? in_dims[1] : in_dims[2];
+  s.in_w = s.channel_last ? in_dims[2] : in_dims[3];
+  s.out_c = s.channel_last ? out_dims[3] : out_dims[1];
+  s.out_h = s.channel_last ? out_dims[1] : out_dims[2];
+  s.out_w = s.channel_last ? out_dims[2] : out_dims[3];
+  s.k_h = filter_dims[2];
+  s.k_w = filter_dims[3];
+  s.groups = std::max(groups, 1);
+  PD_CHECK(s.in_c % s.groups == 0 && s.out_c % s.groups == 0 &&
+               filter_dims[0] == s.out_c &&
+               filter_dims[1] == s.in_c / s.groups,
+           "conv2d filter [%d, %d] does not match %d input channels, %d "
+           "output channels and %d groups.",
+           filter_dims[0],
+           filter_dims[1],
+           s.in_c,
+           s.out_c,
+           s.groups);
+
+  auto paddings = paddings_in;
+  auto dilations = dilations_in;
+  phi::UpdatePaddingAndDilation(&paddings,
+                                &dilations,
+                                padding_algorithm,
+                                {s.in_h, s.in_w},
+                                strides,
+                                {static_cast<int>(s.k_h),
+                                 static_cast<int>(s.k_w)});
+  s.stride_h = strides[0];
+  s.stride_w = strides[1];
+  s.pad_h = paddings[0];
+  s.pad_w = paddings[2];
+  s.dilation_h = dilations[0];
+  s.dilation_w = dilations[1];
+  return s;
+}
+
+// Output positions [*begin, *end) whose input position, o * stride + offset,
+// falls inside [0, size). offset is the tap's dilated position minus the
+// padding.
+inline void ValidRange(int64_t offset,
+                       int64_t stride,
+                       int64_t size,
+                       int64_t out_size,
+                       int64_t* begin,
+                       int64_t* end) {
+  int64_t lo = offset >= 0 ? 0 : (stride - 1 - offset) / stride;
+  int64_t hi = size - 1 - offset < 0 ? 0 : (size - 1 - offset) / stride + 1;
+  *begin = std::min(lo, out_size);
+  *end = std::max(*begin, std::min(hi, out_size));
+}
+
+// What a fused convolution applies to each output element as it is stored:
+// the per-channel bias, a residual shaped as the output, and relu.
+template <typename T>
+struct ConvEpilogue {
+  const T* bias = nullptr;
+  const T* residual = nullptr;
+  bool relu = false;
+
+  T operator()(T value, int64_t channel, int64_t index) const {
+    if (bias) value += bias[channel];
+    if (residual) value += residual[index];
+    return relu && value < static_cast<T>(0) ? static_cast<T>(0) : value;
+  }
+};
+
+constexpr int64_t kConvOcBlock = 4;
+constexpr int64_t kConvOwTile = 64;
+
+// Direct NCHW convolution. Each task computes kConvOcBlock output channels
+// of one image, a row segment at a time, so every input element loaded
+// feeds kConvOcBlock accumulators and no im2col buffer is needed.
+template <typename T>
+void DirectConvNCHW(const ConvShape& s,
+                    const T* in,
+                    const T* filter,
+                    T* out,
+                    const ConvEpilogue<T>& epilogue) {
+  const int64_t icg = s.in_c_per_group(), ocg = s.out_c_per_group();
+  const int64_t oc_blocks = (ocg + kConvOcBlock - 1) / kConvOcBlock;
+  const int64_t in_plane = s.in_h * s.in_w;
+  const int64_t num_tasks = s.batch * s.groups * oc_blocks;
+#pragma omp parallel for schedule(static)
+  for (int64_t task = 0; task < num_tasks; ++task) {
+    const int64_t n = task / (s.groups * oc_blocks);
+    const int64_t g = task / oc_blocks % s.groups;
+    const int64_t oc0 = g * ocg + task % oc_blocks * kConvOcBlock;
+    const int64_t nb = std::min(kConvOcBlock, (g + 1) * ocg - oc0);
+    const T* in_g = in + (n * s.in_c + g * icg) * in_plane;
+    const T* w_block = filter + oc0 * s.filter_size();
+    T acc[kConvOcBlock][kConvOwTile];
+    T w[kConvOcBlock] = {};
+    for (int64_t oh = 0; oh < s.out_h; ++oh) {
+      for (int64_t ow0 = 0; ow0 < s.out_w; ow0 += kConvOwTile) {
+        const int64_t ow1 = std::min(s.out_w, ow0 + kConvOwTile);
+        for (int64_t b = 0; b < kConvOcBlock; ++b) {
+          std::fill(acc[b], acc[b] + kConvOwTile, static_cast<T>(0));
+        }
+        for (int64_t kh = 0; kh < s.k_h; ++kh) {
+          const int64_t ih = oh * s.stride_h - s.pad_h + kh * s.dilation_h;
+          if (ih < 0 || ih >= s.in_h) continue;
+          for (int64_t kw = 0; kw < s.k_w; ++kw) {
+            const int64_t offset = kw * s.dilation_w - s.pad_w;
+            int64_t begin, end;
+            ValidRange(offset, s.stride_w, s.in_w, s.out_w, &begin, &end);
+            begin = std::max(begin, ow0);
+            end = std::min(end, ow1);
+            if (begin >= end) continue;
+            for (int64_t c = 0; c < icg; ++c) {
+              const T* in_row = in_g + c * in_plane + ih * s.in_w;
+              const int64_t w_offset = (c * s.k_h + kh) * s.k_w + kw;
+              for (int64_t b = 0; b < nb; ++b) {
+                w[b] = w_block[b * s.filter_size() + w_offset];
+              }
+              for (int64_t ow = begin; ow < end; ++ow) {
+                const T x = in_row[ow * s.stride_w + offset];
+                for (int64_t b = 0; b < kConvOcBlock; ++b) {
+                  acc[b][ow - ow0] += w[b] * x;
+                }
+              }
+            }
+          }
+        }
+        for (int64_t b = 0; b < nb; ++b) {
+          const int64_t row =
+              ((n * s.out_c + oc0 + b) * s.out_h + oh) * s.out_w;
+          for (int64_t ow = ow0; ow < ow1; ++ow) {
+            out[row + ow] = epilogue(acc[b][ow - ow0], oc0 + b, row + ow);
+          }
+        }
+      }
+    }
+  }
+}
+
+// Direct NHWC convolution over a filter repacked to [g][k_h][k_w][icg][ocg],
+// so the innermost loop runs over contiguous output channels of one pixel.
+template <typename T>
+void DirectConvNHWC(const ConvShape& s,
+                    const T* in,
+                    const T* filter,
+                    T* out,
+                    const ConvEpilogue<T>& epilogue) {
+  const int64_t icg = s.in_c_per_group(), ocg = s.out_c_per_group();
+  const int64_t taps = s.k_h * s.k_w;
+  std::vector<T> packed(s.out_c * s.filter_size());
+  custom_cpu::KernelScope::RecordTemporary(packed.size() * sizeof(T));
+  for (int64_t oc = 0; oc < s.out_c; ++oc) {
+    const int64_t g = oc / ocg, o = oc % ocg;
+    for (int64_t c = 0; c < icg; ++c) {
+      for (int64_t tap = 0; tap < taps; ++tap) {
+        packed[((g * taps + tap) * icg + c) * ocg + o] =
+            filter[(oc * icg + c) * taps + tap];
+      }
+    }
+  }
+  const int64_t num_tasks = s.batch * s.out_h;
+#pragma omp parallel for schedule(static)
+  for (int64_t task = 0; task < num_tasks; ++task) {
+    const int64_t n = task / s.out_h, oh = task % s.out_h;
+    T* out_row = out + task * s.out_w * s.out_c;
+    std::fill(out_row, out_row + s.out_w * s.out_c, static_cast<T>(0));
+    for (int64_t kh = 0; kh < s.k_h; ++kh) {
+      const int64_t ih = oh * s.stride_h - s.pad_h + kh * s.dilation_h;
+      if (ih < 0 || ih >= s.in_h) continue;
+      const T* in_row = in + (n * s.in_h + ih) * s.in_w * s.in_c;
+      for (int64_t kw = 0; kw < s.k_w; ++kw) {
+        const int64_t offset = kw * s.dilation_w - s.pad_w;
+        int64_t begin, end;
+        ValidRange(offset, s.stride_w, s.in_w, s.out_w, &begin, &end);
+        for (int64_t ow = begin; ow < end; ++ow) {
+          const T* x = in_row + (ow * s.stride_w + offset) * s.in_c;
+          T* y = out_row + ow * s.out_c;
+          for (int64_t g = 0; g < s.groups; ++g) {
+            const T* w = packed.data() + ((g * s.k_h + kh) * s.k_w + kw) *
+                                             icg * ocg;
+            for (int64_t c = 0; c < icg; ++c) {
+              const T x_c = x[g * icg + c];
+              const T* w_c = w + c * ocg;
+              T* y_g = y + g * ocg;
+              for (int64_t o = 0; o < ocg; ++o) y_g[o] += x_c * w_c[o];
+            }
+          }
+        }
+      }
+    }
+    const int64_t row = task * s.out_w * s.out_c;
+    for (int64_t i = 0; i < s.out_w * s.out_c; ++i) {
+      out_row[i] = epilogue(out_row[i], i % s.out_c, row + i);
+    }
+  }
+}
+
+template <typename T>
+void DirectConv(const ConvShape& s,
+                const T* in,
+                const T* filter,
+                T* out,
+                const ConvEpilogue<T>& epilogue) {
+  if (s.channel_last) {
+    DirectConvNHWC(s, in, filter, out, epilogue);
+  } else {
+    DirectConvNCHW(s, in, filter, out, epilogue);
+  }
+}
+
+// Depthwise convolution (in_c == groups): every output channel reads a
+// single input channel, so NCHW works plane by plane and NHWC runs the
+// channels of a pixel in the innermost loop.
+template <typename T>
+void DepthwiseConv(const ConvShape& s,
+                   const T* in,
+                   const T* filter,
+                   T* out,
+                   const ConvEpilogue<T>& epilogue) {
+  const int64_t multiplier = s.out_c_per_group();
+  const int64_t taps = s.k_h * s.k_w;
+  if (!s.channel_last) {
+    const int64_t in_plane = s.in_h * s.in_w, out_plane = s.out_h * s.out_w;
+    const int64_t num_tasks = s.batch * s.out_c;
+#pragma omp parallel for schedule(static)
+    for (int64_t task = 0; task < num_tasks; ++task) {
+      const int64_t n = task / s.out_c, oc = task % s.out_c;
+      const T* x = in + (n * s.in_c + oc / multiplier) * in_plane;
+      const T* w = filter + oc * taps;
+      T* y = out + task * out_plane;
+      std::fill(y, y + out_plane, static_cast<T>(0));
+      for (int64_t oh = 0; oh < s.out_h; ++oh) {
+        T* y_row = y + oh * s.out_w;
+        for (int64_t kh = 0; kh < s.k_h; ++kh) {
+          const int64_t ih = oh * s.stride_h - s.pad_h + kh * s.dilation_h;
+          if (ih < 0 || ih >= s.in_h) continue;
+          const T* x_row = x + ih * s.in_w;
+          for (int64_t kw = 0; kw < s.k_w; ++kw) {
+            const int64_t offset = kw * s.dilation_w - s.pad_w;
+            int64_t begin, end;
+            ValidRange(offset, s.stride_w, s.in_w, s.out_w, &begin, &end);
+            const T w_tap = w[kh * s.k_w + kw];
+            for (int64_t ow = begin; ow < end; ++ow) {
+              y_row[ow] += w_tap * x_row[ow * s.stride_w + offset];
+            }
+          }
+        }
+      }
+      for (int64_t i = 0; i < out_plane; ++i) {
+        y[i] = epilogue(y[i], oc, task * out_plane + i);
+      }
+    }
+    return;
+  }
+
+  std::vector<T> packed(taps * s.out_c);
+  custom_cpu::KernelScope::RecordTemporary(packed.size() * sizeof(T));
+  for (int64_t oc = 0; oc < s.out_c; ++oc) {
+    for (int64_t tap = 0; tap < taps; ++tap) {
+      packed[tap * s.out_c + oc] = filter[oc * taps + tap];
+    }
+  }
+  const int64_t num_tasks = s.batch * s.out_h;
+#pragma omp parallel for schedule(static)
+  for (int64_t task = 0; task < num_tasks; ++task) {
+    const int64_t n = task / s.out_h, oh = task % s.out_h;
+    T* out_row = out + task * s.out_w * s.out_c;
+    std::fill(out_row, out_row + s.out_w * s.out_c, static_cast<T>(0));
+    for (int64_t kh = 0; kh < s.k_h; ++kh) {
+      const int64_t ih = oh * s.stride_h - s.pad_h + kh * s.dilation_h;
+      if (ih < 0 || ih >= s.in_h) continue;
+      const T* in_row = in + (n * s.in_h + ih) * s.in_w * s.in_c;
+      for (int64_t kw = 0; kw < s.k_w; ++kw) {
+        const int64_t offset = kw * s.dilation_w - s.pad_w;
+        int64_t begin, end;
+        ValidRange(offset, s.stride_w, s.in_w, s.out_w, &begin, &end);
+        const T* w = packed.data() + (kh * s.k_w + kw) * s.out_c;
+        for (int64_t ow = begin; ow < end; ++ow) {
+          const T* x = in_row + (ow * s.stride_w + offset) * s.in_c;
+          T* y = out_row + ow * s.out_c;
+          if (multiplier == 1) {
+            for (int64_t c = 0; c < s.out_c; ++c) y[c] += x[c] * w[c];
+          } else {
+            for (int64_t oc = 0; oc < s.out_c; ++oc) {
+              y[oc] += x[oc / multiplier] * w[oc];
+            }
+          }
+        }
+      }
+    }
+    const int64_t row = task * s.out_w * s.out_c;
+    for (int64_t i = 0; i < s.out_w * s.out_c; ++i) {
+      out_row[i] = epilogue(out_row[i], i % s.out_c, row + i);
+    }
+  }
+}
+
+// Winograd F(4x4, 3x3) for 3x3, stride 1, dilation 1, ungrouped
+// convolutions: each 4x4 output tile costs 36 multiplies per channel pair
+// instead of 144. Transforms follow Lavin and Gray, "Fast Algorithms for
+// Convolutional Neural Networks", with interpolation points 0, +-1, +-2.
+
+// 6 = G g for one column or row of a 3x3 filter.
+template <typename T>
+inline void WinogradFilter(T g0, T g1, T g2, T* u, int64_t stride) {
+  u[0] = g0 / 4;
+  u[stride] = -(g0 + g1 + g2) / 6;
+  u[2 * stride] = -(g0 - g1 + g2) / 6;
+  u[3 * stride] = g0 / 24 + g1 / 12 + g2 / 6;
+  u[4 * stride] = g0 / 24 - g1 / 12 + g2 / 6;
+  u[5 * stride] = g2;
+}
+
+// B^T d for six input values d[0], d[stride], ...
+template <typename T>
+inline void WinogradInput(const T* d, int64_t stride, T* v, int64_t v_stride) {
+  const T d0 = d[0], d1 = d[stride], d2 = d[2 * stride];
+  const T d3 = d[3 * stride], d4 = d[4 * stride], d5 = d[5 * stride];
+  v[0] = 4 * d0 - 5 * d2 + d4;
+  v[v_stride] = -4 * d1 - 4 * d2 + d3 + d4;
+  v[2 * v_stride] = 4 * d1 - 4 * d2 - d3 + d4;
+  v[3 * v_stride] = -2 * d1 - d2 + 2 * d3 + d4;
+  v[4 * v_stride] = 2 * d1 - d2 - 2 * d3 + d4;
+  v[5 * v_stride] = 4 * d1 - 5 * d3 + d5;
+}
+
+// A^T m for six transformed values.
+template <typename T>
+inline void WinogradOutput(const T* m, int64_t stride, T* y, int64_t y_stride) {
+  const T m0 = m[0], m1 = m[stride], m2 = m[2 * stride];
+  const T m3 = m[3 * stride], m4 = m[4 * stride], m5 = m[5 * stride];
+  y[0] = m0 + m1 + m2 + m3 + m4;
+  y[y_stride] = m1 - m2 + 2 * m3 - 2 * m4;
+  y[2 * y_stride] = m1 + m2 + 4 * m3 + 4 * m4;
+  y[3 * y_stride] = m1 - m2 + 8 * m3 - 8 * m4 + m5;
+}
+
+// Tiles transformed together; their 36 * in_c values stay in L2.
+constexpr int64_t kWinogradTileBlock = 16;
+
+template <typename T>
+void WinogradConv(const ConvShape& s,
+                  const T* in,
+                  const T* filter,
+                  T* out,
+                  const ConvEpilogue<T>& epilogue) {
+  const int64_t in_c = s.in_c, out_c = s.out_c;
+  // Element strides of the channel, row and column of an image.
+  const int64_t in_sc = s.channel_last ? 1 : s.in_h * s.in_w;
+  const int64_t in_sh = s.channel_last ? s.in_w * in_c : s.in_w;
+  const int64_t in_sw = s.channel_last ? in_c : 1;
+  const int64_t out_sc = s.channel_last ? 1 : s.out_h * s.out_w;
+  const int64_t out_sh = s.channel_last ? s.out_w * out_c : s.out_w;
+  const int64_t out_sw = s.channel_last ? out_c : 1;
+
+  // u[xi][oc][ic]: the transformed filter, one matrix per tile position.
+  std::vector<T> u(36 * out_c * in_c);
+  custom_cpu::KernelScope::RecordTemporary(u.size() * sizeof(T));
+  for (int64_t oc = 0; oc < out_c; ++oc) {
+    for (int64_t ic = 0; ic < in_c; ++ic) {
+      const T* g = filter + (oc * in_c + ic) * 9;
+      T tmp[6][3], tile[6][6];
+      for (int j = 0; j < 3; ++j) {
+        WinogradFilter(g[j], g[3 + j], g[6 + j], &tmp[0][j], 3);
+      }
+      for (int i = 0; i < 6; ++i) {
+        WinogradFilter(tmp[i][0], tmp[i][1], tmp[i][2], tile[i], 1);
+      }
+      for (int xi = 0; xi < 36; ++xi) {
+        u[(xi * out_c + oc) * in_c + ic] = tile[xi / 6][xi % 6];
+      }
+    }
+  }
+
+  const int64_t tiles_h = (s.out_h + 3) / 4, tiles_w = (s.out_w + 3) / 4;
+  const int64_t tiles = tiles_h * tiles_w;
+  const int64_t blocks = (tiles + kWinogradTileBlock - 1) / kWinogradTileBlock;
+  const int64_t num_tasks = s.batch * blocks;
+  constexpr int64_t kB = kWinogradTileBlock;
+#pragma omp parallel
+  {
+    // v[xi][ic][t] and m[xi][oc][t] for the tiles of one block.
+    std::vector<T> v(36 * in_c * kB), m(36 * out_c * kB);
+#pragma omp for schedule(static)
+    for (int64_t task = 0; task < num_tasks; ++task) {
+      const int64_t n = task / blocks;
+      const int64_t t0 = task % blocks * kB;
+      const int64_t nt = std::min(kB, tiles - t0);
+      const T* in_n = in + n * in_c * s.in_h * s.in_w;
+      T* out_n = out + n * out_c * s.out_h * s.out_w;
+
+      for (int64_t c = 0; c < in_c; ++c) {
+        for (int64_t t = 0; t < nt; ++t) {
+          const int64_t ih0 = (t0 + t) / tiles_w * 4 - s.pad_h;
+          const int64_t iw0 = (t0 + t) % tiles_w * 4 - s.pad_w;
+          T d[6][6], tmp[6][6];
+          for (int i = 0; i < 6; ++i) {
+            for (int j = 0; j < 6; ++j) {
+              const int64_t ih = ih0 + i, iw = iw0 + j;
+              d[i][j] = ih >= 0 && ih < s.in_h && iw >= 0 && iw < s.in_w
+                            ? in_n[c * in_sc + ih * in_sh + iw * in_sw]
+                            : static_cast<T>(0);
+            }
+          }
+          for (int j = 0; j < 6; ++j) WinogradInput(&d[0][j], 6, &tmp[0][j], 6);
+          for (int i = 0; i < 6; ++i) {
+            T* v_i = &v[(i * 6 * in_c + c) * kB + t];
+            WinogradInput(tmp[i], 1, v_i, in_c * kB);
+          }
+        }
+      }
+
+      // 36 independent [out_c x in_c] x [in_c x kB] products. A short last
+      // block still runs all kB columns, over stale values, so the inner
+      // loop has a constant trip count; those columns are never stored.
+      for (int64_t xi = 0; xi < 36; ++xi) {
+        for (int64_t oc = 0; oc < out_c; ++oc) {
+          T* m_row = &m[(xi * out_c + oc) * kB];
+          std::fill(m_row, m_row + kB, static_cast<T>(0));
+          const T* u_row = &u[(xi * out_c + oc) * in_c];
+          for (int64_t c = 0; c < in_c; ++c) {
+            const T u_c = u_row[c];
+            const T* v_row = &v[(xi * in_c + c) * kB];
+            for (int64_t t = 0; t < kB; ++t) m_row[t] += u_c * v_row[t];
+          }
+        }
+      }
+
+      for (int64_t oc = 0; oc < out_c; ++oc) {
+        for (int64_t t = 0; t < nt; ++t) {
+          const int64_t oh0 = (t0 + t) / tiles_w * 4;
+          const int64_t ow0 = (t0 + t) % tiles_w * 4;
+          T tmp[4][6], y[4][4];
+          const T* m_t = &m[oc * kB + t];
+          const int64_t m_stride = out_c * kB;
+          for (int j = 0; j < 6; ++j) {
+            WinogradOutput(m_t + j * m_stride, 6 * m_stride, &tmp[0][j], 6);
+          }
+          for (int i = 0; i < 4; ++i) WinogradOutput(tmp[i], 1, y[i], 1);
+          for (int i = 0; i < 4 && oh0 + i < s.out_h; ++i) {
+            for (int j = 0; j < 4 && ow0 + j < s.out_w; ++j) {
+              const int64_t index =
+                  oc * out_sc + (oh0 + i) * out_sh + (ow0 + j) * out_sw;
+              out_n[index] = epilogue(
+                  y[i][j], oc, n * out_c * s.out_h * s.out_w + index);
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+bool WinogradApplies(const ConvShape& s) {
+  return s.k_h == 3 && s.k_w == 3 && s.stride_h == 1 && s.stride_w == 1 &&
+         s.dilation_h == 1 && s.dilation_w == 1 && s.groups == 1;
+}
+
+// Below this many multiply-adds direct convolution wins and tuning is not
+// worth a cache entry.
+constexpr int64_t kMinTunedConvWork = 1 << 20;
+
+template <typename T>
+void ConvForward(const ConvShape& s,
+                 const T* in,
+                 const T* filter,
+                 T* out,
+                 const ConvEpilogue<T>& epilogue = {}) {
+  if (s.depthwise()) {
+    DepthwiseConv(s, in, filter, out, epilogue);
+    return;
+  }
+  const int64_t work =
+      s.batch * s.out_h * s.out_w * s.out_c * s.filter_size();
+  if (!WinogradApplies(s) || work < kMinTunedConvWork) {
+    DirectConv(s, in, filter, out, epilogue);
+    return;
+  }
+  using ConvKernel = autotune::TunedKernel<const ConvShape&,
+                                           const T*,
+                                           const T*,
+                                           T*,
+                                           const ConvEpilogue<T>&>;
+  static ConvKernel kernel(
+      "conv2d_3x3",
+      {{"direct", DirectConv<T>}, {"winograd", WinogradConv<T>}});
+  std::string shape_class =
+      autotune::ShapeClass({s.batch, s.in_c, s.in_h, s.in_w, s.out_c}) +
+      (s.channel_last ? "_nhwc" : "");
+  kernel(sizeof(T) == 4 ? "float32" : "float64",
+         shape_class,
+         s,
+         in,
+         filter,
+         out,
+         epilogue);
+}
+
+// dx of an NCHW convolution. Each task owns one input channel of one image
+// and gathers into it from the output channels of its group.
+template <typename T>
+void ConvInputGradNCHW(const ConvShape& s,
+                       const T* dout,
+                       const T* filter,
+                       T* dx) {
+  const int64_t icg = s.in_c_per_group(), ocg = s.out_c_per_group();
+  const int64_t in_plane = s.in_h * s.in_w, out_plane = s.out_h * s.out_w;
+  const int64_t num_tasks = s.batch * s.in_c;
+#pragma omp parallel for schedule(static)
+  for (int64_t task = 0; task < num_tasks; ++task) {
+    const int64_t n = task / s.in_c, ic = task % s.in_c;
+    const int64_t g = ic / icg, c = ic % icg;
+    T* dx_plane = dx + task * in_plane;
+    std::fill(dx_plane, dx_plane + in_plane, static_cast<T>(0));
+    for (int64_t oc = g * ocg; oc < (g + 1) * ocg; ++oc) {
+      const T* dy = dout + (n * s.out_c + oc) * out_plane;
+      const T* w = filter + (oc * icg + c) * s.k_h * s.k_w;
+      for (int64_t oh = 0; oh < s.out_h; ++oh) {
+        const T* dy_row = dy + oh * s.out_w;
+        for (int64_t kh = 0; kh < s.k_h; ++kh) {
+          const int64_t ih = oh * s.stride_h - s.pad_h + kh * s.dilation_h;
+          if (ih < 0 || ih >= s.in_h) continue;
+          T* dx_row = dx_plane + ih * s.in_w;
+          for (int64_t kw = 0; kw < s.k_w; ++kw) {
+            const int64_t offset = kw * s.dilation_w - s.pad_w;
+            int64_t begin, end;
+            ValidRange(offset, s.stride_w, s.in_w, s.out_w, &begin, &end);
+            const T w_tap = w[kh * s.k_w + kw];
+            for (int64_t ow = begin; ow < end; ++ow) {
+              dx_row[ow * s.stride_w + offset] += dy_row[ow] * w_tap;
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// dx of an NHWC convolution. Each task owns one input row and gathers, per
+// pixel, from the output pixels it contributed to, over a filter repacked
+// to [g][k_h][k_w][ocg][icg].
+template <typename T>
+void ConvInputGradNHWC(const ConvShape& s,
+                       const T* dout,
+                       const T* filter,
+                       T* dx) {
+  const int64_t icg = s.in_c_per_group(), ocg = s.out_c_per_group();
+  const int64_t taps = s.k_h * s.k_w;
+  std::vector<T> packed(s.out_c * s.filter_size());
+  custom_cpu::KernelScope::RecordTemporary(packed.size() * sizeof(T));
+  for (int64_t oc = 0; oc < s.out_c; ++oc) {
+    const int64_t g = oc / ocg, o = oc % ocg;
+    for (int64_t c = 0; c < icg; ++c) {
+      for (int64_t tap = 0; tap < taps; ++tap) {
+        packed[((g * taps + tap) * ocg + o) * icg + c] =
+            filter[(oc * icg + c) * taps + tap];
+      }
+    }
+  }
+  const int64_t num_tasks = s.batch * s.in_h;
+#pragma omp parallel for schedule(static)
+  for (int64_t task = 0; task < num_tasks; ++task) {
+    const int64_t n = task / s.in_h, ih = task % s.in_h;
+    T* dx_row = dx + task * s.in_w * s.in_c;
+    std::fill(dx_row, dx_row + s.in_w * s.in_c, static_cast<T>(0));
+    for (int64_t kh = 0; kh < s.k_h; ++kh) {
+      const int64_t oh_scaled = ih + s.pad_h - kh * s.dilation_h;
+      if (oh_scaled < 0 || oh_scaled % s.stride_h != 0) continue;
+      const int64_t oh = oh_scaled / s.stride_h;
+      if (oh >= s.out_h) continue;
+      for (int64_t iw = 0; iw < s.in_w; ++iw) {
+        T* d = dx_row + iw * s.in_c;
+        for (int64_t kw = 0; kw < s.k_w; ++kw) {
+          const int64_t ow_scaled = iw + s.pad_w - kw * s.dilation_w;
+          if (ow_scaled < 0 || ow_scaled % s.stride_w != 0) continue;
+          const int64_t ow = ow_scaled / s.stride_w;
+          if (ow >= s.out_w) continue;
+          const T* dy = dout + ((n * s.out_h + oh) * s.out_w + ow) * s.out_c;
+          for (int64_t g = 0; g < s.groups; ++g) {
+            const T* w = packed.data() + ((g * s.k_h + kh) * s.k_w + kw) *
+                                             ocg * icg;
+            T* d_g = d + g * icg;
+            for (int64_t o = 0; o < ocg; ++o) {
+              const T dy_o = dy[g * ocg + o];
+              const T* w_o = w + o * icg;
+              for (int64_t c = 0; c < icg; ++c) d_g[c] += dy_o * w_o[c];
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// dfilter of a convolution. Each task owns one output channel's filter and
+// reduces over the whole batch.
+template <typename T>
+void ConvFilterGrad(const ConvShape& s, const T* in, const T* dout, T* dw) {
+  const int64_t icg = s.in_c_per_group(), ocg = s.out_c_per_group();
+  const int64_t taps = s.k_h * s.k_w;
+#pragma omp parallel for schedule(static)
+  for (int64_t oc = 0; oc < s.out_c; ++oc) {
+    const int64_t g = oc / ocg;
+    T* dw_oc = dw + oc * s.filter_size();
+    std::fill(dw_oc, dw_oc + s.filter_size(), static_cast<T>(0));
+    for (int64_t n = 0; n < s.batch; ++n) {
+      if (s.channel_last) {
+        for (int64_t oh = 0; oh < s.out_h; ++oh) {
+          for (int64_t ow = 0; ow < s.out_w; ++ow) {
+            const T dy =
+                dout[((n * s.out_h + oh) * s.out_w + ow) * s.out_c + oc];
+            for (int64_t kh = 0; kh < s.k_h; ++kh) {
+              const int64_t ih = oh * s.stride_h - s.pad_h + kh * s.dilation_h;
+              if (ih < 0 || ih >= s.in_h) continue;
+              for (int64_t kw = 0; kw < s.k_w; ++kw) {
+                const int64_t iw =
+                    ow * s.stride_w - s.pad_w + kw * s.dilation_w;
+                if (iw < 0 || iw >= s.in_w) continue;
+                const T* x =
+                    in + ((n * s.in_h + ih) * s.in_w + iw) * s.in_c + g * icg;
+                T* dw_tap = dw_oc + kh * s.k_w + kw;
+                for (int64_t c = 0; c < icg; ++c) dw_tap[c * taps] += dy * x[c];
+              }
+            }
+          }
+        }
+        continue;
+      }
+      const T* dy = dout + (n * s.out_c + oc) * s.out_h * s.out_w;
+      for (int64_t c = 0; c < icg; ++c) {
+        const T* x = in + (n * s.in_c + g * icg + c) * s.in_h * s.in_w;
+        for (int64_t kh = 0; kh < s.k_h; ++kh) {
+          for (int64_t kw = 0; kw < s.k_w; ++kw) {
+            const int64_t offset = kw * s.dilation_w - s.pad_w;
+            int64_t begin, end;
+            ValidRange(offset, s.stride_w, s.in_w, s.out_w, &begin, &end);
+            T sum = 0;
+            for (int64_t oh = 0; oh < s.out_h; ++oh) {
+              const int64_t ih = oh * s.stride_h - s.pad_h + kh * s.dilation_h;
+              if (ih < 0 || ih >= s.in_h) continue;
+              const T* x_row = x + ih * s.in_w;
+              const T* dy_row = dy + oh * s.out_w;
+              for (int64_t ow = begin; ow < end; ++ow) {
+                sum += dy_row[ow] * x_row[ow * s.stride_w + offset];
+              }
+            }
+            dw_oc[c * taps + kh * s.k_w + kw] += sum;
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename T>
+void ConvBackward(const phi::Context& dev_ctx,
+                  const ConvShape& s,
+                  const phi::DenseTensor& input,
+                  const phi::DenseTensor& filter,
+                  const phi::DenseTensor& out_grad,
+                  phi::DenseTensor* input_grad,
+                  phi::DenseTensor* filter_grad) {
+  if (input_grad) {
+    auto dx = dev_ctx.template Alloc<T>(input_grad);
+    if (s.channel_last) {
+      ConvInputGradNHWC(s, out_grad.data<T>(), filter.data<T>(), dx);
+    } else {
+      ConvInputGradNCHW(s, out_grad.data<T>(), filter.data<T>(), dx);
+    }
+  }
+  if (filter_grad) {
+    auto dw = dev_ctx.template Alloc<T>(filter_grad);
+    ConvFilterGrad(s, input.data<T>(), out_grad.data<T>(), dw);
+  }
+}
+
+template <typename T>
+void Conv2dKernel(const phi::Context& dev_ctx,
+                  const phi::DenseTensor& input,
+                  const phi::DenseTensor& filter,
+                  const std::vector<int>& strides,
+                  const std::vector<int>& paddings,
+                  const std::string& padding_algorithm,
+                  const std::vector<int>& dilations,
+                  int groups,
+                  const std::string& data_format,
+                  phi::DenseTensor* out) {
+  KernelStats stats(KERNEL_COUNTERS("conv2d"), {&input, &filter}, {out});
+  auto out_data = dev_ctx.template Alloc<T>(out);
+  if (out->numel() == 0) return;
+  auto s = MakeConvShape(input.dims(),
+                         filter.dims(),
+                         out->dims(),
+                         strides,
+                         paddings,
+                         padding_algorithm,
+                         dilations,
+                         groups,
+                         data_format);
+  ConvForward(s, input.data<T>(), filter.data<T>(), out_data);
+}
+
+template <typename T>
+void Conv2dGradKernel(const phi::Context& dev_ctx,
+                      const phi::DenseTensor& input,
+                      const phi::DenseTensor& filter,
+                      const phi::DenseTensor& out_grad,
+                      const std::vector<int>& strides,
+                      const std::vector<int>& paddings,
+                      const std::string& padding_algorithm,
+                      const std::vector<int>& dilations,
+                      int groups,
+                      const std::string& data_format,
+                      phi::DenseTensor* input_grad,
+                      phi::DenseTensor* filter_grad) {
+  KernelStats stats(KERNEL_COUNTERS("conv2d_grad"),
+                    {&input, &filter, &out_grad},
+                    {input_grad, filter_grad});
+  auto s = MakeConvShape(input.dims(),
+                         filter.dims(),
+                         out_grad.dims(),
+                         strides,
+                         paddings,
+                         padding_algorithm,
+                         dilations,
+                         groups,
+                         data_format);
+  ConvBackward<T>(dev_ctx, s, input, filter, out_grad, input_grad, filter_grad);
+}
+
+template <typename T>
+void DepthwiseConv2dKernel(const phi::Context& dev_ctx,
+                           const phi::DenseTensor& input,
+                           const phi::DenseTensor& filter,
+                           const std::vector<int>& strides,
+                           const std::vector<int>& paddings,
+                           const std::string& padding_algorithm,
+                           int groups,
+                           const std::vector<int>& dilations,
+                           const std::string& data_format,
+                           phi::DenseTensor* out) {
+  KernelStats stats(
+      KERNEL_COUNTERS("depthwise_conv2d"), {&input, &filter}, {out});
+  auto out_data = dev_ctx.template Alloc<T>(out);
+  if (out->numel() == 0) return;
+  auto s = MakeConvShape(input.dims(),
+                         filter.dims(),
+                         out->dims(),
+                         strides,
+                         paddings,
+                         padding_algorithm,
+                         dilations,
+                         groups,
+                         data_format);
+  ConvForward(s, input.data<T>(), filter.data<T>(), out_data);
+}
+
+template <typename T>
+void DepthwiseConv2dGradKernel(const phi::Context& dev_ctx,
+                               const phi::DenseTensor& input,
+                               const phi::DenseTensor& filter,
+                               const phi::DenseTensor& out_grad,
+                               const std::vector<int>& strides,
+                               const std::vector<int>& paddings,
+                               const std::string& padding_algorithm,
+                               int groups,
+                               const std::vector<int>& dilations,
+                               const std::string& data_format,
+                               phi::DenseTensor* input_grad,
+                               phi::DenseTensor* filter_grad) {
+  KernelStats stats(KERNEL_COUNTERS("depthwise_conv2d_grad"),
+                    {&input, &filter, &out_grad},
+                    {input_grad, filter_grad});
+  auto s = MakeConvShape(input.dims(),
+                         filter.dims(),
+                         out_grad.dims(),
+                         strides,
+                         paddings,
+                         padding_algorithm,
+                         dilations,
+                         groups,
+                         data_format);
+  ConvBackward<T>(dev_ctx, s, input, filter, out_grad, input_grad, filter_grad);
+}
+
+// conv2d + bias (+ residual) + activation in one pass over the output, as
+// produced by Paddle's conv + elementwise_add + act fuse passes. Only relu
+// and identity activations are supported.
+template <typename T>
+void FusedConv2dAddActKernel(
+    const phi::Context& dev_ctx,
+    const phi::DenseTensor& input,
+    const phi::DenseTensor& filter,
+    const phi::DenseTensor& bias,
+    const paddle::optional<phi::DenseTensor>& residual,
+    const std::vector<int>& strides,
+    const std::vector<int>& paddings,
+    const std::string& padding_algorithm,
+    const std::vector<int>& dilations,
+    int groups,
+    const std::string& data_format,
+    const std::string& activation,
+    const std::vector<int>& split_channels,
+    bool exhaustive_search,
+    int workspace_size_MB,
+    float fuse_alpha,
+    phi::DenseTensor* out,
+    std::vector<phi::DenseTensor*> outputs) {
+  KernelStats stats(KERNEL_COUNTERS("fused_conv2d_add_act"),
+                    {&input, &filter, &bias, residual.get_ptr()},
+                    {out});
+  PD_CHECK(activation == "relu" || activation == "identity" ||
+               activation.empty(),
+           "fused_conv2d_add_act on custom_cpu supports relu and identity, "
+           "but received %s.",
+           activation.c_str());
+  PD_CHECK(split_channels.empty(),
+           "fused_conv2d_add_act on custom_cpu does not support "
+           "split_channels.");
+  auto out_data = dev_ctx.template Alloc<T>(out);
+  if (out->numel() == 0) return;
+  auto s = MakeConvShape(input.dims(),
+                         filter.dims(),
+                         out->dims(),
+                         strides,
+                         paddings,
+                         padding_algorithm,
+                         dilations,
+                         groups,
+                         data_format);
+  PD_CHECK(bias.numel() == s.out_c,
+           "The bias of fused_conv2d_add_act should have %d elements, but "
+           "received %d.",
+           s.out_c,
+           bias.numel());
+  ConvEpilogue<T> epilogue;
+  epilogue.bias = bias.data<T>();
+  if (residual) {
+    PD_CHECK(residual->numel() == out->numel(),
+             "The residual of fused_conv2d_add_act should be shaped as the "
+             "output.");
+    epilogue.residual = residual->data<T>();
+  }
+  epilogue.relu = activation == "relu";
+  ConvForward(s, input.data<T>(), filter.data<T>(), out_data, epilogue);
+}
+
+}  // namespace custom_kernel
+
+PD_BUILD_PHI_KERNEL(conv2d,
+                    custom_cpu,
+                    ALL_LAYOUT,
+                    custom_kernel::Conv2dKernel,
+                    float,
+                    double) {}
+
+PD_BUILD_PHI_KERNEL(conv2d_grad,
+                    custom_cpu,
+                    ALL_LAYOUT,
+                    custom_kernel::Conv2dGradKernel,
+                    float,
+                    double) {}
+
+PD_BUILD_PHI_KERNEL(depthwise_conv2d,
+                    custom_cpu,
+                    ALL_LAYOUT,
+                    custom_kernel::DepthwiseConv2dKernel,
+                    float,
+                    double) {}
+
+PD_BUILD_PHI_KERNEL(depthwise_conv2d_grad,
+                    custom_cpu,
+                    ALL_LAYOUT,
+                    custom_kernel::DepthwiseConv2dGradKernel,
+                    float,
+                    double) {}
+
+PD_BUILD_PHI_KERNEL(fused_conv2d_add_act,
+                    custom_cpu,
+                    ALL_LAYOUT,
+                    custom_kernel::FusedConv2dAddActKernel,
+                    float,
+                    double) {}
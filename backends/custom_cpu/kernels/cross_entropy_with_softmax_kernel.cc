@@ -166,6 +166,9 @@ void CrossEntropyWithSoftmaxKernel(const phi::Context& dev_ctx,
                                    int axis,
                                    phi::DenseTensor* softmax,
                                    phi::DenseTensor* loss) {
+  KernelStats stats(KERNEL_COUNTERS("cross_entropy_with_softmax"),
+                    {&logits, &label},
+                    {softmax, loss});
   // do not with softmax op, and input is softmax
   if (!use_softmax) {
     auto softmax_data = dev_ctx.template Alloc<T>(softmax);
@@ -341,6 +344,9 @@ void CrossEntropyWithSoftmaxGradKernel(const phi::Context& dev_ctx,
                                        int ignore_index,
                                        int axis,
                                        phi::DenseTensor* logits_grad) {
+  KernelStats stats(KERNEL_COUNTERS("cross_entropy_with_softmax_grad"),
+                    {&label, &softmax, &loss_grad},
+                    {logits_grad});
   if (soft_label) {
     CrossEntropyWithSoftmaxGradCPUKernel<T, T>(dev_ctx,
                                                label,
@@ -23,6 +23,7 @@ void MultiplyRawKernel(const phi::Context& dev_ctx,
                        const phi::DenseTensor& y,
                        int axis,
                        phi::DenseTensor* out) {
+  KernelStats stats(KERNEL_COUNTERS("multiply"), {&x, &y}, {out});
   auto x_dims = x.dims();
   auto y_dims = y.dims();
   auto dst_dims = phi::BroadcastDims(axis, x_dims, y_dims);
@@ -54,6 +55,7 @@ void AddRawKernel(const phi::Context& dev_ctx,
                   const phi::DenseTensor& y,
                   int axis,
                   phi::DenseTensor* out) {
+  KernelStats stats(KERNEL_COUNTERS("add"), {&x, &y}, {out});
   dev_ctx.template Alloc<T>(out);
   auto x_dims = x.dims();
   auto y_dims = y.dims();
@@ -86,6 +88,7 @@ void MaxRawKernel(const phi::Context& dev_ctx,
                   const phi::DenseTensor& y,
                   int axis,
                   phi::DenseTensor* out) {
+  KernelStats stats(KERNEL_COUNTERS("maximum"), {&x, &y}, {out});
   dev_ctx.template Alloc<T>(out);
   auto x_dims = x.dims();
   auto y_dims = y.dims();
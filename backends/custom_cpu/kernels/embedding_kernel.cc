@@ -0,0 +1,74 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "kernels/gather_scatter.h"
+#include "kernels/phi_funcs.h"
+#include "paddle/phi/capi/all.h"
+
+namespace custom_kernel {
+
+// Only the looked up rows of the table are read, so the table is not
+// counted as a kernel input.
+template <typename T>
+void EmbeddingKernel(const phi::Context& dev_ctx,
+                     const phi::DenseTensor& inputx,
+                     const phi::DenseTensor& weight,
+                     int64_t padding_idx,
+                     phi::DenseTensor* out) {
+  KernelStats stats(KERNEL_COUNTERS("embedding"), {&inputx}, {out});
+  auto out_data = dev_ctx.template Alloc<T>(out);
+  auto table = MakeRowView(weight.dims(), 0);
+  auto ids = ReadIndex(inputx, table.rows, "embedding", padding_idx);
+  GatherRows(weight.data<T>(), table, ids, out_data, padding_idx);
+}
+
+// The gradient is dense, as kernels of plugins cannot output SelectedRows.
+// Each looked up row sums the gradients of its occurrences in one pass, so
+// frequent ids cost no more writes than rare ones.
+template <typename T>
+void EmbeddingGradKernel(const phi::Context& dev_ctx,
+                         const phi::DenseTensor& input,
+                         const phi::DenseTensor& weight,
+                         const phi::DenseTensor& out_grad,
+                         int64_t padding_idx,
+                         phi::DenseTensor* weight_grad) {
+  KernelStats stats(
+      KERNEL_COUNTERS("embedding_grad"), {&input, &out_grad}, {weight_grad});
+  auto grad_data = dev_ctx.template Alloc<T>(weight_grad);
+  auto table = MakeRowView(weight.dims(), 0);
+  auto ids = ReadIndex(input, table.rows, "embedding_grad", padding_idx);
+  ParallelFill<T>(grad_data, nullptr, weight_grad->numel());
+  ScatterRows(out_grad.data<T>(),
+              ids.size(),
+              GroupByRow(ids, padding_idx),
+              table,
+              grad_data,
+              ScatterMode::kSum);
+}
+
+}  // namespace custom_kernel
+
+PD_BUILD_PHI_KERNEL(embedding,
+                    custom_cpu,
+                    ALL_LAYOUT,
+                    custom_kernel::EmbeddingKernel,
+                    float,
+                    double) {}
+
+PD_BUILD_PHI_KERNEL(embedding_grad,
+                    custom_cpu,
+                    ALL_LAYOUT,
+                    custom_kernel::EmbeddingGradKernel,
+                    float,
+                    double) {}
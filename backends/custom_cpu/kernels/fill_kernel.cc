@@ -21,6 +21,7 @@ template <typename T>
 void FillKernel(const phi::Context& dev_ctx,
                 const phi::Scalar& value,
                 phi::DenseTensor* out) {
+  KernelStats stats(KERNEL_COUNTERS("fill"), {}, {out});
   double fill_var = value.to<double>();
   PD_CHECK(std::isnan(fill_var) == false,
            "fill value should not be NaN, but received NaN");
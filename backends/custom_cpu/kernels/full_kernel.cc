@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include "kernels/kernel_stats.h"
 #include "paddle/phi/capi/all.h"
 
 namespace custom_kernel {
@@ -32,6 +33,7 @@ void FullKernel(const phi::Context& dev_ctx,
                 const phi::Scalar& val,
                 phi::DataType dtype,
                 phi::DenseTensor* out) {
+  KernelStats stats(KERNEL_COUNTERS("full"), {}, {out});
   auto int_shape = shape.GetData();
   out->Resize(std::vector<int64_t>(int_shape.cbegin(), int_shape.cend()));
   FullValue<T>(dev_ctx, out, val.to<T>());
@@ -0,0 +1,141 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "kernels/gather_scatter.h"
+#include "kernels/phi_funcs.h"
+#include "paddle/phi/capi/all.h"
+
+namespace custom_kernel {
+
+// gather and index_select both take the slices of x at `index` along
+// `axis`; they only differ in how the axis is passed.
+template <typename T>
+void GatherAlongAxis(const phi::Context& dev_ctx,
+                     const phi::DenseTensor& x,
+                     const phi::DenseTensor& index,
+                     int axis,
+                     const char* op,
+                     phi::DenseTensor* out) {
+  auto out_data = dev_ctx.template Alloc<T>(out);
+  if (out->numel() == 0) return;
+  auto dims = x.dims();
+  if (axis < 0) axis += dims.size();
+  auto view = MakeRowView(dims, axis);
+  GatherRows(x.data<T>(), view, ReadIndex(index, view.rows, op), out_data);
+}
+
+// Slices hit by several indices sum their gradients in one pass each.
+template <typename T>
+void GatherAlongAxisGrad(const phi::Context& dev_ctx,
+                         const phi::DenseTensor& index,
+                         const phi::DenseTensor& out_grad,
+                         int axis,
+                         const char* op,
+                         phi::DenseTensor* x_grad) {
+  auto grad_data = dev_ctx.template Alloc<T>(x_grad);
+  ParallelFill<T>(grad_data, nullptr, x_grad->numel());
+  if (out_grad.numel() == 0) return;
+  auto dims = x_grad->dims();
+  if (axis < 0) axis += dims.size();
+  auto view = MakeRowView(dims, axis);
+  auto entries = ReadIndex(index, view.rows, op);
+  ScatterRows(out_grad.data<T>(),
+              entries.size(),
+              GroupByRow(entries),
+              view,
+              grad_data,
+              ScatterMode::kSum);
+}
+
+template <typename T>
+void GatherKernel(const phi::Context& dev_ctx,
+                  const phi::DenseTensor& x,
+                  const phi::DenseTensor& index,
+                  const phi::Scalar& axis,
+                  phi::DenseTensor* out) {
+  KernelStats stats(KERNEL_COUNTERS("gather"), {&x, &index}, {out});
+  GatherAlongAxis<T>(dev_ctx, x, index, axis.to<int>(), "gather", out);
+}
+
+template <typename T>
+void GatherGradKernel(const phi::Context& dev_ctx,
+                      const phi::DenseTensor& x,
+                      const phi::DenseTensor& index,
+                      const phi::DenseTensor& out_grad,
+                      const phi::Scalar& axis,
+                      phi::DenseTensor* x_grad) {
+  KernelStats stats(
+      KERNEL_COUNTERS("gather_grad"), {&index, &out_grad}, {x_grad});
+  GatherAlongAxisGrad<T>(
+      dev_ctx, index, out_grad, axis.to<int>(), "gather_grad", x_grad);
+}
+
+template <typename T>
+void IndexSelectKernel(const phi::Context& dev_ctx,
+                       const phi::DenseTensor& x,
+                       const phi::DenseTensor& index,
+                       int dim,
+                       phi::DenseTensor* output) {
+  KernelStats stats(KERNEL_COUNTERS("index_select"), {&x, &index}, {output});
+  GatherAlongAxis<T>(dev_ctx, x, index, dim, "index_select", output);
+}
+
+template <typename T>
+void IndexSelectGradKernel(const phi::Context& dev_ctx,
+                           const phi::DenseTensor& x,
+                           const phi::DenseTensor& index,
+                           const phi::DenseTensor& out_grad,
+                           int dim,
+                           phi::DenseTensor* x_grad) {
+  KernelStats stats(
+      KERNEL_COUNTERS("index_select_grad"), {&index, &out_grad}, {x_grad});
+  GatherAlongAxisGrad<T>(
+      dev_ctx, index, out_grad, dim, "index_select_grad", x_grad);
+}
+
+}  // namespace custom_kernel
+
+PD_BUILD_PHI_KERNEL(gather,
+                    custom_cpu,
+                    ALL_LAYOUT,
+                    custom_kernel::GatherKernel,
+                    bool,
+                    int32_t,
+                    int64_t,
+                    float,
+                    double) {}
+
+PD_BUILD_PHI_KERNEL(gather_grad,
+                    custom_cpu,
+                    ALL_LAYOUT,
+                    custom_kernel::GatherGradKernel,
+                    float,
+                    double) {}
+
+PD_BUILD_PHI_KERNEL(index_select,
+                    custom_cpu,
+                    ALL_LAYOUT,
+                    custom_kernel::IndexSelectKernel,
+                    bool,
+                    int32_t,
+                    int64_t,
+                    float,
+                    double) {}
+
+PD_BUILD_PHI_KERNEL(index_select_grad,
+                    custom_cpu,
+                    ALL_LAYOUT,
+                    custom_kernel::IndexSelectGradKernel,
+                    float,
+                    double) {}
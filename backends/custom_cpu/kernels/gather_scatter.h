@@ -0,0 +1,202 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "paddle/phi/capi/all.h"
+
+namespace custom_kernel {
+
+constexpr int64_t kNoPadding = -1;
+
+// Rows ahead of the one being copied whose first cache line is
+// prefetched. Table rows are read in index order, which the hardware
+// prefetcher cannot follow.
+constexpr int64_t kPrefetchRows = 4;
+
+// A tensor viewed as [outer, rows, inner] around the axis rows are
+// gathered from or scattered to.
+struct RowView {
+  int64_t outer;
+  int64_t rows;
+  int64_t inner;
+};
+
+inline RowView MakeRowView(const std::vector<int64_t>& dims, int axis) {
+  RowView view{1, dims.empty() ? 1 : dims[axis], 1};
+  for (int i = 0; i < axis; ++i) view.outer *= dims[i];
+  for (size_t i = axis + 1; i < dims.size(); ++i) view.inner *= dims[i];
+  return view;
+}
+
+// The entries of an int32 or int64 index tensor, each checked to address
+// one of `rows` rows or to be `padding_row`.
+inline std::vector<int64_t> ReadIndex(const phi::DenseTensor& index,
+                                      int64_t rows,
+                                      const char* op,
+                                      int64_t padding_row = kNoPadding) {
+  std::vector<int64_t> entries(index.numel());
+  if (index.dtype() == phi::DataType::INT32) {
+    std::copy_n(index.data<int32_t>(), entries.size(), entries.begin());
+  } else {
+    PD_CHECK(index.dtype() == phi::DataType::INT64,
+             "The index of %s should be int32 or int64.",
+             op);
+    std::copy_n(index.data<int64_t>(), entries.size(), entries.begin());
+  }
+  for (int64_t entry : entries) {
+    PD_CHECK((entry >= 0 && entry < rows) ||
+                 (padding_row != kNoPadding && entry == padding_row),
+             "The index of %s should be in [0, %d), but received %d.",
+             op,
+             rows,
+             entry);
+  }
+  return entries;
+}
+
+// dst[o][i][:] = src[o][index[i]][:], with zeros for `padding_row`.
+template <typename T>
+void GatherRows(const T* src,
+                const RowView& src_view,
+                const std::vector<int64_t>& index,
+                T* dst,
+                int64_t padding_row = kNoPadding) {
+  const int64_t n = index.size();
+  const int64_t inner = src_view.inner;
+#pragma omp parallel for schedule(static)
+  for (int64_t task = 0; task < src_view.outer * n; ++task) {
+    const int64_t o = task / n;
+    const int64_t i = task % n;
+    const T* src_rows = src + o * src_view.rows * inner;
+    if (i + kPrefetchRows < n) {
+      __builtin_prefetch(src_rows + index[i + kPrefetchRows] * inner);
+    }
+    if (index[i] == padding_row) {
+      std::memset(dst + task * inner, 0, inner * sizeof(T));
+    } else {
+      std::memcpy(
+          dst + task * inner, src_rows + index[i] * inner, inner * sizeof(T));
+    }
+  }
+}
+
+// The positions of an index grouped by the row they address, rows
+// ascending and positions in order within each group. Scattering one
+// group per task writes every destination row from one thread in a fixed
+// order, without atomics, and a row indexed many times, like a frequent
+// token's embedding, is written once.
+struct RowGroups {
+  std::vector<int64_t> rows;    // distinct rows, ascending
+  std::vector<int64_t> starts;  // group g is order[starts[g], starts[g + 1])
+  std::vector<int64_t> order;   // positions sorted by row
+};
+
+inline RowGroups GroupByRow(const std::vector<int64_t>& index,
+                            int64_t skip_row = kNoPadding) {
+  RowGroups groups;
+  for (int64_t i = 0; i < static_cast<int64_t>(index.size()); ++i) {
+    if (index[i] != skip_row) groups.order.push_back(i);
+  }
+  std::stable_sort(
+      groups.order.begin(), groups.order.end(), [&](int64_t a, int64_t b) {
+        return index[a] < index[b];
+      });
+  for (size_t k = 0; k < groups.order.size(); ++k) {
+    int64_t row = index[groups.order[k]];
+    if (groups.rows.empty() || groups.rows.back() != row) {
+      groups.rows.push_back(row);
+      groups.starts.push_back(k);
+    }
+  }
+  groups.starts.push_back(groups.order.size());
+  return groups;
+}
+
+enum class ScatterMode {
+  kAdd,   // dst row += sum of its updates
+  kSum,   // dst row = sum of its updates
+  kLast,  // dst row = its last update
+};
+
+// Scatters src, viewed as [dst_view.outer, src_rows, inner], into the rows
+// of dst named by `groups`. Rows no group names are left as they are.
+template <typename T>
+void ScatterRows(const T* src,
+                 int64_t src_rows,
+                 const RowGroups& groups,
+                 const RowView& dst_view,
+                 T* dst,
+                 ScatterMode mode) {
+  const int64_t num_groups = groups.rows.size();
+  const int64_t inner = dst_view.inner;
+#pragma omp parallel for schedule(static)
+  for (int64_t task = 0; task < dst_view.outer * num_groups; ++task) {
+    const int64_t o = task / num_groups;
+    const int64_t g = task % num_groups;
+    const T* src_base = src + o * src_rows * inner;
+    T* d = dst + (o * dst_view.rows + groups.rows[g]) * inner;
+    int64_t begin = groups.starts[g];
+    const int64_t end = groups.starts[g + 1];
+    if (mode == ScatterMode::kLast) begin = end - 1;
+    if (mode != ScatterMode::kAdd) {
+      const T* first = src_base + groups.order[begin] * inner;
+      std::memcpy(d, first, inner * sizeof(T));
+      ++begin;
+    }
+    for (int64_t k = begin; k < end; ++k) {
+      const T* s = src_base + groups.order[k] * inner;
+      for (int64_t j = 0; j < inner; ++j) d[j] += s[j];
+    }
+  }
+}
+
+// Zeroes the rows of dst named by `groups`.
+template <typename T>
+void ZeroRows(const RowGroups& groups, const RowView& dst_view, T* dst) {
+  const int64_t num_groups = groups.rows.size();
+  const int64_t inner = dst_view.inner;
+#pragma omp parallel for schedule(static)
+  for (int64_t task = 0; task < dst_view.outer * num_groups; ++task) {
+    const int64_t o = task / num_groups;
+    const int64_t g = task % num_groups;
+    T* d = dst + (o * dst_view.rows + groups.rows[g]) * inner;
+    std::memset(d, 0, inner * sizeof(T));
+  }
+}
+
+// memset and memcpy split across threads, for outputs the size of a table.
+template <typename T>
+void ParallelFill(T* dst, const T* src, int64_t numel) {
+  constexpr int64_t kChunk = 1 << 14;
+  const int64_t chunks = (numel + kChunk - 1) / kChunk;
+#pragma omp parallel for schedule(static)
+  for (int64_t c = 0; c < chunks; ++c) {
+    const int64_t begin = c * kChunk;
+    const int64_t size = std::min(kChunk, numel - begin) * sizeof(T);
+    if (src == nullptr) {
+      std::memset(dst + begin, 0, size);
+    } else {
+      std::memcpy(dst + begin, src + begin, size);
+    }
+  }
+}
+
+}  // namespace custom_kernel
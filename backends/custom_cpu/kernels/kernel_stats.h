@@ -0,0 +1,93 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+#include "paddle/phi/capi/all.h"
+#include "runtime/kernel_stats.h"
+
+// The counters of one kernel, looked up once per call site:
+//
+//   KernelStats stats(KERNEL_COUNTERS("add"), {&x, &y}, {out});
+#define KERNEL_COUNTERS(name)                                            \
+  ([]() {                                                                \
+    static auto* const counters = custom_cpu::GetKernelCounters(name); \
+    return counters;                                                     \
+  }())
+
+namespace custom_kernel {
+
+inline uint64_t TensorBytes(const phi::DenseTensor* tensor) {
+  if (tensor == nullptr) return 0;
+  return tensor->memory_size();
+}
+
+// Counts one call of the enclosing kernel (see custom_cpu::KernelScope).
+// Inputs count as read when the kernel starts; outputs count as written,
+// and as allocated, when it returns. Null tensors, e.g. absent optional
+// inputs, are skipped.
+class KernelStats {
+ public:
+  KernelStats(custom_cpu::KernelCounters* counters,
+              std::initializer_list<const phi::DenseTensor*> inputs,
+              std::initializer_list<phi::DenseTensor*> outputs)
+      : scope_(counters) {
+    if (!scope_.active()) return;
+    uint64_t bytes = 0;
+    for (auto tensor : inputs) bytes += TensorBytes(tensor);
+    scope_.AddRead(bytes);
+    num_outputs_ = std::min(outputs.size(), kMaxOutputs);
+    std::copy_n(outputs.begin(), num_outputs_, outputs_);
+  }
+
+  // For kernels taking a list of inputs.
+  void Read(const std::vector<const phi::DenseTensor*>& inputs) {
+    if (!scope_.active()) return;
+    uint64_t bytes = 0;
+    for (auto tensor : inputs) bytes += TensorBytes(tensor);
+    scope_.AddRead(bytes);
+  }
+
+  ~KernelStats() {
+    if (!scope_.active()) return;
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < num_outputs_; ++i) {
+      bytes += TensorBytes(outputs_[i]);
+    }
+    scope_.AddWritten(bytes);
+    scope_.AddAllocated(bytes);
+  }
+
+ private:
+  static constexpr size_t kMaxOutputs = 4;
+
+  custom_cpu::KernelScope scope_;
+  phi::DenseTensor* outputs_[kMaxOutputs];
+  size_t num_outputs_ = 0;
+};
+
+// Charges a temporary tensor made by a kernel to that kernel.
+inline void RecordTemporary(const phi::DenseTensor& tensor) {
+  if (custom_cpu::KernelStatsEnabled()) {
+    custom_cpu::KernelScope::RecordTemporary(TensorBytes(&tensor));
+  }
+}
+
+}  // namespace custom_kernel
@@ -0,0 +1,102 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace custom_kernel {
+
+// Edge of the square tiles BatchedTranspose moves at a time: a tile of
+// doubles in and out is 16KB, which stays in L1.
+constexpr int64_t kTransposeTile = 32;
+
+// dst[b][j][i] = src[b][i][j] for `batch` row-major rows x cols matrices.
+// NCHW -> NHWC is BatchedTranspose(src, dst, n, c, h * w) and NHWC -> NCHW
+// is BatchedTranspose(src, dst, n, h * w, c).
+template <typename T>
+void BatchedTranspose(
+    const T* src, T* dst, int64_t batch, int64_t rows, int64_t cols) {
+  const int64_t row_tiles = (rows + kTransposeTile - 1) / kTransposeTile;
+  const int64_t col_tiles = (cols + kTransposeTile - 1) / kTransposeTile;
+  const int64_t tasks = batch * row_tiles * col_tiles;
+#pragma omp parallel for schedule(static)
+  for (int64_t task = 0; task < tasks; ++task) {
+    const int64_t b = task / (row_tiles * col_tiles);
+    const int64_t i0 = task / col_tiles % row_tiles * kTransposeTile;
+    const int64_t j0 = task % col_tiles * kTransposeTile;
+    const int64_t i1 = std::min(i0 + kTransposeTile, rows);
+    const int64_t j1 = std::min(j0 + kTransposeTile, cols);
+    const T* s = src + b * rows * cols;
+    T* d = dst + b * rows * cols;
+    for (int64_t j = j0; j < j1; ++j) {
+      for (int64_t i = i0; i < i1; ++i) {
+        d[j * rows + i] = s[i * cols + j];
+      }
+    }
+  }
+}
+
+// Whether transposing `dims` by `perm` only swaps two adjacent groups of
+// axes, i.e. is a BatchedTranspose once size-1 axes are dropped and axes
+// that stay next to each other are merged. NCHW <-> NHWC, and the
+// transposes a layout pass inserts at its boundaries, all are.
+inline bool AsBatchedTranspose(const std::vector<int64_t>& dims,
+                               const std::vector<int>& perm,
+                               int64_t* batch,
+                               int64_t* rows,
+                               int64_t* cols) {
+  // Input axes longer than 1, renumbered, and their output order.
+  std::vector<int> index(dims.size(), -1);
+  std::vector<int64_t> sizes;
+  for (size_t axis = 0; axis < dims.size(); ++axis) {
+    if (dims[axis] == 1) continue;
+    index[axis] = static_cast<int>(sizes.size());
+    sizes.push_back(dims[axis]);
+  }
+  std::vector<int> order;
+  for (int axis : perm) {
+    if (index[axis] >= 0) order.push_back(index[axis]);
+  }
+  // Runs of input axes that stay adjacent and in order.
+  std::vector<std::vector<int>> runs;
+  for (size_t k = 0; k < order.size(); ++k) {
+    if (k == 0 || order[k] != order[k - 1] + 1) runs.emplace_back();
+    runs.back().push_back(order[k]);
+  }
+  auto run_size = [&](const std::vector<int>& run) {
+    int64_t size = 1;
+    for (int axis : run) size *= sizes[axis];
+    return size;
+  };
+  if (runs.size() == 2 && runs[0][0] > runs[1][0]) {
+    *batch = 1;
+    *rows = run_size(runs[1]);
+    *cols = run_size(runs[0]);
+    return true;
+  }
+  if (runs.size() == 3 && runs[0][0] < runs[2][0] &&
+      runs[2][0] < runs[1][0]) {
+    *batch = run_size(runs[0]);
+    *rows = run_size(runs[2]);
+    *cols = run_size(runs[1]);
+    return true;
+  }
+  return false;
+}
+
+}  // namespace custom_kernel
@@ -12,21 +12,25 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <string>
+
+#include "kernels/autotune.h"
 #include "kernels/phi_funcs.h"
 #include "paddle/phi/capi/all.h"
 
 namespace custom_kernel {
 
 template <typename T>
-void GEMM(bool trans_x,
-          bool trans_y,
-          size_t M,
-          size_t K,
-          size_t N,
-          const T* x,
-          const T* y,
-          T* out,
-          bool trans_out = false) {
+void NaiveGEMM(bool trans_x,
+               bool trans_y,
+               size_t M,
+               size_t K,
+               size_t N,
+               const T* x,
+               const T* y,
+               T* out,
+               bool trans_out) {
   memset(out, 0, M * N * sizeof(T));
   for (size_t m = 0; m < M; ++m) {
     for (size_t n = 0; n < N; ++n) {
@@ -40,6 +44,156 @@ void GEMM(bool trans_x,
   }
 }
 
+// Computes rows [m_begin, m_end) of out in kTile cubes. Each output element
+// still accumulates over k in ascending order, so the result matches
+// NaiveGEMM exactly.
+template <typename T, size_t kTile>
+void BlockedGEMMRows(bool trans_x,
+                     bool trans_y,
+                     size_t M,
+                     size_t K,
+                     size_t N,
+                     const T* x,
+                     const T* y,
+                     T* out,
+                     bool trans_out,
+                     size_t m_begin,
+                     size_t m_end) {
+  const size_t x_m = trans_x ? 1 : K, x_k = trans_x ? M : 1;
+  const size_t y_k = trans_y ? 1 : N, y_n = trans_y ? K : 1;
+  const size_t out_m = trans_out ? 1 : N, out_n = trans_out ? M : 1;
+  for (size_t k0 = 0; k0 < K; k0 += kTile) {
+    size_t k_end = std::min(K, k0 + kTile);
+    for (size_t n0 = 0; n0 < N; n0 += kTile) {
+      size_t n_end = std::min(N, n0 + kTile);
+      for (size_t m = m_begin; m < m_end; ++m) {
+        T* out_row = out + m * out_m;
+        for (size_t k = k0; k < k_end; ++k) {
+          T x_dat = x[m * x_m + k * x_k];
+          const T* y_row = y + k * y_k;
+          for (size_t n = n0; n < n_end; ++n) {
+            out_row[n * out_n] += x_dat * y_row[n * y_n];
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename T, size_t kTile>
+void BlockedGEMM(bool trans_x,
+                 bool trans_y,
+                 size_t M,
+                 size_t K,
+                 size_t N,
+                 const T* x,
+                 const T* y,
+                 T* out,
+                 bool trans_out) {
+  memset(out, 0, M * N * sizeof(T));
+  BlockedGEMMRows<T, kTile>(
+      trans_x, trans_y, M, K, N, x, y, out, trans_out, 0, M);
+}
+
+template <typename T, size_t kTile>
+void ParallelBlockedGEMM(bool trans_x,
+                         bool trans_y,
+                         size_t M,
+                         size_t K,
+                         size_t N,
+                         const T* x,
+                         const T* y,
+                         T* out,
+                         bool trans_out) {
+  memset(out, 0, M * N * sizeof(T));
+  int64_t num_tiles = static_cast<int64_t>((M + kTile - 1) / kTile);
+#pragma omp parallel for schedule(static)
+  for (int64_t tile = 0; tile < num_tiles; ++tile) {
+    size_t m_begin = tile * kTile;
+    BlockedGEMMRows<T, kTile>(trans_x,
+                              trans_y,
+                              M,
+                              K,
+                              N,
+                              x,
+                              y,
+                              out,
+                              trans_out,
+                              m_begin,
+                              std::min(M, m_begin + kTile));
+  }
+}
+
+template <typename T>
+const char* GEMMDTypeName();
+
+template <>
+const char* GEMMDTypeName<phi::dtype::float16>() {
+  return "float16";
+}
+
+template <>
+const char* GEMMDTypeName<float>() {
+  return "float32";
+}
+
+template <>
+const char* GEMMDTypeName<double>() {
+  return "float64";
+}
+
+// Below this many multiply-adds the naive loop wins and tuning is not worth
+// a cache entry.
+constexpr size_t kMinTunedGEMMWork = 1 << 15;
+
+template <typename T>
+void GEMM(bool trans_x,
+          bool trans_y,
+          size_t M,
+          size_t K,
+          size_t N,
+          const T* x,
+          const T* y,
+          T* out,
+          bool trans_out = false) {
+  using GEMMKernel = autotune::TunedKernel<bool,
+                                           bool,
+                                           size_t,
+                                           size_t,
+                                           size_t,
+                                           const T*,
+                                           const T*,
+                                           T*,
+                                           bool>;
+  static GEMMKernel kernel(
+      "gemm",
+      {{"naive", NaiveGEMM<T>},
+       {"blocked_32", BlockedGEMM<T, 32>},
+       {"blocked_64", BlockedGEMM<T, 64>},
+       {"parallel_blocked_64", ParallelBlockedGEMM<T, 64>}});
+  if (M * K * N < kMinTunedGEMMWork) {
+    NaiveGEMM(trans_x, trans_y, M, K, N, x, y, out, trans_out);
+    return;
+  }
+  std::string shape_class =
+      autotune::ShapeClass({static_cast<int64_t>(M),
+                            static_cast<int64_t>(K),
+                            static_cast<int64_t>(N)}) +
+      (trans_x ? "_tx" : "") + (trans_y ? "_ty" : "") +
+      (trans_out ? "_to" : "");
+  kernel(GEMMDTypeName<T>(),
+         shape_class,
+         trans_x,
+         trans_y,
+         M,
+         K,
+         N,
+         x,
+         y,
+         out,
+         trans_out);
+}
+
 template <typename T>
 void BatchedGEMM(bool trans_x,
                  bool trans_y,
@@ -100,6 +254,7 @@ void MatmulKernel(const phi::Context& dev_ctx,
                   bool transpose_x,
                   bool transpose_y,
                   phi::DenseTensor* out) {
+  KernelStats stats(KERNEL_COUNTERS("matmul"), {&x, &y}, {out});
   auto x_dims = x.dims();
   auto y_dims = y.dims();
   auto x_data = x.data<T>();
@@ -303,6 +458,8 @@ void MatmulGradKernel(const phi::Context& dev_ctx,
                       bool transpose_y,
                       phi::DenseTensor* dx,
                       phi::DenseTensor* dy) {
+  KernelStats stats(
+      KERNEL_COUNTERS("matmul_grad"), {&x, &y, &out_grad}, {dx, dy});
   auto x_dims = x.dims();
   auto y_dims = y.dims();
   auto dout_dims = out_grad.dims();
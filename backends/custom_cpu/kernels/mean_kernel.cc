@@ -21,6 +21,7 @@ template <typename T>
 void MeanAllKernel(const phi::Context& dev_ctx,
                    const phi::DenseTensor& x,
                    phi::DenseTensor* out) {
+  KernelStats stats(KERNEL_COUNTERS("mean_all"), {&x}, {out});
   auto out_data = dev_ctx.template Alloc<T>(out);
   auto x_data = x.data<T>();
   auto numel = x.numel();
@@ -37,6 +38,8 @@ void MeanAllGradKernel(const phi::Context& dev_ctx,
                        const phi::DenseTensor& x,
                        const phi::DenseTensor& out_grad,
                        phi::DenseTensor* x_grad) {
+  KernelStats stats(
+      KERNEL_COUNTERS("mean_all_grad"), {&x, &out_grad}, {x_grad});
   PD_CHECK(out_grad.numel() == 1UL,
            "Mean Gradient should be scalar. But received "
            "Out@Grad's elements num is %d.",
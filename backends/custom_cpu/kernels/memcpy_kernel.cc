@@ -14,6 +14,7 @@
 
 #include "kernels/phi_funcs.h"
 #include "paddle/phi/capi/all.h"
+#include "runtime/copy.h"
 
 namespace custom_kernel {
 
@@ -22,9 +23,10 @@ void MemcpyD2HKernel(const phi::Context& dev_ctx,
                      const phi::DenseTensor& x,
                      int dst_place_type,
                      phi::DenseTensor* out) {
+  KernelStats stats(KERNEL_COUNTERS("memcpy_d2h"), {&x}, {out});
   auto out_data = dev_ctx.HostAlloc<T>(out);
   auto x_data = x.data<T>();
-  memcpy(out_data, x_data, x.memory_size());
+  custom_cpu::Copy(out_data, x_data, x.memory_size());
 }
 
 template <typename T>
@@ -32,9 +34,10 @@ void MemcpyH2DKernel(const phi::Context& dev_ctx,
                      const phi::DenseTensor& x,
                      int dst_place_type,
                      phi::DenseTensor* out) {
+  KernelStats stats(KERNEL_COUNTERS("memcpy_h2d"), {&x}, {out});
   auto out_data = dev_ctx.Alloc<T>(out);
   auto x_data = x.data<T>();
-  memcpy(out_data, x_data, x.memory_size());
+  custom_cpu::Copy(out_data, x_data, x.memory_size());
 }
 
 }  // namespace custom_kernel
@@ -19,6 +19,7 @@
 #include <numeric>
 #include <sstream>
 
+#include "kernels/kernel_stats.h"
 #include "paddle/phi/capi/all.h"
 
 namespace phi {
@@ -57,6 +58,8 @@ template <>
 inline std::string to_string<phi::DataLayout>(const phi::DataLayout& val) {
   if (val == phi::DataLayout::NCHW) {
     return "nchw";
+  } else if (val == phi::DataLayout::NHWC) {
+    return "nhwc";
   } else {
     return "undefined";
   }
@@ -282,6 +285,7 @@ static inline void BroadcastTo(const phi::Context& dev_ctx,
 
   out->Resize(out_dims);
   auto out_data = dev_ctx.template Alloc<T>(out);
+  custom_kernel::RecordTemporary(*out);
   auto in_data = in.data<T>();
 
   axis = axis == -1 ? std::abs(static_cast<int>(in_dims.size()) -
@@ -465,4 +469,42 @@ static inline std::vector<int64_t> CalcStrides(
                dims.size());
   }
 }
+
+// Expands paddings to a (before, after) pair per spatial dim and applies
+// padding_algorithm ("EXPLICIT", "SAME" or "VALID"). SAME also resets
+// dilation, when given, to 1.
+static inline void UpdatePaddingAndDilation(
+    std::vector<int>* paddings,
+    std::vector<int>* dilation,
+    const std::string& padding_algorithm,
+    const std::vector<int64_t>& data_dims,
+    const std::vector<int>& strides,
+    const std::vector<int>& ksize) {
+  const size_t rank = data_dims.size();
+  if (paddings->size() == rank) {
+    std::vector<int> pairs;
+    for (auto pad : *paddings) {
+      pairs.push_back(pad);
+      pairs.push_back(pad);
+    }
+    *paddings = pairs;
+  }
+  PD_CHECK(paddings->size() == rank * 2,
+           "Paddings size %d should be the same or twice as the input's "
+           "spatial rank %d.",
+           paddings->size(),
+           rank);
+  if (padding_algorithm == "SAME") {
+    for (size_t i = 0; i < rank; ++i) {
+      int64_t out_size = (data_dims[i] + strides[i] - 1) / strides[i];
+      int64_t pad_sum = std::max<int64_t>(
+          (out_size - 1) * strides[i] + ksize[i] - data_dims[i], 0);
+      (*paddings)[i * 2] = pad_sum / 2;
+      (*paddings)[i * 2 + 1] = pad_sum - pad_sum / 2;
+    }
+    if (dilation) std::fill(dilation->begin(), dilation->end(), 1);
+  } else if (padding_algorithm == "VALID") {
+    std::fill(paddings->begin(), paddings->end(), 0);
+  }
+}
 }  // namespace phi
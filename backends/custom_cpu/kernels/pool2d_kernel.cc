@@ -0,0 +1,369 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "kernels/phi_funcs.h"
+#include "paddle/phi/capi/all.h"
+
+namespace custom_kernel {
+
+// Geometry of a 2-D pooling. Input and output are NCHW, or NHWC when
+// channel_last.
+struct PoolShape {
+  int64_t batch, channels, in_h, in_w;
+  int64_t out_h, out_w;
+  int64_t k_h, k_w;
+  int64_t stride_h, stride_w;
+  int64_t pad_h, pad_w;
+  bool channel_last;
+  bool max;
+  bool adaptive;
+  bool exclusive;
+
+  // The input rows [*begin, *end) pooled into output row oh, and likewise
+  // for columns.
+  void Rows(int64_t oh, int64_t* begin, int64_t* end) const {
+    Window(oh, in_h, out_h, k_h, stride_h, pad_h, begin, end);
+  }
+  void Cols(int64_t ow, int64_t* begin, int64_t* end) const {
+    Window(ow, in_w, out_w, k_w, stride_w, pad_w, begin, end);
+  }
+
+  // The divisor of an average pool over a [rows x cols] window. A ceil_mode
+  // window can lie wholly in the padding and be empty.
+  int64_t PoolSize(int64_t rows, int64_t cols) const {
+    return exclusive || adaptive ? std::max<int64_t>(rows * cols, 1)
+                                 : k_h * k_w;
+  }
+
+ private:
+  void Window(int64_t o,
+              int64_t in,
+              int64_t out,
+              int64_t k,
+              int64_t stride,
+              int64_t pad,
+              int64_t* begin,
+              int64_t* end) const {
+    if (adaptive) {
+      *begin = o * in / out;
+      *end = ((o + 1) * in + out - 1) / out;
+      return;
+    }
+    *begin = o * stride - pad;
+    *end = std::min(*begin + k, in);
+    *begin = std::max<int64_t>(*begin, 0);
+  }
+};
+
+PoolShape MakePoolShape(const std::vector<int64_t>& in_dims,
+                        const std::vector<int64_t>& out_dims,
+                        const phi::IntArray& kernel_size,
+                        const std::vector<int>& strides,
+                        const std::vector<int>& paddings_in,
+                        bool exclusive,
+                        const std::string& data_format,
+                        const std::string& pooling_type,
+                        bool global_pooling,
+                        bool adaptive,
+                        const std::string& padding_algorithm) {
+  PD_CHECK(in_dims.size() == 4,
+           "pool2d expects a 4-D input, but received %d-D.",
+           in_dims.size());
+  PD_CHECK(pooling_type == "max" || pooling_type == "avg",
+           "pool2d supports max and avg pooling, but received %s.",
+           pooling_type.c_str());
+  PoolShape s;
+  s.channel_last = data_format == "NHWC";
+  s.batch = in_dims[0];
+  s.channels = s.channel_last ? in_dims[3] : in_dims[1];
+  s.in_h = s.channel_last ? in_dims[1] : in_dims[2];
+  s.in_w = s.channel_last ? in_dims[2] : in_dims[3];
+  s.out_h = s.channel_last ? out_dims[1] : out_dims[2];
+  s.out_w = s.channel_last ? out_dims[2] : out_dims[3];
+  s.max = pooling_type == "max";
+  s.adaptive = adaptive;
+  s.exclusive = exclusive;
+
+  const auto& ksize = kernel_size.GetData();
+  std::vector<int> kernel(ksize.cbegin(), ksize.cend());
+  if (global_pooling) {
+    kernel = {static_cast<int>(s.in_h), static_cast<int>(s.in_w)};
+  }
+  auto paddings = paddings_in;
+  phi::UpdatePaddingAndDilation(&paddings,
+                                nullptr,
+                                padding_algorithm,
+                                {s.in_h, s.in_w},
+                                strides,
+                                kernel);
+  if (global_pooling || adaptive) {
+    std::fill(paddings.begin(), paddings.end(), 0);
+  }
+  s.k_h = kernel[0];
+  s.k_w = kernel[1];
+  s.stride_h = strides[0];
+  s.stride_w = strides[1];
+  s.pad_h = paddings[0];
+  s.pad_w = paddings[2];
+  return s;
+}
+
+template <typename T>
+void PoolNCHW(const PoolShape& s, const T* in, T* out) {
+  const int64_t in_plane = s.in_h * s.in_w, out_plane = s.out_h * s.out_w;
+  const int64_t num_tasks = s.batch * s.channels;
+#pragma omp parallel for schedule(static)
+  for (int64_t task = 0; task < num_tasks; ++task) {
+    const T* x = in + task * in_plane;
+    T* y = out + task * out_plane;
+    for (int64_t oh = 0; oh < s.out_h; ++oh) {
+      int64_t h0, h1;
+      s.Rows(oh, &h0, &h1);
+      for (int64_t ow = 0; ow < s.out_w; ++ow) {
+        int64_t w0, w1;
+        s.Cols(ow, &w0, &w1);
+        T acc = s.max ? std::numeric_limits<T>::lowest() : static_cast<T>(0);
+        for (int64_t h = h0; h < h1; ++h) {
+          const T* x_row = x + h * s.in_w;
+          for (int64_t w = w0; w < w1; ++w) {
+            acc = s.max ? std::max(acc, x_row[w]) : acc + x_row[w];
+          }
+        }
+        if (!s.max) acc /= static_cast<T>(s.PoolSize(h1 - h0, w1 - w0));
+        y[oh * s.out_w + ow] = acc;
+      }
+    }
+  }
+}
+
+// Each task pools one output row; the channels of a pixel are the innermost
+// loop.
+template <typename T>
+void PoolNHWC(const PoolShape& s, const T* in, T* out) {
+  const int64_t c = s.channels;
+  const int64_t num_tasks = s.batch * s.out_h;
+#pragma omp parallel for schedule(static)
+  for (int64_t task = 0; task < num_tasks; ++task) {
+    const int64_t n = task / s.out_h, oh = task % s.out_h;
+    int64_t h0, h1;
+    s.Rows(oh, &h0, &h1);
+    for (int64_t ow = 0; ow < s.out_w; ++ow) {
+      int64_t w0, w1;
+      s.Cols(ow, &w0, &w1);
+      T* y = out + (task * s.out_w + ow) * c;
+      std::fill(
+          y,
+          y + c,
+          s.max ? std::numeric_limits<T>::lowest() : static_cast<T>(0));
+      for (int64_t h = h0; h < h1; ++h) {
+        for (int64_t w = w0; w < w1; ++w) {
+          const T* x = in + ((n * s.in_h + h) * s.in_w + w) * c;
+          if (s.max) {
+            for (int64_t i = 0; i < c; ++i) y[i] = std::max(y[i], x[i]);
+          } else {
+            for (int64_t i = 0; i < c; ++i) y[i] += x[i];
+          }
+        }
+      }
+      if (!s.max) {
+        const T scale = static_cast<T>(1) / s.PoolSize(h1 - h0, w1 - w0);
+        for (int64_t i = 0; i < c; ++i) y[i] *= scale;
+      }
+    }
+  }
+}
+
+// dx of a pooling. Max pooling routes each output gradient to the first
+// input in its window equal to the output, as Paddle's CPU kernel does.
+template <typename T>
+void PoolGradNCHW(
+    const PoolShape& s, const T* in, const T* out, const T* dout, T* dx) {
+  const int64_t in_plane = s.in_h * s.in_w, out_plane = s.out_h * s.out_w;
+  const int64_t num_tasks = s.batch * s.channels;
+#pragma omp parallel for schedule(static)
+  for (int64_t task = 0; task < num_tasks; ++task) {
+    const T* x = in + task * in_plane;
+    const T* y = out + task * out_plane;
+    const T* dy = dout + task * out_plane;
+    T* d = dx + task * in_plane;
+    std::fill(d, d + in_plane, static_cast<T>(0));
+    for (int64_t oh = 0; oh < s.out_h; ++oh) {
+      int64_t h0, h1;
+      s.Rows(oh, &h0, &h1);
+      for (int64_t ow = 0; ow < s.out_w; ++ow) {
+        int64_t w0, w1;
+        s.Cols(ow, &w0, &w1);
+        const int64_t o = oh * s.out_w + ow;
+        if (s.max) {
+          bool found = false;
+          for (int64_t h = h0; h < h1 && !found; ++h) {
+            for (int64_t w = w0; w < w1; ++w) {
+              if (x[h * s.in_w + w] == y[o]) {
+                d[h * s.in_w + w] += dy[o];
+                found = true;
+                break;
+              }
+            }
+          }
+          continue;
+        }
+        const T g = dy[o] / static_cast<T>(s.PoolSize(h1 - h0, w1 - w0));
+        for (int64_t h = h0; h < h1; ++h) {
+          for (int64_t w = w0; w < w1; ++w) d[h * s.in_w + w] += g;
+        }
+      }
+    }
+  }
+}
+
+// Overlapping windows of neighbouring rows write the same inputs, so each
+// task owns a whole image.
+template <typename T>
+void PoolGradNHWC(
+    const PoolShape& s, const T* in, const T* out, const T* dout, T* dx) {
+  const int64_t c = s.channels;
+  const int64_t image = s.in_h * s.in_w * c;
+#pragma omp parallel for schedule(static)
+  for (int64_t n = 0; n < s.batch; ++n) {
+    T* d = dx + n * image;
+    std::fill(d, d + image, static_cast<T>(0));
+    std::vector<bool> found(s.max ? c : 0);
+    for (int64_t oh = 0; oh < s.out_h; ++oh) {
+      int64_t h0, h1;
+      s.Rows(oh, &h0, &h1);
+      for (int64_t ow = 0; ow < s.out_w; ++ow) {
+        int64_t w0, w1;
+        s.Cols(ow, &w0, &w1);
+        const int64_t o = ((n * s.out_h + oh) * s.out_w + ow) * c;
+        const T* y = out + o;
+        const T* dy = dout + o;
+        if (s.max) std::fill(found.begin(), found.end(), false);
+        const T scale =
+            s.max ? static_cast<T>(1)
+                  : static_cast<T>(1) / s.PoolSize(h1 - h0, w1 - w0);
+        for (int64_t h = h0; h < h1; ++h) {
+          for (int64_t w = w0; w < w1; ++w) {
+            const int64_t i = (h * s.in_w + w) * c;
+            const T* x = in + n * image + i;
+            if (s.max) {
+              for (int64_t k = 0; k < c; ++k) {
+                if (!found[k] && x[k] == y[k]) {
+                  d[i + k] += dy[k];
+                  found[k] = true;
+                }
+              }
+            } else {
+              for (int64_t k = 0; k < c; ++k) d[i + k] += dy[k] * scale;
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename T>
+void Pool2dKernel(const phi::Context& dev_ctx,
+                  const phi::DenseTensor& x,
+                  const phi::IntArray& kernel_size,
+                  const std::vector<int>& strides,
+                  const std::vector<int>& paddings,
+                  bool ceil_mode,
+                  bool exclusive,
+                  const std::string& data_format,
+                  const std::string& pooling_type,
+                  bool global_pooling,
+                  bool adaptive,
+                  const std::string& padding_algorithm,
+                  phi::DenseTensor* out) {
+  KernelStats stats(KERNEL_COUNTERS("pool2d"), {&x}, {out});
+  auto out_data = dev_ctx.template Alloc<T>(out);
+  if (out->numel() == 0) return;
+  auto s = MakePoolShape(x.dims(),
+                         out->dims(),
+                         kernel_size,
+                         strides,
+                         paddings,
+                         exclusive,
+                         data_format,
+                         pooling_type,
+                         global_pooling,
+                         adaptive,
+                         padding_algorithm);
+  if (s.channel_last) {
+    PoolNHWC(s, x.data<T>(), out_data);
+  } else {
+    PoolNCHW(s, x.data<T>(), out_data);
+  }
+}
+
+template <typename T>
+void Pool2dGradKernel(const phi::Context& dev_ctx,
+                      const phi::DenseTensor& x,
+                      const phi::DenseTensor& out,
+                      const phi::DenseTensor& out_grad,
+                      const phi::IntArray& kernel_size,
+                      const std::vector<int>& strides,
+                      const std::vector<int>& paddings,
+                      bool ceil_mode,
+                      bool exclusive,
+                      const std::string& data_format,
+                      const std::string& pooling_type,
+                      bool global_pooling,
+                      bool adaptive,
+                      const std::string& padding_algorithm,
+                      phi::DenseTensor* x_grad) {
+  KernelStats stats(
+      KERNEL_COUNTERS("pool2d_grad"), {&x, &out, &out_grad}, {x_grad});
+  auto dx = dev_ctx.template Alloc<T>(x_grad);
+  if (x_grad->numel() == 0) return;
+  auto s = MakePoolShape(x.dims(),
+                         out.dims(),
+                         kernel_size,
+                         strides,
+                         paddings,
+                         exclusive,
+                         data_format,
+                         pooling_type,
+                         global_pooling,
+                         adaptive,
+                         padding_algorithm);
+  if (s.channel_last) {
+    PoolGradNHWC(s, x.data<T>(), out.data<T>(), out_grad.data<T>(), dx);
+  } else {
+    PoolGradNCHW(s, x.data<T>(), out.data<T>(), out_grad.data<T>(), dx);
+  }
+}
+
+}  // namespace custom_kernel
+
+PD_BUILD_PHI_KERNEL(pool2d,
+                    custom_cpu,
+                    ALL_LAYOUT,
+                    custom_kernel::Pool2dKernel,
+                    float,
+                    double) {}
+
+PD_BUILD_PHI_KERNEL(pool2d_grad,
+                    custom_cpu,
+                    ALL_LAYOUT,
+                    custom_kernel::Pool2dGradKernel,
+                    float,
+                    double) {}
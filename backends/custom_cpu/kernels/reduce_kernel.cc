@@ -26,6 +26,7 @@ void MeanRawKernel(const phi::Context& dev_ctx,
                    bool keep_dim,
                    bool reduce_all,
                    phi::DenseTensor* out) {
+  KernelStats stats(KERNEL_COUNTERS("mean"), {&x}, {out});
   auto x_dims = x.dims();
   auto reduce_dims = dims.GetData();
   if (reduce_all) {
@@ -99,6 +100,7 @@ void SumRawKernel(const phi::Context& dev_ctx,
                   bool reduce_all,
                   phi::DataType out_dtype,
                   phi::DenseTensor* out) {
+  KernelStats stats(KERNEL_COUNTERS("sum"), {&x}, {out});
   auto x_dims = x.dims();
   auto reduce_dims = dims.GetData();
   if (reduce_dims.size() == 0) {
@@ -173,6 +175,7 @@ void MinRawKernel(const phi::Context& dev_ctx,
                   bool keep_dim,
                   bool reduce_all,
                   phi::DenseTensor* out) {
+  KernelStats stats(KERNEL_COUNTERS("min"), {&x}, {out});
   auto x_dims = x.dims();
   auto reduce_dims = dims.GetData();
   if (reduce_dims.size() == 0) {
@@ -246,6 +249,7 @@ void MaxRawKernel(const phi::Context& dev_ctx,
                   bool keep_dim,
                   bool reduce_all,
                   phi::DenseTensor* out) {
+  KernelStats stats(KERNEL_COUNTERS("max"), {&x}, {out});
   auto x_dims = x.dims();
   auto reduce_dims = dims.GetData();
   if (reduce_all) {
@@ -126,6 +126,7 @@ void ReshapeKernel(const phi::Context& dev_ctx,
                    const phi::DenseTensor& x,
                    const phi::IntArray& shape,
                    phi::DenseTensor* out) {
+  KernelStats stats(KERNEL_COUNTERS("reshape"), {&x}, {out});
   auto x_dims = x.dims();
   auto out_dims = ValidateShape(shape.GetData(), x_dims);
   out->Resize(out_dims);
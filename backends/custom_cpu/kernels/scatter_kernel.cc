@@ -0,0 +1,93 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "kernels/gather_scatter.h"
+#include "kernels/phi_funcs.h"
+#include "paddle/phi/capi/all.h"
+
+namespace custom_kernel {
+
+// out = x with the rows at `index` replaced by the last of their updates,
+// or without overwrite by the sum of them. The updates are grouped by row
+// first, so duplicate indices are summed by one thread with no atomics.
+template <typename T>
+void ScatterKernel(const phi::Context& dev_ctx,
+                   const phi::DenseTensor& x,
+                   const phi::DenseTensor& index,
+                   const phi::DenseTensor& updates,
+                   bool overwrite,
+                   phi::DenseTensor* out) {
+  KernelStats stats(
+      KERNEL_COUNTERS("scatter"), {&x, &index, &updates}, {out});
+  auto out_data = dev_ctx.template Alloc<T>(out);
+  if (out_data != x.data<T>()) {
+    ParallelFill(out_data, x.data<T>(), x.numel());
+  }
+  if (index.numel() == 0) return;
+  auto view = MakeRowView(x.dims(), 0);
+  auto entries = ReadIndex(index, view.rows, "scatter");
+  PD_CHECK(updates.numel() ==
+               static_cast<int64_t>(entries.size()) * view.inner,
+           "The updates of scatter should have %d rows of %d elements.",
+           static_cast<int64_t>(entries.size()),
+           view.inner);
+  ScatterRows(updates.data<T>(),
+              entries.size(),
+              GroupByRow(entries),
+              view,
+              out_data,
+              overwrite ? ScatterMode::kLast : ScatterMode::kSum);
+}
+
+template <typename T>
+void ScatterGradKernel(const phi::Context& dev_ctx,
+                       const phi::DenseTensor& index,
+                       const phi::DenseTensor& updates,
+                       const phi::DenseTensor& out_grad,
+                       bool overwrite,
+                       phi::DenseTensor* x_grad,
+                       phi::DenseTensor* updates_grad) {
+  KernelStats stats(KERNEL_COUNTERS("scatter_grad"),
+                    {&index, &out_grad},
+                    {x_grad, updates_grad});
+  auto view = MakeRowView(out_grad.dims(), 0);
+  auto entries = ReadIndex(index, view.rows, "scatter_grad");
+  if (x_grad) {
+    auto grad_data = dev_ctx.template Alloc<T>(x_grad);
+    ParallelFill(grad_data, out_grad.data<T>(), out_grad.numel());
+    ZeroRows(GroupByRow(entries), view, grad_data);
+  }
+  if (updates_grad) {
+    auto grad_data = dev_ctx.template Alloc<T>(updates_grad);
+    GatherRows(out_grad.data<T>(), view, entries, grad_data);
+  }
+}
+
+}  // namespace custom_kernel
+
+PD_BUILD_PHI_KERNEL(scatter,
+                    custom_cpu,
+                    ALL_LAYOUT,
+                    custom_kernel::ScatterKernel,
+                    int32_t,
+                    int64_t,
+                    float,
+                    double) {}
+
+PD_BUILD_PHI_KERNEL(scatter_grad,
+                    custom_cpu,
+                    ALL_LAYOUT,
+                    custom_kernel::ScatterGradKernel,
+                    float,
+                    double) {}
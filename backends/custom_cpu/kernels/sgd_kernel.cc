@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include "kernels/kernel_stats.h"
 #include "paddle/phi/capi/all.h"
 
 namespace custom_kernel {
@@ -27,7 +28,8 @@ void sgd_dense_param_dense_grad_impl(const phi::DenseTensor& param,
   const T* grad_data = grad.data<T>();
   T* out_data = param_out->data<T>();
 
-  for (auto i = 0; i < sz; ++i) {
+#pragma omp parallel for schedule(static)
+  for (int64_t i = 0; i < sz; ++i) {
     out_data[i] = param_data[i] - *lr * grad_data[i];
   }
 }
@@ -41,6 +43,9 @@ void SGDDenseKernel(const phi::Context& dev_ctx,
                     bool multi_precision,
                     phi::DenseTensor* param_out,
                     phi::DenseTensor* master_param_out) {
+  KernelStats stats(KERNEL_COUNTERS("sgd"),
+                    {&param, &learning_rate, &grad, master_param.get_ptr()},
+                    {param_out, master_param_out});
   dev_ctx.template Alloc<T>(param_out);
   sgd_dense_param_dense_grad_impl<T>(param, learning_rate, grad, param_out);
 }
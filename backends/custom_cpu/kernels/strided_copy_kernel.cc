@@ -24,6 +24,7 @@ void StridedCopyKernel(const phi::Context& dev_ctx,
                        const std::vector<int64_t>& out_stride,
                        int64_t offset,
                        phi::DenseTensor* out) {
+  KernelStats stats(KERNEL_COUNTERS("strided_copy"), {&input}, {out});
   out->Resize(dims);
   out->set_strides(out_stride);
   out->set_offset(offset);
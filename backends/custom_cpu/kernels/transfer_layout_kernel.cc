@@ -0,0 +1,73 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstring>
+
+#include "kernels/layout.h"
+#include "kernels/phi_funcs.h"
+#include "paddle/phi/capi/all.h"
+
+namespace custom_kernel {
+
+// Reorders a 4-D tensor between NCHW and NHWC, the layouts the conv, pool
+// and batch_norm kernels accept. Any other pair of layouts only retags the
+// data, as phi does for layouts that share a memory order.
+template <typename T>
+void TransferLayoutKernel(const phi::Context& dev_ctx,
+                          const phi::DenseTensor& x,
+                          int src_layout,
+                          int dst_layout,
+                          phi::DenseTensor* out) {
+  KernelStats stats(KERNEL_COUNTERS("transfer_layout"), {&x}, {out});
+  auto src = static_cast<phi::DataLayout>(src_layout);
+  auto dst = static_cast<phi::DataLayout>(dst_layout);
+  auto dims = x.dims();
+  bool to_nhwc = src == phi::DataLayout::NCHW && dst == phi::DataLayout::NHWC;
+  bool to_nchw = src == phi::DataLayout::NHWC && dst == phi::DataLayout::NCHW;
+
+  if ((to_nhwc || to_nchw) && dims.size() == 4) {
+    int64_t n = dims[0];
+    if (to_nhwc) {
+      int64_t c = dims[1], hw = dims[2] * dims[3];
+      out->Resize({n, dims[2], dims[3], c});
+      BatchedTranspose(x.data<T>(), dev_ctx.template Alloc<T>(out), n, c, hw);
+    } else {
+      int64_t c = dims[3], hw = dims[1] * dims[2];
+      out->Resize({n, c, dims[1], dims[2]});
+      BatchedTranspose(x.data<T>(), dev_ctx.template Alloc<T>(out), n, hw, c);
+    }
+  } else {
+    out->Resize(dims);
+    auto out_data = dev_ctx.template Alloc<T>(out);
+    if (x.numel() > 0) {
+      std::memcpy(out_data, x.data<T>(), x.numel() * sizeof(T));
+    }
+  }
+  out->set_layout(dst);
+}
+
+}  // namespace custom_kernel
+
+PD_BUILD_PHI_KERNEL(transfer_layout,
+                    custom_cpu,
+                    ALL_LAYOUT,
+                    custom_kernel::TransferLayoutKernel,
+                    bool,
+                    uint8_t,
+                    int8_t,
+                    int16_t,
+                    int32_t,
+                    int64_t,
+                    float,
+                    double) {}
@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include "kernels/layout.h"
 #include "paddle/phi/capi/all.h"
 #include "phi_funcs.h"  //NOLINT
 
@@ -22,6 +23,7 @@ void TransposeKernel(const phi::Context& ctx,
                      const phi::DenseTensor& x,
                      const std::vector<int>& axis,
                      phi::DenseTensor* out) {
+  KernelStats stats(KERNEL_COUNTERS("transpose"), {&x}, {out});
   auto x_dims = x.dims();
   auto out_dims = out->dims();
 
@@ -39,6 +41,12 @@ void TransposeKernel(const phi::Context& ctx,
            axis.size(),
            rank);
 
+  int64_t batch, rows, cols;
+  if (AsBatchedTranspose(x_dims, axis, &batch, &rows, &cols)) {
+    BatchedTranspose(x_data, out_data, batch, rows, cols);
+    return;
+  }
+
   std::vector<size_t> step(out_dims.size(), 1);
   for (auto i = out_dims.size() - 1; i > 0; --i) {
     step[i - 1] = step[i] * out_dims[i];
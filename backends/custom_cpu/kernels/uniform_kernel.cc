@@ -14,6 +14,7 @@
 
 #include <random>
 
+#include "kernels/kernel_stats.h"
 #include "paddle/phi/capi/all.h"
 
 namespace custom_kernel {
@@ -42,6 +43,7 @@ void UniformRawKernel(const phi::Context &dev_ctx,
                       int diag_step,
                       float diag_val,
                       phi::DenseTensor *out) {
+  KernelStats stats(KERNEL_COUNTERS("uniform"), {}, {out});
   auto shape_data = shape.GetData();
 
   out->Resize(std::vector<int64_t>(shape_data.begin(), shape_data.end()));
@@ -0,0 +1,64 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <glog/logging.h>
+
+#include "custom_engine/fusion_compiler.h"
+#include "paddle/pir/include/core/builtin_attribute.h"
+#include "paddle/pir/include/core/builtin_op.h"
+#include "paddle/pir/include/pass/pass.h"
+#include "paddle/pir/include/pass/pass_registry.h"
+
+namespace {
+
+inline const char kCanFuseAttr[] = "__l_cpu_fusion__";
+
+// Marks every elementwise op the fusion engine can run. The supported set
+// is decided by dtype and attributes as well as op type, so this walks the
+// block instead of registering one rewrite pattern per op.
+class CpuFusionOpMarkerPass : public pir::Pass {
+ public:
+  CpuFusionOpMarkerPass() : pir::Pass("cpu_fusion_op_marker_pass", 2) {}
+
+  void Run(pir::Operation* op) override {
+    auto module_op = op->dyn_cast<pir::ModuleOp>();
+    PADDLE_ENFORCE_NOT_NULL(
+        module_op,
+        common::errors::InvalidArgument(
+            "cpu_fusion_op_marker_pass should run on module op."));
+    pir::IrContext* ctx = pir::IrContext::Instance();
+    int64_t num_marked = 0;
+    for (auto& inner_op : module_op.block()) {
+      if (custom_engine::IsFusableOp(&inner_op)) {
+        inner_op.set_attribute(kCanFuseAttr,
+                               pir::BoolAttribute::get(ctx, true));
+        ++num_marked;
+      }
+    }
+    VLOG(3) << "CpuFusionOpMarkerPass marked " << num_marked << " ops.";
+  }
+
+  bool CanApplyOn(pir::Operation* op) const override {
+    return op->isa<pir::ModuleOp>() && op->num_regions() > 0;
+  }
+};
+}  // namespace
+
+namespace pir {
+std::unique_ptr<Pass> CreateCpuFusionOpMarkerPass() {
+  return std::make_unique<CpuFusionOpMarkerPass>();
+}
+}  // namespace pir
+
+REGISTER_IR_PASS(cpu_fusion_op_marker_pass, CpuFusionOpMarkerPass);
@@ -0,0 +1,91 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "paddle/fluid/pir/transforms/sub_graph_detector.h"
+#include "paddle/pir/include/core/builder.h"
+#include "paddle/pir/include/core/builtin_attribute.h"
+#include "paddle/pir/include/core/builtin_op.h"
+#include "paddle/pir/include/pass/pass.h"
+#include "paddle/pir/include/pass/pass_registry.h"
+
+namespace {
+using GroupOpsVec = std::vector<pir::Operation*>;
+inline const char kCanFuseAttr[] = "__l_cpu_fusion__";
+
+// A single op gains nothing from fusion, so groups are two ops or more
+// unless CUSTOM_CPU_FUSION_MIN_GROUP_SIZE says otherwise.
+size_t MinGroupSize() {
+  const char* env = std::getenv("CUSTOM_CPU_FUSION_MIN_GROUP_SIZE");
+  if (env == nullptr || *env == '\0') return 2;
+  return std::max(1, std::atoi(env));
+}
+
+bool CanFuse(const pir::Operation& op) {
+  return op.HasAttribute(kCanFuseAttr) &&
+         op.attribute<pir::BoolAttribute>(kCanFuseAttr).data();
+}
+
+class CpuFusionSubGraphExtractPass : public pir::Pass {
+ public:
+  CpuFusionSubGraphExtractPass()
+      : pir::Pass("cpu_fusion_sub_graph_extract_pass", 2) {}
+
+  void Run(pir::Operation* op) override {
+    auto module_op = op->dyn_cast<pir::ModuleOp>();
+    PADDLE_ENFORCE_NOT_NULL(
+        module_op,
+        common::errors::InvalidArgument(
+            "cpu_fusion_sub_graph_extract_pass should run on module op."));
+    auto& block = module_op.block();
+
+    std::vector<GroupOpsVec> groups = pir::DetectSubGraphs(&block, CanFuse);
+    const size_t min_group_size = MinGroupSize();
+    VLOG(3) << "CpuFusionSubGraphExtractPass, detected " << groups.size()
+            << " groups.";
+    for (auto& group_ops : groups) {
+      if (group_ops.size() < min_group_size) {
+        VLOG(3) << "current group_ops.size(): " << group_ops.size()
+                << ", less than min_group_size:" << min_group_size
+                << ", will fallback to paddle original graph";
+        continue;
+      }
+      VLOG(3) << "current group_ops.size(): " << group_ops.size()
+              << ", will lower to a fused cpu kernel";
+      pir::ReplaceWithGroupOp(&block, group_ops);
+    }
+  }
+
+  bool CanApplyOn(pir::Operation* op) const override {
+    return op->isa<pir::ModuleOp>() && op->num_regions() > 0;
+  }
+};
+}  // namespace
+
+namespace pir {
+
+std::unique_ptr<Pass> CreateCpuFusionSubGraphExtractPass() {
+  return std::make_unique<CpuFusionSubGraphExtractPass>();
+}
+
+}  // namespace pir
+
+REGISTER_IR_PASS(cpu_fusion_sub_graph_extract_pass,
+                 CpuFusionSubGraphExtractPass);
@@ -0,0 +1,258 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <glog/logging.h>
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "paddle/fluid/pir/dialect/operator/ir/op_type.h"
+#include "paddle/fluid/pir/dialect/operator/ir/pd_op.h"
+#include "paddle/pir/include/core/builder.h"
+#include "paddle/pir/include/core/builtin_attribute.h"
+#include "paddle/pir/include/core/builtin_op.h"
+#include "paddle/pir/include/core/builtin_type.h"
+#include "paddle/pir/include/pass/pass.h"
+#include "paddle/pir/include/pass/pass_registry.h"
+
+namespace {
+
+const std::vector<int> kToNhwc = {0, 2, 3, 1};
+const std::vector<int> kToNchw = {0, 3, 1, 2};
+
+// Ops taking a data_format: which of their operands are activations laid
+// out by it (only result 0 is), and whether the op is worth transposing
+// its input for. Pooling and normalization are as memory bound as the
+// transposes, so they only run in NHWC when their input already is.
+struct LayoutOp {
+  std::vector<size_t> operands;
+  bool starts_chain;
+};
+
+const std::unordered_map<std::string, LayoutOp>& LayoutOps() {
+  static const std::unordered_map<std::string, LayoutOp> ops = {
+      {"pd_op.conv2d", {{0}, true}},
+      {"pd_op.depthwise_conv2d", {{0}, true}},
+      {"pd_op.fused_conv2d_add_act", {{0, 3}, true}},
+      {"pd_op.pool2d", {{0}, false}},
+      {"pd_op.batch_norm", {{0}, false}},
+      {"pd_op.batch_norm_", {{0}, false}},
+  };
+  return ops;
+}
+
+// Ops computing each output element from the elements at the same index
+// of their (broadcast) inputs, which therefore run in any layout.
+const std::unordered_set<std::string>& ElementwiseOps() {
+  static const std::unordered_set<std::string> ops = {
+      "pd_op.abs", "pd_op.add", "pd_op.divide", "pd_op.elu", "pd_op.exp",
+      "pd_op.gelu", "pd_op.hardsigmoid", "pd_op.hardswish", "pd_op.leaky_relu",
+      "pd_op.maximum", "pd_op.minimum", "pd_op.multiply", "pd_op.relu",
+      "pd_op.relu6", "pd_op.scale", "pd_op.sigmoid", "pd_op.silu",
+      "pd_op.subtract", "pd_op.swish", "pd_op.tanh",
+  };
+  return ops;
+}
+
+paddle::dialect::DenseTensorType TensorType(pir::Value value) {
+  if (!value || !value.type()) return nullptr;
+  return value.type().dyn_cast<paddle::dialect::DenseTensorType>();
+}
+
+bool Is4D(pir::Value value) {
+  auto type = TensorType(value);
+  return type && type.dims().size() == 4;
+}
+
+// A tensor whose every dim is 1 broadcasts the same way in any layout.
+bool IsLayoutFree(pir::Value value) {
+  auto type = TensorType(value);
+  if (!type) return false;
+  for (int i = 0; i < type.dims().size(); ++i) {
+    if (type.dims()[i] != 1) return false;
+  }
+  return true;
+}
+
+// A [1, C, 1, 1] tensor, such as a reshaped conv bias, holds its elements
+// in the same order as its NHWC twin, so a reshape stands in for the
+// transpose.
+bool IsChannelVector(pir::Value value) {
+  auto type = TensorType(value);
+  if (!type || type.dims().size() != 4) return false;
+  auto dims = type.dims();
+  return dims[0] == 1 && dims[1] > 1 && dims[2] == 1 && dims[3] == 1;
+}
+
+pir::Value BuildNhwcTwin(pir::Builder* builder, pir::Value value) {
+  if (IsChannelVector(value)) {
+    std::vector<int64_t> shape = {1, 1, 1, TensorType(value).dims()[1]};
+    return builder->Build<paddle::dialect::ReshapeOp>(value, shape).out();
+  }
+  return builder->Build<paddle::dialect::TransposeOp>(value, kToNhwc).out();
+}
+
+pir::Type NhwcType(pir::IrContext* ctx, pir::Type type) {
+  auto dense = type.dyn_cast<paddle::dialect::DenseTensorType>();
+  auto dims = dense.dims();
+  std::vector<int64_t> nhwc_dims;
+  for (int axis : kToNhwc) nhwc_dims.push_back(dims[axis]);
+  return paddle::dialect::DenseTensorType::get(ctx,
+                                               dense.dtype(),
+                                               common::make_ddim(nhwc_dims),
+                                               common::DataLayout::NHWC,
+                                               dense.lod(),
+                                               dense.offset());
+}
+
+// Runs conv2d, depthwise_conv2d, fused_conv2d_add_act, pool2d and
+// batch_norm in NHWC, where the kernels vectorize over the contiguous
+// channels, and carries NHWC through the elementwise ops between them.
+// Inputs are transposed to NHWC once, where a chain starts, and
+// per-channel operands like conv biases are reshaped; every NHWC
+// result gets a transpose back to NCHW for the ops outside the chain,
+// which is erased when there are none, so reorders remain only at the
+// boundaries of each chain.
+class CpuNhwcLayoutPass : public pir::Pass {
+ public:
+  CpuNhwcLayoutPass() : pir::Pass("cpu_nhwc_layout_pass", 2) {}
+
+  void Run(pir::Operation* op) override {
+    auto module_op = op->dyn_cast<pir::ModuleOp>();
+    PADDLE_ENFORCE_NOT_NULL(
+        module_op,
+        common::errors::InvalidArgument(
+            "cpu_nhwc_layout_pass should run on module op."));
+    pir::IrContext* ctx = pir::IrContext::Instance();
+    pir::Builder builder(ctx, module_op.block());
+
+    // The ops are collected first, as the transposes go into the block.
+    std::vector<pir::Operation*> ops;
+    for (auto& inner_op : module_op.block()) ops.push_back(&inner_op);
+
+    // NHWC twin of each NCHW value the chains read or produce.
+    std::unordered_map<pir::Value, pir::Value> nhwc;
+    // The NCHW views of the NHWC results.
+    std::unordered_set<pir::Value> chain_results;
+    std::vector<pir::Operation*> to_nchw;
+    int64_t num_rewritten = 0;
+    for (auto* inner_op : ops) {
+      std::vector<size_t> operands;
+      if (IsNchwLayoutOp(inner_op, nhwc)) {
+        operands = LayoutOps().at(inner_op->name()).operands;
+        inner_op->set_attribute("data_format",
+                                pir::StrAttribute::get(ctx, "NHWC"));
+      } else if (IsElementwiseOnNhwc(inner_op, nhwc, chain_results)) {
+        for (size_t i = 0; i < inner_op->num_operands(); ++i) {
+          pir::Value value = inner_op->operand_source(i);
+          if (nhwc.count(value) || IsChannelVector(value)) {
+            operands.push_back(i);
+          }
+        }
+      } else {
+        continue;
+      }
+
+      for (size_t i : operands) {
+        pir::Value value = inner_op->operand_source(i);
+        if (!value) continue;
+        auto it = nhwc.find(value);
+        if (it == nhwc.end()) {
+          builder.set_insertion_point(inner_op);
+          it = nhwc.emplace(value, BuildNhwcTwin(&builder, value)).first;
+        }
+        inner_op->operand(i).set_source(it->second);
+      }
+
+      pir::Value result = inner_op->result(0);
+      result.set_type(NhwcType(ctx, result.type()));
+      builder.SetInsertionPointAfter(inner_op);
+      auto transpose =
+          builder.Build<paddle::dialect::TransposeOp>(result, kToNchw);
+      pir::Operation* back = transpose.operation();
+      result.ReplaceUsesWithIf(transpose.out(), [back](pir::OpOperand use) {
+        return use.owner() != back;
+      });
+      nhwc.emplace(transpose.out(), result);
+      chain_results.insert(transpose.out());
+      to_nchw.push_back(back);
+      ++num_rewritten;
+    }
+
+    int64_t num_erased = 0;
+    for (auto* back : to_nchw) {
+      if (back->result(0).use_empty()) {
+        back->Erase();
+        ++num_erased;
+      }
+    }
+    VLOG(3) << "CpuNhwcLayoutPass rewrote " << num_rewritten
+            << " ops to NHWC, with " << to_nchw.size() - num_erased
+            << " transposes back to NCHW.";
+  }
+
+  bool CanApplyOn(pir::Operation* op) const override {
+    return op->isa<pir::ModuleOp>() && op->num_regions() > 0;
+  }
+
+ private:
+  // The NHWC kernels are registered for float and double.
+  static bool IsNchwLayoutOp(
+      pir::Operation* op,
+      const std::unordered_map<pir::Value, pir::Value>& nhwc) {
+    auto it = LayoutOps().find(op->name());
+    if (it == LayoutOps().end()) return false;
+    if (!op->HasAttribute("data_format") ||
+        op->attribute<pir::StrAttribute>("data_format").AsString() != "NCHW") {
+      return false;
+    }
+    pir::Value input = op->operand_source(0);
+    if (!Is4D(input) || !Is4D(op->result(0))) return false;
+    if (!it->second.starts_chain && !nhwc.count(input)) return false;
+    auto dtype = TensorType(input).dtype();
+    return dtype.isa<pir::Float32Type>() || dtype.isa<pir::Float64Type>();
+  }
+
+  // Whether `op` reads a chain's result and every other operand of it
+  // also has an NHWC twin, is a channel vector or broadcasts in any layout.
+  static bool IsElementwiseOnNhwc(
+      pir::Operation* op,
+      const std::unordered_map<pir::Value, pir::Value>& nhwc,
+      const std::unordered_set<pir::Value>& chain_results) {
+    if (!ElementwiseOps().count(op->name())) return false;
+    if (op->num_results() != 1 || !Is4D(op->result(0))) return false;
+    bool reads_chain = false;
+    for (size_t i = 0; i < op->num_operands(); ++i) {
+      pir::Value value = op->operand_source(i);
+      if (chain_results.count(value)) {
+        reads_chain = true;
+      } else if (!nhwc.count(value) && !IsChannelVector(value) &&
+                 !IsLayoutFree(value)) {
+        return false;
+      }
+    }
+    return reads_chain;
+  }
+};
+}  // namespace
+
+namespace pir {
+std::unique_ptr<Pass> CreateCpuNhwcLayoutPass() {
+  return std::make_unique<CpuNhwcLayoutPass>();
+}
+}  // namespace pir
+
+REGISTER_IR_PASS(cpu_nhwc_layout_pass, CpuNhwcLayoutPass);
@@ -0,0 +1,528 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace custom_cpu {
+
+// Defaults for the optional parts of a CachingAllocator policy. A policy
+// derives from this and provides at least
+//
+//   using Stream = ...;  // ordered by std::less, e.g. a handle pointer
+//   using Event = ...;
+//   void* Alloc(size_t size);  // nullptr when out of memory
+//   void Free(void* ptr, size_t size);
+//   Event RecordEvent(Stream stream);
+//   bool QueryEvent(Event event);
+//   void SyncEvent(Event event);
+//   void DestroyEvent(Event event);
+//
+// A policy supporting expandable segments also overrides Reserve, Map,
+// Unmap and Unreserve: Reserve takes address space without backing memory,
+// Map and Unmap commit and decommit granularity() multiples inside it.
+struct CachingAllocatorPolicyBase {
+  size_t granularity() const { return 2 << 20; }
+  void* Reserve(size_t /*size*/) { return nullptr; }
+  bool Map(void* /*ptr*/, size_t /*size*/) { return false; }
+  void Unmap(void* /*ptr*/, size_t /*size*/) {}
+  void Unreserve(void* /*ptr*/, size_t /*size*/) {}
+};
+
+struct CachingAllocatorOptions {
+  // Grow one segment per stream in place instead of allocating new
+  // segments for large blocks, if the policy can reserve address space.
+  bool expandable_segments = false;
+  // Address space reserved per expandable segment.
+  size_t expandable_reserve = size_t(1) << 36;
+};
+
+struct CachingAllocatorStats {
+  // Rounded sizes of the blocks handed out, and what was asked for.
+  size_t allocated_bytes = 0;
+  size_t requested_bytes = 0;
+  // Memory obtained from the policy, in use or cached.
+  size_t reserved_bytes = 0;
+  size_t peak_allocated_bytes = 0;
+  size_t peak_reserved_bytes = 0;
+  // Free bytes in segments that also hold other blocks, which EmptyCache
+  // cannot give back.
+  size_t inactive_split_bytes = 0;
+  size_t largest_free_block = 0;
+  uint64_t num_allocs = 0;
+  uint64_t num_frees = 0;
+  // Allocations served from the cache without calling the policy.
+  uint64_t num_cache_hits = 0;
+  uint64_t num_segment_allocs = 0;
+  uint64_t num_segment_frees = 0;
+  uint64_t num_segment_grows = 0;
+  // Frees deferred until the streams using the block pass an event.
+  uint64_t num_deferred_frees = 0;
+  // Allocations that emptied the cache and retried, and that still failed.
+  uint64_t num_alloc_retries = 0;
+  uint64_t num_ooms = 0;
+
+  size_t cached_bytes() const { return reserved_bytes - allocated_bytes; }
+
+  // 0 when the cached memory is one block, approaching 1 as it is split
+  // into many small ones.
+  double fragmentation() const {
+    size_t cached = cached_bytes();
+    return cached == 0 ? 0.0
+                       : 1.0 - static_cast<double>(largest_free_block) /
+                                   static_cast<double>(cached);
+  }
+};
+
+// Stream-ordered caching allocator over a raw alloc/free/event policy.
+//
+// Freed blocks are cached per stream and handed out again to the same
+// stream without synchronizing: work on one stream runs in order, so a
+// later kernel cannot touch the block before an earlier one is done with
+// it. Blocks used by other streams (see RecordStream) go back to the cache
+// only once an event recorded on each of those streams has completed.
+//
+// Requests are rounded to 512 bytes. Those up to 1 MB are carved out of
+// 2 MB segments, larger ones out of 20 MB segments, or a segment of their
+// own size rounded to 2 MB from 10 MB up. Blocks are split on allocation
+// and merged with free neighbours on free. With expandable segments, large
+// blocks of a stream share one segment that grows in place, so a pattern
+// of slowly growing requests does not leave a trail of segments that are
+// each a little too small.
+//
+// When the policy runs out of memory, the allocator waits for pending
+// events, releases every cached segment and tries once more. All methods
+// are thread safe.
+template <typename Policy>
+class CachingAllocator {
+ public:
+  using Stream = typename Policy::Stream;
+  using Event = typename Policy::Event;
+
+  static constexpr size_t kMinBlockSize = 512;
+  static constexpr size_t kSmallSize = 1 << 20;
+  static constexpr size_t kSmallBuffer = 2 << 20;
+  static constexpr size_t kLargeBuffer = 20 << 20;
+  static constexpr size_t kMinLargeAlloc = 10 << 20;
+  static constexpr size_t kRoundLarge = 2 << 20;
+
+  explicit CachingAllocator(Policy policy = Policy(),
+                            CachingAllocatorOptions options = {})
+      : policy_(std::move(policy)), options_(options) {}
+
+  // Waits for deferred frees and releases the cache. Blocks still
+  // allocated are not freed.
+  ~CachingAllocator() {
+    EmptyCache();
+    for (auto& entry : expandable_) {
+      if (entry.second->mapped == 0) {
+        policy_.Unreserve(entry.second->base, entry.second->reserved);
+      }
+    }
+  }
+
+  CachingAllocator(const CachingAllocator&) = delete;
+  CachingAllocator& operator=(const CachingAllocator&) = delete;
+
+  // Returns nullptr when out of memory.
+  void* Allocate(size_t size, Stream stream = Stream()) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    ProcessEvents();
+    size_t rounded = RoundSize(size);
+    BlockSet& pool = PoolOf(rounded);
+    Block* block = FindFree(pool, stream, rounded);
+    if (block != nullptr) {
+      ++stats_.num_cache_hits;
+    } else {
+      block = AllocBlock(pool, stream, rounded);
+    }
+    if (block == nullptr) {
+      ++stats_.num_alloc_retries;
+      SyncEvents();
+      block = FindFree(pool, stream, rounded);
+    }
+    if (block == nullptr) {
+      ReleaseCached();
+      block = AllocBlock(pool, stream, rounded);
+    }
+    if (block == nullptr) {
+      ++stats_.num_ooms;
+      return nullptr;
+    }
+    block = Split(block, rounded);
+    block->allocated = true;
+    block->requested = size;
+    allocated_[block->ptr] = block;
+    ++stats_.num_allocs;
+    stats_.allocated_bytes += block->size;
+    stats_.requested_bytes += size;
+    stats_.peak_allocated_bytes =
+        std::max(stats_.peak_allocated_bytes, stats_.allocated_bytes);
+    return block->ptr;
+  }
+
+  // Returns false if ptr was not allocated here.
+  bool Free(void* ptr) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto it = allocated_.find(ptr);
+    if (it == allocated_.end()) return false;
+    Block* block = it->second;
+    allocated_.erase(it);
+    block->allocated = false;
+    ++stats_.num_frees;
+    stats_.allocated_bytes -= block->size;
+    stats_.requested_bytes -= block->requested;
+    if (block->stream_uses.empty()) {
+      FreeBlock(block);
+      return true;
+    }
+    ++stats_.num_deferred_frees;
+    for (Stream stream : block->stream_uses) {
+      pending_.emplace_back(policy_.RecordEvent(stream), block);
+      ++block->event_count;
+    }
+    block->stream_uses.clear();
+    return true;
+  }
+
+  // Marks ptr as used by stream as well as the stream it was allocated on,
+  // so freeing it waits for the work enqueued on stream until the free.
+  void RecordStream(void* ptr, Stream stream) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto it = allocated_.find(ptr);
+    if (it == allocated_.end()) return;
+    Block* block = it->second;
+    if (!std::less<Stream>()(stream, block->stream) &&
+        !std::less<Stream>()(block->stream, stream)) {
+      return;
+    }
+    auto& uses = block->stream_uses;
+    if (std::find(uses.begin(), uses.end(), stream) == uses.end()) {
+      uses.push_back(stream);
+    }
+  }
+
+  // Waits for the events of every deferred free and caches their blocks,
+  // e.g. before a stream those events were recorded on goes away.
+  void CompletePendingFrees() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    SyncEvents();
+  }
+
+  // Returns every cached segment to the policy and shrinks expandable
+  // segments to their last allocated block, after waiting for deferred
+  // frees.
+  void EmptyCache() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    SyncEvents();
+    ReleaseCached();
+  }
+
+  CachingAllocatorStats GetStats() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    CachingAllocatorStats stats = stats_;
+    for (const BlockSet* pool : {&small_free_, &large_free_}) {
+      for (const Block* block : *pool) {
+        stats.largest_free_block =
+            std::max(stats.largest_free_block, block->size);
+        if (block->prev != nullptr || block->next != nullptr) {
+          stats.inactive_split_bytes += block->size;
+        }
+      }
+    }
+    return stats;
+  }
+
+  void ResetPeakStats() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    stats_.peak_allocated_bytes = stats_.allocated_bytes;
+    stats_.peak_reserved_bytes = stats_.reserved_bytes;
+  }
+
+  Policy& policy() { return policy_; }
+
+ private:
+  struct ExpandableSegment;
+  struct Block;
+
+  // Free blocks, best fit first within a stream.
+  struct BlockLess {
+    bool operator()(const Block* a, const Block* b) const {
+      std::less<Stream> stream_less;
+      if (stream_less(a->stream, b->stream)) return true;
+      if (stream_less(b->stream, a->stream)) return false;
+      if (a->size != b->size) return a->size < b->size;
+      return std::less<char*>()(a->ptr, b->ptr);
+    }
+  };
+  using BlockSet = std::set<Block*, BlockLess>;
+
+  struct Block {
+    char* ptr;
+    size_t size;
+    Stream stream;
+    size_t requested = 0;
+    bool allocated = false;
+    // Events recorded by a deferred free that have not completed yet.
+    int event_count = 0;
+    std::vector<Stream> stream_uses;
+    // Neighbours in the same segment, by address.
+    Block* prev = nullptr;
+    Block* next = nullptr;
+    ExpandableSegment* expandable = nullptr;
+    // The free set of the pool the segment belongs to.
+    BlockSet* pool = nullptr;
+
+    Block(char* ptr, size_t size, Stream stream)
+        : ptr(ptr), size(size), stream(stream) {}
+  };
+
+  struct ExpandableSegment {
+    char* base;
+    size_t reserved;
+    size_t mapped = 0;
+    Block* tail = nullptr;
+  };
+
+  using PendingEvent = std::pair<Event, Block*>;
+
+  static size_t RoundUp(size_t size, size_t align) {
+    return (size + align - 1) / align * align;
+  }
+
+  static size_t RoundSize(size_t size) {
+    return size < kMinBlockSize ? kMinBlockSize : RoundUp(size, kMinBlockSize);
+  }
+
+  BlockSet& PoolOf(size_t size) {
+    return size <= kSmallSize ? small_free_ : large_free_;
+  }
+
+  Block* FindFree(BlockSet& pool, Stream stream, size_t size) {
+    Block key(nullptr, size, stream);
+    auto it = pool.lower_bound(&key);
+    if (it == pool.end()) return nullptr;
+    Block* block = *it;
+    std::less<Stream> stream_less;
+    if (stream_less(stream, block->stream) ||
+        stream_less(block->stream, stream)) {
+      return nullptr;
+    }
+    pool.erase(it);
+    return block;
+  }
+
+  void AddReserved(size_t size) {
+    stats_.reserved_bytes += size;
+    stats_.peak_reserved_bytes =
+        std::max(stats_.peak_reserved_bytes, stats_.reserved_bytes);
+  }
+
+  // A block of at least size bytes that is in no free set.
+  Block* AllocBlock(BlockSet& pool, Stream stream, size_t size) {
+    bool small = &pool == &small_free_;
+    if (!small && options_.expandable_segments) {
+      Block* block = GrowExpandable(stream, size);
+      if (block != nullptr) return block;
+    }
+    size_t segment_size = small                   ? kSmallBuffer
+                          : size < kMinLargeAlloc ? kLargeBuffer
+                                                  : RoundUp(size, kRoundLarge);
+    void* ptr = policy_.Alloc(segment_size);
+    if (ptr == nullptr) return nullptr;
+    ++stats_.num_segment_allocs;
+    AddReserved(segment_size);
+    Block* block = new Block(static_cast<char*>(ptr), segment_size, stream);
+    block->pool = &pool;
+    return block;
+  }
+
+  // Maps enough memory at the end of the stream's expandable segment for a
+  // free tail block of at least size bytes.
+  Block* GrowExpandable(Stream stream, size_t size) {
+    auto& segment = expandable_[stream];
+    if (segment == nullptr) {
+      void* base = policy_.Reserve(options_.expandable_reserve);
+      if (base == nullptr) {
+        expandable_.erase(stream);
+        return nullptr;
+      }
+      segment.reset(new ExpandableSegment{static_cast<char*>(base),
+                                          options_.expandable_reserve});
+    }
+    Block* tail = segment->tail;
+    bool extend = tail != nullptr && !tail->allocated &&
+                  tail->event_count == 0;
+    size_t have = extend ? tail->size : 0;
+    size_t grow = RoundUp(size - have, policy_.granularity());
+    if (segment->reserved - segment->mapped < grow) return nullptr;
+    char* end = segment->base + segment->mapped;
+    if (!policy_.Map(end, grow)) return nullptr;
+    segment->mapped += grow;
+    ++stats_.num_segment_grows;
+    AddReserved(grow);
+    if (extend) {
+      large_free_.erase(tail);
+      tail->size += grow;
+      return tail;
+    }
+    Block* block = new Block(end, grow, stream);
+    block->expandable = segment.get();
+    block->pool = &large_free_;
+    block->prev = tail;
+    if (tail != nullptr) tail->next = block;
+    segment->tail = block;
+    return block;
+  }
+
+  // Splits the remainder off block if it is worth caching on its own.
+  Block* Split(Block* block, size_t size) {
+    size_t remaining = block->size - size;
+    bool split = block->pool == &small_free_ ? remaining >= kMinBlockSize
+                                             : remaining > kSmallSize;
+    if (!split) return block;
+    Block* rest = new Block(block->ptr + size, remaining, block->stream);
+    rest->expandable = block->expandable;
+    rest->pool = block->pool;
+    rest->prev = block;
+    rest->next = block->next;
+    if (rest->next != nullptr) rest->next->prev = rest;
+    block->next = rest;
+    block->size = size;
+    if (rest->expandable != nullptr && rest->next == nullptr) {
+      rest->expandable->tail = rest;
+    }
+    rest->pool->insert(rest);
+    return block;
+  }
+
+  static bool Mergeable(const Block* block) {
+    return block != nullptr && !block->allocated && block->event_count == 0;
+  }
+
+  // Merges a block that is no longer in use with its free neighbours and
+  // caches the result.
+  void FreeBlock(Block* block) {
+    Block* prev = block->prev;
+    if (Mergeable(prev)) {
+      prev->pool->erase(prev);
+      prev->size += block->size;
+      prev->next = block->next;
+      if (prev->next != nullptr) prev->next->prev = prev;
+      delete block;
+      block = prev;
+    }
+    Block* next = block->next;
+    if (Mergeable(next)) {
+      next->pool->erase(next);
+      block->size += next->size;
+      block->next = next->next;
+      if (block->next != nullptr) block->next->prev = block;
+      delete next;
+    }
+    if (block->expandable != nullptr && block->next == nullptr) {
+      block->expandable->tail = block;
+    }
+    block->pool->insert(block);
+  }
+
+  void ProcessEvents() {
+    auto done = std::partition(
+        pending_.begin(), pending_.end(), [this](const PendingEvent& p) {
+          return !policy_.QueryEvent(p.first);
+        });
+    std::vector<PendingEvent> completed(done, pending_.end());
+    pending_.erase(done, pending_.end());
+    for (auto& p : completed) FinishEvent(p);
+  }
+
+  void SyncEvents() {
+    std::vector<PendingEvent> pending;
+    pending.swap(pending_);
+    for (auto& p : pending) {
+      policy_.SyncEvent(p.first);
+      FinishEvent(p);
+    }
+  }
+
+  void FinishEvent(const PendingEvent& p) {
+    policy_.DestroyEvent(p.first);
+    if (--p.second->event_count == 0) FreeBlock(p.second);
+  }
+
+  void ReleaseCached() {
+    for (BlockSet* pool : {&small_free_, &large_free_}) {
+      for (auto it = pool->begin(); it != pool->end();) {
+        Block* block = *it;
+        if (block->expandable != nullptr || block->prev != nullptr ||
+            block->next != nullptr) {
+          ++it;
+          continue;
+        }
+        it = pool->erase(it);
+        policy_.Free(block->ptr, block->size);
+        stats_.reserved_bytes -= block->size;
+        ++stats_.num_segment_frees;
+        delete block;
+      }
+    }
+    for (auto& entry : expandable_) ShrinkExpandable(entry.second.get());
+  }
+
+  // Unmaps the whole granules of a free tail block.
+  void ShrinkExpandable(ExpandableSegment* segment) {
+    Block* tail = segment->tail;
+    if (!Mergeable(tail)) return;
+    size_t granularity = policy_.granularity();
+    size_t keep = RoundUp(tail->ptr - segment->base, granularity);
+    if (keep >= segment->mapped) return;
+    size_t unmap = segment->mapped - keep;
+    large_free_.erase(tail);
+    policy_.Unmap(segment->base + keep, unmap);
+    segment->mapped = keep;
+    stats_.reserved_bytes -= unmap;
+    tail->size -= unmap;
+    if (tail->size > 0) {
+      large_free_.insert(tail);
+      return;
+    }
+    segment->tail = tail->prev;
+    if (tail->prev != nullptr) tail->prev->next = nullptr;
+    delete tail;
+  }
+
+  Policy policy_;
+  const CachingAllocatorOptions options_;
+  mutable std::mutex mutex_;
+  BlockSet small_free_;
+  BlockSet large_free_;
+  std::unordered_map<void*, Block*> allocated_;
+  std::vector<PendingEvent> pending_;
+  std::map<Stream, std::unique_ptr<ExpandableSegment>> expandable_;
+  CachingAllocatorStats stats_;
+};
+
+}  // namespace custom_cpu
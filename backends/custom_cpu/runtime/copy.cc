@@ -0,0 +1,200 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "runtime/copy.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+
+namespace custom_cpu {
+
+namespace {
+
+// Below this a single memcpy is as fast as waking up other threads.
+constexpr size_t kParallelThreshold = 1 << 20;
+// Smallest chunk handed to one thread.
+constexpr size_t kMinChunk = 512 << 10;
+constexpr size_t kChunkAlign = 4096;
+// Below this a regular copy stays in cache and is faster to consume.
+constexpr size_t kStreamingThreshold = 256 << 10;
+constexpr int kDefaultMaxThreads = 8;
+
+std::atomic<uint64_t> num_copies{0};
+std::atomic<uint64_t> num_bytes{0};
+std::atomic<uint64_t> num_elided{0};
+std::atomic<uint64_t> parallel_bytes{0};
+std::atomic<uint64_t> parallel_ns{0};
+
+size_t LastLevelCacheSize() {
+  static const size_t size = [] {
+    long bytes = 0;
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    bytes = sysconf(_SC_LEVEL3_CACHE_SIZE);
+#endif
+    if (bytes <= 0) {
+      // e.g. "32768K"; index3 is the LLC on most x86 and Arm servers.
+      std::ifstream file("/sys/devices/system/cpu/cpu0/cache/index3/size");
+      std::string text;
+      if (file >> text) {
+        bytes = std::atol(text.c_str());
+        if (text.back() == 'K') bytes <<= 10;
+        if (text.back() == 'M') bytes <<= 20;
+      }
+    }
+    return bytes > 0 ? static_cast<size_t>(bytes) : size_t(32) << 20;
+  }();
+  return size;
+}
+
+int MaxCopyThreads() {
+  static const int threads = [] {
+    const char* value = std::getenv("CUSTOM_CPU_COPY_THREADS");
+    if (value != nullptr && std::atoi(value) > 0) return std::atoi(value);
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return static_cast<int>(
+        std::max(1L, std::min<long>(cpus, kDefaultMaxThreads)));
+  }();
+  return threads;
+}
+
+void NonTemporalCopy(char* d, const char* s, size_t size) {
+#if defined(__x86_64__)
+  // Streaming stores need 16 byte aligned destinations.
+  size_t head = (16 - reinterpret_cast<uintptr_t>(d) % 16) % 16;
+  head = std::min(head, size);
+  memcpy(d, s, head);
+  d += head;
+  s += head;
+  size -= head;
+
+  size_t blocks = size / 64;
+  for (size_t i = 0; i < blocks; ++i) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 16));
+    __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 32));
+    __m128i e = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 48));
+    _mm_stream_si128(reinterpret_cast<__m128i*>(d), a);
+    _mm_stream_si128(reinterpret_cast<__m128i*>(d + 16), b);
+    _mm_stream_si128(reinterpret_cast<__m128i*>(d + 32), c);
+    _mm_stream_si128(reinterpret_cast<__m128i*>(d + 48), e);
+    s += 64;
+    d += 64;
+  }
+  // Order the streaming stores before anything that follows the copy.
+  _mm_sfence();
+  memcpy(d, s, size % 64);
+#else
+  memcpy(d, s, size);
+#endif
+}
+
+void CopyRange(char* d, const char* s, size_t size, bool non_temporal) {
+  if (non_temporal) {
+    NonTemporalCopy(d, s, size);
+  } else {
+    memcpy(d, s, size);
+  }
+}
+
+void EngineCopy(void* dst,
+                const void* src,
+                size_t size,
+                size_t non_temporal_threshold) {
+  num_copies.fetch_add(1, std::memory_order_relaxed);
+  num_bytes.fetch_add(size, std::memory_order_relaxed);
+  if (dst == src || size == 0) {
+    num_elided.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  auto* d = static_cast<char*>(dst);
+  auto* s = static_cast<const char*>(src);
+  if (d < s + size && s < d + size) {
+    memmove(d, s, size);
+    return;
+  }
+  bool non_temporal = size >= non_temporal_threshold;
+  int threads = static_cast<int>(
+      std::min<size_t>(MaxCopyThreads(), size / kMinChunk));
+  if (size < kParallelThreshold || threads <= 1) {
+    CopyRange(d, s, size, non_temporal);
+    return;
+  }
+
+  auto begin = std::chrono::steady_clock::now();
+  // Chunk boundaries fall on destination pages, so no two threads write
+  // the same cache line or page.
+  size_t per_thread = (size + threads - 1) / threads;
+  auto boundary = [&](int i) -> size_t {
+    if (i == 0) return 0;
+    if (i == threads) return size;
+    uintptr_t p = reinterpret_cast<uintptr_t>(d) + i * per_thread;
+    p = (p + kChunkAlign - 1) / kChunkAlign * kChunkAlign;
+    return std::min<size_t>(size, p - reinterpret_cast<uintptr_t>(d));
+  };
+#pragma omp parallel for num_threads(threads) schedule(static)
+  for (int i = 0; i < threads; ++i) {
+    size_t offset = boundary(i);
+    size_t end = boundary(i + 1);
+    if (offset < end) {
+      CopyRange(d + offset, s + offset, end - offset, non_temporal);
+    }
+  }
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - begin)
+                .count();
+  parallel_bytes.fetch_add(size, std::memory_order_relaxed);
+  parallel_ns.fetch_add(ns, std::memory_order_relaxed);
+}
+
+}  // namespace
+
+void Copy(void* dst, const void* src, size_t size) {
+  EngineCopy(dst, src, size, LastLevelCacheSize());
+}
+
+void StreamingCopy(void* dst, const void* src, size_t size) {
+  EngineCopy(dst, src, size, kStreamingThreshold);
+}
+
+CopyStats GetCopyStats() {
+  CopyStats stats;
+  stats.copies = num_copies.load(std::memory_order_relaxed);
+  stats.bytes = num_bytes.load(std::memory_order_relaxed);
+  stats.elided = num_elided.load(std::memory_order_relaxed);
+  stats.parallel_bytes = parallel_bytes.load(std::memory_order_relaxed);
+  stats.parallel_ns = parallel_ns.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void ResetCopyStats() {
+  num_copies.store(0, std::memory_order_relaxed);
+  num_bytes.store(0, std::memory_order_relaxed);
+  num_elided.store(0, std::memory_order_relaxed);
+  parallel_bytes.store(0, std::memory_order_relaxed);
+  parallel_ns.store(0, std::memory_order_relaxed);
+}
+
+}  // namespace custom_cpu
@@ -0,0 +1,59 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace custom_cpu {
+
+// Copy engine behind every custom_cpu memcpy (h2d, d2h, d2d, p2p and the
+// memcpy kernels).
+//
+// - Copies where dst == src are skipped; overlapping ranges use memmove.
+// - Copies of at least 1 MB are split into page aligned chunks copied by
+//   several threads (CUSTOM_CPU_COPY_THREADS, default up to 8), since one
+//   core cannot saturate memory bandwidth.
+// - Copies larger than the last level cache use non-temporal stores: the
+//   destination would not stay cached anyway, and streaming it keeps the
+//   working set of other threads in the LLC.
+void Copy(void* dst, const void* src, size_t size);
+
+// Like Copy, but uses non-temporal stores from 256 KB up. For copies whose
+// destination will not be read soon by this core, e.g. into memory owned by
+// another NUMA node: the stores bypass the local caches instead of evicting
+// the working set and crossing the interconnect again on writeback.
+void StreamingCopy(void* dst, const void* src, size_t size);
+
+struct CopyStats {
+  uint64_t copies = 0;
+  uint64_t bytes = 0;
+  uint64_t elided = 0;
+  // Bytes and wall time of the multi-threaded copies, for bandwidth.
+  uint64_t parallel_bytes = 0;
+  uint64_t parallel_ns = 0;
+
+  double ParallelGBps() const {
+    return parallel_ns == 0 ? 0.0 : static_cast<double>(parallel_bytes) /
+                                        static_cast<double>(parallel_ns);
+  }
+};
+
+CopyStats GetCopyStats();
+
+void ResetCopyStats();
+
+}  // namespace custom_cpu
@@ -0,0 +1,244 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "runtime/kernel_stats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+namespace custom_cpu {
+
+namespace {
+
+bool EnabledFromEnv() {
+  const char* value = std::getenv("CUSTOM_CPU_KERNEL_STATS");
+  return value != nullptr && std::strcmp(value, "1") == 0;
+}
+
+uint64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// The innermost counting scope of this thread.
+thread_local KernelScope* current_scope = nullptr;
+
+struct Registry {
+  std::mutex mutex;
+  std::unordered_map<std::string, KernelCounters*> by_name;
+  std::vector<KernelCounters*> all;
+};
+
+// Leaked, as kernels may still run during static destruction.
+Registry& GetRegistry() {
+  static auto* registry = new Registry();
+  return *registry;
+}
+
+// One load of a kernel's counters. Kernels keep counting while a snapshot
+// is taken, so it is sorted and reported from these copies only.
+struct CountersCopy {
+  const KernelCounters* counters;
+  KernelStatsRow row;
+};
+
+// Counters with at least one call, longest total time first.
+std::vector<CountersCopy> SortedCounters() {
+  std::vector<CountersCopy> copies;
+  {
+    auto& registry = GetRegistry();
+    std::lock_guard<std::mutex> guard(registry.mutex);
+    for (auto c : registry.all) {
+      KernelStatsRow row{c->name,
+                         c->calls.load(std::memory_order_relaxed),
+                         c->total_ns.load(std::memory_order_relaxed),
+                         c->allocated_bytes.load(std::memory_order_relaxed),
+                         c->temporaries.load(std::memory_order_relaxed),
+                         c->bytes_read.load(std::memory_order_relaxed),
+                         c->bytes_written.load(std::memory_order_relaxed)};
+      if (row.calls > 0) copies.push_back({c, std::move(row)});
+    }
+  }
+  std::stable_sort(copies.begin(),
+                   copies.end(),
+                   [](const CountersCopy& a, const CountersCopy& b) {
+                     return a.row.total_ns > b.row.total_ns;
+                   });
+  return copies;
+}
+
+}  // namespace
+
+std::atomic<bool> kernel_stats_enabled{EnabledFromEnv()};
+
+void SetKernelStatsEnabled(bool enabled) {
+  kernel_stats_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+KernelCounters* GetKernelCounters(const char* name) {
+  auto& registry = GetRegistry();
+  std::lock_guard<std::mutex> guard(registry.mutex);
+  auto it = registry.by_name.find(name);
+  if (it != registry.by_name.end()) return it->second;
+  auto counters = new KernelCounters(name);
+  registry.by_name.emplace(name, counters);
+  registry.all.push_back(counters);
+  return counters;
+}
+
+KernelScope::KernelScope(KernelCounters* counters) {
+  if (!KernelStatsEnabled() || current_scope != nullptr) return;
+  counters_ = counters;
+  current_scope = this;
+  start_ns_ = NowNs();
+}
+
+KernelScope::~KernelScope() {
+  if (!counters_) return;
+  counters_->total_ns.fetch_add(NowNs() - start_ns_,
+                                std::memory_order_relaxed);
+  counters_->calls.fetch_add(1, std::memory_order_relaxed);
+  current_scope = nullptr;
+}
+
+void KernelScope::AddRead(uint64_t bytes) {
+  if (counters_) {
+    counters_->bytes_read.fetch_add(bytes, std::memory_order_relaxed);
+  }
+}
+
+void KernelScope::AddWritten(uint64_t bytes) {
+  if (counters_) {
+    counters_->bytes_written.fetch_add(bytes, std::memory_order_relaxed);
+  }
+}
+
+void KernelScope::AddAllocated(uint64_t bytes) {
+  if (counters_) {
+    counters_->allocated_bytes.fetch_add(bytes, std::memory_order_relaxed);
+  }
+}
+
+void KernelScope::RecordTemporary(uint64_t bytes) {
+  KernelScope* scope = current_scope;
+  if (!scope) return;
+  scope->counters_->temporaries.fetch_add(1, std::memory_order_relaxed);
+  scope->AddAllocated(bytes);
+}
+
+std::vector<KernelStatsRow> SnapshotKernelStats() {
+  std::vector<KernelStatsRow> rows;
+  for (auto& copy : SortedCounters()) rows.push_back(std::move(copy.row));
+  return rows;
+}
+
+void ResetKernelStats() {
+  auto& registry = GetRegistry();
+  std::lock_guard<std::mutex> guard(registry.mutex);
+  for (auto c : registry.all) {
+    c->calls = 0;
+    c->total_ns = 0;
+    c->allocated_bytes = 0;
+    c->temporaries = 0;
+    c->bytes_read = 0;
+    c->bytes_written = 0;
+  }
+}
+
+std::string FormatKernelStats(const std::vector<KernelStatsRow>& rows) {
+  uint64_t total_ns = 0;
+  size_t name_width = 6;
+  for (const auto& row : rows) {
+    total_ns += row.total_ns;
+    name_width = std::max(name_width, row.name.size());
+  }
+  const double kMB = 1 << 20;
+  std::string table;
+  char line[512];
+  std::snprintf(line,
+                sizeof(line),
+                "%-*s %10s %12s %10s %7s %12s %10s %12s %12s\n",
+                static_cast<int>(name_width),
+                "kernel",
+                "calls",
+                "total ms",
+                "avg us",
+                "time %",
+                "alloc MB",
+                "temps",
+                "read MB",
+                "written MB");
+  table += line;
+  for (const auto& row : rows) {
+    std::snprintf(
+        line,
+        sizeof(line),
+        "%-*s %10llu %12.3f %10.2f %7.2f %12.2f %10llu %12.2f %12.2f\n",
+        static_cast<int>(name_width),
+        row.name.c_str(),
+        static_cast<unsigned long long>(row.calls),  // NOLINT
+        row.total_ns / 1e6,
+        row.calls ? row.total_ns / 1e3 / row.calls : 0.0,
+        total_ns ? 100.0 * row.total_ns / total_ns : 0.0,
+        row.allocated_bytes / kMB,
+        static_cast<unsigned long long>(row.temporaries),  // NOLINT
+        row.bytes_read / kMB,
+        row.bytes_written / kMB);
+    table += line;
+  }
+  return table;
+}
+
+}  // namespace custom_cpu
+
+extern "C" {
+
+void custom_cpu_kernel_stats_enable(int enabled) {
+  custom_cpu::SetKernelStatsEnabled(enabled != 0);
+}
+
+size_t custom_cpu_kernel_stats_snapshot(CustomCpuKernelStats* stats,
+                                        size_t capacity) {
+  auto copies = custom_cpu::SortedCounters();
+  for (size_t i = 0; i < std::min(capacity, copies.size()); ++i) {
+    const auto& row = copies[i].row;
+    // The counters' own name, as the copy's does not outlive this call.
+    stats[i] = {copies[i].counters->name.c_str(),
+                row.calls,
+                row.total_ns,
+                row.allocated_bytes,
+                row.temporaries,
+                row.bytes_read,
+                row.bytes_written};
+  }
+  return copies.size();
+}
+
+void custom_cpu_kernel_stats_reset(void) { custom_cpu::ResetKernelStats(); }
+
+void custom_cpu_kernel_stats_print(void) {
+  std::cout << custom_cpu::FormatKernelStats(custom_cpu::SnapshotKernelStats())
+            << std::flush;
+}
+
+}  // extern "C"
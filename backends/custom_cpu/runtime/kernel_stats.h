@@ -0,0 +1,132 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace custom_cpu {
+
+// Per kernel counters, for telling the time a kernel spends in its math
+// from the time spent around it (allocation, broadcast temporaries, checks
+// and dispatch) without running the tracing profiler.
+//
+// The counters are always compiled in and switched by one flag, off by
+// default: a disabled KernelScope costs one relaxed atomic load.
+// CUSTOM_CPU_KERNEL_STATS=1 turns the flag on at load and prints the table
+// when the runtime finalizes; the C API below reads, resets and toggles it
+// at run time.
+struct KernelCounters {
+  explicit KernelCounters(std::string name) : name(std::move(name)) {}
+
+  const std::string name;
+  std::atomic<uint64_t> calls{0};
+  std::atomic<uint64_t> total_ns{0};
+  // Outputs and temporaries the kernel allocated.
+  std::atomic<uint64_t> allocated_bytes{0};
+  std::atomic<uint64_t> temporaries{0};
+  std::atomic<uint64_t> bytes_read{0};
+  std::atomic<uint64_t> bytes_written{0};
+};
+
+extern std::atomic<bool> kernel_stats_enabled;
+
+inline bool KernelStatsEnabled() {
+  return kernel_stats_enabled.load(std::memory_order_relaxed);
+}
+
+void SetKernelStatsEnabled(bool enabled);
+
+// The counters of the kernel called name, created on first use. They are
+// never freed, so callers may cache the pointer in a static.
+KernelCounters* GetKernelCounters(const char* name);
+
+// Counts one call of a kernel, from construction to destruction.
+//
+// Only the outermost scope of a thread counts, so a kernel calling another
+// instrumented kernel is charged for both, once.
+class KernelScope {
+ public:
+  explicit KernelScope(KernelCounters* counters);
+  ~KernelScope();
+
+  KernelScope(const KernelScope&) = delete;
+  KernelScope& operator=(const KernelScope&) = delete;
+
+  bool active() const { return counters_ != nullptr; }
+
+  void AddRead(uint64_t bytes);
+  void AddWritten(uint64_t bytes);
+  void AddAllocated(uint64_t bytes);
+
+  // Charges a temporary buffer to the kernel running on this thread, if
+  // any is being counted.
+  static void RecordTemporary(uint64_t bytes);
+
+ private:
+  KernelCounters* counters_ = nullptr;
+  uint64_t start_ns_ = 0;
+};
+
+struct KernelStatsRow {
+  std::string name;
+  uint64_t calls;
+  uint64_t total_ns;
+  uint64_t allocated_bytes;
+  uint64_t temporaries;
+  uint64_t bytes_read;
+  uint64_t bytes_written;
+};
+
+// Kernels called at least once, by total time, longest first.
+std::vector<KernelStatsRow> SnapshotKernelStats();
+
+void ResetKernelStats();
+
+std::string FormatKernelStats(const std::vector<KernelStatsRow>& rows);
+
+}  // namespace custom_cpu
+
+// C API of the counters, exported by the plugin, e.g. for ctypes.
+extern "C" {
+
+typedef struct {
+  // Valid for the life of the process.
+  const char* name;
+  uint64_t calls;
+  uint64_t total_ns;
+  uint64_t allocated_bytes;
+  uint64_t temporaries;
+  uint64_t bytes_read;
+  uint64_t bytes_written;
+} CustomCpuKernelStats;
+
+void custom_cpu_kernel_stats_enable(int enabled);
+
+// Copies the rows of up to capacity kernels, sorted as SnapshotKernelStats,
+// into stats and returns the number of kernels with counts.
+size_t custom_cpu_kernel_stats_snapshot(CustomCpuKernelStats* stats,
+                                        size_t capacity);
+
+void custom_cpu_kernel_stats_reset(void);
+
+// Prints the table to stdout.
+void custom_cpu_kernel_stats_print(void);
+
+}  // extern "C"
@@ -0,0 +1,120 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "runtime/mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+namespace custom_cpu {
+
+namespace {
+
+std::mutex external_mutex;
+// Base address -> size of every registered range.
+std::map<uintptr_t, size_t> external_ranges;
+// Lets IsExternalMemory skip the lock while nothing is registered, which is
+// the common case for every Deallocate.
+std::atomic<size_t> num_external_ranges{0};
+std::atomic<size_t> external_bytes{0};
+
+}  // namespace
+
+std::shared_ptr<MappedFile> MappedFile::Open(const std::string& path,
+                                             std::string* error) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    *error = "cannot open " + path + ": " + strerror(errno);
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    *error = "cannot stat " + path + ": " + strerror(errno);
+    close(fd);
+    return nullptr;
+  }
+  if (st.st_size == 0) {
+    *error = path + " is empty";
+    close(fd);
+    return nullptr;
+  }
+  size_t size = static_cast<size_t>(st.st_size);
+  // Writable but private: a read-only fd is enough since writes never reach
+  // the file.
+  void* data =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  int mmap_errno = errno;
+  // The mapping keeps its own reference to the file.
+  close(fd);
+  if (data == MAP_FAILED) {
+    *error = "cannot mmap " + path + ": " + strerror(mmap_errno);
+    return nullptr;
+  }
+  return std::shared_ptr<MappedFile>(
+      new MappedFile(path, static_cast<char*>(data), size));
+}
+
+MappedFile::MappedFile(const std::string& path, char* data, size_t size)
+    : path_(path), data_(data), size_(size) {
+  RegisterExternalMemory(data_, size_);
+}
+
+MappedFile::~MappedFile() {
+  UnregisterExternalMemory(data_);
+  munmap(data_, size_);
+}
+
+void RegisterExternalMemory(const void* base, size_t size) {
+  std::lock_guard<std::mutex> guard(external_mutex);
+  auto inserted =
+      external_ranges.emplace(reinterpret_cast<uintptr_t>(base), size);
+  if (!inserted.second) return;
+  num_external_ranges.fetch_add(1, std::memory_order_release);
+  external_bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+void UnregisterExternalMemory(const void* base) {
+  std::lock_guard<std::mutex> guard(external_mutex);
+  auto it = external_ranges.find(reinterpret_cast<uintptr_t>(base));
+  if (it == external_ranges.end()) return;
+  external_bytes.fetch_sub(it->second, std::memory_order_relaxed);
+  external_ranges.erase(it);
+  num_external_ranges.fetch_sub(1, std::memory_order_release);
+}
+
+bool IsExternalMemory(const void* ptr) {
+  if (num_external_ranges.load(std::memory_order_acquire) == 0) return false;
+  auto addr = reinterpret_cast<uintptr_t>(ptr);
+  std::lock_guard<std::mutex> guard(external_mutex);
+  auto it = external_ranges.upper_bound(addr);
+  if (it == external_ranges.begin()) return false;
+  --it;
+  return addr - it->first < it->second;
+}
+
+size_t ExternalMemoryBytes() {
+  return external_bytes.load(std::memory_order_relaxed);
+}
+
+}  // namespace custom_cpu
@@ -0,0 +1,68 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace custom_cpu {
+
+// A file mapped MAP_PRIVATE with read and write access, so tensors can point
+// straight into it: pages are read from (and shared with) the page cache
+// lazily on first access, and a kernel writing to a page gets a private copy
+// of just that page, leaving the file untouched.
+//
+// The mapping is registered as external memory for its whole lifetime and
+// unmapped when the last reference goes away.
+class MappedFile {
+ public:
+  // Returns nullptr and describes the failure in *error.
+  static std::shared_ptr<MappedFile> Open(const std::string& path,
+                                          std::string* error);
+
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  char* data() const { return data_; }
+
+  size_t size() const { return size_; }
+
+  const std::string& path() const { return path_; }
+
+ private:
+  MappedFile(const std::string& path, char* data, size_t size);
+
+  std::string path_;
+  char* data_;
+  size_t size_;
+};
+
+// External memory is memory custom_cpu tensors may point into that was not
+// handed out by the device allocator, such as a MappedFile. Deallocate never
+// frees a pointer inside a registered range.
+void RegisterExternalMemory(const void* base, size_t size);
+
+void UnregisterExternalMemory(const void* base);
+
+bool IsExternalMemory(const void* ptr);
+
+// Bytes currently registered as external memory.
+size_t ExternalMemoryBytes();
+
+}  // namespace custom_cpu
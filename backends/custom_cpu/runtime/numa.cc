@@ -0,0 +1,191 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "runtime/numa.h"
+
+#include <dirent.h>
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace custom_cpu {
+
+namespace {
+
+// Blocks at least this large are mapped and bound; smaller ones are left to
+// malloc and first touch.
+constexpr size_t kBindThreshold = 1 << 20;
+
+constexpr int kMaxNodes = 1024;
+
+std::string ReadFirstLine(const std::string& path) {
+  std::ifstream file(path);
+  std::string line;
+  std::getline(file, line);
+  return line;
+}
+
+// Mapped blocks and their lengths, so NumaFree does not depend on callers
+// passing back the exact size.
+std::mutex mapped_mutex;
+std::unordered_map<void*, size_t> mapped_blocks;
+
+}  // namespace
+
+std::vector<int> ParseSysfsList(const std::string& list) {
+  std::vector<int> ids;
+  std::stringstream stream(list);
+  std::string range;
+  while (std::getline(stream, range, ',')) {
+    int first = 0, last = 0;
+    int matched = sscanf(range.c_str(), "%d-%d", &first, &last);
+    if (matched == 1) {
+      ids.push_back(first);
+    } else if (matched == 2) {
+      for (int id = first; id <= last; ++id) ids.push_back(id);
+    }
+  }
+  return ids;
+}
+
+NumaTopology::NumaTopology() {
+  const std::string root = "/sys/devices/system/node";
+  for (int id : ParseSysfsList(ReadFirstLine(root + "/online"))) {
+    std::string cpulist =
+        ReadFirstLine(root + "/node" + std::to_string(id) + "/cpulist");
+    std::vector<int> cpus = ParseSysfsList(cpulist);
+    // Memory-only nodes (e.g. CXL expanders) cannot run a device's threads.
+    if (!cpus.empty() && id < kMaxNodes) nodes_.push_back({id, cpus});
+  }
+  if (nodes_.empty()) {
+    std::vector<int> cpus;
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    for (long cpu = 0; cpu < count; ++cpu) cpus.push_back(cpu);
+    nodes_.push_back({0, cpus});
+  }
+}
+
+const NumaTopology& NumaTopology::Instance() {
+  static NumaTopology topology;
+  return topology;
+}
+
+const std::vector<int>& NumaTopology::CpusOfNode(int node) const {
+  for (const auto& n : nodes_) {
+    if (n.id == node) return n.cpus;
+  }
+  return nodes_.front().cpus;
+}
+
+bool NumaTopology::NodeMemInfo(int node, size_t* total, size_t* free) const {
+  std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) +
+                     "/meminfo");
+  if (!file) return false;
+  bool has_total = false, has_free = false;
+  std::string line;
+  while (std::getline(file, line)) {
+    // "Node 0 MemTotal:       5865208 kB"
+    int id = 0;
+    char key[64];
+    size_t kb = 0;
+    if (sscanf(line.c_str(), "Node %d %63s %zu", &id, key, &kb) != 3) {
+      continue;
+    }
+    if (strcmp(key, "MemTotal:") == 0) {
+      *total = kb * 1024;
+      has_total = true;
+    } else if (strcmp(key, "MemFree:") == 0) {
+      *free = kb * 1024;
+      has_free = true;
+    }
+  }
+  return has_total && has_free;
+}
+
+void* NumaAllocate(int node, size_t size) {
+  if (!NumaTopology::Instance().multi_node() || size < kBindThreshold) {
+    return malloc(size);
+  }
+  void* ptr = mmap(nullptr,
+                   size,
+                   PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS,
+                   -1,
+                   0);
+  if (ptr == MAP_FAILED) return nullptr;
+  unsigned long mask[kMaxNodes / (8 * sizeof(unsigned long))] = {0};
+  mask[node / (8 * sizeof(unsigned long))] |=
+      1UL << (node % (8 * sizeof(unsigned long)));
+  // No pages exist yet, so this only steers where they will be faulted in.
+  syscall(SYS_mbind, ptr, size, MPOL_PREFERRED, mask, kMaxNodes + 1, 0);
+  std::lock_guard<std::mutex> guard(mapped_mutex);
+  mapped_blocks.emplace(ptr, size);
+  return ptr;
+}
+
+void NumaFree(void* ptr, size_t size) {
+  if (ptr == nullptr) return;
+  {
+    std::lock_guard<std::mutex> guard(mapped_mutex);
+    auto it = mapped_blocks.find(ptr);
+    if (it != mapped_blocks.end()) {
+      munmap(ptr, it->second);
+      mapped_blocks.erase(it);
+      return;
+    }
+  }
+  free(ptr);
+}
+
+void BindWorkerThreadsToNode(int node) {
+  static const bool enabled = [] {
+    const char* value = std::getenv("CUSTOM_CPU_NUMA_BIND");
+    return value == nullptr || strcmp(value, "0") != 0;
+  }();
+  const auto& topology = NumaTopology::Instance();
+  if (!enabled || !topology.multi_node()) return;
+  thread_local int bound_node = -1;
+  if (bound_node == node) return;
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  for (int cpu : topology.CpusOfNode(node)) {
+    if (cpu < CPU_SETSIZE) CPU_SET(cpu, &cpus);
+  }
+#ifdef _OPENMP
+  // The calling thread is the team's thread 0 and keeps its affinity.
+#pragma omp parallel
+  {
+    if (omp_get_thread_num() != 0) sched_setaffinity(0, sizeof(cpus), &cpus);
+  }
+#endif
+  bound_node = node;
+}
+
+}  // namespace custom_cpu
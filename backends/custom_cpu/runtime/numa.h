@@ -0,0 +1,76 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace custom_cpu {
+
+// NUMA nodes of the host, read once from /sys/devices/system/node. Hosts
+// without that tree (or with a single node) report one node holding every
+// cpu, and all NUMA placement below becomes a no-op.
+class NumaTopology {
+ public:
+  static const NumaTopology& Instance();
+
+  size_t num_nodes() const { return nodes_.size(); }
+
+  bool multi_node() const { return nodes_.size() > 1; }
+
+  // Devices are spread over nodes round robin, so with two sockets devices
+  // 0 and 1 land on different sockets.
+  int NodeOfDevice(size_t device_id) const {
+    return nodes_[device_id % nodes_.size()].id;
+  }
+
+  const std::vector<int>& CpusOfNode(int node) const;
+
+  // MemTotal and MemFree of one node, in bytes. Returns false if the node
+  // has no meminfo.
+  bool NodeMemInfo(int node, size_t* total, size_t* free) const;
+
+ private:
+  struct Node {
+    int id;
+    std::vector<int> cpus;
+  };
+
+  NumaTopology();
+
+  std::vector<Node> nodes_;
+};
+
+// Parses a sysfs cpu or node list such as "0-3,8,10-11".
+std::vector<int> ParseSysfsList(const std::string& list);
+
+// Allocates size bytes whose pages are placed on node. Large blocks are
+// mapped directly and bound with mbind, preferring the node so an exhausted
+// node spills over instead of failing; small blocks come from malloc and
+// rely on first touch, by the node's worker threads for kernel outputs.
+void* NumaAllocate(int node, size_t size);
+
+void NumaFree(void* ptr, size_t size);
+
+// Restricts the OpenMP workers of the calling thread's parallel regions to
+// the cpus of node. The calling thread itself, often Python's main thread,
+// is left alone. Workers added later by a larger team are not bound. Does
+// nothing on single node hosts, when the workers are already bound to
+// node, or when CUSTOM_CPU_NUMA_BIND=0.
+void BindWorkerThreadsToNode(int node);
+
+}  // namespace custom_cpu
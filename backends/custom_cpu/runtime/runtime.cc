@@ -14,22 +14,133 @@
 
 #include <errno.h>
 #include <fcntl.h>
-#include <semaphore.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cstdint>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
 
 #include "paddle/phi/backends/device_ext.h"
+#include "runtime/caching_allocator.h"
+#include "runtime/copy.h"
+#include "runtime/kernel_stats.h"
+#include "runtime/mapped_file.h"
+#include "runtime/numa.h"
+#include "runtime/shm_collective.h"
+#include "runtime/stream.h"
 
 #define MEMORY_FRACTION 0.5f
 
 static int global_current_device = 0;
 
+// Kernels and copies run synchronously whatever the stream; a stream only
+// queues collectives (see custom_cpu::Stream).
+struct C_Stream_st {
+  C_Stream_st(size_t device, bool inline_collectives)
+      : device(device),
+        inline_collectives(inline_collectives),
+        queue(CollectiveOptions()) {}
+
+  static const custom_cpu::StreamOptions &CollectiveOptions() {
+    static const auto options = custom_cpu::StreamOptions::FromEnv();
+    return options;
+  }
+
+  size_t device;
+  bool inline_collectives;
+  custom_cpu::Stream queue;
+};
+
+// Memory of one device, placed on the device's NUMA node. Kernels and
+// copies run synchronously, but collectives on a stream run on its thread,
+// so a block another stream used is reused only once the work queued on
+// that stream before the free has run.
+struct NumaMemoryPolicy : custom_cpu::CachingAllocatorPolicyBase {
+  using Stream = C_Stream;
+  struct Event {
+    C_Stream stream;
+    uint64_t seq;
+  };
+
+  explicit NumaMemoryPolicy(int node) : node(node) {}
+
+  void *Alloc(size_t size) { return custom_cpu::NumaAllocate(node, size); }
+  void Free(void *ptr, size_t size) { custom_cpu::NumaFree(ptr, size); }
+  Event RecordEvent(Stream stream) {
+    return {stream, stream ? stream->queue.last() : 0};
+  }
+  bool QueryEvent(Event event) {
+    return !event.stream || event.stream->queue.Query(event.seq);
+  }
+  void SyncEvent(Event event) {
+    if (event.stream) event.stream->queue.Wait(event.seq);
+  }
+  void DestroyEvent(Event /*event*/) {}
+
+  int node;
+};
+
+using DeviceAllocator = custom_cpu::CachingAllocator<NumaMemoryPolicy>;
+
+static size_t DevicesCount();
+
+// The caching allocator behind device memory, or nullptr when it is turned
+// off with CUSTOM_CPU_CACHING_ALLOCATOR=0. Never destroyed, as Paddle may
+// free tensors during static destruction.
+static DeviceAllocator *GetDeviceAllocator(size_t device_id) {
+  static auto *allocators = []() -> std::vector<DeviceAllocator *> * {
+    const char *env = std::getenv("CUSTOM_CPU_CACHING_ALLOCATOR");
+    if (env != nullptr && strcmp(env, "0") == 0) return nullptr;
+    auto *allocators = new std::vector<DeviceAllocator *>();
+    const auto &topology = custom_cpu::NumaTopology::Instance();
+    for (size_t i = 0; i < DevicesCount(); ++i) {
+      allocators->push_back(
+          new DeviceAllocator(NumaMemoryPolicy(topology.NodeOfDevice(i))));
+    }
+    return allocators;
+  }();
+  return allocators == nullptr ? nullptr : allocators->at(device_id);
+}
+
+struct C_Event_st {
+  C_Stream stream = nullptr;
+  uint64_t seq = 0;
+};
+
+struct DeviceStreams {
+  std::mutex mutex;
+  std::vector<C_Stream> streams;
+  size_t created = 0;
+};
+
+static DeviceStreams &StreamsOf(size_t device_id) {
+  static auto *streams = new std::vector<DeviceStreams>(DevicesCount());
+  return streams->at(device_id);
+}
+
+// The first stream of a device is the one Paddle runs kernels on, which
+// read the result of a collective right after issuing it, so collectives
+// on it run inline. Those on later streams, e.g. the communication stream
+// of a process group, run asynchronously and are waited for through
+// events. CUSTOM_CPU_ASYNC_COLLECTIVES=0 runs every collective inline.
+static bool AsyncCollectivesEnabled() {
+  static const bool enabled = [] {
+    const char *env = std::getenv("CUSTOM_CPU_ASYNC_COLLECTIVES");
+    return env == nullptr || strcmp(env, "0") != 0;
+  }();
+  return enabled;
+}
+
 C_Status Init() {
   std::cout << "custom_cpu plugin compiled with ";
 #ifdef __clang__
@@ -47,6 +158,10 @@ C_Status InitDevice(const C_Device device) {
 
 C_Status SetDevice(const C_Device device) {
   global_current_device = device->id;
+  // Keep the kernel threads of the caller on the node holding the device's
+  // memory, without pinning the caller itself.
+  custom_cpu::BindWorkerThreadsToNode(
+      custom_cpu::NumaTopology::Instance().NodeOfDevice(device->id));
   return C_SUCCESS;
 }
 
@@ -55,26 +170,80 @@ C_Status GetDevice(const C_Device device) {
   return C_SUCCESS;
 }
 
-C_Status DestroyDevice(const C_Device device) { return C_SUCCESS; }
+C_Status DestroyDevice(const C_Device device) {
+  auto allocator = GetDeviceAllocator(device->id);
+  if (allocator) allocator->EmptyCache();
+  return C_SUCCESS;
+}
+
+C_Status Finalize() {
+  const char *show_stats = std::getenv("CUSTOM_CPU_COPY_STATS");
+  if (show_stats != nullptr && strcmp(show_stats, "1") == 0) {
+    auto stats = custom_cpu::GetCopyStats();
+    std::cout << "custom_cpu copies: " << stats.copies << ", bytes: "
+              << stats.bytes << ", elided: " << stats.elided
+              << ", multi-threaded: " << stats.parallel_bytes << " bytes at "
+              << stats.ParallelGBps() << " GB/s\n";
+  }
+  show_stats = std::getenv("CUSTOM_CPU_ALLOCATOR_STATS");
+  if (show_stats != nullptr && strcmp(show_stats, "1") == 0) {
+    for (size_t i = 0; i < DevicesCount(); ++i) {
+      auto allocator = GetDeviceAllocator(i);
+      if (!allocator) break;
+      auto stats = allocator->GetStats();
+      std::cout << "custom_cpu:" << i << " allocator: allocs "
+                << stats.num_allocs << ", cache hits " << stats.num_cache_hits
+                << ", segments " << stats.num_segment_allocs
+                << ", peak allocated " << stats.peak_allocated_bytes
+                << ", peak reserved " << stats.peak_reserved_bytes
+                << ", fragmentation " << stats.fragmentation() << "\n";
+    }
+  }
+  show_stats = std::getenv("CUSTOM_CPU_KERNEL_STATS");
+  if (show_stats != nullptr && strcmp(show_stats, "1") == 0) {
+    std::cout << custom_cpu::FormatKernelStats(
+        custom_cpu::SnapshotKernelStats());
+  }
+  return C_SUCCESS;
+}
 
-C_Status Finalize() { return C_SUCCESS; }
+// One device per NUMA node, but never fewer than two so multi-device tests
+// still run on single node hosts.
+static size_t DevicesCount() {
+  return std::max<size_t>(2, custom_cpu::NumaTopology::Instance().num_nodes());
+}
 
 C_Status GetDevicesCount(size_t *count) {
-  *count = 2;
+  *count = DevicesCount();
   return C_SUCCESS;
 }
 
 C_Status GetDevicesList(size_t *devices) {
-  devices[0] = 0;
-  devices[1] = 1;
+  for (size_t i = 0; i < DevicesCount(); ++i) {
+    devices[i] = i;
+  }
   return C_SUCCESS;
 }
 
+static void CopyP2P(const C_Device dst_device,
+                    const C_Device src_device,
+                    void *dst,
+                    const void *src,
+                    size_t size) {
+  const auto &topology = custom_cpu::NumaTopology::Instance();
+  if (topology.NodeOfDevice(dst_device->id) !=
+      topology.NodeOfDevice(src_device->id)) {
+    custom_cpu::StreamingCopy(dst, src, size);
+  } else {
+    custom_cpu::Copy(dst, src, size);
+  }
+}
+
 C_Status MemCpy(const C_Device device,
                 void *dst,
                 const void *src,
                 size_t size) {
-  memcpy(dst, src, size);
+  custom_cpu::Copy(dst, src, size);
   return C_SUCCESS;
 }
 
@@ -83,7 +252,8 @@ C_Status AsyncMemCpy(const C_Device device,
                      void *dst,
                      const void *src,
                      size_t size) {
-  memcpy(dst, src, size);
+  if (stream) stream->queue.Synchronize();
+  custom_cpu::Copy(dst, src, size);
   return C_SUCCESS;
 }
 
@@ -92,7 +262,7 @@ C_Status MemCpyP2P(const C_Device dst_device,
                    void *dst,
                    const void *src,
                    size_t size) {
-  memcpy(dst, src, size);
+  CopyP2P(dst_device, src_device, dst, src, size);
   return C_SUCCESS;
 }
 
@@ -102,12 +272,14 @@ C_Status AsyncMemCpyP2P(const C_Device dst_device,
                         void *dst,
                         const void *src,
                         size_t size) {
-  memcpy(dst, src, size);
+  if (stream) stream->queue.Synchronize();
+  CopyP2P(dst_device, src_device, dst, src, size);
   return C_SUCCESS;
 }
 
 C_Status Allocate(const C_Device device, void **ptr, size_t size) {
-  auto data = malloc(size);
+  auto data = custom_cpu::NumaAllocate(
+      custom_cpu::NumaTopology::Instance().NodeOfDevice(device->id), size);
   if (data) {
     *ptr = data;
     return C_SUCCESS;
@@ -117,43 +289,106 @@ C_Status Allocate(const C_Device device, void **ptr, size_t size) {
   return C_FAILED;
 }
 
+C_Status DeviceAllocate(const C_Device device, void **ptr, size_t size) {
+  auto allocator = GetDeviceAllocator(device->id);
+  if (!allocator) return Allocate(device, ptr, size);
+  *ptr = allocator->Allocate(size);
+  return *ptr ? C_SUCCESS : C_FAILED;
+}
+
+C_Status DeviceDeallocate(const C_Device device, void *ptr, size_t size) {
+  if (custom_cpu::IsExternalMemory(ptr)) return C_SUCCESS;
+  auto allocator = GetDeviceAllocator(device->id);
+  if (allocator && allocator->Free(ptr)) return C_SUCCESS;
+  custom_cpu::NumaFree(ptr, size);
+  return C_SUCCESS;
+}
+
 C_Status Deallocate(const C_Device device, void *ptr, size_t size) {
-  free(ptr);
+  // Adopted buffers, e.g. parameters mapped from a file, are released by
+  // their owner, never by the allocator.
+  if (custom_cpu::IsExternalMemory(ptr)) return C_SUCCESS;
+  custom_cpu::NumaFree(ptr, size);
   return C_SUCCESS;
 }
 
 C_Status CreateStream(const C_Device device, C_Stream *stream) {
-  stream = nullptr;
+  auto &streams = StreamsOf(device->id);
+  std::lock_guard<std::mutex> guard(streams.mutex);
+  *stream = new C_Stream_st(
+      device->id, streams.created++ == 0 || !AsyncCollectivesEnabled());
+  streams.streams.push_back(*stream);
   return C_SUCCESS;
 }
 
 C_Status DestroyStream(const C_Device device, C_Stream stream) {
+  if (!stream) return C_SUCCESS;
+  {
+    auto &streams = StreamsOf(stream->device);
+    std::lock_guard<std::mutex> guard(streams.mutex);
+    streams.streams.erase(
+        std::find(streams.streams.begin(), streams.streams.end(), stream));
+  }
+  // Deferred frees may wait on events of this stream.
+  auto allocator = GetDeviceAllocator(stream->device);
+  if (allocator) allocator->CompletePendingFrees();
+  delete stream;
   return C_SUCCESS;
 }
 
 C_Status CreateEvent(const C_Device device, C_Event *event) {
+  *event = new C_Event_st();
   return C_SUCCESS;
 }
 
 C_Status RecordEvent(const C_Device device, C_Stream stream, C_Event event) {
+  event->stream = stream;
+  event->seq = stream ? stream->queue.last() : 0;
   return C_SUCCESS;
 }
 
 C_Status DestroyEvent(const C_Device device, C_Event event) {
+  delete event;
   return C_SUCCESS;
 }
 
-C_Status SyncDevice(const C_Device device) { return C_SUCCESS; }
+C_Status SyncDevice(const C_Device device) {
+  auto &streams = StreamsOf(device->id);
+  std::lock_guard<std::mutex> guard(streams.mutex);
+  for (auto stream : streams.streams) stream->queue.Synchronize();
+  return C_SUCCESS;
+}
 
 C_Status SyncStream(const C_Device device, C_Stream stream) {
+  if (stream) stream->queue.Synchronize();
   return C_SUCCESS;
 }
 
-C_Status SyncEvent(const C_Device device, C_Event event) { return C_SUCCESS; }
+C_Status SyncEvent(const C_Device device, C_Event event) {
+  if (event->stream) event->stream->queue.Wait(event->seq);
+  return C_SUCCESS;
+}
 
+C_Status QueryStream(const C_Device device, C_Stream stream) {
+  if (stream && !stream->queue.Query(stream->queue.last())) return C_FAILED;
+  return C_SUCCESS;
+}
+
+C_Status QueryEvent(const C_Device device, C_Event event) {
+  if (event->stream && !event->stream->queue.Query(event->seq)) {
+    return C_FAILED;
+  }
+  return C_SUCCESS;
+}
+
+// Work of the waiting stream is either run by the caller, which blocks
+// here, or queued behind this point, so waiting on the host orders both.
 C_Status StreamWaitEvent(const C_Device device,
                          C_Stream stream,
                          C_Event event) {
+  if (event->stream && event->stream != stream) {
+    event->stream->queue.Wait(event->seq);
+  }
   return C_SUCCESS;
 }
 
@@ -162,6 +397,14 @@ C_Status VisibleDevices(size_t *devices) { return C_SUCCESS; }
 C_Status DeviceMemStats(const C_Device device,
                         size_t *total_memory,
                         size_t *free_memory) {
+  const auto &topology = custom_cpu::NumaTopology::Instance();
+  if (topology.multi_node() &&
+      topology.NodeMemInfo(
+          topology.NodeOfDevice(device->id), total_memory, free_memory)) {
+    *free_memory = *free_memory * MEMORY_FRACTION;
+    return C_SUCCESS;
+  }
+
   float memusage;
   FILE *fp;
   char buffer[1024];
@@ -191,50 +434,109 @@ C_Status DeviceMinChunkSize(const C_Device device, size_t *size) {
 struct C_CCLComm_st {
   size_t rank;
   size_t nranks;
-  sem_t *sig;
-  sem_t *sig_2;
-  std::string sig_name;
-  std::string sig_2_name;
+  std::unique_ptr<custom_cpu::ShmCommunicator> shm;
 };
 
+static bool ToCollectiveType(C_DataType data_type,
+                             custom_cpu::CollectiveType *type) {
+  switch (data_type) {
+    case C_DataType::FLOAT32:
+      *type = custom_cpu::CollectiveType::kFloat32;
+      return true;
+    case C_DataType::FLOAT64:
+      *type = custom_cpu::CollectiveType::kFloat64;
+      return true;
+    case C_DataType::INT32:
+      *type = custom_cpu::CollectiveType::kInt32;
+      return true;
+    case C_DataType::INT64:
+      *type = custom_cpu::CollectiveType::kInt64;
+      return true;
+    default:
+      return false;
+  }
+}
+
+static bool ToReduceOp(C_CCLReduceOp op, custom_cpu::ReduceOp *reduce_op) {
+  switch (op) {
+    case C_CCLReduceOp::SUM:
+      *reduce_op = custom_cpu::ReduceOp::kSum;
+      return true;
+    case C_CCLReduceOp::MAX:
+      *reduce_op = custom_cpu::ReduceOp::kMax;
+      return true;
+    case C_CCLReduceOp::MIN:
+      *reduce_op = custom_cpu::ReduceOp::kMin;
+      return true;
+    case C_CCLReduceOp::PRODUCT:
+      *reduce_op = custom_cpu::ReduceOp::kProduct;
+      return true;
+    default:
+      return false;
+  }
+}
+
+static size_t SizeOfDataType(C_DataType data_type) {
+  switch (data_type) {
+    case C_DataType::BOOL:
+    case C_DataType::UINT8:
+    case C_DataType::INT8:
+      return 1;
+    case C_DataType::INT16:
+    case C_DataType::FLOAT16:
+    case C_DataType::BFLOAT16:
+      return 2;
+    case C_DataType::INT32:
+    case C_DataType::FLOAT32:
+      return 4;
+    case C_DataType::INT64:
+    case C_DataType::FLOAT64:
+      return 8;
+    default:
+      return 0;
+  }
+}
+
 // for unittest
 C_Status XcclGetUniqueIdSize(size_t *sz) {
   *sz = sizeof(size_t);
   return C_SUCCESS;
 }
 
+// Names the shared memory segment, so it must differ between jobs.
 C_Status XcclGetUniqueId(C_CCLRootId *unique_id) {
+  static std::mt19937 engine{std::random_device{}()};
+  std::uniform_int_distribution<int> letter('a', 'z');
   auto ptr = reinterpret_cast<int8_t *>(unique_id->data);
   for (auto i = 0; i < unique_id->sz - 1; ++i) {
-    ptr[i] = static_cast<int8_t>(std::rand() % ('z' - 'a') + 'a');
+    ptr[i] = static_cast<int8_t>(letter(engine));
   }
   ptr[unique_id->sz - 1] = '\0';
   return C_SUCCESS;
 }
 
+// Ranks are processes on this host, exchanging data through a shared
+// memory segment named after the unique id.
 C_Status XcclCommInitRank(size_t ranks,
                           C_CCLRootId *unique_id,
                           size_t rank,
                           C_CCLComm *comm) {
-  auto sig = sem_open(static_cast<char *>(unique_id->data), O_CREAT, 0644, 0);
-  auto sig_2 =
-      sem_open(static_cast<char *>(unique_id->data) + 1, O_CREAT, 0644, 0);
-  *comm =
-      new C_CCLComm_st({rank,
-                        ranks,
-                        sig,
-                        sig_2,
-                        std::string(static_cast<char *>(unique_id->data)),
-                        std::string(static_cast<char *>(unique_id->data) + 1)});
+  auto shm = custom_cpu::ShmCommunicator::Create(
+      std::string("/custom_cpu_xccl_") +
+          static_cast<char *>(unique_id->data),
+      rank,
+      ranks);
+  if (!shm) {
+    std::cerr << "custom_cpu: failed to set up shared memory for rank "
+              << rank << ": " << strerror(errno) << "\n";
+    return C_FAILED;
+  }
+  *comm = new C_CCLComm_st({rank, ranks, std::move(shm)});
   return C_SUCCESS;
 }
 
 C_Status XcclDestroyComm(C_CCLComm comm) {
-  if (comm) {
-    sem_unlink(comm->sig_name.c_str());
-    sem_unlink(comm->sig_2_name.c_str());
-    delete comm;
-  }
+  delete comm;
   return C_SUCCESS;
 }
 
@@ -245,19 +547,27 @@ C_Status XcclAllReduce(void *send_buf,
                        C_CCLReduceOp op,
                        C_CCLComm comm,
                        C_Stream stream) {
-  sem_post(comm->sig);
-
-  if (comm->rank == 0) {
-    for (auto i = 0; i < comm->nranks; ++i) {
-      sem_wait(comm->sig);
-    }
-
-    for (auto i = 0; i < comm->nranks; ++i) {
-      sem_post(comm->sig_2);
-    }
+  custom_cpu::AllReduceArgs args;
+  if (!ToCollectiveType(data_type, &args.type) ||
+      !ToReduceOp(op, &args.op)) {
+    std::cerr << "custom_cpu: all_reduce of data type " << data_type
+              << " with op " << op << " is not supported\n";
+    return C_FAILED;
+  }
+  args.send = send_buf;
+  args.recv = recv_buf;
+  args.count = count;
+  args.comm = comm->shm.get();
+  if (stream && !stream->inline_collectives) {
+    stream->queue.AllReduce(args);
+  } else {
+    comm->shm->AllReduce(send_buf,
+                         recv_buf,
+                         count,
+                         args.type,
+                         args.op,
+                         C_Stream_st::CollectiveOptions().bf16_wire);
   }
-
-  sem_wait(comm->sig_2);
   return C_SUCCESS;
 }
 
@@ -267,19 +577,18 @@ C_Status XcclBroadcast(void *buf,
                        size_t root,
                        C_CCLComm comm,
                        C_Stream stream) {
-  sem_post(comm->sig);
-
-  if (comm->rank == 0) {
-    for (auto i = 0; i < comm->nranks; ++i) {
-      sem_wait(comm->sig);
-    }
-
-    for (auto i = 0; i < comm->nranks; ++i) {
-      sem_post(comm->sig_2);
-    }
+  size_t bytes = count * SizeOfDataType(data_type);
+  if (bytes == 0 && count != 0) {
+    std::cerr << "custom_cpu: broadcast of data type " << data_type
+              << " is not supported\n";
+    return C_FAILED;
+  }
+  auto shm = comm->shm.get();
+  if (stream && !stream->inline_collectives) {
+    stream->queue.Enqueue([=] { shm->Broadcast(buf, bytes, root); });
+  } else {
+    shm->Broadcast(buf, bytes, root);
   }
-
-  sem_wait(comm->sig_2);
   return C_SUCCESS;
 }
 
@@ -331,6 +640,8 @@ void InitPlugin(CustomRuntimeParams *params) {
   params->interface->synchronize_stream = SyncStream;
   params->interface->synchronize_event = SyncEvent;
   params->interface->stream_wait_event = StreamWaitEvent;
+  params->interface->query_stream = QueryStream;
+  params->interface->query_event = QueryEvent;
 
   params->interface->memory_copy_h2d = MemCpy;
   params->interface->memory_copy_d2d = MemCpy;
@@ -340,10 +651,10 @@ void InitPlugin(CustomRuntimeParams *params) {
   params->interface->async_memory_copy_d2d = AsyncMemCpy;
   params->interface->async_memory_copy_d2h = AsyncMemCpy;
   params->interface->async_memory_copy_p2p = AsyncMemCpyP2P;
-  params->interface->device_memory_allocate = Allocate;
+  params->interface->device_memory_allocate = DeviceAllocate;
   params->interface->host_memory_allocate = Allocate;
   params->interface->unified_memory_allocate = Allocate;
-  params->interface->device_memory_deallocate = Deallocate;
+  params->interface->device_memory_deallocate = DeviceDeallocate;
   params->interface->host_memory_deallocate = Deallocate;
   params->interface->unified_memory_deallocate = Deallocate;
 
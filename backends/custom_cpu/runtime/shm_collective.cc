@@ -0,0 +1,307 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "runtime/shm_collective.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+
+namespace custom_cpu {
+
+namespace {
+
+constexpr size_t kPageSize = 4096;
+constexpr size_t kDefaultSlotBytes = 4 << 20;
+constexpr int kSpinsBeforeYield = 2000;
+
+size_t DefaultSlotBytes() {
+  static const size_t bytes = [] {
+    const char* value = std::getenv("CUSTOM_CPU_SHM_SLOT_MB");
+    if (value != nullptr && std::atol(value) > 0) {
+      return static_cast<size_t>(std::atol(value)) << 20;
+    }
+    return kDefaultSlotBytes;
+  }();
+  return bytes;
+}
+
+inline void CpuRelax() {
+#if defined(__x86_64__)
+  _mm_pause();
+#endif
+}
+
+template <typename T>
+inline T Apply(ReduceOp op, T a, T b) {
+  switch (op) {
+    case ReduceOp::kMax:
+      return std::max(a, b);
+    case ReduceOp::kMin:
+      return std::min(a, b);
+    case ReduceOp::kProduct:
+      return a * b;
+    default:
+      return a + b;
+  }
+}
+
+// Reduces elements [begin, end) of every slot, in rank order so the result
+// does not depend on which rank computes it.
+template <typename T>
+void ReduceSlots(char* const* slots,
+                 size_t nranks,
+                 size_t begin,
+                 size_t end,
+                 ReduceOp op,
+                 T* out) {
+  for (size_t i = begin; i < end; ++i) {
+    T acc = reinterpret_cast<const T*>(slots[0])[i];
+    for (size_t r = 1; r < nranks; ++r) {
+      acc = Apply(op, acc, reinterpret_cast<const T*>(slots[r])[i]);
+    }
+    out[i] = acc;
+  }
+}
+
+void ReduceSlotsBFloat16(char* const* slots,
+                         size_t nranks,
+                         size_t begin,
+                         size_t end,
+                         ReduceOp op,
+                         uint16_t* out) {
+  for (size_t i = begin; i < end; ++i) {
+    float acc = BFloat16ToFloat(reinterpret_cast<const uint16_t*>(slots[0])[i]);
+    for (size_t r = 1; r < nranks; ++r) {
+      acc = Apply(
+          op,
+          acc,
+          BFloat16ToFloat(reinterpret_cast<const uint16_t*>(slots[r])[i]));
+    }
+    out[i] = FloatToBFloat16(acc);
+  }
+}
+
+}  // namespace
+
+size_t SizeOf(CollectiveType type) {
+  switch (type) {
+    case CollectiveType::kFloat32:
+    case CollectiveType::kInt32:
+      return 4;
+    default:
+      return 8;
+  }
+}
+
+uint16_t FloatToBFloat16(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  // Keep NaNs quiet instead of rounding them into infinities.
+  if ((bits & 0x7fffffffu) > 0x7f800000u) return (bits >> 16) | 0x40;
+  bits += 0x7fffu + ((bits >> 16) & 1);
+  return static_cast<uint16_t>(bits >> 16);
+}
+
+float BFloat16ToFloat(uint16_t value) {
+  uint32_t bits = static_cast<uint32_t>(value) << 16;
+  float result;
+  std::memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+// Sense-reversing barrier. The counters live in their own cache lines, at
+// the start of the segment, which ftruncate zero-fills.
+struct ShmCommunicator::Header {
+  alignas(64) std::atomic<uint32_t> arrived;
+  alignas(64) std::atomic<uint32_t> generation;
+};
+
+std::unique_ptr<ShmCommunicator> ShmCommunicator::Create(
+    const std::string& name, size_t rank, size_t nranks, size_t slot_bytes) {
+  static_assert(sizeof(Header) <= kPageSize, "header must fit its page");
+  if (nranks == 0 || rank >= nranks) return nullptr;
+  if (slot_bytes == 0) slot_bytes = DefaultSlotBytes();
+  slot_bytes = (slot_bytes + kPageSize - 1) / kPageSize * kPageSize;
+  size_t bytes = kPageSize + (nranks + 1) * slot_bytes;
+
+  int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0600);
+  if (fd < 0) return nullptr;
+  // Every rank sizes the segment the same, so the order does not matter.
+  if (ftruncate(fd, bytes) != 0) {
+    close(fd);
+    return nullptr;
+  }
+  void* base = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) return nullptr;
+
+  std::unique_ptr<ShmCommunicator> comm(
+      new ShmCommunicator(rank, nranks, slot_bytes, base, bytes));
+  comm->Barrier();
+  if (rank == 0) shm_unlink(name.c_str());
+  return comm;
+}
+
+ShmCommunicator::ShmCommunicator(size_t rank,
+                                 size_t nranks,
+                                 size_t slot_bytes,
+                                 void* base,
+                                 size_t mapped_bytes)
+    : rank_(rank),
+      nranks_(nranks),
+      slot_bytes_(slot_bytes),
+      base_(base),
+      mapped_bytes_(mapped_bytes),
+      header_(static_cast<Header*>(base)) {}
+
+ShmCommunicator::~ShmCommunicator() { munmap(base_, mapped_bytes_); }
+
+char* ShmCommunicator::slot(size_t i) const {
+  return static_cast<char*>(base_) + kPageSize + i * slot_bytes_;
+}
+
+void ShmCommunicator::Barrier() {
+  if (nranks_ == 1) return;
+  uint32_t generation = header_->generation.load(std::memory_order_acquire);
+  if (header_->arrived.fetch_add(1, std::memory_order_acq_rel) + 1 ==
+      nranks_) {
+    header_->arrived.store(0, std::memory_order_relaxed);
+    header_->generation.fetch_add(1, std::memory_order_release);
+    return;
+  }
+  for (int spins = 0;
+       header_->generation.load(std::memory_order_acquire) == generation;
+       ++spins) {
+    if (spins < kSpinsBeforeYield) {
+      CpuRelax();
+    } else {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void ShmCommunicator::AllReduce(const void* send,
+                                void* recv,
+                                size_t count,
+                                CollectiveType type,
+                                ReduceOp op,
+                                bool bf16_wire) {
+  bf16_wire = bf16_wire && type == CollectiveType::kFloat32;
+  const size_t element_size = SizeOf(type);
+  const size_t wire_size = bf16_wire ? sizeof(uint16_t) : element_size;
+  const size_t chunk = slot_bytes_ / wire_size;
+
+  std::vector<char*> slots(nranks_);
+  for (size_t r = 0; r < nranks_; ++r) slots[r] = slot(r);
+  auto in = static_cast<const char*>(send);
+  auto out = static_cast<char*>(recv);
+
+  for (size_t offset = 0; offset < count; offset += chunk) {
+    const size_t n = std::min(chunk, count - offset);
+    if (bf16_wire) {
+      auto src = reinterpret_cast<const float*>(in) + offset;
+      auto dst = reinterpret_cast<uint16_t*>(slots[rank_]);
+      for (size_t i = 0; i < n; ++i) dst[i] = FloatToBFloat16(src[i]);
+    } else {
+      std::memcpy(slots[rank_], in + offset * element_size, n * element_size);
+    }
+    Barrier();
+
+    const size_t begin = n * rank_ / nranks_;
+    const size_t end = n * (rank_ + 1) / nranks_;
+    if (bf16_wire) {
+      ReduceSlotsBFloat16(slots.data(),
+                          nranks_,
+                          begin,
+                          end,
+                          op,
+                          reinterpret_cast<uint16_t*>(result()));
+    } else {
+      switch (type) {
+        case CollectiveType::kFloat32:
+          ReduceSlots(slots.data(),
+                      nranks_,
+                      begin,
+                      end,
+                      op,
+                      reinterpret_cast<float*>(result()));
+          break;
+        case CollectiveType::kFloat64:
+          ReduceSlots(slots.data(),
+                      nranks_,
+                      begin,
+                      end,
+                      op,
+                      reinterpret_cast<double*>(result()));
+          break;
+        case CollectiveType::kInt32:
+          ReduceSlots(slots.data(),
+                      nranks_,
+                      begin,
+                      end,
+                      op,
+                      reinterpret_cast<int32_t*>(result()));
+          break;
+        case CollectiveType::kInt64:
+          ReduceSlots(slots.data(),
+                      nranks_,
+                      begin,
+                      end,
+                      op,
+                      reinterpret_cast<int64_t*>(result()));
+          break;
+      }
+    }
+    Barrier();
+
+    if (bf16_wire) {
+      auto src = reinterpret_cast<const uint16_t*>(result());
+      auto dst = reinterpret_cast<float*>(out) + offset;
+      for (size_t i = 0; i < n; ++i) dst[i] = BFloat16ToFloat(src[i]);
+    } else {
+      std::memcpy(out + offset * element_size, result(), n * element_size);
+    }
+    // The next round writes only the staging slots, and the result slot
+    // only after the barrier that every rank reaches once done reading it.
+  }
+}
+
+void ShmCommunicator::Broadcast(void* buf, size_t bytes, size_t root) {
+  auto data = static_cast<char*>(buf);
+  for (size_t offset = 0; offset < bytes; offset += slot_bytes_) {
+    const size_t n = std::min(slot_bytes_, bytes - offset);
+    // Staged through the root's own slot: other ranks may still be copying
+    // the result slot out of the AllReduce before, but nothing reads the
+    // staging slots once an AllReduce has passed its second barrier.
+    if (rank_ == root) std::memcpy(slot(root), data + offset, n);
+    Barrier();
+    if (rank_ != root) std::memcpy(data + offset, slot(root), n);
+    Barrier();
+  }
+}
+
+}  // namespace custom_cpu
@@ -0,0 +1,100 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace custom_cpu {
+
+enum class CollectiveType { kFloat32, kFloat64, kInt32, kInt64 };
+
+enum class ReduceOp { kSum, kMax, kMin, kProduct };
+
+size_t SizeOf(CollectiveType type);
+
+// Round to nearest even, the conversion used for the bf16 wire format.
+uint16_t FloatToBFloat16(float value);
+
+float BFloat16ToFloat(uint16_t value);
+
+// Collectives between the ranks of one host, which exchange data through a
+// POSIX shared memory segment instead of sockets.
+//
+// The segment holds one staging slot per rank plus a result slot. An
+// all-reduce is a reduce-scatter followed by an all-gather: every rank
+// copies its input into its slot, reduces 1/nranks of the elements over all
+// slots into the result slot, and then copies the whole result out, so the
+// reduction work is spread over the ranks. Tensors larger than a slot
+// (CUSTOM_CPU_SHM_SLOT_MB, default 4) go through in several rounds.
+//
+// With bf16_wire, float32 tensors are staged as bfloat16, which halves the
+// bytes moved through memory. Elements are still accumulated in float32, but
+// the result carries bfloat16 precision. Every rank ends up with bitwise
+// identical results either way.
+class ShmCommunicator {
+ public:
+  // Opens (or creates) the segment called name, e.g. "/custom_cpu_xyz",
+  // and waits for all nranks ranks to attach. The name is unlinked once
+  // they have, so no segment outlives the job. Returns nullptr on failure.
+  static std::unique_ptr<ShmCommunicator> Create(const std::string& name,
+                                                 size_t rank,
+                                                 size_t nranks,
+                                                 size_t slot_bytes = 0);
+
+  ~ShmCommunicator();
+
+  ShmCommunicator(const ShmCommunicator&) = delete;
+  ShmCommunicator& operator=(const ShmCommunicator&) = delete;
+
+  size_t rank() const { return rank_; }
+  size_t nranks() const { return nranks_; }
+
+  // send and recv may be the same buffer.
+  void AllReduce(const void* send,
+                 void* recv,
+                 size_t count,
+                 CollectiveType type,
+                 ReduceOp op,
+                 bool bf16_wire);
+
+  void Broadcast(void* buf, size_t bytes, size_t root);
+
+  void Barrier();
+
+ private:
+  struct Header;
+
+  ShmCommunicator(size_t rank,
+                  size_t nranks,
+                  size_t slot_bytes,
+                  void* base,
+                  size_t mapped_bytes);
+
+  char* slot(size_t i) const;
+  char* result() const { return slot(nranks_); }
+
+  const size_t rank_;
+  const size_t nranks_;
+  const size_t slot_bytes_;
+  void* base_;
+  size_t mapped_bytes_;
+  Header* header_;
+};
+
+}  // namespace custom_cpu
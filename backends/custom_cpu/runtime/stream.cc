@@ -0,0 +1,181 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "runtime/stream.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+namespace custom_cpu {
+
+namespace {
+
+size_t BytesOf(const AllReduceArgs& args) {
+  return args.count * SizeOf(args.type);
+}
+
+bool SameBucket(const AllReduceArgs& a, const AllReduceArgs& b) {
+  return a.comm == b.comm && a.type == b.type && a.op == b.op;
+}
+
+}  // namespace
+
+StreamOptions StreamOptions::FromEnv() {
+  StreamOptions options;
+  const char* value = std::getenv("CUSTOM_CPU_ALLREDUCE_BUCKET_MB");
+  if (value != nullptr) {
+    options.bucket_bytes = static_cast<size_t>(std::atol(value)) << 20;
+  }
+  value = std::getenv("CUSTOM_CPU_ALLREDUCE_BF16");
+  options.bf16_wire = value != nullptr && std::strcmp(value, "1") == 0;
+  return options;
+}
+
+Stream::Stream(const StreamOptions& options) : options_(options) {}
+
+Stream::~Stream() {
+  Synchronize();
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    stop_ = true;
+  }
+  work_cv_.notify_one();
+  if (thread_.joinable()) thread_.join();
+}
+
+uint64_t Stream::AllReduce(const AllReduceArgs& args) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  const size_t bytes = BytesOf(args);
+  if (!bucket_.empty() &&
+      (!SameBucket(bucket_.front(), args) ||
+       bucket_size_ + bytes > options_.bucket_bytes)) {
+    FlushBucket();
+  }
+  ++stats_.all_reduces;
+  ++last_;
+  if (bytes >= options_.bucket_bytes) {
+    ++stats_.launches;
+    const bool bf16_wire = options_.bf16_wire;
+    Push(
+        [args, bf16_wire] {
+          args.comm->AllReduce(
+              args.send, args.recv, args.count, args.type, args.op, bf16_wire);
+        },
+        last_);
+    return last_;
+  }
+  bucket_.push_back(args);
+  bucket_size_ += bytes;
+  if (bucket_size_ >= options_.bucket_bytes) FlushBucket();
+  return last_;
+}
+
+uint64_t Stream::Enqueue(std::function<void()> task) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  FlushBucket();
+  Push(std::move(task), ++last_);
+  return last_;
+}
+
+uint64_t Stream::last() const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  return last_;
+}
+
+bool Stream::Query(uint64_t seq) {
+  // Polls are not in program order, so the open bucket is left alone and
+  // the work in it reports as not done.
+  std::lock_guard<std::mutex> guard(mutex_);
+  return completed_ >= seq;
+}
+
+void Stream::Wait(uint64_t seq) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (seq > flushed_) FlushBucket();
+  done_cv_.wait(lock, [&] { return completed_ >= seq; });
+}
+
+Stream::Stats Stream::stats() const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  return stats_;
+}
+
+void Stream::FlushBucket() {
+  if (bucket_.empty()) return;
+  ++stats_.launches;
+  if (bucket_.size() > 1) stats_.bucketed += bucket_.size();
+  Push([this, bucket = std::move(bucket_)] { RunBucket(bucket); }, last_);
+  bucket_.clear();
+  bucket_size_ = 0;
+}
+
+void Stream::Push(std::function<void()> run, uint64_t seq) {
+  tasks_.push_back({std::move(run), seq});
+  flushed_ = seq;
+  if (!thread_.joinable()) thread_ = std::thread(&Stream::Loop, this);
+  work_cv_.notify_one();
+}
+
+void Stream::RunBucket(const std::vector<AllReduceArgs>& bucket) {
+  const AllReduceArgs& first = bucket.front();
+  if (bucket.size() == 1) {
+    first.comm->AllReduce(first.send,
+                          first.recv,
+                          first.count,
+                          first.type,
+                          first.op,
+                          options_.bf16_wire);
+    return;
+  }
+  size_t count = 0;
+  for (const auto& args : bucket) count += args.count;
+  const size_t element_size = SizeOf(first.type);
+  flat_.resize(count * element_size);
+
+  char* offset = flat_.data();
+  for (const auto& args : bucket) {
+    std::memcpy(offset, args.send, args.count * element_size);
+    offset += args.count * element_size;
+  }
+  first.comm->AllReduce(flat_.data(),
+                        flat_.data(),
+                        count,
+                        first.type,
+                        first.op,
+                        options_.bf16_wire);
+  offset = flat_.data();
+  for (const auto& args : bucket) {
+    std::memcpy(args.recv, offset, args.count * element_size);
+    offset += args.count * element_size;
+  }
+}
+
+void Stream::Loop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    work_cv_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+    if (tasks_.empty()) return;
+    Task task = std::move(tasks_.front());
+    tasks_.pop_front();
+    lock.unlock();
+    task.run();
+    lock.lock();
+    completed_ = task.seq;
+    done_cv_.notify_all();
+  }
+}
+
+}  // namespace custom_cpu
@@ -0,0 +1,134 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "runtime/shm_collective.h"
+
+namespace custom_cpu {
+
+struct AllReduceArgs {
+  const void* send;
+  void* recv;
+  size_t count;
+  CollectiveType type;
+  ReduceOp op;
+  ShmCommunicator* comm;
+};
+
+struct StreamOptions {
+  // All-reduces smaller than this are packed into flat buckets of up to
+  // this many bytes (CUSTOM_CPU_ALLREDUCE_BUCKET_MB, default 4); 0 turns
+  // bucketing off.
+  size_t bucket_bytes = 4 << 20;
+  // Stage float32 all-reduces as bfloat16 (CUSTOM_CPU_ALLREDUCE_BF16=1).
+  bool bf16_wire = false;
+
+  static StreamOptions FromEnv();
+};
+
+// In-order queue of the work of one custom_cpu stream.
+//
+// Kernels and copies run on the calling thread as before. Collectives are
+// queued instead and run on a thread owned by the stream, started on first
+// use, so a communication stream reduces gradients while the backward pass
+// goes on computing the next ones.
+//
+// Consecutive small all-reduces over the same communicator, type and op
+// are packed into one flat buffer and reduced together, which replaces many
+// latency-bound rounds through shared memory with one. A bucket is launched
+// as soon as it holds bucket_bytes, or when something needs its result: a
+// wait or other work queued behind it. Those are points in the program
+// order, so every rank cuts its buckets at the same calls, which the
+// collectives require. A query is not, as ranks may poll any number of
+// times, so it never launches a bucket.
+//
+// Work is numbered in queue order; an event is such a number.
+class Stream {
+ public:
+  struct Stats {
+    uint64_t all_reduces = 0;
+    // All-reduces that shared a bucket with others.
+    uint64_t bucketed = 0;
+    // Collectives run on the stream thread.
+    uint64_t launches = 0;
+  };
+
+  explicit Stream(const StreamOptions& options = StreamOptions::FromEnv());
+  ~Stream();
+
+  Stream(const Stream&) = delete;
+  Stream& operator=(const Stream&) = delete;
+
+  // The buffers must stay untouched until the returned work is done.
+  uint64_t AllReduce(const AllReduceArgs& args);
+
+  // Runs task on the stream thread after all work queued before it.
+  uint64_t Enqueue(std::function<void()> task);
+
+  // The last work queued.
+  uint64_t last() const;
+
+  bool Query(uint64_t seq);
+
+  void Wait(uint64_t seq);
+
+  void Synchronize() { Wait(last()); }
+
+  Stats stats() const;
+
+ private:
+  struct Task {
+    std::function<void()> run;
+    uint64_t seq;
+  };
+
+  // Both require mutex_.
+  void FlushBucket();
+  void Push(std::function<void()> run, uint64_t seq);
+
+  void RunBucket(const std::vector<AllReduceArgs>& bucket);
+  void Loop();
+
+  const StreamOptions options_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  std::deque<Task> tasks_;
+  std::vector<AllReduceArgs> bucket_;
+  size_t bucket_size_ = 0;
+  uint64_t last_ = 0;
+  // Everything up to flushed_ has been handed to the thread.
+  uint64_t flushed_ = 0;
+  uint64_t completed_ = 0;
+  bool stop_ = false;
+  Stats stats_;
+  std::thread thread_;
+
+  // Flat bucket buffer, only touched by the stream thread.
+  std::vector<char> flat_;
+};
+
+}  // namespace custom_cpu
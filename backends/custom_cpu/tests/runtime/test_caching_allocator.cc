@@ -0,0 +1,398 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "runtime/caching_allocator.h"
+
+#include <sys/mman.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <set>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+constexpr size_t kMB = 1 << 20;
+
+// Host memory bounded by limit. Events complete when the test says so, or
+// when the allocator synchronizes them.
+struct HostState {
+  size_t limit = size_t(1) << 40;
+  size_t in_use = 0;
+  std::map<void*, size_t> live;
+  std::set<int> events;
+  std::set<int> completed;
+  int next_event = 0;
+  int syncs = 0;
+  std::mutex mutex;
+};
+
+struct HostPolicy : custom_cpu::CachingAllocatorPolicyBase {
+  using Stream = int;
+  using Event = int;
+
+  explicit HostPolicy(HostState* state) : state(state) {}
+
+  void* Alloc(size_t size) {
+    std::lock_guard<std::mutex> guard(state->mutex);
+    if (state->in_use + size > state->limit) return nullptr;
+    void* ptr = std::malloc(size);
+    state->in_use += size;
+    state->live[ptr] = size;
+    return ptr;
+  }
+
+  void Free(void* ptr, size_t size) {
+    std::lock_guard<std::mutex> guard(state->mutex);
+    EXPECT_TRUE(state->live.count(ptr) == 1 && state->live[ptr] == size);
+    state->live.erase(ptr);
+    state->in_use -= size;
+    std::free(ptr);
+  }
+
+  Event RecordEvent(Stream stream) {
+    std::lock_guard<std::mutex> guard(state->mutex);
+    state->events.insert(state->next_event);
+    return state->next_event++;
+  }
+
+  bool QueryEvent(Event event) {
+    std::lock_guard<std::mutex> guard(state->mutex);
+    return state->completed.count(event) > 0;
+  }
+
+  void SyncEvent(Event event) {
+    std::lock_guard<std::mutex> guard(state->mutex);
+    ++state->syncs;
+    state->completed.insert(event);
+  }
+
+  void DestroyEvent(Event event) {
+    std::lock_guard<std::mutex> guard(state->mutex);
+    EXPECT_EQ(state->events.erase(event), 1);
+    state->completed.erase(event);
+  }
+
+  void CompleteAll() {
+    std::lock_guard<std::mutex> guard(state->mutex);
+    state->completed.insert(state->events.begin(), state->events.end());
+  }
+
+  HostState* state;
+};
+
+// Adds expandable segments backed by reserved address space.
+struct ExpandableHostPolicy : HostPolicy {
+  using HostPolicy::HostPolicy;
+
+  size_t granularity() const { return 2 * kMB; }
+
+  void* Reserve(size_t size) {
+    void* ptr = mmap(nullptr,
+                     size,
+                     PROT_NONE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                     -1,
+                     0);
+    return ptr == MAP_FAILED ? nullptr : ptr;
+  }
+
+  bool Map(void* ptr, size_t size) {
+    std::lock_guard<std::mutex> guard(state->mutex);
+    if (state->in_use + size > state->limit) return false;
+    if (mprotect(ptr, size, PROT_READ | PROT_WRITE) != 0) return false;
+    state->in_use += size;
+    return true;
+  }
+
+  void Unmap(void* ptr, size_t size) {
+    std::lock_guard<std::mutex> guard(state->mutex);
+    madvise(ptr, size, MADV_DONTNEED);
+    mprotect(ptr, size, PROT_NONE);
+    state->in_use -= size;
+  }
+
+  void Unreserve(void* ptr, size_t size) { munmap(ptr, size); }
+};
+
+using Allocator = custom_cpu::CachingAllocator<HostPolicy>;
+using ExpandableAllocator = custom_cpu::CachingAllocator<ExpandableHostPolicy>;
+
+TEST(CachingAllocatorTest, ReuseOnSameStream) {
+  HostState state;
+  Allocator allocator{HostPolicy(&state)};
+  void* a = allocator.Allocate(1000, 0);
+  std::memset(a, 1, 1000);
+  EXPECT_TRUE(allocator.Free(a));
+  EXPECT_EQ(allocator.Allocate(1000, 0), a);
+  allocator.Free(a);
+  auto stats = allocator.GetStats();
+  EXPECT_EQ(stats.num_cache_hits, 1);
+  EXPECT_EQ(stats.num_segment_allocs, 1);
+  EXPECT_EQ(stats.allocated_bytes, 0);
+  EXPECT_EQ(stats.requested_bytes, 0);
+  EXPECT_EQ(stats.reserved_bytes, 2 * kMB);
+  EXPECT_FALSE(allocator.Free(static_cast<char*>(a) + 1));
+}
+
+TEST(CachingAllocatorTest, SplitAndMerge) {
+  HostState state;
+  Allocator allocator{HostPolicy(&state)};
+  char* a = static_cast<char*>(allocator.Allocate(512, 0));
+  char* b = static_cast<char*>(allocator.Allocate(4096, 0));
+  char* c = static_cast<char*>(allocator.Allocate(100, 0));
+  // Small blocks are carved out of one segment.
+  EXPECT_EQ(b, a + 512);
+  EXPECT_EQ(c, b + 4096);
+  EXPECT_EQ(state.live.size(), 1);
+
+  allocator.Free(a);
+  allocator.Free(c);
+  auto stats = allocator.GetStats();
+  EXPECT_EQ(stats.inactive_split_bytes, 2 * kMB - 4096);
+  EXPECT_EQ(stats.largest_free_block, 2 * kMB - 4096 - 512);
+  EXPECT_GT(stats.fragmentation(), 0.0);
+
+  // Freeing the middle block merges all three with the rest of the segment.
+  allocator.Free(b);
+  stats = allocator.GetStats();
+  EXPECT_EQ(stats.inactive_split_bytes, 0);
+  EXPECT_EQ(stats.largest_free_block, 2 * kMB);
+  EXPECT_EQ(stats.fragmentation(), 0.0);
+
+  allocator.EmptyCache();
+  EXPECT_TRUE(state.live.empty());
+  EXPECT_EQ(allocator.GetStats().reserved_bytes, 0);
+  EXPECT_EQ(allocator.GetStats().num_segment_frees, 1);
+}
+
+TEST(CachingAllocatorTest, LargeSegments) {
+  HostState state;
+  Allocator allocator{HostPolicy(&state)};
+  // From 10 MB up blocks get a segment of their own, rounded to 2 MB.
+  void* c = allocator.Allocate(11 * kMB, 0);
+  EXPECT_NE(c, nullptr);
+  EXPECT_EQ(state.live[c], 12 * kMB);
+  // Smaller large blocks share 20 MB segments.
+  char* a = static_cast<char*>(allocator.Allocate(3 * kMB, 0));
+  char* b = static_cast<char*>(allocator.Allocate(3 * kMB, 0));
+  EXPECT_EQ(b, a + 3 * kMB);
+  EXPECT_EQ(allocator.GetStats().reserved_bytes, 32 * kMB);
+  // A remainder of at most 1 MB is not split off a large block, and the
+  // best fit wins over the larger free block after b.
+  allocator.Free(c);
+  void* d = allocator.Allocate(11 * kMB + 1, 0);
+  EXPECT_EQ(d, c);
+  EXPECT_EQ(allocator.GetStats().allocated_bytes, 18 * kMB);
+  allocator.Free(a);
+  allocator.Free(b);
+  allocator.Free(d);
+}
+
+TEST(CachingAllocatorTest, StreamsDoNotShareCache) {
+  HostState state;
+  Allocator allocator{HostPolicy(&state)};
+  void* a = allocator.Allocate(4096, 1);
+  allocator.Free(a);
+  void* b = allocator.Allocate(4096, 2);
+  EXPECT_NE(b, a);
+  EXPECT_EQ(allocator.Allocate(4096, 1), a);
+  EXPECT_EQ(allocator.GetStats().num_segment_allocs, 2);
+  allocator.Free(a);
+  allocator.Free(b);
+}
+
+TEST(CachingAllocatorTest, RecordStreamDefersReuse) {
+  HostState state;
+  Allocator allocator{HostPolicy(&state)};
+  void* a = allocator.Allocate(4096, 1);
+  allocator.RecordStream(a, 2);
+  // Recording the allocating stream is a no-op.
+  allocator.RecordStream(a, 1);
+  allocator.Free(a);
+  EXPECT_EQ(state.events.size(), 1);
+  auto stats = allocator.GetStats();
+  EXPECT_EQ(stats.num_deferred_frees, 1);
+  EXPECT_EQ(stats.allocated_bytes, 0);
+
+  void* b = allocator.Allocate(4096, 1);
+  EXPECT_NE(b, a);
+  allocator.Free(b);
+
+  allocator.policy().CompleteAll();
+  // b merged with the rest of the segment, a joins them once its event
+  // has completed.
+  EXPECT_EQ(allocator.Allocate(4096, 1), a);
+  allocator.Free(a);
+  EXPECT_TRUE(state.events.empty());
+  EXPECT_EQ(state.syncs, 0);
+}
+
+TEST(CachingAllocatorTest, CompletePendingFreesWaitsForStreams) {
+  HostState state;
+  Allocator allocator{HostPolicy(&state)};
+  void* a = allocator.Allocate(4096, 1);
+  allocator.RecordStream(a, 2);
+  allocator.Free(a);
+  EXPECT_EQ(state.events.size(), 1);
+  allocator.CompletePendingFrees();
+  EXPECT_EQ(state.syncs, 1);
+  EXPECT_TRUE(state.events.empty());
+  EXPECT_EQ(allocator.Allocate(4096, 1), a);
+  allocator.Free(a);
+}
+
+TEST(CachingAllocatorTest, OutOfMemoryRetry) {
+  HostState state;
+  state.limit = 40 * kMB;
+  Allocator allocator{HostPolicy(&state)};
+  void* a = allocator.Allocate(30 * kMB, 1);
+  allocator.RecordStream(a, 3);
+  allocator.Free(a);
+  // The cached segment belongs to stream 1 and waits on stream 3. Stream 2
+  // only gets memory once the allocator synchronizes and empties the cache.
+  void* b = allocator.Allocate(30 * kMB, 2);
+  EXPECT_NE(b, nullptr);
+  EXPECT_EQ(state.syncs, 1);
+  auto stats = allocator.GetStats();
+  EXPECT_EQ(stats.num_alloc_retries, 1);
+  EXPECT_EQ(stats.num_segment_frees, 1);
+
+  EXPECT_EQ(allocator.Allocate(30 * kMB, 2), nullptr);
+  EXPECT_EQ(allocator.GetStats().num_ooms, 1);
+  allocator.Free(b);
+}
+
+TEST(CachingAllocatorTest, PeakStats) {
+  HostState state;
+  Allocator allocator{HostPolicy(&state)};
+  void* a = allocator.Allocate(8 * kMB, 0);
+  void* b = allocator.Allocate(8 * kMB, 0);
+  allocator.Free(a);
+  auto stats = allocator.GetStats();
+  EXPECT_EQ(stats.allocated_bytes, 8 * kMB);
+  EXPECT_EQ(stats.peak_allocated_bytes, 16 * kMB);
+  EXPECT_EQ(stats.peak_reserved_bytes, 20 * kMB);
+  allocator.ResetPeakStats();
+  EXPECT_EQ(allocator.GetStats().peak_allocated_bytes, 8 * kMB);
+  allocator.Free(b);
+}
+
+TEST(CachingAllocatorTest, ExpandableSegments) {
+  HostState state;
+  custom_cpu::CachingAllocatorOptions options;
+  options.expandable_segments = true;
+  options.expandable_reserve = 64 * kMB;
+  ExpandableAllocator allocator{ExpandableHostPolicy(&state), options};
+
+  // Growing requests extend one mapping instead of adding segments.
+  char* a = static_cast<char*>(allocator.Allocate(3 * kMB, 0));
+  char* b = static_cast<char*>(allocator.Allocate(4 * kMB, 0));
+  char* c = static_cast<char*>(allocator.Allocate(5 * kMB, 0));
+  EXPECT_EQ(b, a + 4 * kMB);
+  EXPECT_EQ(c, b + 4 * kMB);
+  std::memset(a, 1, 3 * kMB);
+  std::memset(c, 1, 5 * kMB);
+  auto stats = allocator.GetStats();
+  EXPECT_EQ(stats.num_segment_allocs, 0);
+  EXPECT_EQ(stats.num_segment_grows, 3);
+  EXPECT_EQ(stats.reserved_bytes, 14 * kMB);
+  EXPECT_EQ(state.in_use, 14 * kMB);
+
+  // A free tail is extended in place.
+  allocator.Free(c);
+  char* d = static_cast<char*>(allocator.Allocate(9 * kMB, 0));
+  EXPECT_EQ(d, c);
+  EXPECT_EQ(allocator.GetStats().reserved_bytes, 18 * kMB);
+
+  // Small blocks still use ordinary segments.
+  void* small = allocator.Allocate(4096, 0);
+  EXPECT_EQ(state.live.size(), 1);
+  allocator.Free(small);
+
+  // Freeing everything but the first block and emptying the cache unmaps
+  // the free tail.
+  allocator.Free(b);
+  allocator.Free(d);
+  allocator.EmptyCache();
+  EXPECT_EQ(allocator.GetStats().reserved_bytes, 4 * kMB);
+  EXPECT_EQ(state.in_use, 4 * kMB);
+  EXPECT_TRUE(state.live.empty());
+
+  allocator.Free(a);
+  allocator.EmptyCache();
+  EXPECT_EQ(allocator.GetStats().reserved_bytes, 0);
+  EXPECT_EQ(state.in_use, 0);
+
+  // Past the reservation blocks fall back to ordinary segments.
+  void* e = allocator.Allocate(65 * kMB, 1);
+  EXPECT_NE(e, nullptr);
+  EXPECT_EQ(allocator.GetStats().num_segment_allocs, 2);
+  allocator.Free(e);
+}
+
+TEST(CachingAllocatorTest, ConcurrentUse) {
+  HostState state;
+  {
+    custom_cpu::CachingAllocatorOptions options;
+    options.expandable_segments = true;
+    ExpandableAllocator allocator{ExpandableHostPolicy(&state), options};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+      threads.emplace_back([&allocator, t] {
+        std::mt19937 rng(t);
+        std::vector<std::pair<unsigned char*, size_t>> live;
+        for (int i = 0; i < 2000; ++i) {
+          if (live.size() < 16 && rng() % 3 != 0) {
+            size_t size = rng() % 4 == 0 ? rng() % (12 * kMB) : rng() % 8192;
+            auto* ptr = static_cast<unsigned char*>(
+                allocator.Allocate(size, t % 2));
+            EXPECT_NE(ptr, nullptr);
+            std::memset(ptr, t + i, size);
+            live.emplace_back(ptr, size);
+          } else if (!live.empty()) {
+            size_t k = rng() % live.size();
+            auto entry = live[k];
+            if (entry.second > 0) {
+              EXPECT_EQ(entry.first[0], entry.first[entry.second - 1]);
+            }
+            if (rng() % 4 == 0) allocator.RecordStream(entry.first, 7);
+            allocator.Free(entry.first);
+            live.erase(live.begin() + k);
+          }
+          if (i % 100 == 0) allocator.policy().CompleteAll();
+          if (i % 500 == 0) allocator.EmptyCache();
+        }
+        for (auto& entry : live) allocator.Free(entry.first);
+      });
+    }
+    for (auto& thread : threads) thread.join();
+    auto stats = allocator.GetStats();
+    EXPECT_EQ(stats.allocated_bytes, 0);
+    EXPECT_EQ(stats.num_allocs, stats.num_frees);
+    allocator.EmptyCache();
+    EXPECT_EQ(allocator.GetStats().reserved_bytes, 0);
+  }
+  EXPECT_TRUE(state.live.empty());
+  EXPECT_EQ(state.in_use, 0);
+  EXPECT_TRUE(state.events.empty());
+}
+
+}  // namespace
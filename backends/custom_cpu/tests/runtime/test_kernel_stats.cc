@@ -0,0 +1,146 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "runtime/kernel_stats.h"
+
+namespace {
+
+using custom_cpu::GetKernelCounters;
+using custom_cpu::KernelScope;
+
+const custom_cpu::KernelStatsRow* FindRow(
+    const std::vector<custom_cpu::KernelStatsRow>& rows, const char* name) {
+  for (const auto& row : rows) {
+    if (row.name == name) return &row;
+  }
+  return nullptr;
+}
+
+TEST(KernelStatsTest, Disabled) {
+  custom_cpu::SetKernelStatsEnabled(false);
+  auto counters = GetKernelCounters("disabled");
+  {
+    KernelScope scope(counters);
+    EXPECT_FALSE(scope.active());
+    scope.AddRead(100);
+    KernelScope::RecordTemporary(100);
+  }
+  EXPECT_EQ(counters->calls, 0);
+  EXPECT_EQ(counters->bytes_read, 0);
+  EXPECT_EQ(FindRow(custom_cpu::SnapshotKernelStats(), "disabled"), nullptr);
+}
+
+TEST(KernelStatsTest, NestedScopes) {
+  custom_cpu::SetKernelStatsEnabled(true);
+  auto outer = GetKernelCounters("outer");
+  auto inner = GetKernelCounters("inner");
+  EXPECT_EQ(GetKernelCounters("outer"), outer);
+  {
+    KernelScope scope(outer);
+    EXPECT_TRUE(scope.active());
+    scope.AddRead(64);
+    {
+      KernelScope nested(inner);
+      EXPECT_FALSE(nested.active());
+      nested.AddRead(1000);
+      KernelScope::RecordTemporary(32);
+    }
+    scope.AddWritten(16);
+    scope.AddAllocated(16);
+  }
+  EXPECT_EQ(outer->calls, 1);
+  EXPECT_EQ(outer->bytes_read, 64);
+  EXPECT_EQ(outer->bytes_written, 16);
+  EXPECT_EQ(outer->temporaries, 1);
+  EXPECT_EQ(outer->allocated_bytes, 48);
+  EXPECT_EQ(inner->calls, 0);
+
+  // Outside of any scope a temporary is charged to no one.
+  KernelScope::RecordTemporary(32);
+  EXPECT_EQ(outer->temporaries, 1);
+}
+
+TEST(KernelStatsTest, Threads) {
+  custom_cpu::SetKernelStatsEnabled(true);
+  auto counters = GetKernelCounters("threaded");
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([counters] {
+      for (int i = 0; i < 1000; ++i) {
+        KernelScope scope(counters);
+        scope.AddRead(1);
+        KernelScope::RecordTemporary(2);
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  EXPECT_EQ(counters->calls, 4000);
+  EXPECT_EQ(counters->bytes_read, 4000);
+  EXPECT_EQ(counters->temporaries, 4000);
+  EXPECT_EQ(counters->allocated_bytes, 8000);
+}
+
+TEST(KernelStatsTest, Snapshot) {
+  custom_cpu::SetKernelStatsEnabled(true);
+  custom_cpu::ResetKernelStats();
+  {
+    KernelScope scope(GetKernelCounters("fast"));
+  }
+  {
+    KernelScope scope(GetKernelCounters("slow"));
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  auto rows = custom_cpu::SnapshotKernelStats();
+  EXPECT_EQ(rows.size(), 2);
+  if (rows.size() == 2) {
+    EXPECT_EQ(rows[0].name, "slow");
+    EXPECT_EQ(rows[1].name, "fast");
+    EXPECT_GE(rows[0].total_ns, 2000000);
+  }
+  auto table = custom_cpu::FormatKernelStats(rows);
+  EXPECT_NE(table.find("slow"), std::string::npos);
+  EXPECT_NE(table.find("written MB"), std::string::npos);
+
+  CustomCpuKernelStats stats[1];
+  EXPECT_EQ(custom_cpu_kernel_stats_snapshot(stats, 1), 2);
+  EXPECT_EQ(std::strcmp(stats[0].name, "slow"), 0);
+  EXPECT_EQ(stats[0].calls, 1);
+  EXPECT_EQ(custom_cpu_kernel_stats_snapshot(nullptr, 0), 2);
+
+  custom_cpu_kernel_stats_reset();
+  EXPECT_TRUE(custom_cpu::SnapshotKernelStats().empty());
+
+  custom_cpu_kernel_stats_enable(0);
+  EXPECT_FALSE(custom_cpu::KernelStatsEnabled());
+}
+
+TEST(KernelStatsTest, FormatRowWithoutCalls) {
+  std::vector<custom_cpu::KernelStatsRow> rows = {
+      {"idle", 0, 0, 0, 0, 0, 0}, {"busy", 2, 4000, 0, 0, 0, 0}};
+  auto table = custom_cpu::FormatKernelStats(rows);
+  EXPECT_EQ(table.find("nan"), std::string::npos);
+  EXPECT_EQ(table.find("inf"), std::string::npos);
+  EXPECT_NE(table.find("2.00"), std::string::npos);
+}
+
+}  // namespace
@@ -0,0 +1,244 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <unistd.h>
+
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "runtime/shm_collective.h"
+#include "runtime/stream.h"
+
+namespace {
+
+using custom_cpu::CollectiveType;
+using custom_cpu::ReduceOp;
+using custom_cpu::ShmCommunicator;
+
+// A slot of one page makes every tensor below take several rounds.
+constexpr size_t kSlotBytes = 4096;
+
+// Runs body(comm) on nranks threads, each rank attached to a fresh segment.
+void RunRanks(size_t nranks,
+              const std::function<void(ShmCommunicator*)>& body) {
+  static std::atomic<int> segments{0};
+  std::string name = "/custom_cpu_test_" + std::to_string(getpid()) + "_" +
+                     std::to_string(segments++);
+  std::vector<std::thread> threads;
+  for (size_t rank = 0; rank < nranks; ++rank) {
+    threads.emplace_back([&, rank] {
+      auto comm = ShmCommunicator::Create(name, rank, nranks, kSlotBytes);
+      EXPECT_NE(comm, nullptr);
+      if (comm) body(comm.get());
+    });
+  }
+  for (auto& thread : threads) thread.join();
+}
+
+TEST(ShmCollectiveTest, AllReduce) {
+  const size_t nranks = 4;
+  const size_t count = 3000;
+  RunRanks(nranks, [&](ShmCommunicator* comm) {
+    const size_t rank = comm->rank();
+    std::vector<float> data(count);
+    for (size_t i = 0; i < count; ++i) data[i] = rank + i * 0.5f;
+    comm->AllReduce(data.data(),
+                    data.data(),
+                    count,
+                    CollectiveType::kFloat32,
+                    ReduceOp::kSum,
+                    false);
+    for (size_t i = 0; i < count; ++i) {
+      EXPECT_EQ(data[i], 6 + i * 2.0f);
+    }
+
+    std::vector<int64_t> send(count), recv(count);
+    for (size_t i = 0; i < count; ++i) send[i] = (rank + i) % 7;
+    comm->AllReduce(send.data(),
+                    recv.data(),
+                    count,
+                    CollectiveType::kInt64,
+                    ReduceOp::kMax,
+                    false);
+    for (size_t i = 0; i < count; ++i) {
+      int64_t expected = 0;
+      for (size_t r = 0; r < nranks; ++r) {
+        expected = std::max<int64_t>(expected, (r + i) % 7);
+      }
+      EXPECT_EQ(recv[i], expected);
+    }
+  });
+}
+
+TEST(ShmCollectiveTest, Broadcast) {
+  RunRanks(3, [](ShmCommunicator* comm) {
+    std::vector<int32_t> data(5000, -1);
+    if (comm->rank() == 1) {
+      for (size_t i = 0; i < data.size(); ++i) data[i] = i;
+    }
+    comm->Broadcast(data.data(), data.size() * sizeof(int32_t), 1);
+    for (size_t i = 0; i < data.size(); ++i) {
+      EXPECT_EQ(data[i], static_cast<int32_t>(i));
+    }
+  });
+}
+
+TEST(ShmCollectiveTest, AllReduceThenBroadcast) {
+  // A broadcast right behind an all-reduce must not overwrite the result
+  // while slower ranks are still copying it out.
+  const size_t nranks = 4;
+  const size_t count = 3000;
+  RunRanks(nranks, [&](ShmCommunicator* comm) {
+    for (int iter = 0; iter < 300; ++iter) {
+      std::vector<float> ones(count, 1.0f);
+      comm->AllReduce(ones.data(),
+                      ones.data(),
+                      count,
+                      CollectiveType::kFloat32,
+                      ReduceOp::kSum,
+                      false);
+      std::vector<int32_t> data(count, -1);
+      if (comm->rank() == 0) {
+        for (size_t i = 0; i < count; ++i) data[i] = iter + i;
+      }
+      comm->Broadcast(data.data(), count * sizeof(int32_t), 0);
+      // Counted rather than asserted, as a rank leaving early would leave
+      // the others waiting at the next barrier.
+      size_t wrong = 0;
+      for (size_t i = 0; i < count; ++i) {
+        wrong += ones[i] != nranks ||
+                 data[i] != static_cast<int32_t>(iter + i);
+      }
+      EXPECT_EQ(wrong, 0u) << "iteration " << iter;
+    }
+  });
+}
+
+TEST(ShmCollectiveTest, BFloat16Wire) {
+  EXPECT_EQ(custom_cpu::BFloat16ToFloat(custom_cpu::FloatToBFloat16(1.5f)),
+            1.5f);
+  // 1 + 2^-8 is halfway between two bfloat16 values and rounds to even.
+  EXPECT_EQ(custom_cpu::BFloat16ToFloat(
+                custom_cpu::FloatToBFloat16(1.0f + 1.0f / 256)),
+            1.0f);
+  EXPECT_TRUE(std::isnan(custom_cpu::BFloat16ToFloat(
+      custom_cpu::FloatToBFloat16(std::nanf("")))));
+
+  const size_t nranks = 4;
+  const size_t count = 5000;
+  std::vector<std::vector<float>> results(nranks);
+  RunRanks(nranks, [&](ShmCommunicator* comm) {
+    std::vector<float> data(count);
+    for (size_t i = 0; i < count; ++i) {
+      data[i] = std::sin(i * 0.01f) * (comm->rank() + 1);
+    }
+    comm->AllReduce(data.data(),
+                    data.data(),
+                    count,
+                    CollectiveType::kFloat32,
+                    ReduceOp::kSum,
+                    true);
+    results[comm->rank()] = data;
+  });
+  for (size_t i = 0; i < count; ++i) {
+    float expected = std::sin(i * 0.01f) * 10;
+    EXPECT_LE(std::fabs(results[0][i] - expected),
+              std::fabs(expected) / 64 + 1e-3f);
+    for (size_t r = 1; r < nranks; ++r) {
+      EXPECT_EQ(results[r][i], results[0][i]);
+    }
+  }
+}
+
+TEST(ShmCollectiveTest, StreamBuckets) {
+  const size_t nranks = 4;
+  // Sizes of a backward pass: many small gradients and one large one.
+  std::vector<size_t> sizes;
+  for (size_t i = 0; i < 40; ++i) sizes.push_back(1 + i * 37 % 300);
+  sizes.push_back(10000);
+  for (size_t i = 0; i < 10; ++i) sizes.push_back(64);
+
+  std::vector<custom_cpu::Stream::Stats> stats(nranks);
+  RunRanks(nranks, [&](ShmCommunicator* comm) {
+    custom_cpu::StreamOptions options;
+    options.bucket_bytes = 8192;
+    custom_cpu::Stream stream(options);
+    std::vector<std::vector<float>> grads;
+    for (size_t i = 0; i < sizes.size(); ++i) {
+      grads.emplace_back(sizes[i], comm->rank() + i);
+    }
+    uint64_t first = 0;
+    for (auto& grad : grads) {
+      uint64_t seq = stream.AllReduce({grad.data(),
+                                       grad.data(),
+                                       grad.size(),
+                                       CollectiveType::kFloat32,
+                                       ReduceOp::kSum,
+                                       comm});
+      if (first == 0) first = seq;
+    }
+    // Waiting on the first gradient launches the bucket holding it.
+    stream.Wait(first);
+    EXPECT_EQ(grads[0][0], 6);
+    stream.Synchronize();
+    EXPECT_TRUE(stream.Query(stream.last()));
+    for (size_t i = 0; i < grads.size(); ++i) {
+      for (float value : grads[i]) EXPECT_EQ(value, 6 + 4.0f * i);
+    }
+
+    // Work queued behind a bucket runs after it.
+    std::vector<float> grad(100, 1.0f);
+    stream.AllReduce({grad.data(),
+                      grad.data(),
+                      grad.size(),
+                      CollectiveType::kFloat32,
+                      ReduceOp::kSum,
+                      comm});
+    float seen = 0;
+    stream.Enqueue([&] { seen = grad[0]; });
+    stream.Synchronize();
+    EXPECT_EQ(seen, 4.0f);
+
+    // A query leaves the open bucket alone; only the wait launches it.
+    uint64_t open = stream.AllReduce({grad.data(),
+                                      grad.data(),
+                                      grad.size(),
+                                      CollectiveType::kFloat32,
+                                      ReduceOp::kSum,
+                                      comm});
+    for (int i = 0; i < 3 + static_cast<int>(comm->rank()); ++i) {
+      EXPECT_FALSE(stream.Query(open));
+    }
+    stream.Wait(open);
+    EXPECT_TRUE(stream.Query(open));
+    EXPECT_EQ(grad[0], 16.0f);
+    stats[comm->rank()] = stream.stats();
+  });
+  for (const auto& rank_stats : stats) {
+    EXPECT_EQ(rank_stats.all_reduces, sizes.size() + 2);
+    EXPECT_LT(rank_stats.launches, sizes.size() / 4);
+    EXPECT_GT(rank_stats.bucketed, sizes.size() / 2);
+    EXPECT_EQ(rank_stats.launches, stats[0].launches);
+  }
+}
+
+}  // namespace
@@ -0,0 +1,49 @@
+# Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import unittest
+
+import numpy as np
+import paddle
+
+
+def train(device, amsgrad, steps=5):
+    paddle.set_device(device)
+    paddle.seed(2024)
+    np.random.seed(2024)
+    model = paddle.nn.Linear(16, 4)
+    opt = paddle.optimizer.Adam(
+        learning_rate=0.01, parameters=model.parameters(), amsgrad=amsgrad
+    )
+    for _ in range(steps):
+        x = paddle.to_tensor(np.random.uniform(-1, 1, [8, 16]).astype("float32"))
+        loss = (model(x) ** 2).mean()
+        loss.backward()
+        opt.step()
+        opt.clear_grad()
+    return [p.numpy() for p in model.parameters()]
+
+
+class TestAdam(unittest.TestCase):
+    def test_adam(self):
+        for actual, expected in zip(train("custom_cpu", False), train("cpu", False)):
+            np.testing.assert_allclose(actual, expected, rtol=1e-5, atol=1e-6)
+
+    def test_amsgrad(self):
+        for actual, expected in zip(train("custom_cpu", True), train("cpu", True)):
+            np.testing.assert_allclose(actual, expected, rtol=1e-5, atol=1e-6)
+
+
+if __name__ == "__main__":
+    unittest.main()
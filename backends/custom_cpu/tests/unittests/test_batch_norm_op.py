@@ -0,0 +1,61 @@
+# Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import unittest
+
+import numpy as np
+import paddle
+
+
+def run(device, data_format, x, dy, training):
+    paddle.set_device(device)
+    paddle.seed(2024)
+    num_channels = x.shape[1] if data_format == "NCHW" else x.shape[-1]
+    bn = paddle.nn.BatchNorm2D(num_channels, data_format=data_format)
+    bn.weight.set_value(np.linspace(0.5, 1.5, num_channels).astype("float32"))
+    bn.bias.set_value(np.linspace(-1, 1, num_channels).astype("float32"))
+    if training:
+        bn.train()
+    else:
+        bn.eval()
+    tensor = paddle.to_tensor(x, stop_gradient=False)
+    out = bn(tensor)
+    out.backward(paddle.to_tensor(dy))
+    return [
+        out.numpy(),
+        tensor.grad.numpy(),
+        bn.weight.grad.numpy(),
+        bn.bias.grad.numpy(),
+        bn._mean.numpy(),
+        bn._variance.numpy(),
+    ]
+
+
+class TestBatchNorm(unittest.TestCase):
+    def setUp(self):
+        np.random.seed(2024)
+
+    def test_batch_norm(self):
+        for data_format, shape in [("NCHW", [4, 3, 5, 6]), ("NHWC", [4, 5, 6, 3])]:
+            for training in [True, False]:
+                x = np.random.uniform(-2, 3, shape).astype("float32")
+                dy = np.random.uniform(-1, 1, shape).astype("float32")
+                expected = run("cpu", data_format, x, dy, training)
+                actual = run("custom_cpu", data_format, x, dy, training)
+                for a, e in zip(actual, expected):
+                    np.testing.assert_allclose(a, e, rtol=1e-4, atol=1e-5)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,230 @@
+# Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import json
+import os
+import tempfile
+import unittest
+
+# The plugin reads the cache location when it is loaded by paddle.
+CACHE_DIR = tempfile.TemporaryDirectory()
+CACHE_PATH = os.path.join(CACHE_DIR.name, "autotune.json")
+os.environ["CUSTOM_CPU_AUTOTUNE_CACHE"] = CACHE_PATH
+
+import numpy as np  # noqa: E402
+import paddle  # noqa: E402
+import paddle.nn.functional as F  # noqa: E402
+
+# Shape classes of the convolutions in test_winograd_shapes, see
+# autotune::ShapeClass.
+WINOGRAD_KEYS = [
+    "conv2d_3x3|float32|2x16x32x32x32",
+    "conv2d_3x3|float32|2x16x32x32x32_nhwc",
+]
+
+
+def cpu_signature():
+    # Mirrors autotune::TuningCache::CpuSignature.
+    model = implementer = part = ""
+    with open("/proc/cpuinfo") as f:
+        for line in f:
+            name, colon, value = line.rstrip("\n").partition(":")
+            if not colon or not name:
+                continue
+            name = name.rstrip(" \t")
+            value = value.lstrip(" \t")
+            if name == "model name" and not model:
+                model = value
+            elif name == "CPU implementer" and not implementer:
+                implementer = value
+            elif name == "CPU part" and not part:
+                part = value
+    if not model and implementer:
+        model = "arm " + implementer + " " + part
+    return (model or "unknown") + " / " + str(os.cpu_count())
+
+
+def seed_autotune_cache(keys, variant):
+    tables = {cpu_signature(): {key: variant for key in keys}}
+    with open(CACHE_PATH, "w") as f:
+        json.dump({"version": 1, "tables": tables}, f)
+
+
+# Pin the Winograd kernel before the first tuned convolution loads the
+# cache, so it is tested whichever variant would win on this host.
+seed_autotune_cache(WINOGRAD_KEYS, "winograd")
+
+
+def run(device, fn, *arrays):
+    paddle.set_device(device)
+    tensors = [paddle.to_tensor(a, stop_gradient=False) for a in arrays]
+    out = fn(*tensors)
+    out.backward(paddle.ones_like(out) * 0.5)
+    return [out.numpy()] + [t.grad.numpy() for t in tensors]
+
+
+class TestConv2d(unittest.TestCase):
+    def setUp(self):
+        np.random.seed(2024)
+
+    def check(self, x_shape, w_shape, rtol=1e-4, atol=1e-4, **kwargs):
+        x = np.random.uniform(-1, 1, x_shape).astype("float32")
+        w = np.random.uniform(-1, 1, w_shape).astype("float32")
+
+        def conv(x, w):
+            return F.conv2d(x, w, **kwargs)
+
+        expected = run("cpu", conv, x, w)
+        actual = run("custom_cpu", conv, x, w)
+        for a, e in zip(actual, expected):
+            np.testing.assert_allclose(a, e, rtol=rtol, atol=atol)
+
+    def test_nchw(self):
+        self.check([2, 3, 9, 11], [5, 3, 3, 3], padding=1)
+        self.check([2, 4, 10, 10], [6, 2, 3, 3], stride=2, padding=1, groups=2)
+        self.check([1, 3, 12, 12], [4, 3, 5, 5], padding=2, dilation=2)
+        self.check([1, 3, 8, 8], [4, 3, 3, 3], padding="SAME", stride=2)
+
+    def test_nhwc(self):
+        self.check([2, 9, 11, 3], [5, 3, 3, 3], padding=1, data_format="NHWC")
+        self.check(
+            [1, 10, 10, 4],
+            [6, 2, 3, 3],
+            stride=2,
+            padding="VALID",
+            groups=2,
+            data_format="NHWC",
+        )
+
+    def test_winograd_shapes(self):
+        # Large enough 3x3 stride-1 convolutions are tuned between the direct
+        # and Winograd kernels; the seeded cache selects Winograd.
+        self.check([2, 16, 20, 20], [32, 16, 3, 3], padding=1, rtol=1e-3)
+        self.check(
+            [2, 20, 20, 16],
+            [32, 16, 3, 3],
+            padding=1,
+            data_format="NHWC",
+            rtol=1e-3,
+        )
+
+        # A cache hit dispatches without retuning, so the seeded choice is
+        # still the one on file.
+        with open(CACHE_PATH) as f:
+            cache = json.load(f)
+        table = cache["tables"][cpu_signature()]
+        for key in WINOGRAD_KEYS:
+            self.assertEqual(table[key], "winograd")
+
+    def test_depthwise(self):
+        self.check([2, 8, 13, 14], [8, 1, 3, 3], padding=1, groups=8)
+        self.check([1, 4, 12, 12], [8, 1, 3, 3], stride=2, padding=1, groups=4)
+        self.check(
+            [2, 13, 14, 8],
+            [8, 1, 3, 3],
+            padding=1,
+            groups=8,
+            data_format="NHWC",
+        )
+
+
+class TestFusedConv2dAddAct(unittest.TestCase):
+    def setUp(self):
+        np.random.seed(2024)
+        paddle.set_device("custom_cpu")
+
+    def check(
+        self,
+        x_shape,
+        w_shape,
+        activation,
+        with_residual,
+        stride=1,
+        padding=0,
+        groups=1,
+        data_format="NCHW",
+        rtol=1e-4,
+    ):
+        x = np.random.uniform(-1, 1, x_shape).astype("float32")
+        w = np.random.uniform(-1, 1, w_shape).astype("float32")
+        bias = np.random.uniform(-1, 1, [w_shape[0]]).astype("float32")
+
+        paddle.set_device("cpu")
+        expected = F.conv2d(
+            paddle.to_tensor(x),
+            paddle.to_tensor(w),
+            stride=stride,
+            padding=padding,
+            groups=groups,
+            data_format=data_format,
+        ).numpy()
+        channel_axis = 1 if data_format == "NCHW" else 3
+        bias_shape = [1, 1, 1, 1]
+        bias_shape[channel_axis] = -1
+        expected = expected + bias.reshape(bias_shape)
+        residual = None
+        if with_residual:
+            residual = np.random.uniform(-1, 1, expected.shape).astype(
+                "float32"
+            )
+            expected = expected + residual
+        if activation == "relu":
+            expected = np.maximum(expected, 0)
+
+        paddle.set_device("custom_cpu")
+        out, _ = paddle._C_ops.fused_conv2d_add_act(
+            paddle.to_tensor(x),
+            paddle.to_tensor(w),
+            paddle.to_tensor(bias),
+            None if residual is None else paddle.to_tensor(residual),
+            [stride, stride],
+            [padding, padding],
+            "EXPLICIT",
+            [1, 1],
+            groups,
+            data_format,
+            activation,
+            [],
+            False,
+            512,
+            0.0,
+        )
+        np.testing.assert_allclose(out.numpy(), expected, rtol=rtol, atol=1e-4)
+
+    def test_bias_residual_act(self):
+        for activation in ["relu", "identity"]:
+            for with_residual in [False, True]:
+                self.check(
+                    [2, 3, 9, 11], [5, 3, 3, 3], activation, with_residual, 1, 1
+                )
+                self.check(
+                    [2, 9, 11, 4],
+                    [6, 2, 3, 3],
+                    activation,
+                    with_residual,
+                    stride=2,
+                    padding=1,
+                    groups=2,
+                    data_format="NHWC",
+                )
+
+    def test_depthwise_and_winograd_shapes(self):
+        self.check([2, 8, 13, 14], [8, 1, 3, 3], "relu", True, 1, 1, groups=8)
+        self.check(
+            [2, 16, 20, 20], [32, 16, 3, 3], "relu", True, 1, 1, rtol=1e-3
+        )
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,115 @@
+# Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import os
+import tempfile
+import unittest
+
+import numpy as np
+import paddle
+
+paddle.enable_static()
+
+FUSION_PASSES = [
+    "cpu_fusion_op_marker_pass",
+    "cpu_fusion_sub_graph_extract_pass",
+    "cpu_fusion_replace_with_engine_op_pass",
+]
+ENGINE_OP = "custom_engine.cpu_fusion"
+FUSED_OPS = ["pd_op.multiply", "pd_op.add", "pd_op.maximum"]
+
+
+class TestElementwiseFusion(unittest.TestCase):
+    def setUp(self):
+        np.random.seed(2024)
+        self.temp_dir = tempfile.TemporaryDirectory()
+        self.model_prefix = os.path.join(self.temp_dir.name, "fusion")
+
+        main = paddle.static.Program()
+        startup = paddle.static.Program()
+        with paddle.static.program_guard(main, startup):
+            x = paddle.static.data("x", [-1, 64], "float32")
+            w = paddle.static.data("w", [-1, 64], "float32")
+            b = paddle.static.data("b", [64], "float32")
+            y = paddle.static.data("y", [-1, 1], "float32")
+            # One group of four ops with two outputs, both broadcasting.
+            out1 = paddle.maximum(paddle.multiply(x, w) + b, y)
+            out2 = paddle.add(out1, x)
+        exe = paddle.static.Executor(paddle.CustomPlace("custom_cpu", 0))
+        exe.run(startup)
+        paddle.static.save_inference_model(
+            self.model_prefix, [x, w, b, y], [out1, out2], exe, program=main
+        )
+
+    def tearDown(self):
+        self.temp_dir.cleanup()
+
+    def create_predictor(self):
+        config = paddle.inference.Config(
+            self.model_prefix + ".json", self.model_prefix + ".pdiparams"
+        )
+        config.enable_custom_device("custom_cpu")
+        config.enable_new_ir(True)
+        config.enable_new_executor(True)
+        config.enable_custom_passes(FUSION_PASSES, True)
+        return paddle.inference.create_predictor(config)
+
+    def optimized_program(self):
+        exe = paddle.static.Executor(paddle.CustomPlace("custom_cpu", 0))
+        program, _, _ = paddle.static.load_inference_model(
+            self.model_prefix, exe
+        )
+        pm = paddle.pir.PassManager()
+        for name in FUSION_PASSES:
+            pm.add_pass(name, {})
+        pm.run(program)
+        return program
+
+    def test_fused_program(self):
+        block = self.optimized_program().global_block()
+        names = [op.name() for op in block.ops]
+        # All four ops form one group, which leaves the main block.
+        self.assertEqual(names.count(ENGINE_OP), 1, names)
+        for name in FUSED_OPS:
+            self.assertNotIn(name, names)
+
+    def test_fused_outputs(self):
+        predictor = self.create_predictor()
+        # The same engine serves every batch size.
+        for batch in [1, 7, 300]:
+            inputs = {
+                "x": np.random.uniform(-1, 1, [batch, 64]).astype("float32"),
+                "w": np.random.uniform(-1, 1, [batch, 64]).astype("float32"),
+                "b": np.random.uniform(-1, 1, [64]).astype("float32"),
+                "y": np.random.uniform(-1, 1, [batch, 1]).astype("float32"),
+            }
+            for name in predictor.get_input_names():
+                predictor.get_input_handle(name).copy_from_cpu(inputs[name])
+            predictor.run()
+            outs = [
+                predictor.get_output_handle(name).copy_to_cpu()
+                for name in predictor.get_output_names()
+            ]
+
+            expect1 = np.maximum(
+                inputs["x"] * inputs["w"] + inputs["b"], inputs["y"]
+            )
+            np.testing.assert_allclose(outs[0], expect1, rtol=1e-6)
+            np.testing.assert_allclose(
+                outs[1], expect1 + inputs["x"], rtol=1e-6
+            )
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,65 @@
+# Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import unittest
+
+import numpy as np
+import paddle
+import paddle.nn.functional as F
+
+
+def run(device, fn, x, index):
+    paddle.set_device(device)
+    tensor = paddle.to_tensor(x, stop_gradient=False)
+    out = fn(tensor, paddle.to_tensor(index))
+    out.backward(paddle.ones_like(out) * 0.5)
+    return out.numpy(), tensor.grad.numpy()
+
+
+class TestEmbedding(unittest.TestCase):
+    def setUp(self):
+        np.random.seed(2024)
+
+    def check(self, vocab, dim, ids_shape, padding_idx=None):
+        weight = np.random.uniform(-1, 1, [vocab, dim]).astype("float32")
+        # Repeated ids sum their gradients.
+        ids = np.random.randint(0, vocab, ids_shape).astype("int64")
+
+        def embedding(w, x):
+            return F.embedding(x, w, padding_idx=padding_idx)
+
+        for actual, expected in zip(
+            run("custom_cpu", embedding, weight, ids),
+            run("cpu", embedding, weight, ids),
+        ):
+            np.testing.assert_allclose(actual, expected, rtol=1e-6, atol=1e-6)
+
+    def test_embedding(self):
+        self.check(10, 8, [4, 7])
+        self.check(1000, 3, [64])
+
+    def test_padding_idx(self):
+        self.check(5, 4, [3, 9], padding_idx=2)
+        self.check(5, 4, [3, 9], padding_idx=-1)
+
+    def test_int32_ids(self):
+        weight = np.random.uniform(-1, 1, [6, 5]).astype("float32")
+        ids = np.array([[0, 5, 5], [3, 0, 1]], dtype="int32")
+        paddle.set_device("custom_cpu")
+        out = F.embedding(paddle.to_tensor(ids), paddle.to_tensor(weight))
+        np.testing.assert_array_equal(out.numpy(), weight[ids])
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,57 @@
+# Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import unittest
+
+import numpy as np
+import paddle
+
+from test_embedding_op import run
+
+
+class TestGather(unittest.TestCase):
+    def setUp(self):
+        np.random.seed(2024)
+
+    def check(self, fn, x_shape, index):
+        x = np.random.uniform(-1, 1, x_shape).astype("float32")
+        for actual, expected in zip(
+            run("custom_cpu", fn, x, index), run("cpu", fn, x, index)
+        ):
+            np.testing.assert_allclose(actual, expected, rtol=1e-6, atol=1e-6)
+
+    def test_gather(self):
+        index = np.array([3, 0, 3, 1, 3], dtype="int64")
+        for axis in [0, 1, 2, -1]:
+            self.check(
+                lambda x, i: paddle.gather(x, i, axis=axis), [4, 5, 6], index
+            )
+        self.check(
+            lambda x, i: paddle.gather(x, i),
+            [7, 3],
+            np.array([6, 2], dtype="int32"),
+        )
+
+    def test_index_select(self):
+        index = np.array([2, 2, 0], dtype="int64")
+        for axis in [0, 1, -1]:
+            self.check(
+                lambda x, i: paddle.index_select(x, i, axis=axis),
+                [3, 4, 5],
+                index,
+            )
+
+
+if __name__ == "__main__":
+    unittest.main()
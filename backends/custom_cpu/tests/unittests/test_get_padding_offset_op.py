@@ -0,0 +1,110 @@
+#   Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import os
+import unittest
+
+import numpy as np
+import paddle
+from paddle.base import core
+
+for lib in os.listdir(os.getenv("CUSTOM_DEVICE_ROOT")):
+    if lib.endswith(".so"):
+        paddle.utils.cpp_extension.extension_utils.load_op_meta_info_and_register_op(
+            lib
+        )
+
+
+def ref_get_padding_offset(input_ids, seq_lens):
+    bsz, max_seq_len = input_ids.shape
+    seq_lens = np.clip(seq_lens, 0, max_seq_len)
+    cu_seqlens = np.concatenate([[0], np.cumsum(seq_lens)]).astype("int32")
+    x_remove_padding = np.concatenate(
+        [input_ids[i, : seq_lens[i]] for i in range(bsz)]
+    )
+    cum_offsets_out = (np.arange(bsz) * max_seq_len - cu_seqlens[:-1]).astype(
+        "int32"
+    )
+    padding_offset = np.concatenate(
+        [np.full([seq_lens[i]], cum_offsets_out[i]) for i in range(bsz)]
+    ).astype("int32")
+    return x_remove_padding, cum_offsets_out, padding_offset, cu_seqlens
+
+
+class TestGetPaddingOffset(unittest.TestCase):
+    def setUp(self):
+        paddle.disable_static()
+        paddle.set_device("custom_cpu")
+        self.bsz = 4
+        self.max_seq_len = 16
+        self.seq_lens = np.array([3, 16, 0, 7]).astype("int32")
+        self.input_ids = np.random.randint(
+            0, 1000, [self.bsz, self.max_seq_len]
+        ).astype("int64")
+
+    def run_op(self, op_name):
+        seq_lens = paddle.to_tensor(self.seq_lens)
+        cum_offsets = paddle.cumsum(self.max_seq_len - seq_lens)
+        token_num = paddle.sum(seq_lens).astype("int64")
+        return core.eager._run_custom_op(
+            op_name,
+            paddle.to_tensor(self.input_ids),
+            cum_offsets,
+            token_num,
+            seq_lens,
+        )
+
+    def test_get_padding_offset(self):
+        outs = self.run_op("get_padding_offset")
+        refs = ref_get_padding_offset(self.input_ids, self.seq_lens)
+        for out, ref in zip(outs, refs[:3]):
+            np.testing.assert_array_equal(out.numpy(), ref)
+
+    def test_get_padding_offset_v2(self):
+        outs = self.run_op("get_padding_offset_v2")
+        refs = ref_get_padding_offset(self.input_ids, self.seq_lens)
+        for out, ref in zip(outs, refs + (refs[3],)):
+            np.testing.assert_array_equal(out.numpy(), ref)
+
+    def test_rebuild_padding(self):
+        dim_embed = 8
+        seq_lens = np.clip(self.seq_lens, 0, self.max_seq_len)
+        token_num = int(seq_lens.sum())
+        tmp_out = np.random.random([token_num, dim_embed]).astype("float32")
+        outs = self.run_op("get_padding_offset")
+        out = core.eager._run_custom_op(
+            "rebuild_padding",
+            paddle.to_tensor(tmp_out),
+            outs[1],
+            paddle.to_tensor(self.seq_lens),
+            paddle.to_tensor(self.input_ids),
+        )[0]
+
+        cu_seqlens = np.cumsum(seq_lens)
+        ref = np.zeros([self.bsz, dim_embed]).astype("float32")
+        for i in range(self.bsz):
+            if seq_lens[i] > 0:
+                ref[i] = tmp_out[cu_seqlens[i] - 1]
+        np.testing.assert_allclose(out.numpy(), ref)
+
+
+class TestGetPaddingOffsetOutOfRange(TestGetPaddingOffset):
+    # Lengths outside [0, max_seq_len] are clamped to it.
+    def setUp(self):
+        super().setUp()
+        self.seq_lens = np.array([3, 20, -2, 7]).astype("int32")
+
+
+if __name__ == "__main__":
+    unittest.main()
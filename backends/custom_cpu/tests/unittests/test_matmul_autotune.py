@@ -0,0 +1,59 @@
+# Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import json
+import os
+import tempfile
+import unittest
+
+# The plugin reads the cache location when it is loaded by paddle.
+CACHE_DIR = tempfile.TemporaryDirectory()
+CACHE_PATH = os.path.join(CACHE_DIR.name, "autotune.json")
+os.environ["CUSTOM_CPU_AUTOTUNE_CACHE"] = CACHE_PATH
+
+import numpy as np  # noqa: E402
+import paddle  # noqa: E402
+
+
+class TestMatmulAutotune(unittest.TestCase):
+    def setUp(self):
+        paddle.set_device("custom_cpu")
+        np.random.seed(2024)
+
+    def test_tuned_matmul(self):
+        for transpose_y in [False, True]:
+            x = np.random.uniform(-1, 1, [96, 200]).astype("float32")
+            y = np.random.uniform(-1, 1, [200, 130]).astype("float32")
+            y_in = y.T.copy() if transpose_y else y
+            # The first call tunes, the second dispatches to the winner.
+            for _ in range(2):
+                out = paddle.matmul(
+                    paddle.to_tensor(x),
+                    paddle.to_tensor(y_in),
+                    transpose_y=transpose_y,
+                )
+                np.testing.assert_allclose(out.numpy(), x @ y, rtol=1e-5, atol=1e-5)
+
+        with open(CACHE_PATH) as f:
+            cache = json.load(f)
+        self.assertEqual(cache["version"], 1)
+        entries = {}
+        for table in cache["tables"].values():
+            entries.update(table)
+        self.assertIn("gemm|float32|128x256x256", entries)
+        self.assertIn("gemm|float32|128x256x256_ty", entries)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,119 @@
+# Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import os
+import struct
+import sys
+import tempfile
+import unittest
+
+import numpy as np
+import paddle
+from paddle.base import core
+
+sys.path.append(os.path.join(os.path.dirname(__file__), "..", "..", "tools"))
+from align_params import align_params  # noqa: E402
+
+for lib in os.listdir(os.getenv("CUSTOM_DEVICE_ROOT")):
+    if lib.endswith(".so"):
+        paddle.utils.cpp_extension.extension_utils.load_op_meta_info_and_register_op(
+            lib
+        )
+
+PROTO_TYPES = {"float32": 5, "int64": 3, "float16": 4, "int8": 21}
+
+
+def varint(value):
+    out = bytearray()
+    while value > 0x7F:
+        out.append(value & 0x7F | 0x80)
+        value >>= 7
+    out.append(value)
+    return bytes(out)
+
+
+def write_combined(path, arrays):
+    """Writes arrays in the save_combine layout, data left unaligned."""
+    with open(path, "wb") as f:
+        for array in arrays:
+            desc = b"\x08" + varint(PROTO_TYPES[str(array.dtype)])
+            for dim in array.shape:
+                desc += b"\x10" + varint(dim)
+            f.write(struct.pack("<IQI", 0, 0, 0))
+            f.write(struct.pack("<i", len(desc)) + desc)
+            f.write(np.ascontiguousarray(array).tobytes())
+
+
+class TestMmapLoadCombine(unittest.TestCase):
+    def setUp(self):
+        paddle.disable_static()
+        paddle.set_device("custom_cpu")
+        np.random.seed(2024)
+        self.temp_dir = tempfile.TemporaryDirectory()
+        self.arrays = [
+            np.random.random([3, 5]).astype("float32"),
+            np.random.randint(-100, 100, [7]).astype("int64"),
+            np.random.random([2, 3, 4]).astype("float16"),
+            np.random.randint(-100, 100, [11]).astype("int8"),
+            np.random.random([256, 64]).astype("float32"),
+        ]
+        self.path = os.path.join(self.temp_dir.name, "model.pdiparams")
+        write_combined(self.path, self.arrays)
+
+    def tearDown(self):
+        self.temp_dir.cleanup()
+
+    def load(self, path):
+        params = [paddle.zeros(a.shape, str(a.dtype)) for a in self.arrays]
+        core.eager._run_custom_op("mmap_load_combine", params, path)
+        return params
+
+    def check(self, params):
+        for param, array in zip(params, self.arrays):
+            self.assertEqual(param.dtype, paddle.to_tensor(array).dtype)
+            np.testing.assert_array_equal(param.numpy(), array)
+
+    def test_load(self):
+        # Misaligned parameters are copied, aligned ones mapped.
+        self.check(self.load(self.path))
+
+    def test_load_aligned(self):
+        aligned = os.path.join(self.temp_dir.name, "aligned.pdiparams")
+        self.assertEqual(align_params(self.path, aligned), len(self.arrays))
+        self.check(self.load(aligned))
+
+    def test_write_does_not_touch_file(self):
+        aligned = os.path.join(self.temp_dir.name, "aligned.pdiparams")
+        align_params(self.path, aligned)
+        with open(aligned, "rb") as f:
+            before = f.read()
+        params = self.load(aligned)
+        params[4].add_(paddle.ones_like(params[4]))
+        np.testing.assert_allclose(params[4].numpy(), self.arrays[4] + 1)
+        del params
+        with open(aligned, "rb") as f:
+            self.assertEqual(f.read(), before)
+        self.check(self.load(aligned))
+
+    def test_mismatch(self):
+        params = [paddle.zeros(a.shape, str(a.dtype)) for a in self.arrays[:2]]
+        with self.assertRaises(Exception):
+            core.eager._run_custom_op("mmap_load_combine", params, self.path)
+        params = [paddle.zeros([1], "float32") for _ in self.arrays]
+        with self.assertRaises(Exception):
+            core.eager._run_custom_op("mmap_load_combine", params, self.path)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,133 @@
+# Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import os
+import tempfile
+import unittest
+
+import numpy as np
+import paddle
+
+paddle.enable_static()
+
+LAYOUT_OPS = [
+    "pd_op.conv2d",
+    "pd_op.batch_norm",
+    "pd_op.batch_norm_",
+    "pd_op.pool2d",
+]
+
+
+class TestNhwcLayoutPass(unittest.TestCase):
+    def setUp(self):
+        np.random.seed(2024)
+        self.temp_dir = tempfile.TemporaryDirectory()
+        self.model_prefix = os.path.join(self.temp_dir.name, "nhwc")
+
+        main = paddle.static.Program()
+        startup = paddle.static.Program()
+        with paddle.static.program_guard(main, startup):
+            x = paddle.static.data("x", [-1, 3, 20, 20], "float32")
+            # conv -> bn -> relu -> pool -> conv + residual runs in NHWC,
+            # with the pooled tensor also leaving the chain as an output.
+            conv1 = paddle.nn.Conv2D(3, 8, 3, padding=1)
+            bn = paddle.nn.BatchNorm2D(8)
+            conv2 = paddle.nn.Conv2D(8, 8, 3, padding=1)
+            pooled = paddle.nn.functional.max_pool2d(
+                paddle.nn.functional.relu(bn(conv1(x))), 2
+            )
+            out = paddle.add(conv2(pooled), pooled) * 0.5
+        exe = paddle.static.Executor(paddle.CustomPlace("custom_cpu", 0))
+        exe.run(startup)
+        paddle.static.save_inference_model(
+            self.model_prefix, [x], [pooled, out], exe, program=main
+        )
+
+    def tearDown(self):
+        self.temp_dir.cleanup()
+
+    def create_predictor(self, passes):
+        config = paddle.inference.Config(
+            self.model_prefix + ".json", self.model_prefix + ".pdiparams"
+        )
+        config.enable_custom_device("custom_cpu")
+        config.enable_new_ir(True)
+        config.enable_new_executor(True)
+        if passes:
+            config.enable_custom_passes(passes, True)
+        return paddle.inference.create_predictor(config)
+
+    def optimized_program(self):
+        exe = paddle.static.Executor(paddle.CustomPlace("custom_cpu", 0))
+        program, _, _ = paddle.static.load_inference_model(
+            self.model_prefix, exe
+        )
+        pm = paddle.pir.PassManager()
+        pm.add_pass("cpu_nhwc_layout_pass", {})
+        pm.run(program)
+        return program
+
+    def run_predictor(self, predictor, x):
+        predictor.get_input_handle("x").copy_from_cpu(x)
+        predictor.run()
+        return [
+            predictor.get_output_handle(name).copy_to_cpu()
+            for name in predictor.get_output_names()
+        ]
+
+    def test_matches_nchw(self):
+        nchw = self.create_predictor([])
+        nhwc = self.create_predictor(["cpu_nhwc_layout_pass"])
+        for batch in [1, 3]:
+            x = np.random.uniform(-1, 1, [batch, 3, 20, 20]).astype("float32")
+            expects = self.run_predictor(nchw, x)
+            outs = self.run_predictor(nhwc, x)
+            self.assertEqual(len(outs), len(expects))
+            for out, expect in zip(outs, expects):
+                self.assertEqual(out.shape, expect.shape)
+                np.testing.assert_allclose(out, expect, rtol=1e-5, atol=1e-5)
+
+
+    def test_rewrites_chain(self):
+        ops = self.optimized_program().global_block().ops
+        layout_ops = [op for op in ops if op.name() in LAYOUT_OPS]
+        # conv, bn, pool and conv again, with the conv biases reshaped.
+        self.assertEqual(len(layout_ops), 4)
+        for op in layout_ops:
+            self.assertEqual(op.attrs()["data_format"], "NHWC", op.name())
+
+        # The input goes into NHWC once, and the two outputs come back.
+        to_nhwc, to_nchw = [], []
+        for op in ops:
+            if op.name() != "pd_op.transpose":
+                continue
+            perm = list(op.attrs()["perm"])
+            if perm == [0, 2, 3, 1]:
+                to_nhwc.append(op)
+            else:
+                self.assertEqual(perm, [0, 3, 1, 2])
+                to_nchw.append(op)
+        self.assertEqual(len(to_nhwc), 1)
+        self.assertEqual(
+            to_nhwc[0].operand_source(0).get_defining_op().name(),
+            "pd_op.data",
+        )
+        self.assertEqual(len(to_nchw), 2)
+        for op in to_nchw:
+            for user in op.result(0).all_used_ops():
+                self.assertEqual(user.name(), "pd_op.fetch")
+
+
+if __name__ == "__main__":
+    unittest.main()
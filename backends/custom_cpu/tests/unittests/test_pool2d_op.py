@@ -0,0 +1,92 @@
+# Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import unittest
+
+import numpy as np
+import paddle
+import paddle.nn.functional as F
+
+
+def run(device, fn, x):
+    paddle.set_device(device)
+    tensor = paddle.to_tensor(x, stop_gradient=False)
+    out = fn(tensor)
+    out.backward(paddle.ones_like(out) * 0.5)
+    return out.numpy(), tensor.grad.numpy()
+
+
+def adaptive_max_pool(x, output_size, data_format):
+    # F.adaptive_max_pool2d runs max_pool2d_with_index; adaptive max pooling
+    # through pool2d itself is what this plugin implements.
+    return paddle._C_ops.pool2d(
+        x,
+        output_size,
+        [1, 1],
+        [0, 0],
+        False,
+        True,
+        data_format,
+        "max",
+        False,
+        True,
+        "EXPLICIT",
+    )
+
+
+class TestPool2d(unittest.TestCase):
+    def setUp(self):
+        np.random.seed(2024)
+
+    def check(self, fn, shape):
+        x = np.random.uniform(-1, 1, shape).astype("float32")
+        for actual, expected in zip(run("custom_cpu", fn, x), run("cpu", fn, x)):
+            np.testing.assert_allclose(actual, expected, rtol=1e-5, atol=1e-6)
+
+    def test_max_pool(self):
+        for data_format, shape in [("NCHW", [2, 3, 9, 10]), ("NHWC", [2, 9, 10, 3])]:
+            self.check(
+                lambda x: F.max_pool2d(
+                    x, 3, stride=2, padding=1, data_format=data_format
+                ),
+                shape,
+            )
+            self.check(
+                lambda x: F.max_pool2d(x, 2, data_format=data_format), shape
+            )
+
+    def test_avg_pool(self):
+        for data_format, shape in [("NCHW", [2, 3, 9, 10]), ("NHWC", [2, 9, 10, 3])]:
+            for exclusive in [True, False]:
+                self.check(
+                    lambda x: F.avg_pool2d(
+                        x,
+                        3,
+                        stride=2,
+                        padding=1,
+                        exclusive=exclusive,
+                        data_format=data_format,
+                    ),
+                    shape,
+                )
+
+    def test_adaptive_pool(self):
+        self.check(lambda x: F.adaptive_avg_pool2d(x, [3, 4]), [2, 3, 7, 9])
+        self.check(lambda x: F.adaptive_avg_pool2d(x, 1), [2, 3, 7, 9])
+        for data_format, shape in [("NCHW", [2, 3, 7, 9]), ("NHWC", [2, 7, 9, 3])]:
+            self.check(lambda x: adaptive_max_pool(x, [3, 4], data_format), shape)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,55 @@
+# Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import unittest
+
+import numpy as np
+import paddle
+
+
+def run(device, x, index, updates, overwrite):
+    paddle.set_device(device)
+    x = paddle.to_tensor(x, stop_gradient=False)
+    updates = paddle.to_tensor(updates, stop_gradient=False)
+    out = paddle.scatter(x, paddle.to_tensor(index), updates, overwrite)
+    out.backward(paddle.ones_like(out) * 0.5)
+    return out.numpy(), x.grad.numpy(), updates.grad.numpy()
+
+
+class TestScatter(unittest.TestCase):
+    def setUp(self):
+        np.random.seed(2024)
+
+    def check(self, index, overwrite):
+        x = np.random.uniform(-1, 1, [6, 4, 3]).astype("float32")
+        updates = np.random.uniform(-1, 1, [len(index), 4, 3])
+        updates = updates.astype("float32")
+        for actual, expected in zip(
+            run("custom_cpu", x, index, updates, overwrite),
+            run("cpu", x, index, updates, overwrite),
+        ):
+            np.testing.assert_allclose(actual, expected, rtol=1e-6, atol=1e-6)
+
+    def test_unique_index(self):
+        for overwrite in [True, False]:
+            self.check(np.array([5, 0, 2], dtype="int64"), overwrite)
+
+    def test_duplicate_index(self):
+        # Without overwrite the updates of a row are summed.
+        self.check(np.array([1, 4, 1, 1, 0], dtype="int64"), False)
+        self.check(np.array([1, 4, 1, 1, 0], dtype="int32"), False)
+
+
+if __name__ == "__main__":
+    unittest.main()
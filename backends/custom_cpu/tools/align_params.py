@@ -0,0 +1,152 @@
+# Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""
+Rewrite a combined parameter file (.pdiparams) so that the data of every
+parameter starts on an aligned offset, letting mmap_load_combine map all of
+them instead of copying the misaligned ones.
+
+The TensorDesc of each parameter is padded with an unknown protobuf field,
+which protobuf parsers skip, so the output still loads with load_combine.
+
+    python align_params.py model.pdiparams model.aligned.pdiparams
+"""
+
+import argparse
+import struct
+
+# An unused TensorDesc field number, written as length-delimited padding.
+PADDING_FIELD = 2047
+DEFAULT_ALIGNMENT = 64
+
+
+def _varint(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return bytes(out)
+
+
+def _read_varint(buf, pos):
+    result = shift = 0
+    while True:
+        byte = buf[pos]
+        pos += 1
+        result |= (byte & 0x7F) << shift
+        if not byte & 0x80:
+            return result, pos
+        shift += 7
+
+
+# Bytes per element of the proto::VarType::Type values a parameter can have.
+_ELEMENT_SIZE = {
+    0: 1, 1: 2, 2: 4, 3: 8, 4: 2, 5: 4, 6: 8,
+    20: 1, 21: 1, 22: 2, 23: 8, 24: 16,
+}  # fmt: skip
+
+
+def _desc_numel_bytes(desc):
+    pos, data_type, numel = 0, None, 1
+    while pos < len(desc):
+        key, pos = _read_varint(desc, pos)
+        field, wire_type = key >> 3, key & 7
+        if wire_type == 0:
+            value, pos = _read_varint(desc, pos)
+            if field == 1:
+                data_type = value
+            elif field == 2:
+                numel *= value
+        elif wire_type == 2:
+            length, pos = _read_varint(desc, pos)
+            end = pos + length
+            while field == 2 and pos < end:
+                value, pos = _read_varint(desc, pos)
+                numel *= value
+            pos = end
+        elif wire_type == 1:
+            pos += 8
+        elif wire_type == 5:
+            pos += 4
+        else:
+            raise ValueError(f"unsupported wire type {wire_type}")
+    if data_type not in _ELEMENT_SIZE:
+        raise ValueError(f"unsupported data type {data_type}")
+    return numel * _ELEMENT_SIZE[data_type]
+
+
+def _padding_field(size):
+    """A padding field encoding to exactly size bytes (size >= 3)."""
+    key = _varint(PADDING_FIELD << 3 | 2)
+    for length_bytes in range(1, 6):
+        payload = size - len(key) - length_bytes
+        if payload >= 0 and len(_varint(payload)) == length_bytes:
+            return key + _varint(payload) + bytes(payload)
+    raise ValueError(f"cannot encode {size} bytes of padding")
+
+
+def align_params(src, dst, alignment=DEFAULT_ALIGNMENT):
+    """
+    Copy the combined parameter file src to dst with every parameter's data
+    aligned to alignment bytes. Returns the number of parameters.
+    """
+    with open(src, "rb") as f:
+        buf = f.read()
+    out = bytearray()
+    pos = count = 0
+    while pos < len(buf):
+        # version and lod, copied verbatim
+        start = pos
+        (lod_level,) = struct.unpack_from("<Q", buf, pos + 4)
+        pos += 12
+        for _ in range(lod_level):
+            (lod_bytes,) = struct.unpack_from("<Q", buf, pos)
+            pos += 8 + lod_bytes
+        out += buf[start : pos + 4]  # + tensor version
+        (desc_size,) = struct.unpack_from("<i", buf, pos + 4)
+        pos += 8
+        desc = buf[pos : pos + desc_size]
+        pos += desc_size
+        data_bytes = _desc_numel_bytes(desc)
+
+        pad = -(len(out) + 4 + len(desc)) % alignment
+        if pad:
+            while pad < 3:
+                pad += alignment
+            desc += _padding_field(pad)
+        out += struct.pack("<i", len(desc)) + desc
+        out += buf[pos : pos + data_bytes]
+        pos += data_bytes
+        count += 1
+    with open(dst, "wb") as f:
+        f.write(out)
+    return count
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("src")
+    parser.add_argument("dst")
+    parser.add_argument("--alignment", type=int, default=DEFAULT_ALIGNMENT)
+    args = parser.parse_args()
+    count = align_params(args.src, args.dst, args.alignment)
+    print(f"aligned {count} parameters to {args.alignment} bytes")
+
+
+if __name__ == "__main__":
+    main()
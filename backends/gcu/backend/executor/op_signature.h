@@ -0,0 +1,92 @@
+/* Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace backend {
+
+// XXH64 of len bytes at data.
+uint64_t XXHash64(const void* data, size_t len, uint64_t seed = 0);
+
+// Binary signature identifying a compiled single op program.
+//
+// Callers append the raw fields that determine the program (dims, dtype
+// enums, attribute values, ...) with no text formatting; every variable
+// length field is prefixed with its length so distinct field sequences
+// never produce the same bytes. Finish() hashes the bytes once. Equality
+// compares the bytes, so a hash collision costs a cache miss at worst,
+// never a wrong program.
+class OpSignature {
+ public:
+  OpSignature() { bytes_.reserve(256); }
+
+  void Append(const void* data, size_t size) {
+    bytes_.append(static_cast<const char*>(data), size);
+  }
+
+  template <typename T>
+  void AppendPod(const T& value) {
+    static_assert(std::is_trivially_copyable<T>::value, "POD only");
+    Append(&value, sizeof(T));
+  }
+
+  void AppendString(const std::string& s) {
+    AppendPod<uint64_t>(s.size());
+    Append(s.data(), s.size());
+  }
+
+  template <typename T>
+  void AppendVector(const std::vector<T>& v) {
+    AppendPod<uint64_t>(v.size());
+    Append(v.data(), v.size() * sizeof(T));
+  }
+
+  void AppendVector(const std::vector<bool>& v) {
+    AppendPod<uint64_t>(v.size());
+    for (bool b : v) AppendPod<uint8_t>(b);
+  }
+
+  void AppendVector(const std::vector<std::string>& v) {
+    AppendPod<uint64_t>(v.size());
+    for (const auto& s : v) AppendString(s);
+  }
+
+  void Finish() { hash_ = XXHash64(bytes_.data(), bytes_.size()); }
+
+  uint64_t hash() const { return hash_; }
+  const std::string& bytes() const { return bytes_; }
+
+  // Hex digest, for logs and error messages.
+  std::string ToString() const;
+
+  bool operator==(const OpSignature& other) const {
+    return hash_ == other.hash_ && bytes_ == other.bytes_;
+  }
+
+  struct Hasher {
+    size_t operator()(const OpSignature& s) const { return s.hash(); }
+  };
+
+ private:
+  std::string bytes_;
+  uint64_t hash_ = 0;
+};
+
+}  // namespace backend
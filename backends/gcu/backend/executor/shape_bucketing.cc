@@ -0,0 +1,119 @@
+/* Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "backend/executor/shape_bucketing.h"
+
+#include <cstdlib>
+#include <sstream>
+
+namespace backend {
+namespace {
+
+std::vector<std::string> Split(const std::string& s, char sep) {
+  std::vector<std::string> out;
+  std::string item;
+  std::istringstream is(s);
+  while (std::getline(is, item, sep)) {
+    size_t begin = item.find_first_not_of(" \t");
+    size_t end = item.find_last_not_of(" \t");
+    if (begin == std::string::npos) continue;
+    out.push_back(item.substr(begin, end - begin + 1));
+  }
+  return out;
+}
+
+bool ParseInt(const std::string& s, int64_t* value) {
+  if (s.empty()) return false;
+  char* end = nullptr;
+  *value = strtoll(s.c_str(), &end, 10);
+  return *end == '\0';
+}
+
+}  // namespace
+
+bool ShapeBucketPolicy::Parse(const std::string& spec,
+                              ShapeBucketPolicy* policy,
+                              std::string* error) {
+  ShapeBucketPolicy parsed;
+  for (const auto& entry : Split(spec, ';')) {
+    size_t colon = entry.find(':');
+    if (colon == std::string::npos) {
+      *error = "missing ':' in bucket entry \"" + entry + "\"";
+      return false;
+    }
+    std::string axis_str = entry.substr(0, colon);
+    std::vector<int64_t> boundaries;
+    for (const auto& b : Split(entry.substr(colon + 1), ',')) {
+      int64_t value = 0;
+      if (!ParseInt(b, &value) || value <= 0) {
+        *error = "invalid bucket boundary \"" + b + "\"";
+        return false;
+      }
+      if (!boundaries.empty() && value <= boundaries.back()) {
+        *error = "bucket boundaries must ascend in \"" + entry + "\"";
+        return false;
+      }
+      boundaries.push_back(value);
+    }
+    if (boundaries.empty()) {
+      *error = "no bucket boundaries in \"" + entry + "\"";
+      return false;
+    }
+
+    if (axis_str == "*") {
+      parsed.default_ = boundaries;
+      continue;
+    }
+    int64_t axis = 0;
+    if (!ParseInt(axis_str, &axis) || axis < 0) {
+      *error = "invalid bucket axis \"" + axis_str + "\"";
+      return false;
+    }
+    parsed.per_axis_[axis] = boundaries;
+  }
+  *policy = parsed;
+  return true;
+}
+
+int64_t ShapeBucketPolicy::BucketDim(size_t axis, int64_t value) const {
+  if (value <= 1) return value;
+  auto it = per_axis_.find(axis);
+  const auto& boundaries = it != per_axis_.end() ? it->second : default_;
+  auto bucket = std::lower_bound(boundaries.begin(), boundaries.end(), value);
+  return bucket == boundaries.end() ? value : *bucket;
+}
+
+std::vector<int64_t> ShapeBucketPolicy::BucketDims(
+    const std::vector<int64_t>& dims, size_t ref_rank) const {
+  std::vector<int64_t> out(dims);
+  size_t offset = ref_rank > dims.size() ? ref_rank - dims.size() : 0;
+  for (size_t i = 0; i < dims.size(); ++i) {
+    out[i] = BucketDim(i + offset, dims[i]);
+  }
+  return out;
+}
+
+std::set<std::string> ParseBucketOpList(const std::string& list) {
+  auto ops = Split(list, ',');
+  return std::set<std::string>(ops.begin(), ops.end());
+}
+
+std::string ShapeBucketStats::ToString() const {
+  std::ostringstream os;
+  os << "calls: " << calls() << ", bucketed: " << bucketed()
+     << ", hits: " << hits() << ", compiles: " << compiles();
+  return os.str();
+}
+
+}  // namespace backend
@@ -0,0 +1,152 @@
+/* Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace backend {
+
+// Maps a runtime shape to the shape of the bucket it is compiled for, so that
+// shapes falling into one bucket share a single executable.
+//
+// The spec is a ';' separated list of "<axis>:<b0>,<b1>,..." entries with
+// ascending boundaries, e.g. "0:1,2,4,8;1:128,256,512,1024". The axis "*"
+// sets the boundaries of every axis without an entry of its own. Axes are
+// counted in the frame of the op output; lower rank tensors are right
+// aligned to it like in broadcasting. A dim is rounded up to the smallest
+// boundary not below it. Dims of 0 or 1 and dims above the largest boundary
+// are kept as is, which keeps broadcasting intact and bounds the padding.
+class ShapeBucketPolicy {
+ public:
+  ShapeBucketPolicy() = default;
+
+  // Returns false and fills error if spec is malformed.
+  static bool Parse(const std::string& spec,
+                    ShapeBucketPolicy* policy,
+                    std::string* error);
+
+  bool empty() const { return per_axis_.empty() && default_.empty(); }
+
+  int64_t BucketDim(size_t axis, int64_t value) const;
+
+  // dims of a tensor with dims.size() <= ref_rank, right aligned to
+  // ref_rank axes.
+  std::vector<int64_t> BucketDims(const std::vector<int64_t>& dims,
+                                  size_t ref_rank) const;
+
+ private:
+  std::map<size_t, std::vector<int64_t>> per_axis_;
+  std::vector<int64_t> default_;
+};
+
+// Comma separated op types, e.g. "elementwise_add,relu". Padding is only
+// correct for ops whose results along the bucketed axes do not depend on
+// the padded elements, so bucketing is opt-in per op.
+std::set<std::string> ParseBucketOpList(const std::string& list);
+
+// Counters of the bucketing layer, shared by all ops.
+class ShapeBucketStats {
+ public:
+  // bucketed: the call ran on padded tensors.
+  // hit: the executable for the call's key was already compiled.
+  void Record(bool bucketed, bool hit) {
+    calls_.fetch_add(1, std::memory_order_relaxed);
+    if (bucketed) bucketed_.fetch_add(1, std::memory_order_relaxed);
+    (hit ? hits_ : compiles_).fetch_add(1, std::memory_order_relaxed);
+  }
+
+  uint64_t calls() const { return calls_.load(std::memory_order_relaxed); }
+  uint64_t bucketed() const {
+    return bucketed_.load(std::memory_order_relaxed);
+  }
+  uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+  uint64_t compiles() const {
+    return compiles_.load(std::memory_order_relaxed);
+  }
+
+  std::string ToString() const;
+
+ private:
+  std::atomic<uint64_t> calls_{0};
+  std::atomic<uint64_t> bucketed_{0};
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> compiles_{0};
+};
+
+// Copies the region two row-major tensors have in common (the per-axis
+// minimum of both shapes) from src to dst. Pads when dst is the bucket and
+// slices when src is. The region is walked as maximal contiguous runs and
+// copy(dst_offset, src_offset, bytes) is called once per run; returns the
+// number of runs.
+template <typename CopyFn>
+size_t CopyOverlap(const std::vector<int64_t>& src_dims,
+                   const std::vector<int64_t>& dst_dims,
+                   size_t elem_size,
+                   CopyFn&& copy) {
+  const size_t rank = src_dims.size();
+  if (rank != dst_dims.size()) return 0;
+  for (size_t i = 0; i < rank; ++i) {
+    if (std::min(src_dims[i], dst_dims[i]) <= 0) return 0;
+  }
+
+  // Trailing axes that match in both shapes fold into one run together with
+  // the first mismatching axis.
+  size_t outer = rank;
+  int64_t run = 1;
+  while (outer > 0 && src_dims[outer - 1] == dst_dims[outer - 1]) {
+    run *= src_dims[outer - 1];
+    --outer;
+  }
+  if (outer > 0) {
+    --outer;
+    run *= std::min(src_dims[outer], dst_dims[outer]);
+  }
+
+  std::vector<int64_t> src_strides(rank + 1, 1), dst_strides(rank + 1, 1);
+  for (size_t i = rank; i > 0; --i) {
+    src_strides[i - 1] = src_strides[i] * src_dims[i - 1];
+    dst_strides[i - 1] = dst_strides[i] * dst_dims[i - 1];
+  }
+
+  const size_t run_bytes = run * elem_size;
+  std::vector<int64_t> index(outer, 0);
+  size_t runs = 0;
+  while (true) {
+    int64_t src_off = 0, dst_off = 0;
+    for (size_t i = 0; i < outer; ++i) {
+      src_off += index[i] * src_strides[i + 1];
+      dst_off += index[i] * dst_strides[i + 1];
+    }
+    copy(dst_off * elem_size, src_off * elem_size, run_bytes);
+    ++runs;
+
+    size_t axis = outer;
+    while (axis > 0) {
+      --axis;
+      if (++index[axis] < std::min(src_dims[axis], dst_dims[axis])) break;
+      index[axis] = 0;
+      if (axis == 0) return runs;
+    }
+    if (outer == 0) return runs;
+  }
+}
+
+}  // namespace backend
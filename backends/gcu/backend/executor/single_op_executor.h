@@ -18,9 +18,11 @@ limitations under the License. */
 #include <map>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "backend/executor/gcu_node.h"
+#include "backend/executor/op_signature.h"
 #include "paddle/phi/backends/custom/custom_context.h"
 #include "paddle/phi/core/dense_tensor.h"
 
@@ -68,16 +70,17 @@ class SingleOpGcuExecutorManager {
     single_executors_.clear();
   }
 
-  void Add(const std::string& key,
+  void Add(const OpSignature& key,
            const std::shared_ptr<SingleOpGcuExecutor>& exec) {
     single_executors_[key] = exec;
   }
 
-  std::shared_ptr<SingleOpGcuExecutor> Find(const std::string& key) {
-    if (single_executors_.count(key) == 0) {
+  std::shared_ptr<SingleOpGcuExecutor> Find(const OpSignature& key) {
+    auto it = single_executors_.find(key);
+    if (it == single_executors_.end()) {
       return nullptr;
     }
-    auto exec = single_executors_[key];
+    auto exec = it->second;
     PADDLE_ENFORCE_NE(
         exec, nullptr, phi::errors::NotFound("buffered exec is nullptr"));
     return exec;
@@ -90,7 +93,10 @@ class SingleOpGcuExecutorManager {
   }
 
  private:
-  std::map<std::string, std::shared_ptr<SingleOpGcuExecutor>> single_executors_;
+  std::unordered_map<OpSignature,
+                     std::shared_ptr<SingleOpGcuExecutor>,
+                     OpSignature::Hasher>
+      single_executors_;
 };
 
 }  // namespace backend
@@ -23,3 +23,15 @@ FLAGS_DEFINE_int32(custom_engine_min_group_size,
                    "when the custom device subgraph size is not larger than "
                    "`custom_engine_min_group_size`, the group will fallback to "
                    "original graph.");
+
+FLAGS_DEFINE_string(gcu_shape_buckets,
+                    "",
+                    "Bucket boundaries for JIT single-op compilation, e.g. "
+                    "\"0:1,2,4,8;1:128,256,512\". Inputs of the ops listed "
+                    "in `gcu_shape_bucket_ops` are zero padded up to their "
+                    "bucket so one executable serves every shape in it.");
+
+FLAGS_DEFINE_string(gcu_shape_bucket_ops,
+                    "",
+                    "Comma separated op types that may run on padded "
+                    "inputs, see `gcu_shape_buckets`.");
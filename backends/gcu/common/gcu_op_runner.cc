@@ -14,20 +14,27 @@
 
 #include "common/gcu_op_runner.h"
 
+#include <algorithm>
 #include <map>
 #include <memory>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include "backend/equivalence_trans/all_ops.h"
+#include "backend/executor/shape_bucketing.h"
 #include "backend/executor/single_op_executor.h"
 #include "backend/executor/tops_compiler.h"
 #include "backend/utils/gcu_op_desc.h"
 #include "backend/utils/utils.h"
 #include "common/gcu_funcs.h"
 #include "runtime/flags.h"
+#include "runtime/runtime.h"
+
+FLAGS_DECLARE_string(gcu_shape_buckets);
+FLAGS_DECLARE_string(gcu_shape_bucket_ops);
 
 namespace custom_kernel {
 namespace {
@@ -36,6 +43,55 @@ const char* const kRunningModeSerial = "serial";
 const char* const kPlaceHolder = " ";
 
 static std::set<std::string> kUnusedArchetype = {"ReserveSpace"};
+
+struct ShapeBucketing {
+  backend::ShapeBucketPolicy policy;
+  std::set<std::string> ops;
+  backend::ShapeBucketStats stats;
+};
+
+ShapeBucketing* GetShapeBucketing() {
+  static ShapeBucketing* bucketing = [] {
+    auto* b = new ShapeBucketing();
+    std::string error;
+    PADDLE_ENFORCE_EQ(
+        backend::ShapeBucketPolicy::Parse(
+            FLAGS_gcu_shape_buckets, &b->policy, &error),
+        true,
+        phi::errors::InvalidArgument("Invalid FLAGS_gcu_shape_buckets: %s",
+                                     error.c_str()));
+    b->ops = backend::ParseBucketOpList(FLAGS_gcu_shape_bucket_ops);
+    return b;
+  }();
+  return bucketing;
+}
+
+// Copies the region src and dst have in common, see backend::CopyOverlap.
+void CopyBucketRegion(const phi::CustomContext& dev_ctx,
+                      const DenseTensor& src,
+                      DenseTensor* dst) {
+  auto stream = static_cast<topsStream_t>(dev_ctx.stream());
+  auto src_ptr = static_cast<const char*>(src.data());
+  auto dst_ptr = static_cast<char*>(dst->data());
+  backend::CopyOverlap(
+      phi::vectorize(src.dims()),
+      phi::vectorize(dst->dims()),
+      phi::SizeOf(src.dtype()),
+      [&](size_t dst_offset, size_t src_offset, size_t bytes) {
+        RT_CHECK(topsMemcpyAsync(dst_ptr + dst_offset,
+                                 src_ptr + src_offset,
+                                 bytes,
+                                 topsMemcpyDeviceToDevice,
+                                 stream));
+      });
+}
+
+std::shared_ptr<DenseTensor> MakeBucketTensor(const DenseTensor& tensor,
+                                              const phi::DDim& dims) {
+  auto bucket = std::make_shared<DenseTensor>();
+  bucket->set_meta(phi::DenseTensorMeta(tensor.dtype(), dims, tensor.layout()));
+  return bucket;
+}
 }  // namespace
 
 using GcuOpDesc = backend::GcuOpDesc;
@@ -147,7 +203,9 @@ std::string GcuOpRunner::AttrString(const GcuExecutionContext& ctx) {
   return os.str();
 }
 
-std::string GcuOpRunner::BuildSignature(const GcuExecutionContext& ctx) {
+std::string GcuOpRunner::BuildSignature(
+    const GcuExecutionContext& ctx,
+    const std::unordered_map<const DenseTensor*, phi::DDim>* bucket_dims) {
   auto to_signature = [&](std::ostringstream& os,
                           const TensorNameMap& tensor_names,
                           const TensorValueMap& tensor_values) {
@@ -162,8 +220,12 @@ std::string GcuOpRunner::BuildSignature(const GcuExecutionContext& ctx) {
       for (size_t i = 0; i < rumtime_names.size(); ++i) {
         auto* src_tensor = runtime_vars[i];
         PADDLE_ENFORCE_NOT_NULL(src_tensor);
+        auto dims = src_tensor->dims();
+        if (bucket_dims != nullptr && bucket_dims->count(src_tensor) > 0) {
+          dims = bucket_dims->at(src_tensor);
+        }
         os << "["
-           << "dims: " << src_tensor->dims().to_str()
+           << "dims: " << dims.to_str()
            << ", dtype: " << src_tensor->dtype() << ", index: " << i << "]; ";
       }
       os << " ]; ";
@@ -190,6 +252,73 @@ std::string GcuOpRunner::BuildSignature(const GcuExecutionContext& ctx) {
   return os.str();
 }
 
+backend::OpSignature GcuOpRunner::BuildProgramKey(
+    const GcuExecutionContext& ctx,
+    const std::unordered_map<const DenseTensor*, phi::DDim>* bucket_dims) {
+  backend::OpSignature key;
+  key.AppendString(ctx.Type());
+
+  auto append_tensors = [&](const TensorNameMap& tensor_names,
+                            const TensorValueMap& tensor_values) {
+    key.AppendPod<uint64_t>(tensor_names.size());
+    for (const auto& name_iter : tensor_names) {
+      key.AppendString(name_iter.first);
+      auto& runtime_vars = tensor_values.at(name_iter.first);
+      key.AppendPod<uint64_t>(name_iter.second.size());
+      for (size_t i = 0; i < name_iter.second.size(); ++i) {
+        auto* tensor = runtime_vars[i];
+        PADDLE_ENFORCE_NOT_NULL(tensor);
+        const phi::DDim* dims = &tensor->dims();
+        if (bucket_dims != nullptr) {
+          auto it = bucket_dims->find(tensor);
+          if (it != bucket_dims->end()) dims = &it->second;
+        }
+        key.AppendPod<int32_t>(dims->size());
+        key.Append(dims->Get(), dims->size() * sizeof(int64_t));
+        key.AppendPod<int32_t>(static_cast<int32_t>(tensor->dtype()));
+      }
+    }
+  };
+  append_tensors(ctx.AllInputNames(), ctx.AllInputs());
+  append_tensors(ctx.AllOutputNames(), ctx.AllOutputs());
+
+  const auto& attrs = ctx.Attrs();
+  key.AppendPod<uint64_t>(attrs.size());
+  for (const auto& iter : attrs) {
+    const auto& value = iter.second;
+    key.AppendString(iter.first);
+    key.AppendPod<int32_t>(value.index());
+    if (value.type() == typeid(int)) {
+      key.AppendPod(PADDLE_GET_CONST(int, value));
+    } else if (value.type() == typeid(float)) {
+      key.AppendPod(PADDLE_GET_CONST(float, value));
+    } else if (value.type() == typeid(std::string)) {
+      key.AppendString(PADDLE_GET_CONST(std::string, value));
+    } else if (value.type() == typeid(bool)) {
+      key.AppendPod(PADDLE_GET_CONST(bool, value));
+    } else if (value.type() == typeid(int64_t)) {
+      key.AppendPod(PADDLE_GET_CONST(int64_t, value));
+    } else if (value.type() == typeid(double)) {
+      key.AppendPod(PADDLE_GET_CONST(double, value));
+    } else if (value.type() == typeid(std::vector<int>)) {
+      key.AppendVector(PADDLE_GET_CONST(std::vector<int>, value));
+    } else if (value.type() == typeid(std::vector<float>)) {
+      key.AppendVector(PADDLE_GET_CONST(std::vector<float>, value));
+    } else if (value.type() == typeid(std::vector<std::string>)) {
+      key.AppendVector(PADDLE_GET_CONST(std::vector<std::string>, value));
+    } else if (value.type() == typeid(std::vector<bool>)) {
+      key.AppendVector(PADDLE_GET_CONST(std::vector<bool>, value));
+    } else if (value.type() == typeid(std::vector<int64_t>)) {
+      key.AppendVector(PADDLE_GET_CONST(std::vector<int64_t>, value));
+    } else if (value.type() == typeid(std::vector<double>)) {
+      key.AppendVector(PADDLE_GET_CONST(std::vector<double>, value));
+    }
+  }
+
+  key.Finish();
+  return key;
+}
+
 void GcuOpRunner::CompileAndRun(
     const GcuExecutionContext& ctx,
     const std::vector<TensorNameValuePair>& input_vars,
@@ -198,13 +327,6 @@ void GcuOpRunner::CompileAndRun(
 
   VLOG(3) << "op " << ctx.Type() << " start to run program ";
 
-  std::hash<std::string> hasher;
-  std::string signature = BuildSignature(ctx);
-
-  VLOG(3) << "[JIT_KERNEL] " << ctx.Type() << " signature: " << signature;
-
-  auto program_key = std::to_string(hasher(signature + ctx.Type()));
-
   std::vector<DenseTensor*> inputs;
   std::vector<DenseTensor*> outputs;
   std::vector<std::string> input_names;
@@ -223,24 +345,114 @@ void GcuOpRunner::CompileAndRun(
           << ", output_names: " << output_names.size()
           << ", inputs: " << inputs.size() << ", outputs: " << outputs.size();
 
+  std::unordered_map<const DenseTensor*, phi::DDim> bucket_dims;
+  bool bucketed = GetBucketDims(ctx, inputs, outputs, &bucket_dims);
+
+  auto program_key = BuildProgramKey(ctx, bucketed ? &bucket_dims : nullptr);
+  if (VLOG_IS_ON(3)) {
+    VLOG(3) << "[JIT_KERNEL] " << ctx.Type() << " signature: "
+            << BuildSignature(ctx, bucketed ? &bucket_dims : nullptr)
+            << " program_key: " << program_key.ToString();
+  }
+
+  // Tensors whose shape differs from their bucket are replaced by bucket
+  // shaped ones: inputs are zero padded, outputs are sliced back after the
+  // run.
+  std::vector<DenseTensor*> run_inputs(inputs);
+  std::vector<DenseTensor*> run_outputs(outputs);
+  std::vector<std::shared_ptr<DenseTensor>> bucket_tensors;
+  auto dev_ctx =
+      static_cast<const phi::CustomContext*>(&ctx.GetDeviceContext());
+  if (bucketed) {
+    auto stream = static_cast<topsStream_t>(dev_ctx->stream());
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      auto it = bucket_dims.find(inputs[i]);
+      if (it == bucket_dims.end()) continue;
+      auto bucket = MakeBucketTensor(*inputs[i], it->second);
+      dev_ctx->Alloc(bucket.get(), bucket->dtype());
+      RT_CHECK(topsMemsetAsync(bucket->data(),
+                               0,
+                               bucket->numel() * phi::SizeOf(bucket->dtype()),
+                               stream));
+      CopyBucketRegion(*dev_ctx, *inputs[i], bucket.get());
+      run_inputs[i] = bucket.get();
+      bucket_tensors.emplace_back(bucket);
+    }
+    for (size_t i = 0; i < outputs.size(); ++i) {
+      auto it = bucket_dims.find(outputs[i]);
+      if (it == bucket_dims.end()) continue;
+      auto bucket = MakeBucketTensor(*outputs[i], it->second);
+      // An uninitialized output is unused and stays so in its bucket.
+      if (outputs[i]->initialized()) {
+        dev_ctx->Alloc(bucket.get(), bucket->dtype());
+      }
+      run_outputs[i] = bucket.get();
+      bucket_tensors.emplace_back(bucket);
+    }
+  }
+
   auto manager = backend::SingleOpGcuExecutorManager::GetInstance();
   auto gcu_exec = manager->Find(program_key);
+  auto bucketing = GetShapeBucketing();
+  bucketing->stats.Record(bucketed, gcu_exec != nullptr);
+  VLOG(3) << "op " << ctx.Type() << " bucketed: " << bucketed
+          << ", shape bucket stats: " << bucketing->stats.ToString();
   if (gcu_exec == nullptr) {
     CompileExecutable(
-        ctx, program_key, inputs, outputs, input_names, output_names);
+        ctx, program_key, run_inputs, run_outputs, input_names, output_names);
   }
 
   RunExecutableSync(ctx,
                     program_key,
-                    inputs,
-                    outputs,
+                    run_inputs,
+                    run_outputs,
                     input_names,
                     output_names,
                     tensor_split);
 
+  for (size_t i = 0; i < outputs.size(); ++i) {
+    if (run_outputs[i] != outputs[i] && outputs[i]->initialized()) {
+      CopyBucketRegion(*dev_ctx, *run_outputs[i], outputs[i]);
+    }
+  }
+
   VLOG(3) << "op " << ctx.Type() << " run program finished.";
 }
 
+bool GcuOpRunner::GetBucketDims(
+    const GcuExecutionContext& ctx,
+    const std::vector<DenseTensor*>& inputs,
+    const std::vector<DenseTensor*>& outputs,
+    std::unordered_map<const DenseTensor*, phi::DDim>* bucket_dims) {
+  auto bucketing = GetShapeBucketing();
+  if (bucketing->policy.empty() || bucketing->ops.count(ctx.Type()) == 0 ||
+      outputs.empty()) {
+    return false;
+  }
+  // Uninitialized inputs are folded into constants of their exact shape and
+  // dynamic outputs are resized by the compiler, neither can be padded.
+  size_t ref_rank = 0;
+  for (auto tensor : inputs) {
+    if (!tensor->initialized()) return false;
+  }
+  for (auto tensor : outputs) {
+    auto dims = phi::vectorize(tensor->dims());
+    if (TransformUtil::IsDyn(dims)) return false;
+    ref_rank = std::max(ref_rank, dims.size());
+  }
+
+  auto add = [&](const DenseTensor* tensor) {
+    auto dims = phi::vectorize(tensor->dims());
+    auto bucket = bucketing->policy.BucketDims(dims, ref_rank);
+    if (bucket != dims) {
+      (*bucket_dims)[tensor] = phi::make_ddim(bucket);
+    }
+  };
+  for (auto tensor : inputs) add(tensor);
+  for (auto tensor : outputs) add(tensor);
+  return !bucket_dims->empty();
+}
+
 GcuOpPtr GcuOpRunner::AddGteOp(const DenseTensor* tensor,
                                const std::string& tensor_name,
                                const GcuOpPtr& input) {
@@ -269,14 +481,14 @@ GcuOpPtr GcuOpRunner::AddGteOp(const DenseTensor* tensor,
 
 void GcuOpRunner::CompileExecutable(
     const GcuExecutionContext& ctx,
-    const std::string& program_key_in,
+    const backend::OpSignature& program_key_in,
     const std::vector<DenseTensor*>& inputs,
     const std::vector<DenseTensor*>& outputs,
     const std::vector<std::string>& input_names,
     const std::vector<std::string>& output_names) {  // NOLINT
   auto op_type = ctx.Type();
   VLOG(3) << "OpType " << op_type << " start to compile. ";
-  std::string program_key = program_key_in;
+  backend::OpSignature program_key = program_key_in;
   std::map<std::string, GcuOpPtr> gcu_op_cache;
   std::map<std::string, DenseTensor*> tensor_cache;
 
@@ -284,7 +496,8 @@ void GcuOpRunner::CompileExecutable(
   PADDLE_ENFORCE_NE(
       builder,
       nullptr,
-      phi::errors::Fatal("builfer is nullptr, graph:%s", program_key.c_str()));
+      phi::errors::Fatal("builfer is nullptr, graph:%s",
+                         program_key.ToString().c_str()));
   builder->SetShapeInference(true);
 
   auto func =
@@ -611,13 +824,12 @@ void GcuOpRunner::CompileExecutable(
   }
 
   if (refresh_program_key) {
-    std::hash<std::string> hasher;
-    std::string signature = BuildSignature(ctx);
-
-    VLOG(3) << "[JIT_KERNEL] " << ctx.Type()
-            << " signature(refreshed): " << signature;
-
-    program_key = std::to_string(hasher(signature + ctx.Type()));
+    program_key = BuildProgramKey(ctx);
+    if (VLOG_IS_ON(3)) {
+      VLOG(3) << "[JIT_KERNEL] " << ctx.Type()
+              << " signature(refreshed): " << BuildSignature(ctx)
+              << " program_key: " << program_key.ToString();
+    }
     auto manager = backend::SingleOpGcuExecutorManager::GetInstance();
     auto gcu_exec = manager->Find(program_key);
     if (gcu_exec != nullptr) {
@@ -640,10 +852,12 @@ void GcuOpRunner::CompileExecutable(
 
   auto hlir_module = builder->GetModule();
 
-  VLOG(3) << "Compiler begin to CompileHLIR for program " << program_key;
+  VLOG(3) << "Compiler begin to CompileHLIR for program "
+          << program_key.ToString();
   topsExecutable_t tops_executable =
       backend::CompileTopsExecutable(hlir_module);
-  VLOG(3) << "Compiler CompileHLIR end for program " << program_key;
+  VLOG(3) << "Compiler CompileHLIR end for program "
+          << program_key.ToString();
 
   auto gcu_exec = std::make_shared<backend::SingleOpGcuExecutor>(
       op_type, tops_executable, input_nodes, output_nodes);
@@ -652,7 +866,7 @@ void GcuOpRunner::CompileExecutable(
 
 void GcuOpRunner::RunExecutableSync(
     const GcuExecutionContext& ctx,
-    const std::string& program_key,
+    const backend::OpSignature& program_key,
     const std::vector<DenseTensor*>& inputs,
     const std::vector<DenseTensor*>& outputs,
     const std::vector<std::string>& input_names,
@@ -666,7 +880,7 @@ void GcuOpRunner::RunExecutableSync(
   PADDLE_ENFORCE_NOT_NULL(
       gcu_exec,
       phi::errors::NotFound("Not found executor for program_key:%s",
-                            program_key.c_str()));
+                            program_key.ToString().c_str()));
 
   auto device_context =
       static_cast<const phi::CustomContext*>(&ctx.GetDeviceContext());
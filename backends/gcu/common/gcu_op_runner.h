@@ -17,9 +17,11 @@
 #include <memory>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "backend/executor/op_signature.h"
 #include "backend/utils/utils.h"
 #include "common/gcu_funcs.h"
 
@@ -243,7 +245,26 @@ class GcuOpRunner {
       std::vector<TensorNameValuePair>& output_vars);  // NOLINT
 
   std::string AttrString(const GcuExecutionContext& ctx);
-  std::string BuildSignature(const GcuExecutionContext& ctx);
+  // Human readable form of BuildProgramKey, only built for logging.
+  // bucket_dims overrides the dims of the tensors it contains.
+  std::string BuildSignature(
+      const GcuExecutionContext& ctx,
+      const std::unordered_map<const DenseTensor*, phi::DDim>* bucket_dims =
+          nullptr);
+  // Key of the executor cache: op type, tensor dims and dtypes and attribute
+  // values appended in binary.
+  backend::OpSignature BuildProgramKey(
+      const GcuExecutionContext& ctx,
+      const std::unordered_map<const DenseTensor*, phi::DDim>* bucket_dims =
+          nullptr);
+  // Fills bucket_dims with the tensors whose shape differs from their bucket.
+  // Returns false if the op does not take part in shape bucketing or every
+  // tensor already has its bucket shape.
+  bool GetBucketDims(
+      const GcuExecutionContext& ctx,
+      const std::vector<DenseTensor*>& inputs,
+      const std::vector<DenseTensor*>& outputs,
+      std::unordered_map<const DenseTensor*, phi::DDim>* bucket_dims);
   void CompileAndRun(const GcuExecutionContext& ctx,
                      const std::vector<TensorNameValuePair>& input_vars,
                      const std::vector<TensorNameValuePair>& output_vars,
@@ -252,20 +273,18 @@ class GcuOpRunner {
                     const std::string& tensor_name,
                     const GcuOpPtr& input);
   void CompileExecutable(const GcuExecutionContext& ctx,
-                         const std::string& program_key_in,
+                         const backend::OpSignature& program_key_in,
                          const std::vector<DenseTensor*>& inputs,
                          const std::vector<DenseTensor*>& outputs,
                          const std::vector<std::string>& input_names,
                          const std::vector<std::string>& output_names);
   void RunExecutableSync(const GcuExecutionContext& ctx,
-                         const std::string& program_key,
+                         const backend::OpSignature& program_key,
                          const std::vector<DenseTensor*>& inputs,
                          const std::vector<DenseTensor*>& outputs,
                          const std::vector<std::string>& input_names,
                          const std::vector<std::string>& output_names,
                          bool tensor_split);
-
-  std::map<size_t, topsExecutable_t> executable_cache_;
 };
 
 void GcuRunner(const TensorNameMap& input_names,
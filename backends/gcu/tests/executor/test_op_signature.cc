@@ -0,0 +1,244 @@
+/* Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "backend/executor/op_signature.h"
+
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+using backend::OpSignature;
+using backend::XXHash64;
+
+uint64_t Hash(const std::string& s, uint64_t seed = 0) {
+  return XXHash64(s.data(), s.size(), seed);
+}
+
+// Known answers from the reference implementation, for prefixes of a
+// fixed buffer. The lengths cover every tail path (1, 4 and 8 byte steps)
+// on both sides of the 32 byte stripe loop.
+struct Vector {
+  size_t len;
+  uint64_t seed0;
+  uint64_t seed_prime;
+};
+
+const Vector kVectors[] = {
+    {1, 0xA96C7F0CE858BBB7ULL, 0x84E535B36672440DULL},
+    {3, 0xBED43740EE6332BBULL, 0x00B77B485431CE5DULL},
+    {4, 0xFA212AE44B3BB23DULL, 0x60492C4BFCB70CACULL},
+    {7, 0x2744460DD675D2C0ULL, 0xCDF83B729545B016ULL},
+    {8, 0x994B676B71CE94DDULL, 0xF424EDEBFEA8D23FULL},
+    {12, 0xB92F588CE720786EULL, 0xDDD89BDBF8AA26E0ULL},
+    {31, 0x6711D55E306B5D8FULL, 0xFA1259CC8B20EB58ULL},
+    {32, 0x07F7B8E3BC5D6E25ULL, 0x920F3E10A5DB09C6ULL},
+    {33, 0x09F85EEB4E1CBE9FULL, 0x3D805E8712CB4890ULL},
+    {63, 0xB7C9968C066CB6A5ULL, 0x184BC5097530BB9AULL},
+    {64, 0x50D4159A0411632EULL, 0x94667E10D68B3991ULL},
+    {101, 0x8742D6C2018318FDULL, 0xC62535787E3AE83AULL},
+};
+
+// A simplified op description, keyed the way GcuOpRunner::BuildProgramKey
+// keys the real one.
+struct FakeTensor {
+  std::string name;
+  std::vector<int64_t> dims;
+  int32_t dtype;
+};
+
+struct FakeOp {
+  std::string type;
+  std::vector<FakeTensor> inputs;
+  std::vector<FakeTensor> outputs;
+  std::vector<std::pair<std::string, int>> int_attrs;
+  std::vector<std::pair<std::string, int64_t>> int64_attrs;
+  std::vector<std::pair<std::string, float>> float_attrs;
+  std::vector<std::pair<std::string, std::vector<std::string>>> str_attrs;
+};
+
+OpSignature BuildKey(const FakeOp& op) {
+  OpSignature key;
+  key.AppendString(op.type);
+  auto append_tensors = [&](const std::vector<FakeTensor>& tensors) {
+    key.AppendPod<uint64_t>(tensors.size());
+    for (const auto& tensor : tensors) {
+      key.AppendString(tensor.name);
+      key.AppendPod<int32_t>(tensor.dims.size());
+      key.Append(tensor.dims.data(), tensor.dims.size() * sizeof(int64_t));
+      key.AppendPod<int32_t>(tensor.dtype);
+    }
+  };
+  append_tensors(op.inputs);
+  append_tensors(op.outputs);
+  // Each attribute value follows the index of its type, as in the real key.
+  key.AppendPod<uint64_t>(op.int_attrs.size() + op.int64_attrs.size() +
+                          op.float_attrs.size() + op.str_attrs.size());
+  for (const auto& attr : op.int_attrs) {
+    key.AppendString(attr.first);
+    key.AppendPod<int32_t>(1);
+    key.AppendPod(attr.second);
+  }
+  for (const auto& attr : op.int64_attrs) {
+    key.AppendString(attr.first);
+    key.AppendPod<int32_t>(9);
+    key.AppendPod(attr.second);
+  }
+  for (const auto& attr : op.float_attrs) {
+    key.AppendString(attr.first);
+    key.AppendPod<int32_t>(2);
+    key.AppendPod(attr.second);
+  }
+  for (const auto& attr : op.str_attrs) {
+    key.AppendString(attr.first);
+    key.AppendPod<int32_t>(5);
+    key.AppendVector(attr.second);
+  }
+  key.Finish();
+  return key;
+}
+
+FakeOp Conv() {
+  FakeOp op;
+  op.type = "conv2d";
+  op.inputs = {{"Input", {1, 3, 224, 224}, 10}, {"Filter", {64, 3, 7, 7}, 10}};
+  op.outputs = {{"Output", {1, 64, 112, 112}, 10}};
+  op.int_attrs = {{"groups", 1}};
+  op.float_attrs = {{"alpha", 1.f}};
+  op.str_attrs = {{"data_format", {"NCHW"}}};
+  return op;
+}
+
+}  // namespace
+
+TEST(XXHash64, KnownAnswers) {
+  EXPECT_EQ(Hash(""), 0xEF46DB3751D8E999ULL);
+  EXPECT_EQ(Hash("", 1), 0xD5AFBA1336A3BE4BULL);
+  EXPECT_EQ(Hash("a"), 0xD24EC4F1A98C6E5BULL);
+  EXPECT_EQ(Hash("abc"), 0x44BC2CF5AD770999ULL);
+  EXPECT_EQ(Hash("message digest"), 0x066ED728FCEEB3BEULL);
+  EXPECT_EQ(Hash("abcdefghijklmnopqrstuvwxyz"), 0xCFE1F278FA89835CULL);
+  std::string digits;
+  for (int i = 0; i < 8; ++i) digits += "1234567890";
+  EXPECT_EQ(Hash(digits), 0xE04A477F19EE145DULL);
+  EXPECT_EQ(Hash("abc", 0x9E3779B185EBCA87ULL), 0xA7CB2AAC405E36C7ULL);
+}
+
+TEST(XXHash64, KnownAnswersForEveryTailLength) {
+  std::vector<uint8_t> buf(101);
+  for (size_t i = 0; i < buf.size(); ++i) {
+    buf[i] = static_cast<uint8_t>(i * 131 + 7);
+  }
+  for (const auto& v : kVectors) {
+    EXPECT_EQ(XXHash64(buf.data(), v.len), v.seed0) << "len " << v.len;
+    EXPECT_EQ(XXHash64(buf.data(), v.len, 2654435761ULL), v.seed_prime)
+        << "len " << v.len;
+  }
+}
+
+TEST(XXHash64, IgnoresAlignment) {
+  std::string text = "the quick brown fox jumps over the lazy dog, twice";
+  std::vector<char> storage(text.size() + 8);
+  const uint64_t expect = Hash(text);
+  for (size_t offset = 0; offset < 8; ++offset) {
+    std::memcpy(storage.data() + offset, text.data(), text.size());
+    EXPECT_EQ(XXHash64(storage.data() + offset, text.size()), expect);
+  }
+}
+
+TEST(OpSignature, StableAcrossBuilds) {
+  OpSignature a = BuildKey(Conv());
+  OpSignature b = BuildKey(Conv());
+  EXPECT_EQ(a.bytes(), b.bytes());
+  EXPECT_EQ(a.hash(), b.hash());
+  EXPECT_TRUE(a == b);
+  EXPECT_EQ(a.hash(), XXHash64(a.bytes().data(), a.bytes().size()));
+  EXPECT_EQ(a.ToString().size(), 16u);
+  EXPECT_EQ(a.ToString(), b.ToString());
+}
+
+TEST(OpSignature, DiffersByShapeDtypeAndAttr) {
+  std::vector<FakeOp> ops;
+  ops.push_back(Conv());
+  auto add = [&](void (*edit)(FakeOp*)) {
+    FakeOp op = Conv();
+    edit(&op);
+    ops.push_back(op);
+  };
+  // Shapes: a changed dim, swapped dims, the same numel at another rank.
+  add([](FakeOp* op) { op->inputs[0].dims[0] = 2; });
+  add([](FakeOp* op) { op->inputs[0].dims = {1, 3, 112, 448}; });
+  add([](FakeOp* op) { op->inputs[0].dims = {3, 224, 224}; });
+  add([](FakeOp* op) { op->outputs[0].dims[1] = 32; });
+  // Dtypes.
+  add([](FakeOp* op) { op->inputs[1].dtype = 15; });
+  add([](FakeOp* op) { op->outputs[0].dtype = 15; });
+  // Attribute values, names and types.
+  add([](FakeOp* op) { op->int_attrs[0].second = 2; });
+  add([](FakeOp* op) { op->int_attrs[0].first = "group"; });
+  add([](FakeOp* op) { op->float_attrs[0].second = -1.f; });
+  add([](FakeOp* op) { op->float_attrs[0].second = 1.0000001f; });
+  add([](FakeOp* op) { op->str_attrs[0].second = {"NHWC"}; });
+  add([](FakeOp* op) {
+    op->int_attrs.clear();
+    op->int64_attrs = {{"groups", 1}};
+  });
+  add([](FakeOp* op) { op->int_attrs.clear(); });
+  // Renames, and splits or moves that keep the concatenated text the same.
+  add([](FakeOp* op) { op->type = "conv2"; });
+  add([](FakeOp* op) { op->inputs[0].name = "Inpu"; });
+  add([](FakeOp* op) { op->str_attrs[0].second = {"NC", "HW"}; });
+  add([](FakeOp* op) { op->outputs.push_back(op->inputs[1]); });
+  add([](FakeOp* op) {
+    op->outputs.insert(op->outputs.begin(), op->inputs.back());
+    op->inputs.pop_back();
+  });
+
+  std::vector<OpSignature> keys;
+  for (const auto& op : ops) keys.push_back(BuildKey(op));
+  for (size_t i = 0; i < keys.size(); ++i) {
+    for (size_t j = i + 1; j < keys.size(); ++j) {
+      EXPECT_FALSE(keys[i] == keys[j]) << i << " vs " << j;
+      EXPECT_NE(keys[i].hash(), keys[j].hash()) << i << " vs " << j;
+    }
+  }
+}
+
+TEST(OpSignature, VectorsAreLengthPrefixed) {
+  OpSignature a, b, c;
+  a.AppendVector(std::vector<int64_t>{1, 2});
+  a.AppendVector(std::vector<int64_t>{3});
+  b.AppendVector(std::vector<int64_t>{1});
+  b.AppendVector(std::vector<int64_t>{2, 3});
+  c.AppendVector(std::vector<bool>{true, false});
+  c.AppendVector(std::vector<bool>{});
+  for (auto* key : {&a, &b, &c}) key->Finish();
+  EXPECT_FALSE(a == b);
+  EXPECT_EQ(c.bytes().size(), 2 * sizeof(uint64_t) + 2);
+}
+
+TEST(OpSignature, KeysAnExecutorCache) {
+  std::unordered_map<OpSignature, int, OpSignature::Hasher> cache;
+  cache[BuildKey(Conv())] = 1;
+  FakeOp other = Conv();
+  other.inputs[0].dims[0] = 8;
+  cache[BuildKey(other)] = 2;
+  EXPECT_EQ(cache.size(), 2u);
+  EXPECT_EQ(cache.at(BuildKey(Conv())), 1);
+  EXPECT_EQ(cache.at(BuildKey(other)), 2);
+}
@@ -0,0 +1,288 @@
+/* Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "backend/executor/shape_bucketing.h"
+
+#include <cstring>
+#include <functional>
+#include <numeric>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+using backend::CopyOverlap;
+using backend::ShapeBucketPolicy;
+using backend::ShapeBucketStats;
+
+ShapeBucketPolicy MustParse(const std::string& spec) {
+  ShapeBucketPolicy policy;
+  std::string error;
+  EXPECT_TRUE(ShapeBucketPolicy::Parse(spec, &policy, &error)) << error;
+  return policy;
+}
+
+int64_t Numel(const std::vector<int64_t>& dims) {
+  return std::accumulate(
+      dims.begin(), dims.end(), int64_t(1), std::multiplies<int64_t>());
+}
+
+// Copies the overlap of two host buffers, as GcuOpRunner does on device.
+template <typename T>
+size_t CopyRegion(const std::vector<int64_t>& src_dims,
+                  const T* src,
+                  const std::vector<int64_t>& dst_dims,
+                  T* dst) {
+  return CopyOverlap(
+      src_dims,
+      dst_dims,
+      sizeof(T),
+      [&](size_t dst_offset, size_t src_offset, size_t bytes) {
+        std::memcpy(reinterpret_cast<char*>(dst) + dst_offset,
+                    reinterpret_cast<const char*>(src) + src_offset,
+                    bytes);
+      });
+}
+
+// Stand-in for the single op executor: a program is compiled once per
+// input shape and computes out[n][w] = x[n][w] + bias[w].
+class FakeExecutor {
+ public:
+  // Returns true if a program for dims was already compiled.
+  bool Run(const std::vector<int64_t>& dims,
+           const float* x,
+           const float* bias,
+           float* out) {
+    bool hit = !programs_.insert(dims).second;
+    for (int64_t n = 0; n < dims[0]; ++n) {
+      for (int64_t w = 0; w < dims[1]; ++w) {
+        out[n * dims[1] + w] = x[n * dims[1] + w] + bias[w];
+      }
+    }
+    return hit;
+  }
+
+  size_t programs() const { return programs_.size(); }
+
+ private:
+  std::set<std::vector<int64_t>> programs_;
+};
+
+// Mirrors GcuOpRunner: inputs are zero padded to their buckets, the
+// executor runs on the bucket shapes and the output is sliced back.
+std::vector<float> RunBucketed(const ShapeBucketPolicy& policy,
+                               FakeExecutor* executor,
+                               ShapeBucketStats* stats,
+                               const std::vector<int64_t>& dims,
+                               const std::vector<float>& x,
+                               const std::vector<float>& bias) {
+  const std::vector<int64_t> bias_dims = {dims[1]};
+  auto bucket = policy.BucketDims(dims, dims.size());
+  auto bias_bucket = policy.BucketDims(bias_dims, dims.size());
+  EXPECT_EQ(bias_bucket[0], bucket[1]);
+  const bool bucketed = bucket != dims;
+
+  std::vector<float> out(Numel(dims));
+  if (!bucketed) {
+    bool hit = executor->Run(dims, x.data(), bias.data(), out.data());
+    stats->Record(false, hit);
+    return out;
+  }
+  std::vector<float> run_x(Numel(bucket), 0.f);
+  std::vector<float> run_bias(Numel(bias_bucket), 0.f);
+  std::vector<float> run_out(Numel(bucket), -1.f);
+  CopyRegion(dims, x.data(), bucket, run_x.data());
+  CopyRegion(bias_dims, bias.data(), bias_bucket, run_bias.data());
+  stats->Record(
+      true,
+      executor->Run(bucket, run_x.data(), run_bias.data(), run_out.data()));
+  CopyRegion(bucket, run_out.data(), dims, out.data());
+  return out;
+}
+
+}  // namespace
+
+TEST(ShapeBucketPolicy, BucketsPerAxis) {
+  auto policy = MustParse("0:1,2,4,8; 1:128,256,512 ;*:16,32");
+  EXPECT_FALSE(policy.empty());
+  EXPECT_EQ(policy.BucketDim(0, 3), 4);
+  EXPECT_EQ(policy.BucketDim(0, 8), 8);
+  EXPECT_EQ(policy.BucketDim(1, 129), 256);
+  EXPECT_EQ(policy.BucketDim(1, 128), 128);
+  // Axes without an entry use the "*" boundaries.
+  EXPECT_EQ(policy.BucketDim(2, 17), 32);
+  EXPECT_EQ(policy.BucketDim(5, 3), 16);
+  // 0 and 1 keep broadcasting intact; dims past the last boundary are not
+  // padded.
+  EXPECT_EQ(policy.BucketDim(1, 0), 0);
+  EXPECT_EQ(policy.BucketDim(1, 1), 1);
+  EXPECT_EQ(policy.BucketDim(0, 9), 9);
+  EXPECT_EQ(policy.BucketDim(1, 1000), 1000);
+}
+
+TEST(ShapeBucketPolicy, AxesWithoutBoundariesAreKept) {
+  auto policy = MustParse("1:64");
+  EXPECT_EQ(policy.BucketDim(0, 3), 3);
+  EXPECT_EQ(policy.BucketDim(2, 3), 3);
+  EXPECT_TRUE(MustParse("").empty());
+  EXPECT_TRUE(MustParse(" ; ").empty());
+}
+
+TEST(ShapeBucketPolicy, LowerRankIsRightAligned) {
+  auto policy = MustParse("0:8;1:16;2:32");
+  EXPECT_EQ(policy.BucketDims({3, 5, 7}, 3),
+            (std::vector<int64_t>{8, 16, 32}));
+  EXPECT_EQ(policy.BucketDims({5, 7}, 3), (std::vector<int64_t>{16, 32}));
+  EXPECT_EQ(policy.BucketDims({7}, 3), (std::vector<int64_t>{32}));
+  EXPECT_EQ(policy.BucketDims({1, 7}, 3), (std::vector<int64_t>{1, 32}));
+  EXPECT_EQ(policy.BucketDims({}, 3), std::vector<int64_t>{});
+}
+
+TEST(ShapeBucketPolicy, RejectsMalformedSpecs) {
+  const std::vector<std::string> bad = {
+      "0",          // missing ':'
+      "0:",         // no boundaries
+      "0:4,2",      // not ascending
+      "0:2,2",      // not strictly ascending
+      "0:0,2",      // boundaries are positive
+      "0:2,x",      // not a number
+      "-1:2",       // negative axis
+      "a:2",        // not an axis
+      "0:2;1:3,1",  // a later entry is bad
+  };
+  for (const auto& spec : bad) {
+    auto policy = MustParse("0:64");
+    std::string error;
+    EXPECT_FALSE(ShapeBucketPolicy::Parse(spec, &policy, &error)) << spec;
+    EXPECT_FALSE(error.empty()) << spec;
+    // A failed parse leaves the policy as it was.
+    EXPECT_EQ(policy.BucketDim(0, 3), 64) << spec;
+  }
+}
+
+TEST(ShapeBucketPolicy, ParsesOpList) {
+  EXPECT_EQ(backend::ParseBucketOpList(" relu,elementwise_add ,,relu "),
+            (std::set<std::string>{"elementwise_add", "relu"}));
+  EXPECT_TRUE(backend::ParseBucketOpList("").empty());
+}
+
+TEST(CopyOverlap, PadsAndSlicesBack) {
+  std::mt19937 rng(2024);
+  for (int iter = 0; iter < 200; ++iter) {
+    const size_t rank = 1 + rng() % 4;
+    std::vector<int64_t> dims(rank), bucket(rank);
+    for (size_t i = 0; i < rank; ++i) {
+      dims[i] = static_cast<int64_t>(1 + rng() % 6);
+      bucket[i] = dims[i] + static_cast<int64_t>(rng() % 2 ? 0 : rng() % 3);
+    }
+    std::vector<int> src(Numel(dims));
+    std::iota(src.begin(), src.end(), 1);
+
+    std::vector<int> padded(Numel(bucket), 0);
+    CopyRegion(dims, src.data(), bucket, padded.data());
+    // Every element lands at the same index in the bigger shape, and the
+    // padding stays zero.
+    int64_t nonzero = 0;
+    for (int64_t flat = 0; flat < Numel(bucket); ++flat) {
+      int64_t rest = flat, src_flat = 0, src_stride = 1;
+      bool inside = true;
+      for (size_t i = rank; i > 0; --i) {
+        int64_t index = rest % bucket[i - 1];
+        rest /= bucket[i - 1];
+        inside = inside && index < dims[i - 1];
+        src_flat += index * src_stride;
+        src_stride *= dims[i - 1];
+      }
+      ASSERT_EQ(padded[flat], inside ? src[src_flat] : 0);
+      nonzero += padded[flat] != 0;
+    }
+    EXPECT_EQ(nonzero, Numel(dims));
+
+    std::vector<int> sliced(Numel(dims), 0);
+    CopyRegion(bucket, padded.data(), dims, sliced.data());
+    ASSERT_EQ(sliced, src);
+  }
+}
+
+TEST(CopyOverlap, FoldsMatchingTrailingAxesIntoRuns) {
+  std::vector<float> src(2 * 3 * 4), dst(4 * 3 * 4);
+  // Only axis 0 differs, so the whole overlap is one run.
+  EXPECT_EQ(CopyRegion({2, 3, 4}, src.data(), {4, 3, 4}, dst.data()), 1u);
+  // Axis 1 differs: one run per index of axis 0.
+  dst.resize(2 * 5 * 4);
+  EXPECT_EQ(CopyRegion({2, 3, 4}, src.data(), {2, 5, 4}, dst.data()), 2u);
+  // The last axis differs: one run per row.
+  dst.resize(2 * 3 * 8);
+  EXPECT_EQ(CopyRegion({2, 3, 4}, src.data(), {2, 3, 8}, dst.data()), 6u);
+  // Equal shapes copy everything at once.
+  EXPECT_EQ(CopyRegion({2, 3, 4}, src.data(), {2, 3, 4}, src.data()), 1u);
+}
+
+TEST(CopyOverlap, SkipsEmptyAndMismatchedRanks) {
+  std::vector<float> src(8), dst(8);
+  auto fail = [](size_t, size_t, size_t) { FAIL() << "unexpected copy"; };
+  EXPECT_EQ(CopyOverlap({2, 4}, {8}, sizeof(float), fail), 0u);
+  EXPECT_EQ(CopyOverlap({0, 4}, {2, 4}, sizeof(float), fail), 0u);
+  EXPECT_EQ(CopyOverlap({2, 4}, {2, 0}, sizeof(float), fail), 0u);
+}
+
+TEST(ShapeBucketing, BucketedRunsMatchExactRuns) {
+  auto policy = MustParse("0:2,4,8;1:64,128,256");
+  FakeExecutor bucketed_executor, exact_executor;
+  ShapeBucketStats stats;
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<float> value(-1.f, 1.f);
+  std::set<std::vector<int64_t>> shapes;
+  for (int iter = 0; iter < 300; ++iter) {
+    std::vector<int64_t> dims = {static_cast<int64_t>(1 + rng() % 8),
+                                 static_cast<int64_t>(1 + rng() % 256)};
+    shapes.insert(dims);
+    std::vector<float> x(Numel(dims)), bias(dims[1]);
+    for (auto& v : x) v = value(rng);
+    for (auto& v : bias) v = value(rng);
+
+    auto out = RunBucketed(policy, &bucketed_executor, &stats, dims, x, bias);
+    std::vector<float> expect(out.size());
+    exact_executor.Run(dims, x.data(), bias.data(), expect.data());
+    ASSERT_EQ(out, expect) << "dims " << dims[0] << "x" << dims[1];
+  }
+
+  // At most 4 row buckets (1, 2, 4, 8) times 4 column buckets (1, 64, 128,
+  // 256) are compiled, however many exact shapes were seen.
+  EXPECT_LE(bucketed_executor.programs(), 16u);
+  EXPECT_EQ(exact_executor.programs(), shapes.size());
+  EXPECT_GT(shapes.size(), 16u);
+  EXPECT_EQ(stats.calls(), 300u);
+  EXPECT_EQ(stats.compiles(), bucketed_executor.programs());
+  EXPECT_EQ(stats.hits(), 300u - stats.compiles());
+  EXPECT_GT(stats.bucketed(), 0u);
+  EXPECT_LT(stats.bucketed(), 300u);
+}
+
+TEST(ShapeBucketStats, CountsAndFormats) {
+  ShapeBucketStats stats;
+  stats.Record(true, false);
+  stats.Record(true, true);
+  stats.Record(false, true);
+  EXPECT_EQ(stats.calls(), 3u);
+  EXPECT_EQ(stats.bucketed(), 2u);
+  EXPECT_EQ(stats.hits(), 2u);
+  EXPECT_EQ(stats.compiles(), 1u);
+  EXPECT_EQ(stats.ToString(),
+            "calls: 3, bucketed: 2, hits: 2, compiles: 1");
+}
@@ -0,0 +1,51 @@
+# Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import os
+
+# Shape bucketing only applies to JIT kernels and reads its flags when the
+# plugin is loaded, so both must be set before importing paddle.
+os.environ["PADDLE_GCU_USE_JIT_KERNELS_ONLY"] = "true"
+os.environ["FLAGS_gcu_shape_buckets"] = "0:2,4,8;1:16,32,64"
+os.environ["FLAGS_gcu_shape_bucket_ops"] = "elementwise_add,relu"
+
+import numpy as np
+import paddle
+import unittest
+
+
+class TestShapeBucketing(unittest.TestCase):
+    def setUp(self):
+        paddle.set_device("gcu")
+        np.random.seed(2024)
+
+    def test_elementwise_add_with_broadcast(self):
+        # Every (batch, seq) pair is padded to a bucket; the bias keeps its
+        # exact shape since its axis has no boundaries.
+        for batch, seq in [(1, 5), (3, 17), (2, 16), (5, 33), (9, 70)]:
+            x = np.random.uniform(-1, 1, [batch, seq, 8]).astype("float32")
+            bias = np.random.uniform(-1, 1, [8]).astype("float32")
+            out = paddle.add(paddle.to_tensor(x), paddle.to_tensor(bias))
+            self.assertEqual(list(out.shape), [batch, seq, 8])
+            np.testing.assert_allclose(out.numpy(), x + bias, rtol=1e-6)
+
+    def test_relu(self):
+        for seq in [3, 11, 29, 64]:
+            x = np.random.uniform(-1, 1, [3, seq]).astype("float32")
+            out = paddle.nn.functional.relu(paddle.to_tensor(x))
+            np.testing.assert_allclose(out.numpy(), np.maximum(x, 0))
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -134,7 +134,7 @@ void ArgsortKernel(const phi::Context& dev_ctx,
                                  << " desc=" << descending);
   // TODO(Zhiwei35): support argsort with dims >=3
   PD_CHECK(in_dims.size() < 3, "PoC Lenet/Mnist use case only");
-  auto* q = static_cast<sycl::queue*>(const_cast<void*>(dev_ctx.stream()));
+  auto* q = FlushedQueue(dev_ctx.stream());
   size_t n = 1;
   size_t m = in_dims[0];
 
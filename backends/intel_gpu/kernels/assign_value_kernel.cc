@@ -36,7 +36,7 @@ void AssignValueKernel(const phi::Context& dev_ctx,
   out->Resize({static_cast<int64_t>(out_size)});
   auto out_data = dev_ctx.template Alloc<T>(out);
 
-  auto* q = static_cast<sycl::queue*>(dev_ctx.stream());
+  auto* q = FlushedQueue(dev_ctx.stream());
 
   std::vector<T> assign_values;
   assign_values.reserve(values.size());
@@ -70,7 +70,7 @@ void AssignRawKernel(const phi::Context& dev_ctx,
     auto x_data = x->data<T>();
     auto out_data = dev_ctx.template Alloc<T>(out);
 
-    auto* q = static_cast<sycl::queue*>(dev_ctx.stream());
+    auto* q = FlushedQueue(dev_ctx.stream());
     q->memcpy(out_data, x_data, x->numel());
     q->wait();
   }
@@ -28,7 +28,7 @@ void CastKernel(const phi::Context& dev_ctx,
   auto x_data = x.data<T>();
   out->Resize(x.dims());
   auto numel = x.numel();
-  auto* q = static_cast<sycl::queue*>(dev_ctx.stream());
+  auto* q = FlushedQueue(dev_ctx.stream());
 
   switch (out_dtype) {
     case phi::DataType::BFLOAT16: {
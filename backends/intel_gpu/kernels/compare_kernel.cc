@@ -39,7 +39,7 @@ void RawCompareKernelSycl(const phi::Context& dev_ctx,
   auto out_data = dev_ctx.template Alloc<bool>(out);
   auto numel = out->numel();
 
-  auto* q = static_cast<sycl::queue*>(dev_ctx.stream());
+  auto* q = FlushedQueue(dev_ctx.stream());
   // if float_func == func only func is to be calculated
   if (float_func != func && std::is_floating_point<T>::value) {
     q->parallel_for(numel,
@@ -62,7 +62,7 @@ void RawCompareKernelDNN(const phi::Context& dev_ctx,
                           << dnn_support::type2String<T>::name());
 
   void* stream = const_cast<void*>(dev_ctx.stream());
-  auto* q = static_cast<sycl::queue*>(const_cast<void*>(dev_ctx.stream()));
+  auto* q = FlushedQueue(dev_ctx.stream());
 
   using tag = dnnl::memory::format_tag;
   using dt = dnnl::memory::data_type;
@@ -28,6 +28,10 @@ template <int v>
 struct DeviceConfig {
   size_t chunk_size;
   size_t plugin_verbose;
+  // Async copies of at most copy_coalesce_size bytes are batched into
+  // submissions of up to copy_batch_size bytes; 0 turns batching off.
+  size_t copy_coalesce_size;
+  size_t copy_batch_size;
 
   template <class T>
   T getEnvValue(const char* name, T defaultValue) {
@@ -47,9 +51,16 @@ struct DeviceConfig {
     return ret;
   }
 
-  DeviceConfig() : chunk_size{4}, plugin_verbose{config::vError} {
+  DeviceConfig()
+      : chunk_size{4},
+        plugin_verbose{config::vError},
+        copy_coalesce_size{64 << 10},
+        copy_batch_size{1 << 20} {
     chunk_size = getEnvValue("PLUGIN_CHUNK_SIZE", chunk_size);
     plugin_verbose = getEnvValue("PLUGIN_VERBOSE", plugin_verbose);
+    copy_coalesce_size =
+        getEnvValue("PLUGIN_COPY_COALESCE_SIZE", copy_coalesce_size);
+    copy_batch_size = getEnvValue("PLUGIN_COPY_BATCH_SIZE", copy_batch_size);
     if (plugin_verbose) {
       plugin_verbose |= config::vError;
     }
@@ -64,6 +75,11 @@ extern DeviceConfigPtr devconf;
 extern std::mutex mx;
 extern std::recursive_mutex rmux;
 
+// The queue of a stream, once the copies the runtime is still batching on
+// it have been submitted. Kernels get their queue from here so they see
+// the results of the copies enqueued before them.
+sycl::queue* FlushedQueue(const void* stream);
+
 inline void InitializeDevConf() {
   if (!devconf) {
     std::lock_guard<decltype(mx)> l(mx);
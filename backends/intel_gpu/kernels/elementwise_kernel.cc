@@ -27,7 +27,7 @@ void MultiplyRawKernelGPU(const phi::Context& dev_ctx,
   show_kernel(
       "ElementWise-SYCL-MUL type=" << dnn_support::type2String<T>::name());
   void* stream = const_cast<void*>(dev_ctx.stream());
-  auto* q = static_cast<sycl::queue*>(stream);
+  auto* q = FlushedQueue(stream);
 
   T* out_data = dev_ctx.Alloc<T>(out);
 
@@ -62,7 +62,7 @@ void MultiplyOneDNNRawKernel(const phi::Context& dev_ctx,
                              phi::DenseTensor* out) {
   show_kernel(
       "ElementWise-ONEDNN type=" << dnn_support::type2String<T>::name());
-  auto* q = static_cast<sycl::queue*>(const_cast<void*>(dev_ctx.stream()));
+  auto* q = FlushedQueue(dev_ctx.stream());
 
   using tag = dnnl::memory::format_tag;
   using dt = dnnl::memory::data_type;
@@ -23,7 +23,7 @@ void FullValue(const phi::Context& dev_ctx,
                VType val) {
   show_kernel("FullValue type=" << dnn_support::type2String<T>::name());
   auto t = dev_ctx.template Alloc<T>(tensor);
-  auto* q = static_cast<sycl::queue*>(dev_ctx.stream());
+  auto* q = FlushedQueue(dev_ctx.stream());
   auto num = tensor->numel();
   show_debug("FullValue size=" << num << " sizeof(T)=" << sizeof(T));
   auto e = q->submit([&](sycl::handler& h) { h.fill(t, val, num); });
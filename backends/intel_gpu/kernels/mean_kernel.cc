@@ -25,7 +25,7 @@ void MeanAllKernel(const phi::Context& dev_ctx,
   auto x_data = x.data<T>();
   auto numel = x.numel();
 
-  auto* q = static_cast<sycl::queue*>(dev_ctx.stream());
+  auto* q = FlushedQueue(dev_ctx.stream());
 
   show_kernel("MeanAll, size=" << numel);
 
@@ -53,7 +53,7 @@ void MeanAllGradKernel(const phi::Context& dev_ctx,
   auto x_grad_data = dev_ctx.template Alloc<T>(x_grad);
   auto out_grad_data = out_grad.data<T>();
   auto numel = x_grad->numel();
-  auto* q = static_cast<sycl::queue*>(dev_ctx.stream());
+  auto* q = FlushedQueue(dev_ctx.stream());
 
   show_kernel("MeanAllGrad, size=" << numel);
 
@@ -27,7 +27,7 @@ void MemcpyD2HKernel(const phi::Context& dev_ctx,
   auto out_data = dev_ctx.HostAlloc<T>(out);
   auto x_data = x.data<T>();
   void* stream = const_cast<void*>(dev_ctx.stream());
-  auto* q = static_cast<sycl::queue*>(stream);
+  auto* q = FlushedQueue(stream);
   show_debug("memcpy_d2h -> memcpy(to=" << std::hex << out_data << ", from="
                                         << x_data << ", size=" << std::dec
                                         << x.memory_size() << ")");
@@ -44,7 +44,7 @@ void MemcpyH2DKernel(const phi::Context& dev_ctx,
   auto x_data = x.data<T>();
 
   void* stream = const_cast<void*>(dev_ctx.stream());
-  auto* q = static_cast<sycl::queue*>(stream);
+  auto* q = FlushedQueue(stream);
   show_debug("memcpy_h2d -> memcpy(to=" << std::hex << out_data << ", from="
                                         << x_data << ", size=" << std::dec
                                         << x.memory_size() << ")");
@@ -52,7 +52,7 @@ void ReduceKernel(const phi::Context& dev_ctx,
                   << ", dims=" << dims << ", keep_dim=" << keep_dim
                   << ", reduce_dims=" << reduce_dims);
   void* stream = const_cast<void*>(dev_ctx.stream());
-  auto* q = static_cast<sycl::queue*>(const_cast<void*>(dev_ctx.stream()));
+  auto* q = FlushedQueue(dev_ctx.stream());
   auto out_data = dev_ctx.template Alloc<T>(out);
 
   if (x_dims == reduce_dims) {
@@ -143,7 +143,7 @@ void ReshapeKernel(const phi::Context& dev_ctx,
     auto out_data = out->data<T>();
 
     void* stream = const_cast<void*>(dev_ctx.stream());
-    auto* q = static_cast<sycl::queue*>(stream);
+    auto* q = FlushedQueue(stream);
     q->memcpy(out_data, x_data, x.numel() * sizeof(T));
 
     out->Resize(dims);
@@ -37,7 +37,7 @@ void SliceRawKernel(const phi::Context& ctx,
            "The size of ends must be equal to the size of axes.");
 
   void* stream = const_cast<void*>(ctx.stream());
-  auto* q = static_cast<sycl::queue*>(stream);
+  auto* q = FlushedQueue(stream);
 
   // Step 2: Compute output
   auto in = &input;
@@ -96,7 +96,7 @@ void SoftmaxGradKernel(const phi::Context& dev_ctx,
     return;
   }
 
-  auto* q = static_cast<sycl::queue*>(const_cast<void*>(dev_ctx.stream()));
+  auto* q = FlushedQueue(dev_ctx.stream());
 
   auto eng = dnnl::sycl_interop::make_engine(q->get_device(), q->get_context());
   auto engine_stream = dnnl::sycl_interop::make_stream(eng, *q);
@@ -162,7 +162,7 @@ void SoftmaxKernel(const phi::Context& ctx,
 
     using tag = dnnl::memory::format_tag;
     using dt = dnnl::memory::data_type;
-    auto* q = static_cast<sycl::queue*>(const_cast<void*>(ctx.stream()));
+    auto* q = FlushedQueue(ctx.stream());
 
     auto eng =
         dnnl::sycl_interop::make_engine(q->get_device(), q->get_context());
@@ -26,7 +26,7 @@ void TransposeKernelGPU(const phi::Context& ctx,
   show_kernel("TransposeKernelGPU ");
   using tag = dnnl::memory::format_tag;
   using dt = dnnl::memory::data_type;
-  auto* q = static_cast<sycl::queue*>(const_cast<void*>(ctx.stream()));
+  auto* q = FlushedQueue(ctx.stream());
 
   auto eng = dnnl::sycl_interop::make_engine(q->get_device(), q->get_context());
   auto engine_stream = dnnl::sycl_interop::make_stream(eng, *q);
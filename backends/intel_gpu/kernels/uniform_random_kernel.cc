@@ -79,7 +79,7 @@ void UniformRandomRawKernel(const phi::Context &dev_ctx,
   }
 
   // 2. CPU Copy to IntelGPU
-  auto *q = static_cast<sycl::queue *>(dev_ctx.stream());
+  auto *q = FlushedQueue(dev_ctx.stream());
   q->memcpy(out_data, cpu_data, numel * sizeof(T));
 }
 
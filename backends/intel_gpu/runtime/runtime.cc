@@ -20,6 +20,7 @@
 
 #include "kernels/dnn_support.hpp"
 #include "paddle/phi/backends/device_ext.h"
+#include "runtime/stream_registry.h"
 
 #define MEMORY_FRACTION 0.5f
 
@@ -46,62 +47,64 @@ auto intel_match = [](sycl::device &dev) -> bool {  // NOLINT
   return (name.find("Intel(R) Graphics") != std::string::npos) ? true : false;
 };
 
+// Stream handles are Stream pointers converted to sycl::queue*, which is
+// what kernels cast them back to.
+using Stream = BatchedStream<sycl::queue>;
+
+inline Stream *ToStream(const void *stream) {
+  return static_cast<Stream *>(
+      static_cast<sycl::queue *>(const_cast<void *>(stream)));
+}
+
+inline C_Stream ToHandle(Stream *stream) {
+  return reinterpret_cast<C_Stream>(static_cast<sycl::queue *>(stream));
+}
+
+constexpr size_t kMaxStreams = 1024;
+
 struct DeviceCtx {
   sycl::device _dev;
-  std::vector<std::unique_ptr<sycl::queue>> _streams;
-  bool _def_stream;
+  std::unique_ptr<StreamRegistry<Stream>> _streams;
+  // Used for allocations and synchronous copies.
+  Stream *_default_stream;
   size_t allocated_mem;
   size_t _dev_memory_size;
   DeviceCtx(sycl::device dev)  // NOLINT
       : _dev{std::move(dev)},
-        _def_stream{true},
+        _streams{std::make_unique<StreamRegistry<Stream>>(kMaxStreams)},
         allocated_mem{0},
         _dev_memory_size(_dev.get_info<sycl::info::device::global_mem_size>()) {
+    _default_stream = create_stream();
   }
 
-  sycl::queue *create_stream() {
-    auto u_ptr = std::make_unique<sycl::queue>(_dev);
-    _streams.push_back(std::move(u_ptr));
-
-    return &(*(*(_streams.rbegin())));
+  Stream *create_stream() {
+    InitializeDevConf();
+    return _streams->Add(std::make_unique<Stream>(
+        devconf->copy_coalesce_size, devconf->copy_batch_size, _dev));
   }
 
-  sycl::queue *getDefaultOrCreate() {
-    if (_def_stream && _streams.size()) {
-      _def_stream = false;
-      return _streams[0].get();
-    }
-
-    return create_stream();
-  }
+  sycl::queue &getStream() { return *_default_stream; }
 
-  sycl::queue &getStream(size_t index = 0) {
-    if (!_streams.size()) create_stream();
-    return *(_streams[index]);
+  // Submits the copies every stream is still batching, before memory they
+  // may touch is freed or accessed synchronously.
+  void flush() {
+    _streams->ForEach([](Stream *stream) { stream->Flush(); });
   }
 
-  void copy(sycl::queue &q,  // NOLINT
-            void *dst,
-            const void *src,
-            size_t size) {
+  void copy(void *dst, const void *src, size_t size) {
+    flush();
+    auto &q = getStream();
     q.submit([&](sycl::handler &h) { h.memcpy(dst, src, size); });
     q.wait();
   }
 
-  void copy(void *dst, const void *src, size_t size) {
-    copy(getStream(), dst, src, size);
-  }
-
-  sycl::queue &getStream(C_Stream stream) {
-    auto it = std::find_if(
-        _streams.begin(), _streams.end(), [stream](auto &single_stream) {
-          return single_stream.get() == reinterpret_cast<sycl::queue *>(stream);
-        });
-
-    if (it == _streams.end()) {
+  Stream &getStream(C_Stream stream) {
+    auto found = _streams->Find(ToStream(stream));
+    if (!found) {
       show_error("*FATAL ERROR STREAM not found*");
+      return *_default_stream;
     }
-    return **it;
+    return *found;
   }
 
   size_t getMemorySize() { return _dev_memory_size; }
@@ -115,6 +118,13 @@ struct DeviceCtx {
 
 std::vector<DeviceCtx> reg_dev;
 
+sycl::queue *FlushedQueue(const void *stream) {
+  if (!stream) return nullptr;
+  auto dev_stream = ToStream(stream);
+  dev_stream->Flush();
+  return dev_stream;
+}
+
 C_Status InitDevice(const C_Device device) {
   InitializeDevConf();
   show_debug("init-device : device->id=" << device->id);
@@ -177,22 +187,49 @@ C_Status MemCpy(const C_Device device,
   return C_SUCCESS;
 }
 
+// Small adjacent copies are batched on the stream, see CopyCoalescer.
 C_Status AsyncMemCpy(const C_Device device,
                      C_Stream stream,
                      void *dst,
                      const void *src,
-                     size_t size) {
+                     size_t size,
+                     CopyCoalescer::Kind kind) {
   show_debug("async-memcpy  dst=" << dst << " src=" << src << " size=" << size);
 
-  auto &dev_ctx = reg_dev[device->id];
-
-  auto &dev_stream = dev_ctx.getStream(stream);
+  auto &dev_stream = reg_dev[device->id].getStream(stream);
 
-  dev_ctx.copy(dev_stream, dst, src, size);
+  dev_stream.Copy(kind, dst, src, size);
 
   return C_SUCCESS;
 }
 
+C_Status AsyncMemCpyH2D(const C_Device device,
+                        C_Stream stream,
+                        void *dst,
+                        const void *src,
+                        size_t size) {
+  return AsyncMemCpy(
+      device, stream, dst, src, size, CopyCoalescer::kHostToDevice);
+}
+
+C_Status AsyncMemCpyD2D(const C_Device device,
+                        C_Stream stream,
+                        void *dst,
+                        const void *src,
+                        size_t size) {
+  return AsyncMemCpy(
+      device, stream, dst, src, size, CopyCoalescer::kDeviceToDevice);
+}
+
+C_Status AsyncMemCpyD2H(const C_Device device,
+                        C_Stream stream,
+                        void *dst,
+                        const void *src,
+                        size_t size) {
+  return AsyncMemCpy(
+      device, stream, dst, src, size, CopyCoalescer::kDeviceToHost);
+}
+
 C_Status MemCpyP2P(const C_Device dst_device,
                    const C_Device src_device,
                    void *dst,
@@ -249,6 +286,8 @@ C_Status Allocate(const C_Device device, void **ptr, size_t size) {
 C_Status Deallocate(const C_Device device, void *ptr, size_t size) {
   show_memory("deallocate size=" << size);
 
+  reg_dev[device->id].flush();
+
   auto &stream = reg_dev[device->id].getStream();
 
   sycl::free(ptr, stream);
@@ -261,7 +300,12 @@ C_Status Deallocate(const C_Device device, void *ptr, size_t size) {
 C_Status CreateStream(const C_Device device, C_Stream *stream) {
   show_debug("create-stream for device=" << device->id);
 
-  *stream = reinterpret_cast<C_Stream>(reg_dev[device->id].create_stream());
+  auto created = reg_dev[device->id].create_stream();
+  if (!created) {
+    show_error("Can't create more than " << kMaxStreams << " streams");
+    return C_FAILED;
+  }
+  *stream = ToHandle(created);
 
   return C_SUCCESS;
 }
@@ -270,29 +314,59 @@ C_Status DestroyStream(const C_Device device, C_Stream stream) {
   show_debug("destroy-stream device->id=" << device->id
                                           << " stream=" << stream);
 
-  auto &_streams = reg_dev[device->id]._streams;
-  auto it = std::find_if(
-      _streams.begin(), _streams.end(), [stream](auto &single_stream) {
-        return single_stream.get() == reinterpret_cast<sycl::queue *>(stream);
-      });
-
-  if (it != _streams.end()) _streams.erase(it);
+  auto &streams = reg_dev[device->id]._streams;
+  auto found = streams->Find(ToStream(stream));
+  if (found) {
+    found->Flush();
+    auto stats = found->stats();
+    show_debug("destroy-stream copies=" << stats.copies
+                                        << " submissions=" << stats.submissions
+                                        << " coalesced=" << stats.coalesced);
+    streams->Remove(found);
+  }
 
   return C_SUCCESS;
 }
 
+// The stream an event was last recorded on. Kernels and submitted copies
+// complete in order, so only copies still batched on that stream can be
+// behind the event. The slot is kept so a stream destroyed since is
+// recognised without touching it.
+struct C_Event_st {
+  Stream *stream = nullptr;
+  size_t registry_index = 0;
+};
+
+// The stream event was recorded on, with its batched copies submitted, or
+// nullptr if it is gone.
+Stream *FlushRecordingStream(const C_Device device, C_Event event) {
+  if (!event) return nullptr;
+  auto found = reg_dev[device->id]._streams->Find(event->registry_index,
+                                                  event->stream);
+  if (found) found->Flush();
+  return found;
+}
+
 C_Status CreateEvent(const C_Device device, C_Event *event) {
   show_debug("create-event devid=" << device->id);
+  *event = new C_Event_st();
   return C_SUCCESS;
 }
 
 C_Status RecordEvent(const C_Device device, C_Stream stream, C_Event event) {
   show_debug("record-event devid=" << device->id);
+  auto &dev_ctx = reg_dev[device->id];
+  auto &recording =
+      stream ? dev_ctx.getStream(stream) : *dev_ctx._default_stream;
+  recording.Flush();
+  event->stream = &recording;
+  event->registry_index = recording.registry_index;
   return C_SUCCESS;
 }
 
 C_Status DestroyEvent(const C_Device device, C_Event event) {
   show_debug("destroy-event devid=" << device->id);
+  delete event;
   return C_SUCCESS;
 }
 
@@ -300,15 +374,17 @@ C_Status SyncDevice(const C_Device device) {
   show_debug("sync-device devid=" << device->id);
   auto &dev_ctx = reg_dev[device->id];
 
-  for (auto &stream : dev_ctx._streams) {
-    stream->wait();  // ???????
-  }
+  dev_ctx._streams->ForEach([](Stream *stream) {
+    stream->Flush();
+    stream->wait();
+  });
   return C_SUCCESS;
 }
 
 C_Status SyncStream(const C_Device device, C_Stream stream) {
   show_debug("sync-stream devid=" << device->id);
-  auto ret_stream = reg_dev[device->id].getStream(stream);
+  auto &ret_stream = reg_dev[device->id].getStream(stream);
+  ret_stream.Flush();
   ret_stream.wait();
 
   return C_SUCCESS;
@@ -316,14 +392,18 @@ C_Status SyncStream(const C_Device device, C_Stream stream) {
 
 C_Status SyncEvent(const C_Device device, C_Event event) {
   show_debug("sync-event devid=" << device->id);
+  auto recording = FlushRecordingStream(device, event);
+  if (recording) recording->wait();
   return C_SUCCESS;
 }
 
+// Flushing submits and completes the copies the recording stream still
+// batches, so none of them can land after work queued on stream.
 C_Status StreamWaitEvent(const C_Device device,
                          C_Stream stream,
                          C_Event event) {
   show_debug("stream-wait-event devid=" << device->id);
-
+  FlushRecordingStream(device, event);
   return C_SUCCESS;
 }
 
@@ -427,9 +507,9 @@ void InitPlugin(CustomRuntimeParams *params) {
   params->interface->memory_copy_d2h = MemoryCopyD2H;
 
   params->interface->memory_copy_p2p = MemCpyP2P;
-  params->interface->async_memory_copy_h2d = AsyncMemCpy;
-  params->interface->async_memory_copy_d2d = AsyncMemCpy;
-  params->interface->async_memory_copy_d2h = AsyncMemCpy;
+  params->interface->async_memory_copy_h2d = AsyncMemCpyH2D;
+  params->interface->async_memory_copy_d2d = AsyncMemCpyD2D;
+  params->interface->async_memory_copy_d2h = AsyncMemCpyD2H;
   params->interface->async_memory_copy_p2p = AsyncMemCpyP2P;
   params->interface->device_memory_allocate = Allocate;
   params->interface->host_memory_allocate = Allocate;
@@ -0,0 +1,257 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Merges memcpys enqueued back to back on a stream into one submission,
+// as long as each continues where the previous one ended and all are
+// small. Small host to device copies are staged in a host buffer, so only
+// their destinations need to be adjacent, and the caller may reuse the
+// source as soon as the copy is enqueued. Device to host copies are never
+// deferred: the host reads their destination right after.
+//
+// Not thread safe; BatchedStream serializes the calls.
+class CopyCoalescer {
+ public:
+  enum Kind { kHostToDevice, kDeviceToDevice, kDeviceToHost };
+
+  struct Stats {
+    uint64_t copies = 0;
+    uint64_t submissions = 0;
+    // Copies that went out as part of a larger submission.
+    uint64_t coalesced = 0;
+  };
+
+  // small_size 0 turns coalescing off.
+  CopyCoalescer(size_t small_size, size_t max_batch)
+      : small_size_(std::min(small_size, max_batch)), max_batch_(max_batch) {}
+
+  // submit(dst, src, size) must be done reading src when it returns.
+  template <typename Submit>
+  void Add(Kind kind,
+           void* dst,
+           const void* src,
+           size_t size,
+           Submit&& submit) {
+    ++stats_.copies;
+    bool small = kind != kDeviceToHost && size <= small_size_;
+    if (!small || !Continues(kind, dst, src, size)) Flush(submit);
+    if (!small) {
+      ++stats_.submissions;
+      submit(dst, src, size);
+      return;
+    }
+    if (run_copies_ == 0) {
+      run_kind_ = kind;
+      run_dst_ = static_cast<char*>(dst);
+      run_src_ = static_cast<const char*>(src);
+    }
+    if (kind == kHostToDevice) {
+      if (staging_.empty()) staging_.resize(max_batch_);
+      std::memcpy(staging_.data() + run_size_, src, size);
+    }
+    run_size_ += size;
+    ++run_copies_;
+  }
+
+  template <typename Submit>
+  void Flush(Submit&& submit) {
+    if (run_copies_ == 0) return;
+    const void* src =
+        run_kind_ == kHostToDevice ? staging_.data() : run_src_;
+    ++stats_.submissions;
+    if (run_copies_ > 1) stats_.coalesced += run_copies_;
+    size_t size = run_size_;
+    run_size_ = 0;
+    run_copies_ = 0;
+    submit(run_dst_, src, size);
+  }
+
+  bool pending() const { return run_copies_ != 0; }
+
+  const Stats& stats() const { return stats_; }
+
+ private:
+  bool Continues(Kind kind, void* dst, const void* src, size_t size) const {
+    return run_copies_ != 0 && kind == run_kind_ &&
+           dst == run_dst_ + run_size_ && run_size_ + size <= max_batch_ &&
+           (kind == kHostToDevice || src == run_src_ + run_size_);
+  }
+
+  const size_t small_size_;
+  const size_t max_batch_;
+  Kind run_kind_ = kDeviceToDevice;
+  char* run_dst_ = nullptr;
+  const char* run_src_ = nullptr;
+  size_t run_size_ = 0;
+  size_t run_copies_ = 0;
+  std::vector<char> staging_;
+  Stats stats_;
+};
+
+// A queue plus the copies still being batched on it. The queue is the
+// base, so the stream handle handed to Paddle works as a Queue* for the
+// kernels and as the stream (and its registry slot) for the runtime.
+//
+// Queue needs memcpy(dst, src, size) returning something with wait().
+// Copies on different streams never share a lock, and Flush on a stream
+// with nothing batched does not lock at all.
+template <typename Queue>
+class BatchedStream : public Queue {
+ public:
+  template <typename... Args>
+  BatchedStream(size_t small_size, size_t max_batch, Args&&... args)
+      : Queue(std::forward<Args>(args)...), copies_(small_size, max_batch) {}
+
+  void Copy(CopyCoalescer::Kind kind,
+            void* dst,
+            const void* src,
+            size_t size) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    copies_.Add(kind, dst, src, size, Submitter{this});
+    pending_.store(copies_.pending(), std::memory_order_release);
+  }
+
+  // Submits the batched copies; they have completed when it returns.
+  void Flush() {
+    if (!pending_.load(std::memory_order_acquire)) return;
+    std::lock_guard<std::mutex> guard(mutex_);
+    copies_.Flush(Submitter{this});
+    pending_.store(false, std::memory_order_release);
+  }
+
+  CopyCoalescer::Stats stats() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return copies_.stats();
+  }
+
+  size_t registry_index = 0;
+
+ private:
+  struct Submitter {
+    void operator()(void* dst, const void* src, size_t size) const {
+      stream->Queue::memcpy(dst, src, size).wait();
+    }
+    BatchedStream* stream;
+  };
+
+  std::mutex mutex_;
+  std::atomic<bool> pending_{false};
+  CopyCoalescer copies_;
+};
+
+// Streams of one device. A stream knows its slot, so Find is a bounds
+// check and one atomic load; only adding, removing and visiting every
+// stream lock.
+//
+// Stream needs a size_t registry_index member.
+template <typename Stream>
+class StreamRegistry {
+ public:
+  explicit StreamRegistry(size_t capacity)
+      : capacity_(capacity), slots_(new std::atomic<Stream*>[capacity]) {
+    for (size_t i = 0; i < capacity_; ++i) slots_[i].store(nullptr);
+  }
+
+  ~StreamRegistry() {
+    for (size_t i = 0; i < end_; ++i) delete slots_[i].load();
+  }
+
+  StreamRegistry(const StreamRegistry&) = delete;
+  StreamRegistry& operator=(const StreamRegistry&) = delete;
+
+  // Takes ownership of stream. Returns nullptr when every slot is taken.
+  Stream* Add(std::unique_ptr<Stream> stream) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    size_t index;
+    if (!free_.empty()) {
+      index = free_.back();
+      free_.pop_back();
+    } else if (end_ < capacity_) {
+      index = end_++;
+    } else {
+      return nullptr;
+    }
+    stream->registry_index = index;
+    Stream* added = stream.release();
+    slots_[index].store(added, std::memory_order_release);
+    ++size_;
+    return added;
+  }
+
+  // Returns stream if it is in the registry, nullptr otherwise. stream
+  // must be nullptr or point to a stream not yet removed.
+  Stream* Find(Stream* stream) const {
+    if (stream == nullptr || stream->registry_index >= capacity_) {
+      return nullptr;
+    }
+    return slots_[stream->registry_index].load(std::memory_order_acquire) ==
+                   stream
+               ? stream
+               : nullptr;
+  }
+
+  // Returns stream if it is still in slot index, which was its
+  // registry_index. Unlike Find, stream may have been removed already.
+  Stream* Find(size_t index, Stream* stream) const {
+    if (stream == nullptr || index >= capacity_) return nullptr;
+    return slots_[index].load(std::memory_order_acquire) == stream ? stream
+                                                                   : nullptr;
+  }
+
+  // Deletes stream. Returns false if it is not in the registry.
+  bool Remove(Stream* stream) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (Find(stream) == nullptr) return false;
+    slots_[stream->registry_index].store(nullptr, std::memory_order_release);
+    free_.push_back(stream->registry_index);
+    --size_;
+    delete stream;
+    return true;
+  }
+
+  template <typename Fn>
+  void ForEach(Fn&& fn) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    for (size_t i = 0; i < end_; ++i) {
+      Stream* stream = slots_[i].load(std::memory_order_relaxed);
+      if (stream != nullptr) fn(stream);
+    }
+  }
+
+  size_t size() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return size_;
+  }
+
+ private:
+  const size_t capacity_;
+  std::unique_ptr<std::atomic<Stream*>[]> slots_;
+  mutable std::mutex mutex_;
+  std::vector<size_t> free_;
+  // Slots at or past end_ have never been used.
+  size_t end_ = 0;
+  size_t size_ = 0;
+};
@@ -0,0 +1,209 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "runtime/stream_registry.h"
+
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+// Host-only stand-in for sycl::queue: memcpy copies right away and counts
+// submissions.
+class FakeQueue {
+ public:
+  struct Event {
+    void wait() {}
+  };
+
+  explicit FakeQueue(int id) : id(id) {}
+
+  Event memcpy(void* dst, const void* src, size_t size) {
+    std::memcpy(dst, src, size);
+    ++submissions;
+    sizes.push_back(size);
+    return Event();
+  }
+
+  int id;
+  int submissions = 0;
+  std::vector<size_t> sizes;
+};
+
+using Stream = BatchedStream<FakeQueue>;
+using Kind = CopyCoalescer::Kind;
+
+}  // namespace
+
+TEST(StreamRegistry, FindIsBySlot) {
+  StreamRegistry<Stream> registry(2);
+  Stream* a = registry.Add(std::make_unique<Stream>(64, 1024, 1));
+  Stream* b = registry.Add(std::make_unique<Stream>(64, 1024, 2));
+  ASSERT_NE(a, nullptr);
+  ASSERT_NE(b, nullptr);
+  EXPECT_EQ(registry.Add(std::make_unique<Stream>(64, 1024, 3)), nullptr);
+  EXPECT_EQ(registry.Find(a), a);
+  EXPECT_EQ(registry.Find(b), b);
+  EXPECT_EQ(registry.Find(nullptr), nullptr);
+
+  // The handle kernels see is the queue itself.
+  auto* handle = static_cast<void*>(static_cast<FakeQueue*>(b));
+  EXPECT_EQ(static_cast<FakeQueue*>(handle)->id, 2);
+  auto* queue = static_cast<FakeQueue*>(handle);
+  EXPECT_EQ(registry.Find(static_cast<Stream*>(queue)), b);
+
+  EXPECT_TRUE(registry.Remove(a));
+  EXPECT_EQ(registry.size(), 1u);
+  // The free slot is reused.
+  Stream* c = registry.Add(std::make_unique<Stream>(64, 1024, 3));
+  ASSERT_NE(c, nullptr);
+  EXPECT_EQ(c->registry_index, 0u);
+  EXPECT_EQ(registry.Find(c), c);
+
+  // A stream of another registry is not found, even in a used slot.
+  StreamRegistry<Stream> other(2);
+  Stream* foreign = other.Add(std::make_unique<Stream>(64, 1024, 4));
+  EXPECT_EQ(registry.Find(foreign), nullptr);
+  EXPECT_FALSE(registry.Remove(foreign));
+
+  int visited = 0;
+  registry.ForEach([&](Stream* stream) { ++visited; });
+  EXPECT_EQ(visited, 2);
+}
+
+TEST(StreamRegistry, FindBySlotAfterRemove) {
+  // Events keep the slot of their stream, which may be destroyed first.
+  StreamRegistry<Stream> registry(2);
+  Stream* a = registry.Add(std::make_unique<Stream>(64, 1024, 1));
+  ASSERT_NE(a, nullptr);
+  const size_t index = a->registry_index;
+  EXPECT_EQ(registry.Find(index, a), a);
+  EXPECT_EQ(registry.Find(index + 1, a), nullptr);
+  EXPECT_EQ(registry.Find(2, a), nullptr);
+
+  EXPECT_TRUE(registry.Remove(a));
+  EXPECT_EQ(registry.Find(index, a), nullptr);
+  // The slot goes to the next stream added.
+  Stream* b = registry.Add(std::make_unique<Stream>(64, 1024, 2));
+  ASSERT_EQ(b->registry_index, index);
+  EXPECT_EQ(registry.Find(index, b), b);
+}
+
+TEST(CopyCoalescer, MergesAdjacentSmallCopies) {
+  Stream stream(64, 256, 0);
+  std::vector<char> src(1024), dst(1024, 0);
+  for (size_t i = 0; i < src.size(); ++i) src[i] = static_cast<char>(i);
+
+  // Four adjacent device to device copies become one submission.
+  for (int i = 0; i < 4; ++i) {
+    stream.Copy(Kind::kDeviceToDevice, &dst[i * 16], &src[i * 16], 16);
+  }
+  EXPECT_EQ(stream.submissions, 0);
+  stream.Flush();
+  ASSERT_EQ(stream.submissions, 1);
+  EXPECT_EQ(stream.sizes[0], 64u);
+  EXPECT_EQ(std::memcmp(dst.data(), src.data(), 64), 0);
+
+  // A gap in src or dst starts a new run.
+  stream.Copy(Kind::kDeviceToDevice, &dst[100], &src[100], 8);
+  stream.Copy(Kind::kDeviceToDevice, &dst[108], &src[200], 8);
+  stream.Copy(Kind::kDeviceToDevice, &dst[120], &src[208], 8);
+  stream.Flush();
+  EXPECT_EQ(stream.submissions, 4);
+
+  // Large copies and device to host copies go out at once, after the run
+  // before them.
+  stream.Copy(Kind::kDeviceToDevice, &dst[300], &src[300], 8);
+  stream.Copy(Kind::kDeviceToDevice, &dst[308], &src[308], 100);
+  EXPECT_EQ(stream.submissions, 6);
+  stream.Copy(Kind::kDeviceToHost, &dst[408], &src[408], 4);
+  EXPECT_EQ(stream.submissions, 7);
+
+  // Runs stop at max_batch: five adjacent 64 byte copies go out as 256
+  // bytes and 64 bytes.
+  for (int i = 0; i < 5; ++i) {
+    stream.Copy(Kind::kDeviceToDevice, &dst[500 + i * 64], &src[i * 64], 64);
+  }
+  stream.Flush();
+  ASSERT_EQ(stream.submissions, 9);
+  EXPECT_EQ(stream.sizes[7], 256u);
+
+  auto stats = stream.stats();
+  EXPECT_EQ(stats.copies, 4u + 3u + 3u + 5u);
+  EXPECT_EQ(stats.submissions, 9u);
+  EXPECT_EQ(stats.coalesced, 8u);
+}
+
+TEST(CopyCoalescer, StagesHostToDevice) {
+  Stream stream(64, 1024, 0);
+  std::vector<char> dst(256, 0);
+  char value[4];
+  // Each copy reuses the same host buffer, so only the destinations are
+  // adjacent; staging keeps every value.
+  for (int i = 0; i < 8; ++i) {
+    std::memset(value, i + 1, sizeof(value));
+    stream.Copy(Kind::kHostToDevice, &dst[i * 4], value, sizeof(value));
+  }
+  std::memset(value, 0, sizeof(value));
+  stream.Flush();
+  EXPECT_EQ(stream.submissions, 1);
+  for (int i = 0; i < 32; ++i) EXPECT_EQ(dst[i], i / 4 + 1);
+
+  // Disabled coalescing submits every copy.
+  Stream plain(0, 1024, 1);
+  plain.Copy(Kind::kHostToDevice, &dst[0], value, 4);
+  plain.Copy(Kind::kHostToDevice, &dst[4], value, 4);
+  EXPECT_EQ(plain.submissions, 2);
+}
+
+TEST(StreamRegistry, ConcurrentCopiesAndLookups) {
+  StreamRegistry<Stream> registry(64);
+  constexpr int kThreads = 4;
+  constexpr int kCopies = 4096;
+  std::vector<Stream*> streams;
+  for (int i = 0; i < kThreads; ++i) {
+    streams.push_back(registry.Add(std::make_unique<Stream>(64, 512, i)));
+  }
+  std::vector<std::vector<int>> src(kThreads, std::vector<int>(kCopies));
+  std::vector<std::vector<int>> dst(kThreads, std::vector<int>(kCopies, -1));
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t] {
+      for (int i = 0; i < kCopies; ++i) {
+        src[t][i] = t * kCopies + i;
+        Stream* stream = registry.Find(streams[t]);
+        stream->Copy(
+            Kind::kHostToDevice, &dst[t][i], &src[t][i], sizeof(int));
+        // Streams and kernels flush each other's streams too.
+        if (i % 97 == 0) registry.Find(streams[(t + 1) % kThreads])->Flush();
+      }
+    });
+  }
+  // Churn other slots meanwhile.
+  for (int i = 0; i < 100; ++i) {
+    Stream* extra = registry.Add(std::make_unique<Stream>(64, 512, 100));
+    registry.ForEach([](Stream* stream) { stream->Flush(); });
+    registry.Remove(extra);
+  }
+  for (auto& thread : threads) thread.join();
+  registry.ForEach([](Stream* stream) { stream->Flush(); });
+  for (int t = 0; t < kThreads; ++t) {
+    EXPECT_EQ(dst[t], src[t]);
+    EXPECT_LT(streams[t]->stats().submissions, kCopies / 2u);
+  }
+}
@@ -395,7 +395,8 @@ void FusedGateUpMlpKernel(const Context& dev_ctx,
   if (axis < 0) {
     axis = proj_weight.dims().size() + axis;
   }
-  synSplitParams params = {{0}};
+  synSplitParams params;
+  ZeroParams(&params);
   params.axis = proj_weight.dims().size() - 1 - axis;
 
   ConvertTensors ct;
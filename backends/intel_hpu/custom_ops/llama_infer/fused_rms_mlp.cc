@@ -255,7 +255,7 @@ void FusedRmsMlpKernel(const Context& dev_ctx,
     axis = proj_weight.dims().size() + axis;
   }
   FusedRmsMlpParams params;
-  memset(reinterpret_cast<void*>(&params), 0x00, sizeof(FusedRmsMlpParams));
+  ZeroParams(&params);
   params.rmsnorm_params.epsValid = true;
   params.rmsnorm_params.eps = epsilon.to<float>();
 
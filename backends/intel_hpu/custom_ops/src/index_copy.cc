@@ -94,7 +94,8 @@ void IndexCopyKernel(const Context& dev_ctx,
   ct.Add(input, false);
 
   std::vector<DIMS> inputs_dims = ct.GetDims();
-  ns_IndexCopy::Params params{};
+  ns_IndexCopy::Params params;
+  ZeroParams(&params);
   params.axis = dim.to<unsigned>();
 
   OpCacheOperator op_info;
@@ -217,6 +217,7 @@ void AnyKernel(const Context& dev_ctx,
   ct.Add(out, false);
 
   ReduceAnyParams params;
+  ZeroParams(&params);
   // params.params.keepDim = keep_dim;
   // params.params.reductionDimensionMask = 0;
   params.keep_dim = keep_dim;
@@ -201,6 +201,7 @@ void ArangeTensorKernel(const Context& dev_ctx,
   ct.Add(out, false);
 
   RangeParams params;
+  ZeroParams(&params);
   if (std::is_same<T, phi::dtype::bfloat16>::value ||
       std::is_same<T, phi::dtype::float16>::value ||
       std::is_same<T, float>::value) {
@@ -252,6 +253,7 @@ void ArangeKernel(const Context& dev_ctx,
   ct.Add(out, false);
 
   RangeParams params;
+  ZeroParams(&params);
   if (std::is_same<T, phi::dtype::bfloat16>::value ||
       std::is_same<T, phi::dtype::float16>::value ||
       std::is_same<T, float>::value) {
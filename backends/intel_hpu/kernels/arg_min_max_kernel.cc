@@ -89,6 +89,7 @@ void doArgMaxMinTensor(const Context& dev_ctx,
 
   OpCacheOperator op_info;
   ArgMinMaxParams params;
+  ZeroParams(&params);
   params.params.reductionDimension = axis;
   params.type = out_datatype;
   op_info.prepareOpInfo<T, ArgMinMaxParams>(guid_prefix, {x_dims}, &params);
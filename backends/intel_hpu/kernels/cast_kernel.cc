@@ -110,6 +110,7 @@ void CastKernelF32(const Context& dev_ctx,
   ct.Add(out, false);
 
   CastParams params;
+  ZeroParams(&params);
   params.src_type = x.dtype();
   params.dst_type = dtype;
 
@@ -239,7 +239,8 @@ void NotEqualRawKernel(const Context& dev_ctx,
   ct.Add(y);
   ct.Add(out, false);
 
-  CompareParams params = {};
+  CompareParams params;
+  ZeroParams(&params);
   snprintf(params.op, MAX_OPNAME_LEN, "%s", "not_equal");
   std::vector<DIMS> inputs_dims = ct.GetDims();
   OpCacheOperator op_info;
@@ -290,7 +291,8 @@ void EqualRawKernel(const Context& dev_ctx,
   ct.Add(y);
   ct.Add(out, false);
 
-  CompareParams params = {};
+  CompareParams params;
+  ZeroParams(&params);
   snprintf(params.op, MAX_OPNAME_LEN, "%s", "equal");
   std::vector<DIMS> inputs_dims = ct.GetDims();
   OpCacheOperator op_info;
@@ -335,7 +337,8 @@ void LessThanRawKernel(const Context& dev_ctx,
   ct.Add(y);
   ct.Add(out, false);
 
-  CompareParams params = {};
+  CompareParams params;
+  ZeroParams(&params);
   snprintf(params.op, MAX_OPNAME_LEN, "%s", "less");
   std::vector<DIMS> inputs_dims = ct.GetDims();
   OpCacheOperator op_info;
@@ -386,7 +389,8 @@ void LessEqualRawKernel(const Context& dev_ctx,
   ct.Add(y);
   ct.Add(out, false);
 
-  CompareParams params = {};
+  CompareParams params;
+  ZeroParams(&params);
   snprintf(params.op, MAX_OPNAME_LEN, "%s", "less_equal");
   std::vector<DIMS> inputs_dims = ct.GetDims();
   OpCacheOperator op_info;
@@ -437,7 +441,8 @@ void GreaterThanRawKernel(const Context& dev_ctx,
   ct.Add(y);
   ct.Add(out, false);
 
-  CompareParams params = {};
+  CompareParams params;
+  ZeroParams(&params);
   snprintf(params.op, MAX_OPNAME_LEN, "%s", "greater");
   std::vector<DIMS> inputs_dims = ct.GetDims();
   OpCacheOperator op_info;
@@ -488,7 +493,8 @@ void GreaterEqualRawKernel(const Context& dev_ctx,
   ct.Add(y);
   ct.Add(out, false);
 
-  CompareParams params = {};
+  CompareParams params;
+  ZeroParams(&params);
   snprintf(params.op, MAX_OPNAME_LEN, "%s", "greater_equal");
   std::vector<DIMS> inputs_dims = ct.GetDims();
   OpCacheOperator op_info;
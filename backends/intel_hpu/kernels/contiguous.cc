@@ -65,6 +65,7 @@ void ContiguousKernel(const Context& dev_ctx,
   phi::DenseTensorMeta meta = input.meta();
 
   ContiguousParams params;
+  ZeroParams(&params);
   params.params.baseOffset = meta.offset / sizeof(T);
 
   std::vector<int32_t> input_strides = phi::vectorize<int32_t>(meta.strides);
@@ -194,7 +194,10 @@ void EinsumKernel(const Context& dev_ctx,
   EinsumParams params;
   params.params = synEinsumParams(equation.c_str());
   std::vector<DIMS> inputs_dims = ct.GetDims();
-  op_info.prepareOpInfo<T, EinsumParams>("EinsumKernel", inputs_dims, &params);
+  // synEinsumParams only points at the equation, and the key also names
+  // the recipe on disk, so the equation's text is keyed instead.
+  op_info.prepareOpInfo<T, nullptr_t>("EinsumKernel", inputs_dims, nullptr);
+  op_info.key_creator_.AddAsKey(equation);
   auto recipe = op_info.GetRecipe();
 
   if (recipe == nullptr) {
@@ -77,6 +77,7 @@ void FullKernel(const Context& dev_ctx,
 
   OpCacheOperator op_info;
   FullParams params;
+  ZeroParams(&params);
   params.dst_type = dtype;
   if (dtype == phi::DataType::FLOAT32 || dtype == phi::DataType::FLOAT16 ||
       dtype == phi::DataType::BFLOAT16) {
@@ -88,6 +88,7 @@ void GatherKernel(const Context& dev_ctx,
 
   OpCacheOperator op_info;
   GatherParams params;
+  ZeroParams(&params);
   params.params.axis = static_cast<int32_t>(x.dims().size()) - 1 - dim;
   params.type = index.dtype();
   std::vector<DIMS> inputs_dims = ct.GetDims();
@@ -125,6 +126,7 @@ void EmbeddingKernel(const Context& dev_ctx,
   OpCacheOperator op_info;
 
   GatherParams params;
+  ZeroParams(&params);
   params.params.axis = 1;
   params.type = inputx.dtype();
 
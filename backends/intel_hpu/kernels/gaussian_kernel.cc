@@ -74,6 +74,7 @@ void GaussianKernel(const Context& dev_ctx,
   ct.Add(out, false);
 
   GaussianParams params;
+  ZeroParams(&params);
   params.params.seed = seed;
   params.params.mean = mean;
   params.params.stddev = std;
@@ -14,8 +14,12 @@
 #include "kernels/hpu_operator.h"
 
 #include <assert.h>
+#include <dlfcn.h>
+#include <sys/stat.h>
 
+#include <atomic>
 #include <memory>
+#include <string>
 
 #include "glog/logging.h"
 #include "habanalabs/synapse_api.h"
@@ -25,21 +29,93 @@
 #include "paddle/phi/common/type_traits.h"
 #include "paddle/phi/extension.h"
 #include "utils/hpu_helper.h"
+#include "utils/workspace_arena.h"
 
 #define TOTAL_NUMBER_OF_TENSORS 1024
 
 FLAGS_DEFINE_bool(intel_hpu_sync_execute, false, "set sync execute mode");
+FLAGS_DEFINE_string(intel_hpu_recipe_cache_dir,
+                    "",
+                    "directory of the persistent compiled recipe cache, "
+                    "disabled when empty");
+FLAGS_DEFINE_uint64(intel_hpu_recipe_cache_max_size_mb,
+                    4096,
+                    "size limit of the persistent recipe cache in MB");
 
 typedef std::pair<synSectionHandle, bool> sectionWithFirstIndication;
 static std::unordered_map<std::string, sectionWithFirstIndication> sectionMap;
 
-static uint64_t cached_workspaceSize = 0;
-static uint64_t cached_workspaceAddress = 0;
-static uint32_t recipe_count = 0;
+static std::atomic<uint32_t> recipe_count{0};
+
+// Identifies what compiles the recipes. The driver version alone misses a
+// Synapse or graph compiler update on an unchanged driver, so the loaded
+// Synapse library is fingerprinted by its path, size and mtime as well.
+static std::string RecipeCompilerVersion() {
+  char driver[256] = {0};
+  synStatus status = synDriverGetVersion(driver, sizeof(driver));
+  LOG_IF(ERROR, status != synSuccess)
+      << "synDriverGetVersion() failed = " << status;
+  std::string version = std::string("driver ") + driver;
+
+  Dl_info info;
+  struct stat st;
+  if (dladdr(reinterpret_cast<void*>(&synGraphCompile), &info) != 0 &&
+      info.dli_fname != nullptr && stat(info.dli_fname, &st) == 0) {
+    version += std::string(", synapse ") + info.dli_fname + " " +
+               std::to_string(st.st_size) + " " +
+               std::to_string(st.st_mtim.tv_sec) + "." +
+               std::to_string(st.st_mtim.tv_nsec);
+  } else {
+    LOG(WARNING) << "cannot locate the Synapse library, recipes cached on "
+                    "disk are keyed by the driver version only";
+  }
+  return version;
+}
+
+RecipeDiskCache* GetRecipeDiskCache() {
+  static RecipeDiskCache* cache = []() -> RecipeDiskCache* {
+    if (FLAGS_intel_hpu_recipe_cache_dir.empty()) return nullptr;
+    std::string version = RecipeCompilerVersion();
+    VLOG(1) << "recipe disk cache " << FLAGS_intel_hpu_recipe_cache_dir
+            << ", compiler version " << version;
+    return new RecipeDiskCache(
+        FLAGS_intel_hpu_recipe_cache_dir,
+        FLAGS_intel_hpu_recipe_cache_max_size_mb * 1024 * 1024,
+        version);
+  }();
+  return cache;
+}
+
+synRecipeHandle LoadCachedRecipe(const std::string& key) {
+  RecipeDiskCache* disk_cache = GetRecipeDiskCache();
+  if (disk_cache == nullptr) return nullptr;
+
+  synRecipeHandle recipe = nullptr;
+  bool loaded = disk_cache->Load(key, [&](const std::string& path) {
+    synStatus status = synRecipeDeSerialize(&recipe, path.c_str());
+    LOG_IF(WARNING, status != synSuccess)
+        << "synRecipeDeSerialize() " << path << " failed = " << status;
+    return status == synSuccess;
+  });
+  return loaded ? recipe : nullptr;
+}
+
+void StoreCachedRecipe(const std::string& key, synRecipeHandle recipe) {
+  RecipeDiskCache* disk_cache = GetRecipeDiskCache();
+  if (disk_cache == nullptr) return;
+
+  bool stored = disk_cache->Store(key, [&](const std::string& path) {
+    synStatus status = synRecipeSerialize(recipe, path.c_str());
+    LOG_IF(WARNING, status != synSuccess)
+        << "synRecipeSerialize() " << path << " failed = " << status;
+    return status == synSuccess;
+  });
+  VLOG_IF(4, stored) << "recipe stored as " << disk_cache->EntryName(key);
+}
 
 void HpuOperator::Compile() {
   std::string recipe_name =
-      guid_ + "_" + std::to_string(recipe_count) + ".recipe";
+      guid_ + "_" + std::to_string(recipe_count++) + ".recipe";
   synStatus status =
       synGraphCompile(&recipeHandle_, graphHandle_, recipe_name.c_str(), 0);
 
@@ -51,8 +127,7 @@ void HpuOperator::Compile() {
            " eager = ",
            is_eager_);
 
-  VLOG(9) << " synGraphCompile =" << guid_ << ", count = " << recipe_count;
-  recipe_count += 1;
+  VLOG(9) << " synGraphCompile =" << guid_ << ", name = " << recipe_name;
   // cleanup
   status = synGraphDestroy(graphHandle_);
   LOG_IF(ERROR, status != synSuccess)
@@ -133,6 +208,64 @@ void RecipeRunner::prepareTensorInfo(synRecipeHandle recipe,
   }
 }
 
+namespace {
+
+class HpuWorkspaceBackend : public WorkspaceBackend {
+ public:
+  uint64_t Malloc(uint64_t size) override {
+    uint64_t addr = 0;
+    synStatus status = synDeviceMalloc(0, size, 0, 0, &addr);
+    LOG_IF(WARNING, status != synSuccess)
+        << "synDeviceMalloc() " << size << " failed = " << status;
+    VLOG(6) << "malloc device workspace " << size;
+    return status == synSuccess ? addr : 0;
+  }
+
+  void Free(uint64_t addr) override {
+    synStatus status = synDeviceFree(0, addr, 0);
+    PD_CHECK(status == synSuccess, "synDeviceFree() failed = ", status);
+  }
+
+  void* RecordEvent(void* stream) override {
+    synEventHandle event = nullptr;
+    synStatus status = synEventCreate(&event, 0, 0);
+    PD_CHECK(status == synSuccess, "synEventCreate() failed = ", status);
+    status = synEventRecord(event, reinterpret_cast<synStreamHandle>(stream));
+    PD_CHECK(status == synSuccess, "synEventRecord() failed = ", status);
+    return reinterpret_cast<void*>(event);
+  }
+
+  bool QueryEvent(void* event) override {
+    return synEventQuery(reinterpret_cast<synEventHandle>(event)) ==
+           synSuccess;
+  }
+
+  void SyncEvent(void* event) override {
+    synStatus status =
+        synEventSynchronize(reinterpret_cast<synEventHandle>(event));
+    PD_CHECK(status == synSuccess, "synEventSynchronize() failed = ", status);
+  }
+
+  void DestroyEvent(void* event) override {
+    synStatus status = synEventDestroy(reinterpret_cast<synEventHandle>(event));
+    LOG_IF(ERROR, status != synSuccess)
+        << "synEventDestroy() failed = " << status;
+  }
+};
+
+WorkspaceArena& GetWorkspaceArena() {
+  // Leaked on purpose, the device may be gone during static destruction.
+  static WorkspaceArena* arena = new WorkspaceArena(
+      std::unique_ptr<WorkspaceBackend>(new HpuWorkspaceBackend()));
+  return *arena;
+}
+
+}  // namespace
+
+void ReleaseStreamWorkspace(C_Stream stream) {
+  GetWorkspaceArena().ReleaseStream(stream);
+}
+
 void RecipeRunner::Run(C_Stream stream,
                        std::map<std::string, uint64_t> tensors) {
   uint64_t request_workspace_size = 0;
@@ -140,26 +273,14 @@ void RecipeRunner::Run(C_Stream stream,
       synWorkspaceGetSize(&request_workspace_size, recipeHandle_);
   PD_CHECK(status == synSuccess, "synWorkspaceGetSize() failed = ", status);
 
-  if (request_workspace_size > cached_workspaceSize) {
-    if (cached_workspaceSize != 0) {
-      VLOG(6) << "workspace size changed, sync... from " << cached_workspaceSize
-              << " to " << request_workspace_size;
-      status = synStreamSynchronize(reinterpret_cast<synStreamHandle>(stream));
-      PD_CHECK(
-          status == synSuccess, "synStreamSynchronize() failed = ", status);
-
-      status = synDeviceFree(0, cached_workspaceAddress, 0);
-      PD_CHECK(status == synSuccess, "synDeviceFree() failed = ", status);
-    }
-
-    cached_workspaceSize = request_workspace_size;
-    VLOG(6) << "malloc device workspace " << cached_workspaceSize;
-    status = synDeviceMalloc(
-        0, cached_workspaceSize, 0, 0, &cached_workspaceAddress);
-    PD_CHECK(status == synSuccess, "synDeviceMalloc() failed = ", status);
-  }
+  uint64_t workspace_address =
+      GetWorkspaceArena().Acquire(stream, request_workspace_size);
+  PD_CHECK(request_workspace_size == 0 || workspace_address != 0,
+           "allocate device workspace of ",
+           request_workspace_size,
+           " bytes failed");
 
-  VLOG(6) << "workspace size = " << cached_workspaceSize
+  VLOG(6) << "workspace size = " << request_workspace_size
           << ", stream = " << stream << ", recipe = " << recipeHandle_;
 
   std::vector<synLaunchTensorInfo> concatTensors;
@@ -170,7 +291,7 @@ void RecipeRunner::Run(C_Stream stream,
   status = synLaunch(reinterpret_cast<synStreamHandle>(stream),
                      concatTensors.data(),
                      concatTensors.size(),
-                     cached_workspaceAddress,
+                     workspace_address,
                      recipeHandle_,
                      0);
 
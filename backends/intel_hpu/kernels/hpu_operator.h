@@ -27,6 +27,7 @@
 #include "paddle/phi/common/type_traits.h"
 #include "paddle/phi/extension.h"
 #include "utils/hpu_helper.h"
+#include "utils/recipe_disk_cache.h"
 
 class HpuOperator {
  public:
@@ -87,4 +88,18 @@ class RecipeRunner {
   synRecipeHandle recipeHandle_;
 };
 
+// Returns the persistent recipe cache configured by
+// FLAGS_intel_hpu_recipe_cache_dir, or nullptr when it is disabled.
+RecipeDiskCache* GetRecipeDiskCache();
+
+// Loads a recipe compiled by an earlier process for the op cache key, or
+// returns nullptr.
+synRecipeHandle LoadCachedRecipe(const std::string& key);
+
+// Persists a freshly compiled recipe under the op cache key.
+void StoreCachedRecipe(const std::string& key, synRecipeHandle recipe);
+
+// Retires the recipe workspace of a stream about to be destroyed.
+void ReleaseStreamWorkspace(C_Stream stream);
+
 #endif  // BACKENDS_INTEL_HPU_KERNELS_HPU_OPERATOR_H_
@@ -81,6 +81,7 @@ void IndexSampleKernel(const Context& dev_ctx,
 
   OpCacheOperator op_info;
   IndexSampleParams params;
+  ZeroParams(&params);
   params.params.axis = 0;
   std::vector<DIMS> inputs_dims = ct.GetDims();
   op_info.prepareOpInfo<T, IndexSampleParams>(
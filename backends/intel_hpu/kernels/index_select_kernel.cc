@@ -87,6 +87,7 @@ void IndexSelectKernel(const Context& dev_ctx,
 
   OpCacheOperator op_info;
   IndexSelectParams params;
+  ZeroParams(&params);
   params.params.axis = static_cast<int32_t>(x.dims().size()) - 1 - dim;
   std::vector<DIMS> inputs_dims = ct.GetDims();
   op_info.prepareOpInfo<T, IndexSelectParams>(
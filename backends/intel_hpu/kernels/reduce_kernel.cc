@@ -114,7 +114,8 @@ void MeanKernel(const Context& dev_ctx,
   auto rank = static_cast<int32_t>(x.dims().size());
   std::vector<DIMS> inputs_dims = ct.GetDims();
   OpCacheOperator op_info;
-  ReduceParams params = {};
+  ReduceParams params;
+  ZeroParams(&params);
   params.keep_dim = keep_dim;
   snprintf(params.op, MAX_OPNAME_LEN, "%s", "mean");
   if (dims.size() == 0) {
@@ -164,7 +165,8 @@ void MaxKernel(const Context& dev_ctx,
   auto rank = static_cast<int32_t>(x.dims().size());
   std::vector<DIMS> inputs_dims = ct.GetDims();
   OpCacheOperator op_info;
-  ReduceParams params = {};
+  ReduceParams params;
+  ZeroParams(&params);
   params.keep_dim = keep_dim;
   snprintf(params.op, MAX_OPNAME_LEN, "%s", "max");
   if (dims.size() == 0) {
@@ -213,7 +215,8 @@ void MinKernel(const Context& dev_ctx,
   auto rank = static_cast<int32_t>(x.dims().size());
   std::vector<DIMS> inputs_dims = ct.GetDims();
   OpCacheOperator op_info;
-  ReduceParams params = {};
+  ReduceParams params;
+  ZeroParams(&params);
   params.keep_dim = keep_dim;
   snprintf(params.op, MAX_OPNAME_LEN, "%s", "min");
   if (dims.size() == 0) {
@@ -263,7 +266,8 @@ void SumKernel(const Context& dev_ctx,
   auto rank = static_cast<int32_t>(x.dims().size());
   std::vector<DIMS> inputs_dims = ct.GetDims();
   OpCacheOperator op_info;
-  ReduceParams params = {};
+  ReduceParams params;
+  ZeroParams(&params);
   params.keep_dim = keep_dim;
   snprintf(params.op, MAX_OPNAME_LEN, "%s", "sum");
   if (dims.size() == 0) {
@@ -313,7 +317,8 @@ void ProdKernel(const Context& dev_ctx,
   auto rank = static_cast<int32_t>(x.dims().size());
   std::vector<DIMS> inputs_dims = ct.GetDims();
   OpCacheOperator op_info;
-  ReduceParams params = {};
+  ReduceParams params;
+  ZeroParams(&params);
   params.keep_dim = keep_dim;
   snprintf(params.op, MAX_OPNAME_LEN, "%s", "prod");
   if (dims.size() == 0) {
@@ -103,6 +103,7 @@ void RmsNormKernel(const Context& dev_ctx,
   }
 
   ns_LayerNormKernel::Params params;
+  ZeroParams(&params);
   memset(reinterpret_cast<void*>(&params),
          0x00,
          sizeof(ns_LayerNormKernel::Params));
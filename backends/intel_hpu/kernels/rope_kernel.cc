@@ -93,6 +93,7 @@ void FusedRopeKernel(const Context& dev_ctx,
   std::vector<int64_t> out_q_dim = phi::vectorize<int64_t>(out_q->dims());
 
   ns_RoPESt2::ParamsV2 params;
+  ZeroParams(&params);
   params.offset = 0;
   params.mode = ROTARY_POS_EMBEDDING_MODE_BLOCKWISE;
 
@@ -358,6 +358,7 @@ void ScaleKernel(const Context& dev_ctx,
   std::vector<DIMS> inputs_dims = ct.GetDims();
 
   ScaleParams params;
+  ZeroParams(&params);
   auto scale = in_scale.to<float>();
   auto bias = in_bias.to<float>();
 
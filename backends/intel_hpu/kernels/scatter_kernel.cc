@@ -302,6 +302,7 @@ void ScatterKernel(const Context& dev_ctx,
 
   OpCacheOperator op_info;
   ns_ScatterKernel::Params params;
+  ZeroParams(&params);
   params.axis = x.dims().size() - 1;
   std::vector<DIMS> inputs_dims = ct.GetDims();
 
@@ -244,6 +244,7 @@ void FusedDotProductAttentionKernel(
   in_out_dims.insert(in_out_dims.end(), out_dims.begin(), out_dims.end());
 
   ns_Sdpa::ParamsV2 params;
+  ZeroParams(&params);
   memset(reinterpret_cast<void *>(&params), 0x00, sizeof(ns_Sdpa::ParamsV2));
   params.scale = scaling_factor;
   params.is_causal = (mask_type_str == "causal");
@@ -166,7 +166,8 @@ void SetTensorValueKernel(const Context& dev_ctx,
     v_new_sum = v_new_sum * new_dims[i];
   }
 
-  synSliceParams params = {{0}};
+  synSliceParams params;
+  ZeroParams(&params);
   for (int i = 0; i < in_dims.size(); i++) {
     params.axes[i] = i;
     params.steps[i] = 1;
@@ -135,6 +135,7 @@ void SliceRawKernel(const Context& dev_ctx,
   dev_ctx.template Alloc<T>(out);
 
   synSliceParamsV2 params;
+  ZeroParams(&params);
   for (int i = 0; i < in_dims.size(); i++) {
     params.axes[i] = i;
     params.steps[i] = 1;
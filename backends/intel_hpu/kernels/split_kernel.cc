@@ -89,7 +89,8 @@ void SplitKernel(const Context& dev_ctx,
     ct.Add(outs[i], false);
   }
 
-  synSplitParams params = {{0}};
+  synSplitParams params;
+  ZeroParams(&params);
   params.axis = x.dims().size() - 1 - axis;
 
   std::vector<DIMS> inputs_dims = ct.GetDims();
@@ -219,6 +219,7 @@ void SqueezeKernel(const Context& dev_ctx,
 
     OpCacheOperator op_info;
     SqueezeParams params;
+    ZeroParams(&params);
     params.params.axis = static_cast<int32_t>(x.dims().size()) - 1 - dim;
     std::vector<DIMS> inputs_dims = ct.GetDims();
     op_info.prepareOpInfo<T, SqueezeParams>(op_name, inputs_dims, &params);
@@ -282,6 +283,7 @@ void UnsqueezeKernel(const Context& dev_ctx,
 
   OpCacheOperator op_info;
   UnsqueezParams params;
+  ZeroParams(&params);
   params.params.axis = dims[0];
 
   std::vector<DIMS> inputs_dims = ct.GetDims();
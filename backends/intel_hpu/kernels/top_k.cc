@@ -82,7 +82,8 @@ void TopkKernel(const Context& dev_ctx,
   ct.Add(out, false);
   ct.Add(indices, false);
 
-  ns_TopkNodeV2::ParamsV4 params{};
+  ns_TopkNodeV2::ParamsV4 params;
+  ZeroParams(&params);
   params.bsw = k_scalar.to<int>();
   axis = axis < 0 ? axis + x.dims().size() : axis;
   params.axis = x.dims().size() - axis - 1;
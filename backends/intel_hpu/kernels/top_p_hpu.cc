@@ -487,7 +487,8 @@ void TopPSamplingKernel_hpu(const Context& dev_ctx,
   ct.Add(*out, false);
   ct.Add(*ids, false);
 
-  ns_TopkNodeV2::ParamsV4 params{};
+  ns_TopkNodeV2::ParamsV4 params;
+  ZeroParams(&params);
   params.bsw = length;
   params.axis = 0;
   params.bottomK = false;
@@ -60,6 +60,7 @@ void TransposeKernel(const Context& dev_ctx,
   dev_ctx.template Alloc<T>(out);
 
   synTransposeParams params;
+  ZeroParams(&params);
   auto rank = axis.size();
   std::vector<int> tmp_axis = axis;
   for (size_t i = 0; i < axis.size(); i++) {
@@ -70,6 +70,7 @@ void TrilTriuKernel(const Context& dev_ctx,
   std::vector<int64_t> inputs_dim = phi::vectorize<int64_t>(x.dims());
   std::vector<int64_t> outputs_dim = phi::vectorize<int64_t>(out->dims());
   ns_MatrixBandPartKernel::triParams params;
+  ZeroParams(&params);
 
   if (lower) {
     params.numLower = INT_MIN;
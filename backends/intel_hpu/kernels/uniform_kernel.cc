@@ -128,6 +128,7 @@ void UniformRawKernel(const Context& dev_ctx,
     ct.Add(out, false);
 
     uniformParams params;
+    ZeroParams(&params);
 
     if (dtype == phi::DataType::FLOAT32 || dtype == phi::DataType::FLOAT16 ||
         dtype == phi::DataType::BFLOAT16) {
@@ -34,6 +34,7 @@
 
 #include "habanalabs/hccl.h"
 #include "habanalabs/hccl_types.h"
+#include "kernels/hpu_operator.h"
 #include "paddle/phi/common/type_traits.h"
 
 FLAGS_DEFINE_bool(intel_hpu_runtime_debug, false, "runtime debug log");
@@ -201,6 +202,7 @@ class RuntimeManager {
         << ", current = " << moduleID;
     auto it = streams.find(reinterpret_cast<synStreamHandle>(stream));
     if (it != streams.end()) {
+      ReleaseStreamWorkspace(stream);
       synStatus status = synStreamDestroy(*it);
       PD_CHECK(status == synSuccess,
                "[RUNTIME] synStreamDestroy() failed = ",
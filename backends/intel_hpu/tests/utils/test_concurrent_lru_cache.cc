@@ -0,0 +1,168 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may
+// not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "utils/concurrent_lru_cache.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+HashedKey MakeKey(int64_t v) {
+  HashedKey key;
+  key.Append(&v, sizeof(v));
+  return key;
+}
+
+// Every hash collides, so lookups must rely on the full key comparison.
+struct ConstantHasher {
+  size_t operator()(const HashedKey& key) const { return 42; }
+};
+
+}  // namespace
+
+TEST(ConcurrentLRUCache, GetPutAndEvict) {
+  std::vector<int> evicted;
+  ConcurrentLRUCache<int, int> cache(
+      2, 1, [&](const int& key, int& val) { evicted.push_back(val); });
+
+  int val = 0;
+  EXPECT_FALSE(cache.Get(1, &val));
+  EXPECT_EQ(cache.Put(1, 10), 10);
+  EXPECT_EQ(cache.Put(2, 20), 20);
+  EXPECT_TRUE(cache.Get(1, &val));
+  EXPECT_EQ(val, 10);
+
+  // 2 is now the least recently used entry.
+  cache.Put(3, 30);
+  EXPECT_FALSE(cache.Get(2, &val));
+  ASSERT_EQ(evicted.size(), 1u);
+  EXPECT_EQ(evicted[0], 20);
+
+  auto stats = cache.GetStats();
+  EXPECT_EQ(stats.hits, 1u);
+  EXPECT_EQ(stats.misses, 2u);
+  EXPECT_EQ(stats.evictions, 1u);
+  EXPECT_EQ(stats.size, 2u);
+}
+
+TEST(ConcurrentLRUCache, PutKeepsExistingValue) {
+  std::vector<int> released;
+  ConcurrentLRUCache<int, int> cache(
+      4, 1, [&](const int& key, int& val) { released.push_back(val); });
+
+  cache.Put(1, 10);
+  EXPECT_EQ(cache.Put(1, 11), 10);
+  ASSERT_EQ(released.size(), 1u);
+  EXPECT_EQ(released[0], 11);
+}
+
+TEST(ConcurrentLRUCache, ClearReleasesEverything) {
+  int released = 0;
+  {
+    ConcurrentLRUCache<int, int> cache(
+        64, 4, [&](const int& key, int& val) { ++released; });
+    for (int i = 0; i < 32; ++i) cache.Put(i, i);
+  }
+  EXPECT_EQ(released, 32);
+}
+
+TEST(ConcurrentLRUCache, HashCollisionsVerifyFullKey) {
+  ConcurrentLRUCache<HashedKey, int, ConstantHasher> cache(16, 2);
+  for (int i = 0; i < 8; ++i) cache.Put(MakeKey(i), i);
+  for (int i = 0; i < 8; ++i) {
+    int val = -1;
+    ASSERT_TRUE(cache.Get(MakeKey(i), &val));
+    EXPECT_EQ(val, i);
+  }
+  int val = -1;
+  EXPECT_FALSE(cache.Get(MakeKey(100), &val));
+}
+
+TEST(ConcurrentLRUCache, ConcurrentGetOrCreate) {
+  constexpr int kThreads = 8;
+  constexpr int kKeys = 64;
+  constexpr int kIters = 20000;
+
+  std::atomic<int> created{0};
+  std::atomic<int> released{0};
+  ConcurrentLRUCache<HashedKey, int, HashedKey::Hasher> cache(
+      kKeys / 2, 4, [&](const HashedKey& key, int& val) { ++released; });
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < kIters; ++i) {
+        int64_t k = (i * 7 + t) % kKeys;
+        int v = cache.GetOrCreate(MakeKey(k), [&]() {
+          ++created;
+          return static_cast<int>(k);
+        });
+        ASSERT_EQ(v, k);
+      }
+    });
+  }
+  for (auto& th : threads) th.join();
+
+  // Every created value is either still cached or was released once.
+  EXPECT_EQ(created.load(), released.load() + cache.Size());
+  EXPECT_LE(cache.Size(), static_cast<size_t>(kKeys / 2));
+}
+
+// Recipes are cached as shared_ptrs whose deleter destroys them, so a
+// recipe evicted while another thread launches it outlives the launch.
+TEST(ConcurrentLRUCache, EvictedSharedValuesOutliveTheirUsers) {
+  struct Recipe {
+    std::atomic<bool> destroyed{false};
+  };
+  constexpr int kThreads = 8;
+  constexpr int kKeys = 64;
+  constexpr int kIters = 5000;
+
+  std::atomic<int> created{0};
+  std::atomic<int> destroyed{0};
+  auto make = [&]() {
+    ++created;
+    return std::shared_ptr<Recipe>(new Recipe(), [&](Recipe* recipe) {
+      recipe->destroyed = true;
+      ++destroyed;
+      delete recipe;
+    });
+  };
+  {
+    ConcurrentLRUCache<HashedKey, std::shared_ptr<Recipe>, HashedKey::Hasher>
+        cache(kKeys / 4, 4);
+    std::atomic<int> used_after_destroy{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+      threads.emplace_back([&, t]() {
+        for (int i = 0; i < kIters; ++i) {
+          auto recipe = cache.GetOrCreate(MakeKey((i * 7 + t) % kKeys), make);
+          // Other threads evict it meanwhile; the reference keeps it alive.
+          std::this_thread::yield();
+          if (recipe->destroyed) ++used_after_destroy;
+        }
+      });
+    }
+    for (auto& th : threads) th.join();
+    EXPECT_EQ(used_after_destroy.load(), 0);
+    EXPECT_EQ(created.load(), destroyed.load() + cache.Size());
+  }
+  EXPECT_EQ(created.load(), destroyed.load());
+}
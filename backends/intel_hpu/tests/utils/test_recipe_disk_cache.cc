@@ -0,0 +1,206 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may
+// not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "utils/recipe_disk_cache.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+// Stands in for synRecipeSerialize/synRecipeDeSerialize: a "recipe" is just
+// a string written verbatim.
+RecipeDiskCache::SerializeFn StubSerialize(const std::string& recipe) {
+  return [recipe](const std::string& path) {
+    std::ofstream out(path, std::ios::binary);
+    out << recipe;
+    return static_cast<bool>(out);
+  };
+}
+
+RecipeDiskCache::DeserializeFn StubDeserialize(std::string* recipe) {
+  return [recipe](const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    *recipe = ss.str();
+    return static_cast<bool>(in);
+  };
+}
+
+size_t CountFiles(const std::string& dir) {
+  size_t n = 0;
+  DIR* d = opendir(dir.c_str());
+  while (struct dirent* ent = readdir(d)) {
+    if (ent->d_name[0] != '.') ++n;
+  }
+  closedir(d);
+  return n;
+}
+
+void WriteFile(const std::string& path, size_t bytes, bool stale) {
+  std::ofstream(path, std::ios::binary) << std::string(bytes, 'z');
+  if (stale) {
+    // Two hours ago, past the age at which leftovers are dropped.
+    struct timespec times[2];
+    times[0].tv_sec = times[1].tv_sec = time(nullptr) - 7200;
+    times[0].tv_nsec = times[1].tv_nsec = 0;
+    ASSERT_EQ(utimensat(AT_FDCWD, path.c_str(), times, 0), 0);
+  }
+}
+
+bool Exists(const std::string& path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0;
+}
+
+class RecipeDiskCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char tmpl[] = "/tmp/recipe_cache_XXXXXX";
+    dir_ = mkdtemp(tmpl);
+  }
+
+  void TearDown() override {
+    std::string cmd = "rm -rf " + dir_;
+    ASSERT_EQ(system(cmd.c_str()), 0);
+  }
+
+  std::string dir_;
+};
+
+}  // namespace
+
+TEST_F(RecipeDiskCacheTest, StoreThenLoad) {
+  RecipeDiskCache cache(dir_, 1 << 20, "1.0");
+  std::string loaded;
+  EXPECT_FALSE(cache.Load("key_a", StubDeserialize(&loaded)));
+  ASSERT_TRUE(cache.Store("key_a", StubSerialize("recipe_a")));
+  ASSERT_TRUE(cache.Load("key_a", StubDeserialize(&loaded)));
+  EXPECT_EQ(loaded, "recipe_a");
+  // Only the final files remain, no temporaries.
+  EXPECT_EQ(CountFiles(dir_), 2u);
+
+  // A second process sees the same entry.
+  RecipeDiskCache other(dir_, 1 << 20, "1.0");
+  loaded.clear();
+  ASSERT_TRUE(other.Load("key_a", StubDeserialize(&loaded)));
+  EXPECT_EQ(loaded, "recipe_a");
+}
+
+TEST_F(RecipeDiskCacheTest, CompilerVersionInvalidates) {
+  RecipeDiskCache cache(dir_, 1 << 20, "1.0");
+  ASSERT_TRUE(cache.Store("key_a", StubSerialize("recipe_a")));
+
+  RecipeDiskCache upgraded(dir_, 1 << 20, "2.0");
+  std::string loaded;
+  EXPECT_NE(cache.EntryName("key_a"), upgraded.EntryName("key_a"));
+  EXPECT_FALSE(upgraded.Load("key_a", StubDeserialize(&loaded)));
+}
+
+TEST_F(RecipeDiskCacheTest, FailedSerializeLeavesNoEntry) {
+  RecipeDiskCache cache(dir_, 1 << 20, "1.0");
+  EXPECT_FALSE(cache.Store("key_a", [](const std::string&) { return false; }));
+  EXPECT_EQ(CountFiles(dir_), 0u);
+}
+
+TEST_F(RecipeDiskCacheTest, TruncatedRecipeIsRejected) {
+  RecipeDiskCache cache(dir_, 1 << 20, "1.0");
+  ASSERT_TRUE(cache.Store("key_a", StubSerialize("recipe_a")));
+  std::string path = dir_ + "/" + cache.EntryName("key_a") + ".recipe";
+  ASSERT_EQ(truncate(path.c_str(), 3), 0);
+  std::string loaded;
+  EXPECT_FALSE(cache.Load("key_a", StubDeserialize(&loaded)));
+}
+
+TEST_F(RecipeDiskCacheTest, EvictsLeastRecentlyUsed) {
+  const std::string blob(1000, 'x');
+  // Room for roughly two entries including their meta files.
+  RecipeDiskCache cache(dir_, 2500, "1.0");
+  ASSERT_TRUE(cache.Store("key_a", StubSerialize(blob)));
+  sleep(1);
+  ASSERT_TRUE(cache.Store("key_b", StubSerialize(blob)));
+  sleep(1);
+  std::string loaded;
+  ASSERT_TRUE(cache.Load("key_a", StubDeserialize(&loaded)));
+  ASSERT_TRUE(cache.Store("key_c", StubSerialize(blob)));
+
+  EXPECT_TRUE(cache.Load("key_a", StubDeserialize(&loaded)));
+  EXPECT_FALSE(cache.Load("key_b", StubDeserialize(&loaded)));
+  EXPECT_TRUE(cache.Load("key_c", StubDeserialize(&loaded)));
+}
+
+TEST_F(RecipeDiskCacheTest, ScansOnlyWhenTrackedSizeCrossesLimit) {
+  const std::string blob(1000, 'x');
+  {
+    RecipeDiskCache cache(dir_, 1 << 20, "1.0");
+    ASSERT_TRUE(cache.Store("key_a", StubSerialize(blob)));
+    ASSERT_TRUE(cache.Store("key_b", StubSerialize(blob)));
+  }
+  RecipeDiskCache cache(dir_, 2500, "1.0");
+  // The constructor scans what earlier runs left.
+  const uint64_t entry_bytes = cache.tracked_bytes() / 2;
+  EXPECT_GT(entry_bytes, blob.size());
+  // Written behind the cache's back, so only a scan would notice it.
+  std::ofstream(dir_ + "/0000000000000000.meta") << std::string(600, 'm');
+  sleep(1);
+  ASSERT_TRUE(cache.Store("key_c", StubSerialize(std::string(10, 'y'))));
+  EXPECT_EQ(CountFiles(dir_), 7u);
+
+  // Crossing the limit rescans and evicts down below it, oldest first.
+  ASSERT_TRUE(cache.Store("key_d", StubSerialize(blob)));
+  std::string loaded;
+  EXPECT_FALSE(cache.Load("key_a", StubDeserialize(&loaded)));
+  EXPECT_TRUE(cache.Load("key_d", StubDeserialize(&loaded)));
+  EXPECT_LE(cache.tracked_bytes(), 2500u - 250u);
+}
+
+TEST_F(RecipeDiskCacheTest, CountsAndDropsLeftoversOfDeadWriters) {
+  const std::string stale_recipe = dir_ + "/00000000000000aa.recipe";
+  const std::string fresh_recipe = dir_ + "/00000000000000bb.recipe";
+  const std::string stale_temp = dir_ + "/00000000000000cc.meta.tmp.1.1";
+  const std::string fresh_temp = dir_ + "/00000000000000dd.recipe.tmp.1.2";
+  WriteFile(stale_recipe, 3000, true);
+  WriteFile(fresh_recipe, 300, false);
+  WriteFile(stale_temp, 3000, true);
+  WriteFile(fresh_temp, 200, false);
+
+  RecipeDiskCache cache(dir_, 2500, "1.0");
+  EXPECT_FALSE(Exists(stale_recipe));
+  EXPECT_FALSE(Exists(stale_temp));
+  // Fresh ones may belong to a live writer: kept, but counted.
+  EXPECT_TRUE(Exists(fresh_recipe));
+  EXPECT_TRUE(Exists(fresh_temp));
+  EXPECT_EQ(cache.tracked_bytes(), 500u);
+
+  // Leftovers are never evicted as entries, so entries make way instead.
+  const std::string blob(1000, 'x');
+  ASSERT_TRUE(cache.Store("key_a", StubSerialize(blob)));
+  sleep(1);
+  ASSERT_TRUE(cache.Store("key_b", StubSerialize(blob)));
+  std::string loaded;
+  EXPECT_FALSE(cache.Load("key_a", StubDeserialize(&loaded)));
+  EXPECT_TRUE(cache.Load("key_b", StubDeserialize(&loaded)));
+  EXPECT_TRUE(Exists(fresh_recipe));
+  EXPECT_LE(cache.tracked_bytes(), 2250u);
+}
@@ -0,0 +1,165 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may
+// not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "utils/workspace_arena.h"
+
+#include <map>
+#include <memory>
+#include <set>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+// Events complete only when the test says so; memory is bounded by limit.
+class MockBackend : public WorkspaceBackend {
+ public:
+  uint64_t Malloc(uint64_t size) override {
+    if (in_use + size > limit) return 0;
+    in_use += size;
+    uint64_t addr = next_addr;
+    next_addr += size;
+    live[addr] = size;
+    ++mallocs;
+    return addr;
+  }
+
+  void Free(uint64_t addr) override {
+    ASSERT_EQ(live.count(addr), 1u);
+    in_use -= live[addr];
+    live.erase(addr);
+  }
+
+  void* RecordEvent(void* stream) override {
+    auto* event = new int(static_cast<int>(events.size()));
+    events.insert(event);
+    return event;
+  }
+
+  bool QueryEvent(void* event) override { return completed.count(event) > 0; }
+
+  void SyncEvent(void* event) override {
+    ++syncs;
+    completed.insert(event);
+  }
+
+  void DestroyEvent(void* event) override {
+    ASSERT_EQ(events.erase(event), 1u);
+    completed.erase(event);
+    delete static_cast<int*>(event);
+  }
+
+  void CompleteAll() { completed.insert(events.begin(), events.end()); }
+
+  uint64_t limit = UINT64_MAX;
+  uint64_t in_use = 0;
+  uint64_t next_addr = 0x1000;
+  int mallocs = 0;
+  int syncs = 0;
+  std::map<uint64_t, uint64_t> live;
+  std::set<void*> events;
+  std::set<void*> completed;
+};
+
+void* Stream(int i) { return reinterpret_cast<void*>(0x100 + i); }
+
+// The arena owns its backend; tests keep a pointer to inspect it.
+std::unique_ptr<WorkspaceBackend> Own(MockBackend* backend) {
+  return std::unique_ptr<WorkspaceBackend>(backend);
+}
+
+}  // namespace
+
+TEST(WorkspaceArena, ReusesSliceWithinStream) {
+  auto* backend = new MockBackend;
+  WorkspaceArena arena(Own(backend), 1);
+  uint64_t a = arena.Acquire(Stream(0), 100);
+  EXPECT_EQ(arena.Acquire(Stream(0), 50), a);
+  EXPECT_EQ(arena.Acquire(Stream(0), 100), a);
+  EXPECT_EQ(backend->mallocs, 1);
+}
+
+TEST(WorkspaceArena, StreamsGetSeparateSlices) {
+  auto* backend = new MockBackend;
+  WorkspaceArena arena(Own(backend), 1);
+  uint64_t a = arena.Acquire(Stream(0), 100);
+  uint64_t b = arena.Acquire(Stream(1), 10);
+  EXPECT_NE(a, b);
+  // New slices are sized from the high-water mark.
+  EXPECT_EQ(backend->live[b], 100u);
+}
+
+TEST(WorkspaceArena, GrowDefersFreeUntilEventCompletes) {
+  auto* backend = new MockBackend;
+  WorkspaceArena arena(Own(backend), 1);
+  uint64_t a = arena.Acquire(Stream(0), 100);
+  uint64_t b = arena.Acquire(Stream(0), 200);
+  EXPECT_NE(a, b);
+  EXPECT_EQ(backend->syncs, 0);
+  EXPECT_EQ(backend->live.count(a), 1u);
+  EXPECT_EQ(arena.GetStats().pending_frees, 1u);
+
+  arena.Reclaim();
+  EXPECT_EQ(backend->live.count(a), 1u);
+
+  backend->CompleteAll();
+  arena.Reclaim();
+  EXPECT_EQ(backend->live.count(a), 0u);
+  EXPECT_EQ(arena.GetStats().pending_frees, 0u);
+  EXPECT_EQ(arena.GetStats().allocated_bytes, 200u);
+}
+
+TEST(WorkspaceArena, OutOfMemoryWaitsForRetiredSlices) {
+  auto* backend = new MockBackend;
+  backend->limit = 250;
+  WorkspaceArena arena(Own(backend), 1);
+  arena.Acquire(Stream(0), 100);
+  EXPECT_NE(arena.Acquire(Stream(0), 200), 0u);
+  EXPECT_EQ(backend->syncs, 1);
+  EXPECT_EQ(backend->in_use, 200u);
+  EXPECT_EQ(arena.Acquire(Stream(1), 400), 0u);
+}
+
+TEST(WorkspaceArena, AlignsToGranularity) {
+  auto* backend = new MockBackend;
+  WorkspaceArena arena(Own(backend), 64);
+  uint64_t a = arena.Acquire(Stream(0), 65);
+  EXPECT_EQ(backend->live[a], 128u);
+  EXPECT_EQ(arena.GetStats().high_water, 65u);
+}
+
+TEST(WorkspaceArena, ReleaseStreamRetiresItsSlice) {
+  auto* backend = new MockBackend;
+  WorkspaceArena arena(Own(backend), 1);
+  uint64_t a = arena.Acquire(Stream(0), 100);
+  arena.Acquire(Stream(1), 100);
+  arena.ReleaseStream(Stream(0));
+  // Work already enqueued on the stream may still use the slice.
+  EXPECT_EQ(backend->syncs, 0);
+  EXPECT_EQ(backend->live.count(a), 1u);
+  EXPECT_EQ(arena.GetStats().pending_frees, 1u);
+
+  backend->CompleteAll();
+  arena.Reclaim();
+  EXPECT_EQ(backend->live.count(a), 0u);
+  EXPECT_EQ(arena.GetStats().allocated_bytes, 100u);
+
+  // Releasing twice, or a stream that never launched, is a no-op, and a
+  // stream handle that is reused starts over with a fresh slice.
+  arena.ReleaseStream(Stream(0));
+  arena.ReleaseStream(Stream(2));
+  EXPECT_EQ(arena.GetStats().pending_frees, 0u);
+  EXPECT_NE(arena.Acquire(Stream(0), 10), 0u);
+  EXPECT_EQ(backend->mallocs, 3);
+}
@@ -0,0 +1,114 @@
+#   Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Pre-populates the intel_hpu persistent recipe cache.
+
+Replays every distinct input shape set from a recorded shape log through an
+inference model with FLAGS_intel_hpu_recipe_cache_dir pointing at the cache,
+so that serving processes started later load compiled recipes from disk
+instead of compiling them.
+
+The shape log holds one JSON object per line mapping input names to shapes,
+optionally with a dtype:
+
+    {"input_ids": [1, 128], "attention_mask": [1, 128]}
+    {"input_ids": {"shape": [4, 512], "dtype": "int64"}}
+
+Example:
+
+    python recipe_cache_warmup.py --model_file model.pdmodel \
+        --params_file model.pdiparams --shape_log shapes.jsonl \
+        --cache_dir /data/recipe_cache
+"""
+
+import argparse
+import json
+import os
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--model_file", required=True)
+    parser.add_argument("--params_file", required=True)
+    parser.add_argument("--shape_log", required=True)
+    parser.add_argument("--cache_dir", required=True)
+    parser.add_argument("--cache_max_size_mb", type=int, default=4096)
+    parser.add_argument("--device_id", type=int, default=0)
+    return parser.parse_args()
+
+
+def load_shape_sets(path):
+    """Returns the distinct shape sets of the log, in first-seen order."""
+    seen = set()
+    shape_sets = []
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if not line:
+                continue
+            entry = {}
+            for name, spec in json.loads(line).items():
+                if isinstance(spec, dict):
+                    entry[name] = (tuple(spec["shape"]), spec.get("dtype"))
+                else:
+                    entry[name] = (tuple(spec), None)
+            key = tuple(sorted(entry.items()))
+            if key not in seen:
+                seen.add(key)
+                shape_sets.append(entry)
+    return shape_sets
+
+
+def main():
+    args = parse_args()
+    # The plugin reads its flags from the environment when it is loaded.
+    os.environ["FLAGS_intel_hpu_recipe_cache_dir"] = args.cache_dir
+    os.environ["FLAGS_intel_hpu_recipe_cache_max_size_mb"] = str(
+        args.cache_max_size_mb
+    )
+
+    import numpy as np
+    import paddle.inference as paddle_infer
+
+    config = paddle_infer.Config(args.model_file, args.params_file)
+    config.enable_custom_device("intel_hpu", args.device_id)
+    predictor = paddle_infer.create_predictor(config)
+    input_names = predictor.get_input_names()
+
+    shape_sets = load_shape_sets(args.shape_log)
+    for i, shape_set in enumerate(shape_sets):
+        for name in input_names:
+            if name not in shape_set:
+                raise ValueError(
+                    "input '{}' missing from shape log entry {}".format(name, i)
+                )
+            shape, dtype = shape_set[name]
+            handle = predictor.get_input_handle(name)
+            if dtype is None:
+                # e.g. DataType.FLOAT32 -> float32
+                dtype = str(handle.type()).split(".")[-1].lower()
+                if dtype == "bfloat16":
+                    dtype = "uint16"
+            handle.reshape(list(shape))
+            handle.copy_from_cpu(np.zeros(shape, dtype=dtype))
+        predictor.run()
+        print(
+            "[{}/{}] warmed up {}".format(
+                i + 1, len(shape_sets), {k: v[0] for k, v in shape_set.items()}
+            )
+        )
+
+
+if __name__ == "__main__":
+    main()
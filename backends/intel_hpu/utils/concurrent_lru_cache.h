@@ -0,0 +1,222 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may
+// not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Byte-string key with a 64-bit FNV-1a hash computed while it is built.
+// Lookups compare the hash first and fall back to the full bytes, so hash
+// collisions never return a wrong entry.
+class HashedKey {
+ public:
+  HashedKey() { bytes_.reserve(kReserveLength); }
+
+  void Append(const void* data, size_t size) {
+    auto p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+      hash_ = (hash_ ^ p[i]) * kFnvPrime;
+    }
+    bytes_.append(reinterpret_cast<const char*>(p), size);
+  }
+
+  uint64_t hash() const { return hash_; }
+  const std::string& bytes() const { return bytes_; }
+
+  bool operator==(const HashedKey& other) const {
+    return hash_ == other.hash_ && bytes_ == other.bytes_;
+  }
+
+  struct Hasher {
+    size_t operator()(const HashedKey& key) const {
+      return static_cast<size_t>(key.hash_);
+    }
+  };
+
+ private:
+  static constexpr uint64_t kFnvOffset = 14695981039346656037ULL;
+  static constexpr uint64_t kFnvPrime = 1099511628211ULL;
+  static constexpr size_t kReserveLength = 256;
+
+  uint64_t hash_ = kFnvOffset;
+  std::string bytes_;
+};
+
+// Thread-safe LRU cache split into independently locked shards. Each shard
+// keeps its own recency list and capacity, so concurrent lookups on
+// different keys rarely contend. Values dropped from the cache (capacity
+// eviction, Clear(), or a losing racer in GetOrCreate) are handed to the
+// eviction callback outside of the shard lock so it can release resources.
+template <class KEY_T, class VAL_T, class HASH_T = std::hash<KEY_T>>
+class ConcurrentLRUCache {
+ public:
+  using EvictCallback = std::function<void(const KEY_T&, VAL_T&)>;
+
+  struct Stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t size;
+  };
+
+  explicit ConcurrentLRUCache(size_t capacity,
+                              size_t num_shards = 16,
+                              EvictCallback on_evict = nullptr)
+      : shards_(num_shards == 0 ? 1 : num_shards),
+        on_evict_(std::move(on_evict)) {
+    size_t per_shard = (capacity + shards_.size() - 1) / shards_.size();
+    for (auto& shard : shards_) {
+      shard.capacity = per_shard == 0 ? 1 : per_shard;
+    }
+  }
+
+  ConcurrentLRUCache(const ConcurrentLRUCache&) = delete;
+  ConcurrentLRUCache& operator=(const ConcurrentLRUCache&) = delete;
+
+  ~ConcurrentLRUCache() { Clear(); }
+
+  // Looks the key up once and promotes it to most recently used.
+  bool Get(const KEY_T& key, VAL_T* val) {
+    Shard& shard = GetShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.map.find(key);
+    if (it == shard.map.end()) {
+      misses_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    shard.items.splice(shard.items.begin(), shard.items, it->second);
+    *val = it->second->second;
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // Inserts val unless the key is already cached and returns the cached
+  // value. When the key already exists, val is passed to the eviction
+  // callback since the cache does not take ownership of it.
+  VAL_T Put(const KEY_T& key, VAL_T val) {
+    std::vector<std::pair<KEY_T, VAL_T>> dropped;
+    VAL_T result = Insert(key, std::move(val), &dropped);
+    Release(&dropped);
+    return result;
+  }
+
+  // Get, then on a miss create and Put: the shard lock is taken twice, and
+  // the factory runs without it. Threads missing on the same key at once
+  // each count a miss and each create a value; the first one inserted
+  // wins and the others are released through the eviction callback.
+  template <class FACTORY_T>
+  VAL_T GetOrCreate(const KEY_T& key, FACTORY_T&& create) {
+    VAL_T val;
+    if (Get(key, &val)) {
+      return val;
+    }
+    return Put(key, create());
+  }
+
+  void Clear() {
+    std::vector<std::pair<KEY_T, VAL_T>> dropped;
+    for (auto& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      for (auto& item : shard.items) {
+        dropped.emplace_back(std::move(item));
+      }
+      shard.items.clear();
+      shard.map.clear();
+    }
+    evictions_.fetch_add(dropped.size(), std::memory_order_relaxed);
+    Release(&dropped);
+  }
+
+  size_t Size() const {
+    size_t size = 0;
+    for (auto& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      size += shard.map.size();
+    }
+    return size;
+  }
+
+  Stats GetStats() const {
+    return {hits_.load(std::memory_order_relaxed),
+            misses_.load(std::memory_order_relaxed),
+            evictions_.load(std::memory_order_relaxed),
+            Size()};
+  }
+
+ private:
+  using ItemList = std::list<std::pair<KEY_T, VAL_T>>;
+
+  struct Shard {
+    mutable std::mutex mutex;
+    ItemList items;
+    std::unordered_map<KEY_T, typename ItemList::iterator, HASH_T> map;
+    size_t capacity = 1;
+  };
+
+  Shard& GetShard(const KEY_T& key) {
+    // Mix the hash so shard selection does not reuse the low bits that the
+    // shard's own unordered_map buckets on.
+    uint64_t h = static_cast<uint64_t>(HASH_T()(key));
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return shards_[h % shards_.size()];
+  }
+
+  VAL_T Insert(const KEY_T& key,
+               VAL_T val,
+               std::vector<std::pair<KEY_T, VAL_T>>* dropped) {
+    Shard& shard = GetShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.map.find(key);
+    if (it != shard.map.end()) {
+      shard.items.splice(shard.items.begin(), shard.items, it->second);
+      dropped->emplace_back(key, std::move(val));
+      return it->second->second;
+    }
+    shard.items.emplace_front(key, std::move(val));
+    shard.map.emplace(key, shard.items.begin());
+    while (shard.map.size() > shard.capacity) {
+      auto last = std::prev(shard.items.end());
+      shard.map.erase(last->first);
+      dropped->emplace_back(std::move(*last));
+      shard.items.pop_back();
+      evictions_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return shard.items.front().second;
+  }
+
+  void Release(std::vector<std::pair<KEY_T, VAL_T>>* dropped) {
+    if (!on_evict_) return;
+    for (auto& item : *dropped) {
+      on_evict_(item.first, item.second);
+    }
+  }
+
+  std::vector<Shard> shards_;
+  EvictCallback on_evict_;
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+  std::atomic<uint64_t> evictions_{0};
+};
@@ -0,0 +1,299 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may
+// not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "utils/recipe_disk_cache.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "utils/concurrent_lru_cache.h"
+
+namespace {
+
+const char kMagic[8] = {'P', 'D', 'H', 'P', 'U', 'R', 'C', 'P'};
+const uint32_t kFormatVersion = 1;
+const char kMetaExt[] = ".meta";
+const char kRecipeExt[] = ".recipe";
+const char kTempInfix[] = ".tmp.";
+// Leftovers of a store older than this are taken to be from a dead writer.
+const time_t kStaleSeconds = 3600;
+
+void WriteU32(std::ofstream* out, uint32_t v) {
+  out->write(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+void WriteU64(std::ofstream* out, uint64_t v) {
+  out->write(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+template <typename T>
+bool ReadPod(std::ifstream* in, T* v) {
+  in->read(reinterpret_cast<char*>(v), sizeof(T));
+  return static_cast<bool>(*in);
+}
+
+bool ReadString(std::ifstream* in, uint64_t len, std::string* s) {
+  // Guard against corrupt lengths before allocating.
+  if (len > (1ULL << 30)) return false;
+  s->resize(len);
+  in->read(&(*s)[0], len);
+  return static_cast<bool>(*in);
+}
+
+int64_t FileSize(const std::string& path) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) return -1;
+  return st.st_size;
+}
+
+bool EndsWith(const std::string& s, const char* suffix) {
+  size_t n = strlen(suffix);
+  return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+}  // namespace
+
+RecipeDiskCache::RecipeDiskCache(const std::string& dir,
+                                 uint64_t max_bytes,
+                                 const std::string& compiler_version)
+    : dir_(dir), max_bytes_(max_bytes), compiler_version_(compiler_version) {
+  mkdir(dir_.c_str(), 0755);
+  // Picks up what earlier runs left behind.
+  Evict();
+}
+
+std::string RecipeDiskCache::EntryName(const std::string& key) const {
+  HashedKey hashed;
+  hashed.Append(compiler_version_.data(), compiler_version_.size());
+  hashed.Append(key.data(), key.size());
+  char name[17];
+  snprintf(name,
+           sizeof(name),
+           "%016llx",
+           static_cast<unsigned long long>(hashed.hash()));  // NOLINT
+  return name;
+}
+
+std::string RecipeDiskCache::MetaPath(const std::string& name) const {
+  return dir_ + "/" + name + kMetaExt;
+}
+
+std::string RecipeDiskCache::RecipePath(const std::string& name) const {
+  return dir_ + "/" + name + kRecipeExt;
+}
+
+std::string RecipeDiskCache::TempPath(const std::string& path) const {
+  return path + kTempInfix + std::to_string(getpid()) + "." +
+         std::to_string(syscall(SYS_gettid));
+}
+
+bool RecipeDiskCache::Load(const std::string& key,
+                           const DeserializeFn& deserialize) {
+  const std::string name = EntryName(key);
+  const std::string meta_path = MetaPath(name);
+  std::ifstream in(meta_path, std::ios::binary);
+  if (!in) return false;
+
+  char magic[sizeof(kMagic)];
+  uint32_t format_version = 0;
+  uint64_t version_len = 0, key_len = 0, recipe_size = 0;
+  std::string version, stored_key;
+  in.read(magic, sizeof(magic));
+  if (!in || memcmp(magic, kMagic, sizeof(kMagic)) != 0) return false;
+  if (!ReadPod(&in, &format_version) || format_version != kFormatVersion) {
+    return false;
+  }
+  if (!ReadPod(&in, &version_len) || !ReadString(&in, version_len, &version) ||
+      version != compiler_version_) {
+    return false;
+  }
+  if (!ReadPod(&in, &key_len) || !ReadString(&in, key_len, &stored_key) ||
+      stored_key != key) {
+    return false;
+  }
+  if (!ReadPod(&in, &recipe_size)) return false;
+  in.close();
+
+  const std::string recipe_path = RecipePath(name);
+  if (FileSize(recipe_path) != static_cast<int64_t>(recipe_size)) {
+    return false;
+  }
+  if (!deserialize(recipe_path)) return false;
+
+  // Refresh recency for eviction.
+  utimensat(AT_FDCWD, meta_path.c_str(), nullptr, 0);
+  return true;
+}
+
+bool RecipeDiskCache::Store(const std::string& key,
+                            const SerializeFn& serialize) {
+  const std::string name = EntryName(key);
+  const std::string recipe_path = RecipePath(name);
+  const std::string recipe_tmp = TempPath(recipe_path);
+  if (!serialize(recipe_tmp)) {
+    unlink(recipe_tmp.c_str());
+    return false;
+  }
+  int64_t recipe_size = FileSize(recipe_tmp);
+  if (recipe_size < 0 || rename(recipe_tmp.c_str(), recipe_path.c_str())) {
+    unlink(recipe_tmp.c_str());
+    return false;
+  }
+
+  const std::string meta_path = MetaPath(name);
+  const std::string meta_tmp = TempPath(meta_path);
+  {
+    std::ofstream out(meta_tmp, std::ios::binary | std::ios::trunc);
+    out.write(kMagic, sizeof(kMagic));
+    WriteU32(&out, kFormatVersion);
+    WriteU64(&out, compiler_version_.size());
+    out.write(compiler_version_.data(), compiler_version_.size());
+    WriteU64(&out, key.size());
+    out.write(key.data(), key.size());
+    WriteU64(&out, static_cast<uint64_t>(recipe_size));
+    if (!out) {
+      unlink(meta_tmp.c_str());
+      return false;
+    }
+  }
+  int64_t meta_size = FileSize(meta_tmp);
+  if (meta_size < 0 || rename(meta_tmp.c_str(), meta_path.c_str())) {
+    unlink(meta_tmp.c_str());
+    return false;
+  }
+
+  bool over_limit = false;
+  {
+    std::lock_guard<std::mutex> lock(evict_mutex_);
+    // Replacing an entry counts it twice; the next scan corrects that.
+    tracked_bytes_ += recipe_size + meta_size;
+    over_limit = tracked_bytes_ > max_bytes_;
+  }
+  if (over_limit) Evict();
+  return true;
+}
+
+uint64_t RecipeDiskCache::tracked_bytes() {
+  std::lock_guard<std::mutex> lock(evict_mutex_);
+  return tracked_bytes_;
+}
+
+size_t RecipeDiskCache::Evict() {
+  std::lock_guard<std::mutex> lock(evict_mutex_);
+
+  struct Entry {
+    struct timespec mtime = {0, 0};
+    uint64_t meta_bytes = 0;
+    uint64_t recipe_bytes = 0;
+    bool has_meta = false;
+  };
+  std::unordered_map<std::string, Entry> by_name;
+  std::vector<std::string> temps;
+  uint64_t total = 0;
+  size_t removed = 0;
+  const time_t stale_before = time(nullptr) - kStaleSeconds;
+
+  DIR* d = opendir(dir_.c_str());
+  if (d == nullptr) {
+    tracked_bytes_ = 0;
+    return 0;
+  }
+  while (struct dirent* ent = readdir(d)) {
+    std::string file = ent->d_name;
+    if (file.find(kTempInfix) != std::string::npos) {
+      temps.push_back(file);
+    } else if (EndsWith(file, kMetaExt)) {
+      by_name[file.substr(0, file.size() - strlen(kMetaExt))].has_meta = true;
+    } else if (EndsWith(file, kRecipeExt)) {
+      by_name[file.substr(0, file.size() - strlen(kRecipeExt))];
+    }
+  }
+  closedir(d);
+
+  // Temporaries of writers that died mid-store are never renamed into
+  // place; ones still fresh may belong to a live writer and only count.
+  for (const auto& file : temps) {
+    const std::string path = dir_ + "/" + file;
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) continue;
+    if (st.st_mtim.tv_sec < stale_before) {
+      unlink(path.c_str());
+      ++removed;
+    } else {
+      total += st.st_size;
+    }
+  }
+
+  std::vector<std::pair<std::string, Entry>> entries;
+  for (auto& it : by_name) {
+    const std::string& name = it.first;
+    Entry& entry = it.second;
+    struct stat st;
+    if (stat(RecipePath(name).c_str(), &st) == 0) {
+      entry.recipe_bytes = st.st_size;
+      entry.mtime = st.st_mtim;
+    }
+    if (entry.has_meta) {
+      if (stat(MetaPath(name).c_str(), &st) != 0) continue;
+      entry.meta_bytes = st.st_size;
+      entry.mtime = st.st_mtim;
+    } else if (entry.mtime.tv_sec < stale_before) {
+      // A recipe whose meta file was never written, as a writer crashed in
+      // between. Fresh ones may still get theirs.
+      unlink(RecipePath(name).c_str());
+      ++removed;
+      continue;
+    }
+    total += entry.meta_bytes + entry.recipe_bytes;
+    if (entry.has_meta) entries.emplace_back(name, entry);
+  }
+  tracked_bytes_ = total;
+  if (total <= max_bytes_) return removed;
+
+  std::sort(entries.begin(),
+            entries.end(),
+            [](const std::pair<std::string, Entry>& a,
+               const std::pair<std::string, Entry>& b) {
+              const struct timespec& x = a.second.mtime;
+              const struct timespec& y = b.second.mtime;
+              if (x.tv_sec != y.tv_sec) return x.tv_sec < y.tv_sec;
+              return x.tv_nsec < y.tv_nsec;
+            });
+
+  // Down to a tenth below the limit, so the stores right after this one do
+  // not cross it again and rescan.
+  const uint64_t target = max_bytes_ - max_bytes_ / 10;
+  for (auto& entry : entries) {
+    if (total <= target) break;
+    // Meta first, so concurrent readers see a miss instead of a torn entry.
+    unlink(MetaPath(entry.first).c_str());
+    unlink(RecipePath(entry.first).c_str());
+    total -= entry.second.meta_bytes + entry.second.recipe_bytes;
+    ++removed;
+  }
+  tracked_bytes_ = total;
+  return removed;
+}
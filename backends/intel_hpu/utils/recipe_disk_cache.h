@@ -0,0 +1,78 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may
+// not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+
+// Content-addressed directory of compiled recipes shared across processes.
+//
+// An entry is named after a 64-bit hash of the compiler version and the full
+// op cache key (guid, dtype, shapes and params) and consists of two files:
+//   <name>.recipe  the blob written by the serialize hook
+//   <name>.meta    magic, format version, compiler version, full key bytes
+//                  and recipe size, used to reject collisions and stale
+//                  entries
+// Both files are written to temporaries and renamed into place, the meta
+// file last, so a reader never observes a partially written entry. The
+// directory is kept below max_bytes by removing the least recently used
+// entries; a hit refreshes the meta file's mtime. Stores add to a running
+// size, and the directory is only scanned when that crosses max_bytes, so
+// entries written by other processes are noticed at the next scan.
+//
+// The cache never touches the device itself: serialization goes through the
+// hooks passed to Load/Store, so it can be exercised with a stub compiler.
+class RecipeDiskCache {
+ public:
+  // Writes the recipe blob to path. Returns false on failure.
+  using SerializeFn = std::function<bool(const std::string& path)>;
+  // Reads the recipe blob from path. Returns false on failure.
+  using DeserializeFn = std::function<bool(const std::string& path)>;
+
+  RecipeDiskCache(const std::string& dir,
+                  uint64_t max_bytes,
+                  const std::string& compiler_version);
+
+  bool Load(const std::string& key, const DeserializeFn& deserialize);
+  bool Store(const std::string& key, const SerializeFn& serialize);
+
+  // Deletes temporaries and meta-less recipes left over an hour ago by
+  // writers that died mid-store. Then, if the directory holds more than
+  // max_bytes, counting fresh leftovers too, removes least recently used
+  // entries until it is a tenth below that. Resets the running size to
+  // what is left and returns the number of entries and leftovers removed.
+  size_t Evict();
+
+  // Bytes this cache believes the directory holds.
+  uint64_t tracked_bytes();
+
+  // Name of the entry for key, without extension.
+  std::string EntryName(const std::string& key) const;
+  const std::string& dir() const { return dir_; }
+
+ private:
+  std::string MetaPath(const std::string& name) const;
+  std::string RecipePath(const std::string& name) const;
+  std::string TempPath(const std::string& path) const;
+
+  std::string dir_;
+  uint64_t max_bytes_;
+  std::string compiler_version_;
+  std::mutex evict_mutex_;
+  // Size of the directory at the last scan plus what was stored since.
+  uint64_t tracked_bytes_ = 0;
+};
@@ -17,77 +17,37 @@
 #include <assert.h>
 
 #include <cstdarg>
+#include <cstring>
 #include <iostream>
-#include <list>
-#include <unordered_map>
+#include <memory>
+#include <type_traits>
 #include <vector>
 
 #include "glog/logging.h"
 #include "habanalabs/synapse_api.h"
 #include "habanalabs/synapse_common_types.h"
+#include "utils/concurrent_lru_cache.h"
 
 #define MAX_OPNAME_LEN 32
 
-template <class KEY_T, class VAL_T>
-class LRUCache {
- private:
-  std::list<std::pair<KEY_T, VAL_T>> item_list;
-  std::unordered_map<KEY_T, decltype(item_list.begin())> item_map;
-  size_t cache_size;
-
- private:
-  void clean(void) {
-    while (item_map.size() > cache_size) {
-      auto last_it = item_list.end();
-      last_it--;
-      item_map.erase(last_it->first);
-      item_list.pop_back();
-    }
-  }
-
- public:
-  explicit LRUCache(int cache_size_) : cache_size(cache_size_) {}
-
-  void put(const KEY_T& key, const VAL_T& val) {
-    auto it = item_map.find(key);
-    if (it != item_map.end()) {
-      item_list.erase(it->second);
-      item_map.erase(it);
-    }
-    item_list.push_front(make_pair(key, val));
-    item_map.insert(make_pair(key, item_list.begin()));
-    clean();
-  }
-
-  bool exist(const KEY_T& key) { return (item_map.count(key) > 0); }
-
-  VAL_T get(const KEY_T& key) {
-    auto it = item_map.find(key);
-    if (it != item_map.end()) {
-      item_list.splice(item_list.begin(), item_list, it->second);
-      return it->second->second;
-    } else {
-      return nullptr;
-    }
-  }
-};
-
 class KeyCreator {
  public:
-  KeyCreator() { key_.reserve(kMaxKeyLength); }
+  KeyCreator() {}
 
   ~KeyCreator() {}
 
   void AddAsKey(const std::string& str) {
-    key_.append(str);
-    key_.append(1, delimiter);
+    key_.Append(str.data(), str.size());
+    key_.Append(&delimiter, 1);
   }
 
+  // Appends the bytes of data, padding included; see ZeroParams.
   template <typename T>
-  void AddAsKey(const T data) {
-    auto buffer = reinterpret_cast<const char*>(&data);
-    key_.append(buffer, sizeof(T));
-    key_.append(1, delimiter);
+  void AddAsKey(const T& data) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "only plain structs can be keyed by their bytes");
+    key_.Append(&data, sizeof(T));
+    key_.Append(&delimiter, 1);
   }
 
   void AddAsKey(const std::vector<int64_t>& dims) {
@@ -96,16 +56,45 @@ class KeyCreator {
     }
   }
 
-  std::string GetKey() { return key_; }
+  const HashedKey& GetKey() { return key_; }
 
  private:
-  std::string key_ = "";
+  HashedKey key_;
   const char delimiter = '_';
-  const int kMaxKeyLength = 256;
 };
 
+// Zeroes a params struct, padding included, before its fields are set.
+// Params are keyed byte for byte, and the key is also the name of the
+// recipe on disk, so padding left uninitialized (as `params = {}` may
+// leave it) would make equal params miss the cache from run to run.
+template <typename T>
+void ZeroParams(T* params) {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "params must be plain structs");
+  std::memset(params, 0, sizeof(T));
+}
+
+// A recipe shared by the cache and the ops launching it. It is destroyed
+// when the last of them lets go, so evicting a recipe another thread is
+// still launching only drops the cache's reference.
+using RecipePtr = std::shared_ptr<std::remove_pointer<synRecipeHandle>::type>;
+
+inline RecipePtr MakeRecipePtr(synRecipeHandle recipe) {
+  return RecipePtr(recipe, [](synRecipeHandle handle) {
+    synStatus status = synRecipeDestroy(handle);
+    LOG_IF(ERROR, status != synSuccess)
+        << "synRecipeDestroy() failed = " << status;
+  });
+}
+
 class OpCacheOperator {
  public:
+  using RecipeCache =
+      ConcurrentLRUCache<HashedKey, RecipePtr, HashedKey::Hasher>;
+
+  // params is keyed by its bytes, so it must not hold pointers: their
+  // addresses change from run to run and say nothing of what they point
+  // at. Key the pointees through key_creator_ instead.
   template <typename T, typename TP>
   void prepareOpInfo(std::string guid_prefix,
                      const std::vector<DIMS>& ins,
@@ -149,22 +138,36 @@ class OpCacheOperator {
     if (params != nullptr) key_creator_.AddAsKey<TP>(*params);
   }
 
+  // The handle stays valid while this operator lives, even if the cache
+  // evicts it meanwhile.
   synRecipeHandle GetRecipe() {
-    auto& lru_cache = OpCacheOperator::GetLRUCache();
-    if (lru_cache.exist(key_creator_.GetKey())) {
-      auto h = lru_cache.get(key_creator_.GetKey());
-      VLOG(4) << "hint cache " << key_creator_.GetKey() << ", " << h;
-      return h;
-    } else {
-      VLOG(4) << "mis hint cache " << key_creator_.GetKey();
-      return nullptr;
+    if (recipe_ == nullptr) {
+      const HashedKey& key = key_creator_.GetKey();
+      synRecipeHandle loaded = nullptr;
+      if (GetRecipeCache().Get(key, &recipe_)) {
+        VLOG(4) << "hint cache " << guid_ << ", " << recipe_.get();
+      } else if ((loaded = LoadCachedRecipe(key.bytes())) != nullptr) {
+        VLOG(4) << "hint disk cache " << guid_ << ", " << loaded;
+        recipe_ = GetRecipeCache().Put(key, MakeRecipePtr(loaded));
+      } else {
+        VLOG(4) << "mis hint cache " << guid_;
+      }
     }
+    return recipe_.get();
   }
 
-  void setOp(HpuOperator op) {
-    auto& lru_cache = OpCacheOperator::GetLRUCache();
-    lru_cache.put(key_creator_.GetKey(), op.GetRecipe());
-    return;
+  // The recipe is persisted before it is published, since once in the
+  // in-memory cache another thread may evict it. If another thread cached
+  // a recipe for the same key first, that recipe is kept and the one
+  // compiled here is destroyed.
+  void setOp(HpuOperator& op) {  // NOLINT
+    const HashedKey& key = key_creator_.GetKey();
+    StoreCachedRecipe(key.bytes(), op.GetRecipe());
+    recipe_ = GetRecipeCache().Put(key, MakeRecipePtr(op.GetRecipe()));
+  }
+
+  static RecipeCache::Stats GetCacheStats() {
+    return GetRecipeCache().GetStats();
   }
 
   template <typename T>
@@ -184,12 +187,17 @@ class OpCacheOperator {
   }
 
  private:
-  static inline LRUCache<std::string, synRecipeHandle>& GetLRUCache() {
+  static inline RecipeCache& GetRecipeCache() {
     static const int kCapacity = 10240;  // cache capacity
-    static LRUCache<std::string, synRecipeHandle> lru_cache_(kCapacity);
-    return lru_cache_;
+    static const int kShards = 16;
+    // Intentionally leaked: recipes must not be destroyed during static
+    // destruction, after the device may already have been released.
+    static RecipeCache* recipe_cache_ = new RecipeCache(kCapacity, kShards);
+    return *recipe_cache_;
   }
 
+  RecipePtr recipe_;
+
  public:
   std::string guid_;
   synDataType datatype_;
@@ -0,0 +1,108 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may
+// not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "utils/workspace_arena.h"
+
+#include <algorithm>
+#include <utility>
+
+WorkspaceArena::WorkspaceArena(std::unique_ptr<WorkspaceBackend> backend,
+                               uint64_t alignment)
+    : backend_(std::move(backend)),
+      alignment_(alignment == 0 ? 1 : alignment) {}
+
+WorkspaceArena::~WorkspaceArena() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ReclaimLocked(true);
+  for (auto& it : slices_) {
+    if (it.second.addr != 0) backend_->Free(it.second.addr);
+  }
+}
+
+uint64_t WorkspaceArena::Acquire(void* stream, uint64_t size) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ReclaimLocked(false);
+
+  Slice& slice = slices_[stream];
+  if (size <= slice.size) {
+    return slice.addr;
+  }
+
+  high_water_ = std::max(high_water_, size);
+  uint64_t new_size = (high_water_ + alignment_ - 1) / alignment_ * alignment_;
+
+  RetireLocked(stream, &slice);
+
+  uint64_t addr = MallocLocked(new_size);
+  if (addr == 0) {
+    return 0;
+  }
+  slice.addr = addr;
+  slice.size = new_size;
+  ++grow_count_;
+  return addr;
+}
+
+void WorkspaceArena::ReleaseStream(void* stream) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = slices_.find(stream);
+  if (it == slices_.end()) return;
+  RetireLocked(stream, &it->second);
+  slices_.erase(it);
+  ReclaimLocked(false);
+}
+
+void WorkspaceArena::Reclaim() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ReclaimLocked(false);
+}
+
+WorkspaceArena::Stats WorkspaceArena::GetStats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return {high_water_, allocated_bytes_, grow_count_, retired_.size()};
+}
+
+void WorkspaceArena::RetireLocked(void* stream, Slice* slice) {
+  if (slice->addr == 0) return;
+  // Launches already enqueued on the stream may still use the slice.
+  retired_.push_back(
+      {slice->addr, slice->size, backend_->RecordEvent(stream)});
+  *slice = Slice();
+}
+
+void WorkspaceArena::ReclaimLocked(bool wait) {
+  for (auto it = retired_.begin(); it != retired_.end();) {
+    if (wait) {
+      backend_->SyncEvent(it->event);
+    } else if (!backend_->QueryEvent(it->event)) {
+      ++it;
+      continue;
+    }
+    backend_->DestroyEvent(it->event);
+    backend_->Free(it->addr);
+    allocated_bytes_ -= it->size;
+    it = retired_.erase(it);
+  }
+}
+
+uint64_t WorkspaceArena::MallocLocked(uint64_t size) {
+  uint64_t addr = backend_->Malloc(size);
+  if (addr == 0 && !retired_.empty()) {
+    // Out of memory: only now block on the retired slices and retry.
+    ReclaimLocked(true);
+    addr = backend_->Malloc(size);
+  }
+  if (addr != 0) allocated_bytes_ += size;
+  return addr;
+}
@@ -0,0 +1,98 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may
+// not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+// Device operations used by WorkspaceArena. The HPU implementation wraps
+// synDeviceMalloc and synEvent*, tests plug in a mock.
+class WorkspaceBackend {
+ public:
+  virtual ~WorkspaceBackend() {}
+  // Returns the device address, or 0 on failure.
+  virtual uint64_t Malloc(uint64_t size) = 0;
+  virtual void Free(uint64_t addr) = 0;
+  // Records an event after all work currently enqueued on stream.
+  virtual void* RecordEvent(void* stream) = 0;
+  // Returns true once the event has completed.
+  virtual bool QueryEvent(void* event) = 0;
+  virtual void SyncEvent(void* event) = 0;
+  virtual void DestroyEvent(void* event) = 0;
+};
+
+// Recipe workspace memory shared by all launches.
+//
+// Every stream owns a slice that its launches reuse; launches on one stream
+// are ordered, so reuse needs no synchronization and streams never wait on
+// each other. The largest request seen so far (the high-water mark, mostly
+// learned during warmup) sizes every new slice, so a stream grows at most
+// once per new peak. A slice that is outgrown is not freed immediately: an
+// event is recorded on its stream and the memory is released once that
+// event completes, so growing never blocks the host.
+class WorkspaceArena {
+ public:
+  struct Stats {
+    uint64_t high_water;
+    uint64_t allocated_bytes;
+    uint64_t grow_count;
+    uint64_t pending_frees;
+  };
+
+  explicit WorkspaceArena(std::unique_ptr<WorkspaceBackend> backend,
+                          uint64_t alignment = 2 * 1024 * 1024);
+  ~WorkspaceArena();
+
+  // Returns a workspace of at least size bytes reserved for stream, or 0 if
+  // the device is out of memory.
+  uint64_t Acquire(void* stream, uint64_t size);
+
+  // Retires the slice of a stream about to be destroyed. Its memory is
+  // freed once the work already enqueued on the stream completes.
+  void ReleaseStream(void* stream);
+
+  // Frees retired slices whose streams have moved past them.
+  void Reclaim();
+
+  Stats GetStats();
+
+ private:
+  struct Slice {
+    uint64_t addr = 0;
+    uint64_t size = 0;
+  };
+
+  struct Retired {
+    uint64_t addr;
+    uint64_t size;
+    void* event;
+  };
+
+  void RetireLocked(void* stream, Slice* slice);
+  void ReclaimLocked(bool wait);
+  uint64_t MallocLocked(uint64_t size);
+
+  std::unique_ptr<WorkspaceBackend> backend_;
+  uint64_t alignment_;
+  std::mutex mutex_;
+  std::unordered_map<void*, Slice> slices_;
+  std::deque<Retired> retired_;
+  uint64_t high_water_ = 0;
+  uint64_t allocated_bytes_ = 0;
+  uint64_t grow_count_ = 0;
+};
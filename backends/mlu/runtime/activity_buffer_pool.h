@@ -0,0 +1,262 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <concurrentqueue.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct ActivityBuffer {
+  ActivityBuffer() = default;
+  ActivityBuffer(uint64_t* addr, size_t size) : addr(addr), valid_size(size) {}
+  uint64_t* addr = nullptr;
+  size_t valid_size = 0;
+};
+
+// Recycled activity buffers with a lock-free handoff from the cnpapi
+// buffer-completed callback to the thread decoding them.
+//
+// cnpapi asks for a buffer whenever the previous one fills up, from the
+// thread doing the device work. Acquire hands out a cached buffer, so after
+// warm up no 8 MB allocation (and its page faults) lands on that path;
+// Produce and Consume never block each other.
+class ActivityBufferPool {
+ public:
+  ActivityBufferPool(size_t buffer_size,
+                     size_t alignment,
+                     size_t num_prealloc,
+                     size_t max_cached)
+      : buffer_size_(buffer_size),
+        alignment_(alignment),
+        max_cached_(max_cached) {
+    for (size_t i = 0; i < num_prealloc; ++i) {
+      uint64_t* buffer = Allocate();
+      if (buffer == nullptr) break;
+      free_.enqueue(buffer);
+      num_cached_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  ~ActivityBufferPool() {
+    uint64_t* buffer = nullptr;
+    while (free_.try_dequeue(buffer)) free(buffer);
+    ActivityBuffer produced;
+    while (completed_.try_dequeue(produced)) free(produced.addr);
+  }
+
+  ActivityBufferPool(const ActivityBufferPool&) = delete;
+  ActivityBufferPool& operator=(const ActivityBufferPool&) = delete;
+
+  size_t buffer_size() const { return buffer_size_; }
+
+  uint64_t* Acquire() {
+    uint64_t* buffer = nullptr;
+    if (free_.try_dequeue(buffer)) {
+      num_cached_.fetch_sub(1, std::memory_order_relaxed);
+      return buffer;
+    }
+    return Allocate();
+  }
+
+  // Returns a decoded buffer to the pool, or frees it past max_cached.
+  void Release(uint64_t* buffer) {
+    if (buffer == nullptr) return;
+    if (num_cached_.fetch_add(1, std::memory_order_relaxed) < max_cached_) {
+      free_.enqueue(buffer);
+      return;
+    }
+    num_cached_.fetch_sub(1, std::memory_order_relaxed);
+    free(buffer);
+  }
+
+  void Produce(uint64_t* buffer, size_t valid_size) {
+    completed_.enqueue(ActivityBuffer(buffer, valid_size));
+  }
+
+  // Moves every produced buffer into out, oldest first for each producer.
+  size_t Consume(std::vector<ActivityBuffer>* out) {
+    size_t count = 0;
+    ActivityBuffer batch[16];
+    while (size_t n = completed_.try_dequeue_bulk(batch, 16)) {
+      out->insert(out->end(), batch, batch + n);
+      count += n;
+    }
+    return count;
+  }
+
+  size_t num_allocated() const {
+    return num_allocated_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  uint64_t* Allocate() {
+    void* mem = nullptr;
+    if (posix_memalign(&mem, alignment_, buffer_size_) != 0) return nullptr;
+    num_allocated_.fetch_add(1, std::memory_order_relaxed);
+    return static_cast<uint64_t*>(mem);
+  }
+
+  const size_t buffer_size_;
+  const size_t alignment_;
+  const size_t max_cached_;
+  std::atomic<size_t> num_cached_{0};
+  std::atomic<size_t> num_allocated_{0};
+  moodycamel::ConcurrentQueue<uint64_t*> free_;
+  moodycamel::ConcurrentQueue<ActivityBuffer> completed_;
+};
+
+// Drains the buffers produced into an ActivityBufferPool on a background
+// thread and recycles them. decode is called once per buffer, never
+// concurrently, and in order for each producer.
+//
+// Produce runs on cnpapi's thread and takes no lock, so a wakeup can be
+// missed; the thread also polls every interval.
+class ActivityDecoder {
+ public:
+  using DecodeFn = std::function<void(const ActivityBuffer&)>;
+
+  ActivityDecoder(ActivityBufferPool* pool,
+                  DecodeFn decode,
+                  std::chrono::milliseconds interval)
+      : pool_(pool), decode_(std::move(decode)), interval_(interval) {}
+
+  ~ActivityDecoder() { Stop(); }
+
+  ActivityDecoder(const ActivityDecoder&) = delete;
+  ActivityDecoder& operator=(const ActivityDecoder&) = delete;
+
+  void Produce(uint64_t* buffer, size_t valid_size) {
+    pool_->Produce(buffer, valid_size);
+    has_pending_.store(true, std::memory_order_release);
+    cv_.notify_one();
+  }
+
+  void Start() {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (thread_.joinable()) return;
+    stop_ = false;
+    thread_ = std::thread([this] { Loop(); });
+  }
+
+  void Stop() {
+    {
+      std::lock_guard<std::mutex> guard(lock_);
+      if (!thread_.joinable()) return;
+      stop_ = true;
+    }
+    cv_.notify_one();
+    thread_.join();
+    thread_ = std::thread();
+  }
+
+  // Decodes everything produced so far on the calling thread.
+  void DecodePending() {
+    std::lock_guard<std::mutex> guard(decode_lock_);
+    has_pending_.store(false, std::memory_order_relaxed);
+    buffers_.clear();
+    pool_->Consume(&buffers_);
+    for (const auto& buffer : buffers_) {
+      if (buffer.addr == nullptr) continue;
+      decode_(buffer);
+      pool_->Release(buffer.addr);
+    }
+  }
+
+ private:
+  void Loop() {
+    std::unique_lock<std::mutex> lock(lock_);
+    while (!stop_) {
+      cv_.wait_for(lock, interval_, [this] {
+        return stop_ || has_pending_.load(std::memory_order_acquire);
+      });
+      if (stop_) break;
+      lock.unlock();
+      DecodePending();
+      lock.lock();
+    }
+  }
+
+  ActivityBufferPool* pool_;
+  const DecodeFn decode_;
+  const std::chrono::milliseconds interval_;
+
+  std::mutex decode_lock_;  // serializes DecodePending, guards buffers_
+  std::vector<ActivityBuffer> buffers_;
+
+  std::mutex lock_;
+  std::condition_variable cv_;
+  std::atomic<bool> has_pending_{false};
+  bool stop_ = false;
+  std::thread thread_;
+};
+
+// Interns names (kernel names, API names) so decoded records hold a
+// pointer instead of a string copy each. Lookups by C string do not
+// allocate; interned strings live as long as the interner.
+class StringInterner {
+ public:
+  const std::string* Intern(const char* name) {
+    if (name == nullptr) name = "";
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto it = strings_.find(name);
+    if (it != strings_.end()) return it->second.get();
+    auto owned = std::make_unique<std::string>(name);
+    const std::string* interned = owned.get();
+    strings_.emplace(interned->c_str(), std::move(owned));
+    return interned;
+  }
+
+  size_t size() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return strings_.size();
+  }
+
+ private:
+  struct CStrHash {
+    size_t operator()(const char* s) const {
+      // FNV-1a
+      size_t h = 14695981039346656037ULL;
+      for (; *s; ++s) {
+        h ^= static_cast<unsigned char>(*s);
+        h *= 1099511628211ULL;
+      }
+      return h;
+    }
+  };
+  struct CStrEq {
+    bool operator()(const char* a, const char* b) const {
+      return strcmp(a, b) == 0;
+    }
+  };
+
+  mutable std::mutex mutex_;
+  std::unordered_map<const char*,
+                     std::unique_ptr<std::string>,
+                     CStrHash,
+                     CStrEq>
+      strings_;
+};
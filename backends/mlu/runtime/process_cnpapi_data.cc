@@ -17,10 +17,12 @@
 #include <sys/syscall.h>
 #include <unistd.h>
 
-#include <cassert>
+#include <chrono>
 #include <cstdio>
-#include <sstream>
-#include <thread>
+#include <cstring>
+#include <string>
+
+#include "glog/logging.h"
 
 pid_t gettid() { return syscall(SYS_gettid); }
 
@@ -46,33 +48,31 @@ inline uint64_t GetTimeGap() {
   return time_gap;
 }
 
-inline std::string demangle(std::string name) { return name; }
-
-void AddKernelRecord(const cnpapiActivityKernel *kernel,
+void AddKernelRecord(const DecodedActivity &kernel,
                      uint64_t start_ns,
                      C_Profiler collector) {
   static uint64_t time_gap = GetTimeGap();
-  if (kernel->start + time_gap < start_ns) {
+  if (kernel.start + time_gap < start_ns) {
     return;
   }
   phi::DeviceTraceEvent event;
-  event.name = demangle(kernel->name);
+  event.name = *kernel.name;
   event.type = phi::TracerEventType::Kernel;
-  event.start_ns = kernel->start + time_gap;
-  event.end_ns = kernel->end + time_gap;
-  event.device_id = kernel->device_id;
-  event.context_id = kernel->context_id;
-  event.stream_id = kernel->queue_id;
-  event.correlation_id = kernel->correlation_id;
-  event.kernel_info.block_x = kernel->dimx;
-  event.kernel_info.block_y = kernel->dimy;
-  event.kernel_info.block_z = kernel->dimz;
-  event.kernel_info.grid_x = kernel->kernel_type;
+  event.start_ns = kernel.start + time_gap;
+  event.end_ns = kernel.end + time_gap;
+  event.device_id = kernel.device_id;
+  event.context_id = kernel.context_id;
+  event.stream_id = kernel.queue_id;
+  event.correlation_id = kernel.correlation_id;
+  event.kernel_info.block_x = kernel.dimx;
+  event.kernel_info.block_y = kernel.dimy;
+  event.kernel_info.block_z = kernel.dimz;
+  event.kernel_info.grid_x = kernel.kernel_type;
   event.kernel_info.grid_y = 0;
   event.kernel_info.grid_z = 0;
-  event.kernel_info.queued = kernel->queued;
-  event.kernel_info.submitted = kernel->submitted;
-  event.kernel_info.completed = kernel->received;
+  event.kernel_info.queued = kernel.queued;
+  event.kernel_info.submitted = kernel.submitted;
+  event.kernel_info.completed = kernel.received;
 
   profiler_add_device_trace_event(collector, &event);
 }
@@ -95,72 +95,48 @@ const char *MemcpyKind(cnpapiActivityMemcpyType kind) {
   return "MEMCPY";
 }
 
-void AddMemcpyRecord(const cnpapiActivityMemcpy *memcpy,
+void AddMemcpyRecord(const DecodedActivity &memcpy,
                      uint64_t start_ns,
                      C_Profiler collector) {
   static uint64_t time_gap = GetTimeGap();
-  if (memcpy->start + time_gap < start_ns) {
-    return;
-  }
-  phi::DeviceTraceEvent event;
-  event.name = MemcpyKind(memcpy->copy_type);
-  event.type = phi::TracerEventType::Memcpy;
-  event.start_ns = memcpy->start + time_gap;
-  event.end_ns = memcpy->end + time_gap;
-  event.device_id = memcpy->device_id;
-  event.context_id = memcpy->context_id;
-  event.stream_id = memcpy->queue_id;
-  event.correlation_id = memcpy->correlation_id;
-  event.memcpy_info.num_bytes = memcpy->bytes;
-  snprintf(event.memcpy_info.copy_kind,
-           phi::kMemKindMaxLen,
-           "%s",
-           MemcpyKind(memcpy->copy_type));
-  profiler_add_device_trace_event(collector, &event);
-}
-
-void AddMemcpy2Record(const cnpapiActivityMemcpyPtoP *memcpy2,
-                      uint64_t start_ns,
-                      C_Profiler collector) {
-  static uint64_t time_gap = GetTimeGap();
-  if (memcpy2->start + time_gap < start_ns) {
+  if (memcpy.start + time_gap < start_ns) {
     return;
   }
   phi::DeviceTraceEvent event;
-  event.name = MemcpyKind(memcpy2->copy_type);
+  event.name = *memcpy.name;
   event.type = phi::TracerEventType::Memcpy;
-  event.start_ns = memcpy2->start + time_gap;
-  event.end_ns = memcpy2->end + time_gap;
-  event.device_id = memcpy2->device_id;
-  event.context_id = memcpy2->context_id;
-  event.stream_id = memcpy2->queue_id;
-  event.correlation_id = memcpy2->correlation_id;
-  event.memcpy_info.num_bytes = memcpy2->bytes;
+  event.start_ns = memcpy.start + time_gap;
+  event.end_ns = memcpy.end + time_gap;
+  event.device_id = memcpy.device_id;
+  event.context_id = memcpy.context_id;
+  event.stream_id = memcpy.queue_id;
+  event.correlation_id = memcpy.correlation_id;
+  event.memcpy_info.num_bytes = memcpy.bytes;
   snprintf(event.memcpy_info.copy_kind,
            phi::kMemKindMaxLen,
            "%s",
-           MemcpyKind(memcpy2->copy_type));
+           memcpy.name->c_str());
   profiler_add_device_trace_event(collector, &event);
 }
 
-void AddMemsetRecord(const cnpapiActivityMemset *memset,
+void AddMemsetRecord(const DecodedActivity &memset,
                      uint64_t start_ns,
                      C_Profiler collector) {
   static uint64_t time_gap = GetTimeGap();
-  if (memset->start + time_gap < start_ns) {
+  if (memset.start + time_gap < start_ns) {
     return;
   }
   phi::DeviceTraceEvent event;
-  event.name = "MEMSET";
+  event.name = *memset.name;
   event.type = phi::TracerEventType::Memset;
-  event.start_ns = memset->start + time_gap;
-  event.end_ns = memset->end + time_gap;
-  event.device_id = memset->device_id;
-  event.context_id = memset->context_id;
-  event.stream_id = memset->queue_id;
-  event.correlation_id = memset->correlation_id;
-  event.memset_info.num_bytes = memset->bytes;
-  event.memset_info.value = memset->value;
+  event.start_ns = memset.start + time_gap;
+  event.end_ns = memset.end + time_gap;
+  event.device_id = memset.device_id;
+  event.context_id = memset.context_id;
+  event.stream_id = memset.queue_id;
+  event.correlation_id = memset.correlation_id;
+  event.memset_info.num_bytes = memset.bytes;
+  event.memset_info.value = memset.value;
   profiler_add_device_trace_event(collector, &event);
 }
 
@@ -171,12 +147,12 @@ class CnpapiRuntimeCbidStr {
     return inst;
   }
 
-  std::string RuntimeKind(cnpapi_CallbackId cbid) const {
+  const char *RuntimeKind(cnpapi_CallbackId cbid) const {
     auto iter = cbid_str_.find(cbid);
     if (iter == cbid_str_.end()) {
-      return "MLU Runtime API " + std::to_string(cbid);
+      return nullptr;
     }
-    return iter->second;
+    return iter->second.c_str();
   }
 
  private:
@@ -232,120 +208,180 @@ CnpapiRuntimeCbidStr::CnpapiRuntimeCbidStr() {
 #undef REGISTER_RUNTIME_CBID_STR
 }
 
-void AddApiRecord(const cnpapiActivityAPI *api,
+void AddApiRecord(const DecodedActivity &api,
                   uint64_t start_ns,
-                  const std::unordered_map<uint32_t, uint64_t> tid_mapping,
                   C_Profiler collector) {
   static uint64_t time_gap = GetTimeGap();
-  if (api->start + time_gap < start_ns) {
+  if (api.start + time_gap < start_ns) {
     return;
   }
   phi::RuntimeTraceEvent event;
-  event.name = CnpapiRuntimeCbidStr::GetInstance().RuntimeKind(api->cbid);
-  event.start_ns = api->start + time_gap;
-  event.end_ns = api->end + time_gap;
-  event.process_id = api->process_id;
-  event.thread_id = api->thread_id;
-  event.correlation_id = api->correlation_id;
-  event.callback_id = api->cbid;
+  event.name = *api.name;
+  event.start_ns = api.start + time_gap;
+  event.end_ns = api.end + time_gap;
+  event.process_id = api.process_id;
+  event.thread_id = api.thread_id;
+  event.correlation_id = api.correlation_id;
+  event.callback_id = api.cbid;
   event.type = phi::TracerEventType::CudaRuntime;
   profiler_add_runtime_trace_event(collector, &event);
 }
 
-void ProcessCnpapiActivityRecord(
-    const cnpapiActivity *record,
-    uint64_t start_ns,
-    const std::unordered_map<uint32_t, uint64_t> tid_mapping,
-    C_Profiler collector) {
+template <typename T>
+void DecodeCommon(const T *record, DecodedActivity *out) {
+  out->start = record->start;
+  out->end = record->end;
+  out->device_id = record->device_id;
+  out->context_id = record->context_id;
+  out->queue_id = record->queue_id;
+  out->correlation_id = record->correlation_id;
+}
+
+bool DecodeCnpapiActivityRecord(const cnpapiActivity *record,
+                                StringInterner *names,
+                                DecodedActivity *out) {
+  memset(out, 0, sizeof(*out));
+  out->type = record->type;
   switch (record->type) {
+    case CNPAPI_ACTIVITY_TYPE_KERNEL: {
+      auto *kernel = reinterpret_cast<const cnpapiActivityKernel *>(record);
+      DecodeCommon(kernel, out);
+      out->name = names->Intern(kernel->name);
+      out->dimx = kernel->dimx;
+      out->dimy = kernel->dimy;
+      out->dimz = kernel->dimz;
+      out->kernel_type = kernel->kernel_type;
+      out->queued = kernel->queued;
+      out->submitted = kernel->submitted;
+      out->received = kernel->received;
+      return true;
+    }
+    case CNPAPI_ACTIVITY_TYPE_MEMCPY: {
+      auto *memcpy = reinterpret_cast<const cnpapiActivityMemcpy *>(record);
+      DecodeCommon(memcpy, out);
+      out->name = names->Intern(MemcpyKind(memcpy->copy_type));
+      out->bytes = memcpy->bytes;
+      return true;
+    }
+    case CNPAPI_ACTIVITY_TYPE_MEMCPY_PTOP: {
+      auto *memcpy2 =
+          reinterpret_cast<const cnpapiActivityMemcpyPtoP *>(record);
+      DecodeCommon(memcpy2, out);
+      out->type = CNPAPI_ACTIVITY_TYPE_MEMCPY;
+      out->name = names->Intern(MemcpyKind(memcpy2->copy_type));
+      out->bytes = memcpy2->bytes;
+      return true;
+    }
+    case CNPAPI_ACTIVITY_TYPE_MEMSET: {
+      auto *memset = reinterpret_cast<const cnpapiActivityMemset *>(record);
+      DecodeCommon(memset, out);
+      out->name = names->Intern("MEMSET");
+      out->bytes = memset->bytes;
+      out->value = memset->value;
+      return true;
+    }
+    case CNPAPI_ACTIVITY_TYPE_CNDRV_API: {
+      auto *api = reinterpret_cast<const cnpapiActivityAPI *>(record);
+      out->start = api->start;
+      out->end = api->end;
+      out->correlation_id = api->correlation_id;
+      out->process_id = api->process_id;
+      out->thread_id = api->thread_id;
+      out->cbid = api->cbid;
+      const char *kind =
+          CnpapiRuntimeCbidStr::GetInstance().RuntimeKind(api->cbid);
+      out->name =
+          kind != nullptr
+              ? names->Intern(kind)
+              : names->Intern(
+                    ("MLU Runtime API " + std::to_string(api->cbid)).c_str());
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+void ProcessDecodedActivity(const DecodedActivity &record,
+                            uint64_t start_ns,
+                            C_Profiler collector) {
+  switch (record.type) {
     case CNPAPI_ACTIVITY_TYPE_KERNEL:
-      AddKernelRecord(reinterpret_cast<const cnpapiActivityKernel *>(record),
-                      start_ns,
-                      collector);
+      AddKernelRecord(record, start_ns, collector);
       break;
     case CNPAPI_ACTIVITY_TYPE_MEMCPY:
-      AddMemcpyRecord(reinterpret_cast<const cnpapiActivityMemcpy *>(record),
-                      start_ns,
-                      collector);
-      break;
-    case CNPAPI_ACTIVITY_TYPE_MEMCPY_PTOP:
-      AddMemcpy2Record(
-          reinterpret_cast<const cnpapiActivityMemcpyPtoP *>(record),
-          start_ns,
-          collector);
+      AddMemcpyRecord(record, start_ns, collector);
       break;
     case CNPAPI_ACTIVITY_TYPE_MEMSET:
-      AddMemsetRecord(reinterpret_cast<const cnpapiActivityMemset *>(record),
-                      start_ns,
-                      collector);
+      AddMemsetRecord(record, start_ns, collector);
       break;
     case CNPAPI_ACTIVITY_TYPE_CNDRV_API:
-      AddApiRecord(reinterpret_cast<const cnpapiActivityAPI *>(record),
-                   start_ns,
-                   tid_mapping,
-                   collector);
+      AddApiRecord(record, start_ns, collector);
       break;
     default:
       break;
   }
 }
 
-void *AlignedMalloc(size_t size, size_t alignment) {
-  assert(alignment >= sizeof(void *) && (alignment & (alignment - 1)) == 0);
-  size = (size + alignment - 1) / alignment * alignment;
-#if defined(_POSIX_C_SOURCE) && _POSIX_C_SOURCE >= 200112L
-  void *aligned_mem = nullptr;
-  if (posix_memalign(&aligned_mem, alignment, size) != 0) {
-    aligned_mem = nullptr;
-  }
-  return aligned_mem;
-#elif defined(_WIN32)
-  return _aligned_malloc(size, alignment);
-#else
-  void *mem = malloc(size + alignment);
-  if (mem == nullptr) {
-    return nullptr;
-  }
-  size_t adjust = alignment - reinterpret_cast<uint64_t>(mem) % alignment;
-  void *aligned_mem = reinterpret_cast<char *>(mem) + adjust;
-  *(reinterpret_cast<void **>(aligned_mem) - 1) = mem;
-  assert(reinterpret_cast<uint64_t>(aligned_mem) % alignment == 0);
-  return aligned_mem;
-#endif
-}
+namespace {
+constexpr size_t kBufferSize = 1 << 23;  // 8 MB
+constexpr size_t kBufferAlignSize = 8;
+// Enough for cnpapi to keep filling buffers while earlier ones are decoded.
+constexpr size_t kNumPreallocBuffers = 2;
+constexpr size_t kMaxCachedBuffers = 8;
+// The decoder also wakes on this period in case a notification was missed.
+constexpr auto kDecodeInterval = std::chrono::milliseconds(50);
+}  // namespace
 
-void AlignedFree(void *mem_ptr) {
-#if defined(_POSIX_C_SOURCE) && _POSIX_C_SOURCE >= 200112L
-  free(mem_ptr);
-#elif defined(_WIN32)
-  _aligned_free(mem_ptr);
-#else
-  if (mem_ptr) {
-    free(*(reinterpret_cast<void **>(mem_ptr) - 1));
-  }
-#endif
-}
+Tracer::Tracer()
+    : pool_(kBufferSize,
+            kBufferAlignSize,
+            kNumPreallocBuffers,
+            kMaxCachedBuffers),
+      decoder_(&pool_,
+               [this](const ActivityBuffer &buffer) { DecodeBuffer(buffer); },
+               kDecodeInterval) {}
 
 void Tracer::AllocateBuffer(uint64_t **buffer, size_t *size) {
-  constexpr size_t kBufferSize = 1 << 23;  // 8 MB
-  constexpr size_t kBufferAlignSize = 8;
-  *buffer = reinterpret_cast<uint64_t *>(
-      AlignedMalloc(kBufferSize, kBufferAlignSize));
-  *size = kBufferSize;
+  *buffer = pool_.Acquire();
+  *size = *buffer != nullptr ? pool_.buffer_size() : 0;
 }
 
 void Tracer::ProduceBuffer(uint64_t *buffer, size_t valid_size) {
-  std::lock_guard<std::mutex> guard(activity_buffer_lock_);
-  activity_buffers_.emplace_back(buffer, valid_size);
+  decoder_.Produce(buffer, valid_size);
 }
 
-std::vector<ActivityBuffer> Tracer::ConsumeBuffers() {
-  std::vector<ActivityBuffer> buffers;
-  {
-    std::lock_guard<std::mutex> guard(activity_buffer_lock_);
-    buffers.swap(activity_buffers_);
+void Tracer::StartDecoder() { decoder_.Start(); }
+
+void Tracer::StopDecoder() { decoder_.Stop(); }
+
+void Tracer::DecodeBuffer(const ActivityBuffer &buffer) {
+  size_t valid_size = buffer.valid_size;
+  cnpapiActivity *record = nullptr;
+  std::lock_guard<std::mutex> guard(records_lock_);
+  while (valid_size > 0) {
+    cnpapiResult status =
+        cnpapiActivityGetNextRecord(buffer.addr, valid_size, &record);
+    if (status != CNPAPI_SUCCESS) {
+      if (status != CNPAPI_ERROR_MAX_LIMIT_REACHED) {
+        LOG(WARNING) << "cnpapiActivityGetNextRecord failed with " << status
+                     << ", dropping the rest of the activity buffer.";
+      }
+      break;
+    }
+    DecodedActivity decoded;
+    if (DecodeCnpapiActivityRecord(record, &names_, &decoded)) {
+      records_.push_back(decoded);
+    }
   }
-  return buffers;
 }
 
-void Tracer::ReleaseBuffer(uint64_t *buffer) { AlignedFree(buffer); }
+std::vector<DecodedActivity> Tracer::ConsumeRecords() {
+  decoder_.DecodePending();
+  std::vector<DecodedActivity> records;
+  {
+    std::lock_guard<std::mutex> guard(records_lock_);
+    records.swap(records_);
+  }
+  return records;
+}
@@ -18,24 +18,57 @@
 #include <cnpapi_cndrv_id.h>
 
 #include <mutex>
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "paddle/phi/api/profiler/trace_event.h"
 #include "paddle/phi/backends/device_ext.h"
 #include "paddle/phi/core/os_info.h"
+#include "runtime/activity_buffer_pool.h"
 
-struct ActivityBuffer {
-  ActivityBuffer(uint64_t* addr, size_t size) : addr(addr), valid_size(size) {}
-  uint64_t* addr;
-  size_t valid_size;
+// The fields of one cnpapi activity record the profiler reports, copied out
+// of the activity buffer so the buffer can be recycled right away. Names
+// are interned by the Tracer.
+struct DecodedActivity {
+  cnpapiActivityType type;
+  uint64_t start;
+  uint64_t end;
+  uint64_t device_id;
+  uint64_t context_id;
+  uint64_t queue_id;
+  uint64_t correlation_id;
+  const std::string* name;
+  // kernel
+  uint64_t dimx;
+  uint64_t dimy;
+  uint64_t dimz;
+  uint64_t kernel_type;
+  uint64_t queued;
+  uint64_t submitted;
+  uint64_t received;
+  // memcpy / memset
+  uint64_t bytes;
+  uint64_t value;
+  // api
+  uint64_t process_id;
+  uint64_t thread_id;
+  uint32_t cbid;
 };
 
-void ProcessCnpapiActivityRecord(
-    const cnpapiActivity* record,
-    uint64_t start_ns,
-    const std::unordered_map<uint32_t, uint64_t> tid_mapping,
-    C_Profiler collector);
+// Copies the reported fields of record into out; false for record types the
+// profiler ignores.
+bool DecodeCnpapiActivityRecord(const cnpapiActivity* record,
+                                StringInterner* names,
+                                DecodedActivity* out);
 
+void ProcessDecodedActivity(const DecodedActivity& record,
+                            uint64_t start_ns,
+                            C_Profiler collector);
+
+// Receives cnpapi activity buffers and decodes them on a background thread
+// while profiling runs, so collecting data at the end of a step only has to
+// turn compact records into trace events.
 class Tracer {
  public:
   static Tracer& Instance() {
@@ -43,14 +76,30 @@ class Tracer {
     return instance;
   }
 
+  ~Tracer() { decoder_.Stop(); }
+
+  // cnpapi callbacks.
   void AllocateBuffer(uint64_t** buffer, size_t* size);
   void ProduceBuffer(uint64_t* buffer, size_t valid_size);
-  std::vector<ActivityBuffer> ConsumeBuffers();
-  void ReleaseBuffer(uint64_t* buffer);
+
+  void StartDecoder();
+  void StopDecoder();
+
+  // Decodes whatever is still pending and returns all records decoded since
+  // the last call.
+  std::vector<DecodedActivity> ConsumeRecords();
 
  private:
-  Tracer() {}
+  Tracer();
+
+  // Decodes the records of one produced buffer into records_.
+  void DecodeBuffer(const ActivityBuffer& buffer);
+
+  ActivityBufferPool pool_;
+  StringInterner names_;
+
+  std::mutex records_lock_;  // guards records_
+  std::vector<DecodedActivity> records_;
 
-  std::mutex activity_buffer_lock_;
-  std::vector<ActivityBuffer> activity_buffers_;
+  ActivityDecoder decoder_;
 };
@@ -24,9 +24,22 @@
 #include "glog/logging.h"
 #include "runtime/CNRTEvent.h"
 #include "runtime/flags.h"
+#include "runtime/staging_ring.h"
 
 FLAGS_DEFINE_bool(mlu_reuse_event, true, "reuse_event");
 FLAGS_DEFINE_bool(mlu_runtime_debug, false, "runtime debug log");
+FLAGS_DEFINE_uint64(mlu_h2d_staging_size,
+                    4 << 20,
+                    "pinned staging memory preallocated per stream for "
+                    "asynchronous H2D copies, in bytes");
+FLAGS_DEFINE_uint64(mlu_h2d_staging_max_size,
+                    256 << 20,
+                    "size the H2D staging memory of a stream may grow to "
+                    "before copies wait for earlier ones, in bytes");
+FLAGS_DEFINE_uint64(mlu_h2d_staging_chunk_size,
+                    1 << 20,
+                    "asynchronous H2D copies are staged in chunks of this "
+                    "size so host copies overlap DMA, in bytes");
 
 thread_local int g_current_device_id(-1);
 
@@ -89,89 +102,61 @@ class EventPool {
   std::vector<PerDevicePool> pools_{};
 } g_event_pool;
 
-class AlignnedAllocator {
+// Pinned memory and notifiers of one queue, for its H2D staging ring. Uses
+// notifiers directly rather than CreateEvent and friends, which go through
+// the framework event bookkeeping under a global lock.
+class MLUStagingDevice : public StagingDevice {
  public:
-  explicit AlignnedAllocator(int dev_id) : device({dev_id}) {}
-  void *Alloc(const C_Device device, size_t size, size_t align) {
-    std::lock_guard<std::mutex> lock(mtx_);
-    ProcessEvents();
-    void *p = nullptr;
-    HostAllocate(device, &p, align + size);
-    void *ret =
-        reinterpret_cast<void *>(reinterpret_cast<size_t>(p) + align -
-                                 (reinterpret_cast<size_t>(p) & (align - 1)));
-    recorded_events_[ret] = {p, nullptr};
-    return ret;
-  }
+  explicit MLUStagingDevice(cnrtQueue_t queue) : queue_(queue) {}
 
-  void Record(void *p, cnrtNotifier_t event) {
-    std::lock_guard<std::mutex> lock(mtx_);
-    recorded_events_[p].second = event;
+  void *HostAlloc(size_t size) override {
+    void *ptr = nullptr;
+    PADDLE_ENFORCE_MLU_SUCCESS(cnrtHostMalloc(&ptr, size));
+    return ptr;
   }
 
-  void ClearEvent() {
-    std::lock_guard<std::mutex> lock(mtx_);
-    for (auto it = recorded_events_.begin(); it != recorded_events_.end();) {
-      cnrtNotifier_t event = it->second.second;
-      if (!event) continue;
-      PADDLE_ENFORCE_MLU_SUCCESS(
-          cnrtWaitNotifier(reinterpret_cast<cnrtNotifier_t>(event)));
-      void *ptr = it->second.first;
-      HostDeallocate(nullptr, ptr, 0);
-      PADDLE_ENFORCE_MLU_SUCCESS(cnrtNotifierDestroy(event));
-      it = recorded_events_.erase(it);
-    }
+  void HostFree(void *ptr) override {
+    PADDLE_ENFORCE_MLU_SUCCESS(cnrtFreeHost(ptr));
   }
 
-  void ProcessEvents() {
-    for (auto it = recorded_events_.begin(); it != recorded_events_.end();) {
-      cnrtNotifier_t event = it->second.second;
-      if (!event) continue;
-      auto status = QueryEvent(&device, reinterpret_cast<C_Event>(event));
-      if (status == C_SUCCESS) {
-        void *ptr = it->second.first;
-        HostDeallocate(nullptr, ptr, 0);
-        it = recorded_events_.erase(it);
-        DestroyEvent(&device, reinterpret_cast<C_Event>(event));
-      } else {
-        ++it;
-      }
-    }
+  Event CreateEvent() override {
+    cnrtNotifier_t notifier;
+    PADDLE_ENFORCE_MLU_SUCCESS(cnrtNotifierCreateWithFlags(
+        &notifier, CNRT_NOTIFIER_DISABLE_TIMING_ALL));
+    return notifier;
   }
 
- private:
-  std::unordered_map<void *, std::pair<void *, cnrtNotifier_t>>
-      recorded_events_;
-  std::mutex mtx_;
-  C_Device_st device;
-};
-
-class AlignnedAllocatorList {
- public:
-  explicit AlignnedAllocatorList(size_t device_count)
-      : allocator_list(device_count, nullptr) {}
+  void DestroyEvent(Event event) override {
+    PADDLE_ENFORCE_MLU_SUCCESS(
+        cnrtNotifierDestroy(static_cast<cnrtNotifier_t>(event)));
+  }
 
-  void Init(size_t dev_id) {
-    allocator_list[dev_id] = new AlignnedAllocator(dev_id);
+  void RecordEvent(Event event) override {
+    PADDLE_ENFORCE_MLU_SUCCESS(
+        cnrtPlaceNotifier(static_cast<cnrtNotifier_t>(event), queue_));
   }
 
-  void Deinit(size_t dev_id) {
-    delete allocator_list[dev_id];
-    allocator_list[dev_id] = nullptr;
+  bool EventDone(Event event) override {
+    if (cnrtQueryNotifier(static_cast<cnrtNotifier_t>(event)) ==
+        cnrtSuccess) {
+      return true;
+    }
+    (void)cnrtGetLastError();
+    return false;
   }
 
-  AlignnedAllocator *GetAllocator(size_t dev_id) {
-    return allocator_list[dev_id];
+  void WaitEvent(Event event) override {
+    PADDLE_ENFORCE_MLU_SUCCESS(
+        cnrtWaitNotifier(static_cast<cnrtNotifier_t>(event)));
   }
 
  private:
-  std::vector<AlignnedAllocator *> allocator_list;
+  cnrtQueue_t queue_;
 };
 
 // static variables
 static std::vector<std::vector<EventPool::Event>> hold_event_vecs(
     get_devices_count());
-static AlignnedAllocatorList *global_allocator_list = nullptr;
 static std::mutex g_mutex;
 
 // some help functions
@@ -208,6 +193,10 @@ C_Status CreateStream(const C_Device device, C_Stream *stream) {
   mlu_stream->queue = queue;
   mlu_stream->handle = handle;
   mlu_stream->op_handle = op_handle;
+  mlu_stream->h2d_staging = new StagingRing(
+      std::unique_ptr<StagingDevice>(new MLUStagingDevice(queue)),
+      FLAGS_mlu_h2d_staging_size,
+      FLAGS_mlu_h2d_staging_max_size);
 
   *stream = reinterpret_cast<C_Stream>(mlu_stream);
 
@@ -215,12 +204,16 @@ C_Status CreateStream(const C_Device device, C_Stream *stream) {
 }
 
 C_Status DestroyStream(const C_Device device, C_Stream stream) {
+  mluStream_t mlu_stream = reinterpret_cast<mluStream_t>(stream);
+  // Waits for the copies still reading staged memory, so it must go before
+  // the queue.
+  delete mlu_stream->h2d_staging;
+
   PADDLE_ENFORCE_MLU_SUCCESS(cnnlDestroy(GetHandle(stream)));
   PADDLE_ENFORCE_MLU_SUCCESS(mluOpDestroy(GetOpHandle(stream)));
   PADDLE_ENFORCE_MLU_SUCCESS(cnrtQueueDestroy(GetQueue(stream)));
 
-  mluStream_t mlu_stream = reinterpret_cast<mluStream_t>(stream);
-  delete[] mlu_stream;
+  delete mlu_stream;
 
   return C_SUCCESS;
 }
@@ -400,19 +393,10 @@ C_Status SyncEvent(const C_Device device, C_Event event) {
 }
 
 // Device
-C_Status Init() {
-  size_t dev_cnt = get_devices_count();
-  if (dev_cnt) {
-    global_allocator_list = new AlignnedAllocatorList(dev_cnt);
-  }
-  return C_SUCCESS;
-}
+C_Status Init() { return C_SUCCESS; }
 
 C_Status InitDevice(const C_Device device) {
   SetDevice(device);
-  if (global_allocator_list) {
-    global_allocator_list->Init(device->id);
-  }
   return C_SUCCESS;
 }
 
@@ -436,17 +420,10 @@ C_Status GetDevice(const C_Device device) {
 
 C_Status ReleaseDevice(const C_Device device) {
   SetDevice(device);
-  if (global_allocator_list) {
-    global_allocator_list->Deinit(device->id);
-  }
   return C_SUCCESS;
 }
 
 C_Status Finalize() {
-  if (global_allocator_list) {
-    delete global_allocator_list;
-    global_allocator_list = nullptr;
-  }
   for (auto iter = hold_event_vecs.begin(); iter != hold_event_vecs.end();
        iter++) {
     iter->clear();
@@ -561,19 +538,21 @@ C_Status AsyncMemCpyH2D(const C_Device device,
   if (device) {
     check_uninitialized_thread(device->id);
   }
-  auto allocator = global_allocator_list->GetAllocator(get_current_device_id());
-  void *tmp = allocator->Alloc(device, size, 64);
-  cnrtNotifier_t event;
-  CreateEvent(device, reinterpret_cast<C_Event *>(&event));
-  memcpy(tmp, src, size);
-  PADDLE_ENFORCE_MLU_SUCCESS(cnrtMemcpyAsync(dst,
-                                             const_cast<void *>(tmp),
-                                             size,
-                                             GetQueue(stream),
-                                             cnrtMemcpyHostToDev));
-
-  RecordEvent(device, stream, reinterpret_cast<C_Event>(event));
-  allocator->Record(tmp, event);
+  // src may be pageable and reused as soon as this returns, so it is copied
+  // into the stream's pinned staging ring and the DMA reads from there.
+  auto mlu_stream = reinterpret_cast<mluStream_t>(stream);
+  mlu_stream->h2d_staging->Stage(
+      src,
+      size,
+      FLAGS_mlu_h2d_staging_chunk_size,
+      [&](void *staged, size_t offset, size_t bytes) {
+        PADDLE_ENFORCE_MLU_SUCCESS(
+            cnrtMemcpyAsync(static_cast<char *>(dst) + offset,
+                            staged,
+                            bytes,
+                            mlu_stream->queue,
+                            cnrtMemcpyHostToDev));
+      });
   return C_SUCCESS;
 }
 
@@ -827,42 +806,14 @@ void BufferCompletedCallback(uint64_t *buffer, size_t size, size_t valid_size) {
   Tracer::Instance().ProduceBuffer(buffer, valid_size);
 }
 
-std::unordered_map<uint32_t, uint64_t> CreateThreadIdMapping() {
-  std::unordered_map<uint32_t, uint64_t> mapping;
-  std::unordered_map<uint64_t, phi::ThreadId> ids = phi::GetAllThreadIds();
-  for (const auto &id : ids) {
-    mapping[id.second.cupti_tid] = id.second.sys_tid;
-  }
-  return mapping;
-}
-
 int ProcessCnpapiActivity(C_Profiler prof, uint64_t tracing_start_ns_) {
-  int record_cnt = 0;
   CNPAPI_CALL(cnpapiActivityFlushAll());
-  auto mapping = CreateThreadIdMapping();
-  std::vector<ActivityBuffer> buffers = Tracer::Instance().ConsumeBuffers();
-  for (auto &buffer : buffers) {
-    if (buffer.addr == nullptr || buffer.valid_size == 0) {
-      continue;
-    }
-
-    cnpapiActivity *record = nullptr;
-    while (true) {
-      cnpapiResult status =
-          cnpapiActivityGetNextRecord(buffer.addr, buffer.valid_size, &record);
-      if (status == CNPAPI_SUCCESS) {
-        ProcessCnpapiActivityRecord(record, tracing_start_ns_, mapping, prof);
-        ++record_cnt;
-      } else if (status == CNPAPI_ERROR_MAX_LIMIT_REACHED) {
-        break;
-      } else {
-        CNPAPI_CALL(status);
-      }
-    }
-
-    Tracer::Instance().ReleaseBuffer(buffer.addr);
+  // Most buffers were already decoded in the background while the step ran.
+  std::vector<DecodedActivity> records = Tracer::Instance().ConsumeRecords();
+  for (const auto &record : records) {
+    ProcessDecodedActivity(record, tracing_start_ns_, prof);
   }
-  return record_cnt;
+  return static_cast<int>(records.size());
 }
 
 C_Status ProfilerInitialize(C_Profiler prof, void **user_data) {
@@ -870,6 +821,7 @@ C_Status ProfilerInitialize(C_Profiler prof, void **user_data) {
 }
 
 C_Status ProfilerFinalize(C_Profiler prof, void *user_data) {
+  Tracer::Instance().StopDecoder();
   CNPAPI_CALL(cnpapiRelease());
   return C_SUCCESS;
 }
@@ -883,12 +835,13 @@ C_Status ProfilerPrepare(C_Profiler prof, void *user_data) {
   CNPAPI_CALL(cnpapiActivityEnable(CNPAPI_ACTIVITY_TYPE_MEMCPY_PTOP));
   CNPAPI_CALL(cnpapiActivityEnable(CNPAPI_ACTIVITY_TYPE_MEMSET));
   CNPAPI_CALL(cnpapiActivityEnable(CNPAPI_ACTIVITY_TYPE_CNDRV_API));
+  Tracer::Instance().StartDecoder();
   VLOG(3) << "enable cnpapi activity";
   return C_SUCCESS;
 }
 
 C_Status ProfilerStart(C_Profiler prof, void *user_data) {
-  Tracer::Instance().ConsumeBuffers();
+  Tracer::Instance().ConsumeRecords();
   return C_SUCCESS;
 }
 
@@ -109,10 +109,14 @@ inline size_t get_devices_count() {
   return static_cast<size_t>(count);
 }
 
+class StagingRing;
+
 struct mluStream {
   cnnlHandle_t handle;
   mluOpHandle_t op_handle;
   cnrtQueue_t queue;
+  // Pinned memory for the asynchronous H2D copies on this queue.
+  StagingRing *h2d_staging = nullptr;
 };
 typedef mluStream *mluStream_t;
 
@@ -0,0 +1,265 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Pinned host memory and completion events of one stream, as used by
+// StagingRing. The MLU runtime implements it with cnrt; tests can drive the
+// ring with a fake device on any host.
+class StagingDevice {
+ public:
+  using Event = void *;
+
+  virtual ~StagingDevice() = default;
+
+  virtual void *HostAlloc(size_t size) = 0;
+  virtual void HostFree(void *ptr) = 0;
+
+  virtual Event CreateEvent() = 0;
+  virtual void DestroyEvent(Event event) = 0;
+  // Marks the point after all work enqueued on the stream so far.
+  virtual void RecordEvent(Event event) = 0;
+  // True once the work before the recorded point has finished.
+  virtual bool EventDone(Event event) = 0;
+  virtual void WaitEvent(Event event) = 0;
+};
+
+// Alignment of every staged chunk.
+constexpr size_t kStagingAlignment = 64;
+
+// Per-stream ring of pinned staging memory for asynchronous H2D copies.
+//
+// Source data is copied into the ring and the DMA reads it from there, so
+// the caller may reuse its buffer as soon as the copy is enqueued. Space is
+// handed out in FIFO order and reclaimed the same way: the stream completes
+// copies in order, so only the oldest outstanding event is ever polled.
+// When the ring is full it grows geometrically up to max_capacity, after
+// which callers wait for the oldest copy. A grown-out buffer is freed once
+// its last copy completes.
+//
+// Large copies are staged in chunks, so the host memcpy of one chunk
+// overlaps the DMA of the previous one.
+class StagingRing {
+ public:
+  StagingRing(std::unique_ptr<StagingDevice> device,
+              size_t initial_capacity,
+              size_t max_capacity)
+      : device_(std::move(device)),
+        max_capacity_(std::max(max_capacity, kStagingAlignment)) {
+    current_ = NewBuffer(
+        std::min(AlignUp(std::max<size_t>(initial_capacity, 1)),
+                 max_capacity_));
+  }
+
+  ~StagingRing() {
+    for (auto &segment : segments_) {
+      device_->WaitEvent(segment.event);
+      free_events_.push_back(segment.event);
+    }
+    for (auto &buffer : buffers_) device_->HostFree(buffer->data);
+    for (auto event : free_events_) device_->DestroyEvent(event);
+  }
+
+  StagingRing(const StagingRing &) = delete;
+  StagingRing &operator=(const StagingRing &) = delete;
+
+  // Stages size bytes of src in chunks of at most chunk_size and calls
+  // enqueue(staged, offset, bytes) for each, which must enqueue the copy of
+  // src[offset, offset + bytes) from staged on the ring's stream.
+  template <typename EnqueueFn>
+  void Stage(const void *src,
+             size_t size,
+             size_t chunk_size,
+             EnqueueFn &&enqueue) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    chunk_size = std::max(chunk_size, kStagingAlignment);
+    for (size_t offset = 0; offset < size; offset += chunk_size) {
+      const size_t bytes = std::min(chunk_size, size - offset);
+      char *staged = Acquire(bytes);
+      memcpy(staged, static_cast<const char *>(src) + offset, bytes);
+      StagingDevice::Event event = nullptr;
+      try {
+        event = TakeEvent();
+        enqueue(staged, offset, bytes);
+      } catch (...) {
+        if (event != nullptr) free_events_.push_back(event);
+        Abandon();
+        throw;
+      }
+      device_->RecordEvent(event);
+      segments_.back().event = event;
+    }
+  }
+
+  size_t capacity() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return current_->capacity;
+  }
+
+  size_t outstanding() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return segments_.size();
+  }
+
+  // Times a copy had to wait for an earlier one to free space.
+  size_t num_waits() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return num_waits_;
+  }
+
+ private:
+  struct Buffer {
+    char *data;
+    size_t capacity;
+    // Live bytes form [tail, head) modulo capacity.
+    size_t head = 0;
+    size_t used = 0;
+  };
+
+  struct Segment {
+    Buffer *buffer;
+    // Includes the end of the buffer skipped when the segment wrapped.
+    size_t bytes;
+    StagingDevice::Event event;
+  };
+
+  static size_t AlignUp(size_t size) {
+    return (size + kStagingAlignment - 1) / kStagingAlignment *
+           kStagingAlignment;
+  }
+
+  Buffer *NewBuffer(size_t capacity) {
+    void *data = device_->HostAlloc(capacity);
+    buffers_.push_back(std::unique_ptr<Buffer>(
+        new Buffer{static_cast<char *>(data), capacity}));
+    return buffers_.back().get();
+  }
+
+  char *Acquire(size_t bytes) {
+    bytes = AlignUp(bytes);
+    Reclaim();
+    while (true) {
+      size_t offset = 0;
+      if (bytes <= current_->capacity && Carve(bytes, &offset)) {
+        return current_->data + offset;
+      }
+      const bool can_grow = current_->capacity < max_capacity_;
+      if (bytes > current_->capacity || (can_grow && current_->used > 0)) {
+        Grow(bytes);
+        continue;
+      }
+      ++num_waits_;
+      device_->WaitEvent(segments_.front().event);
+      Reclaim();
+    }
+  }
+
+  // Takes bytes from the head of the current buffer, wrapping to its start
+  // if the end is too short, and queues a segment for them.
+  bool Carve(size_t bytes, size_t *offset) {
+    Buffer *buffer = current_;
+    if (buffer->used == 0) buffer->head = 0;
+    if (buffer->used == buffer->capacity) return false;
+    const size_t tail =
+        (buffer->head + buffer->capacity - buffer->used) % buffer->capacity;
+    size_t taken = 0;
+    if (buffer->used == 0 || buffer->head > tail) {
+      if (bytes <= buffer->capacity - buffer->head) {
+        *offset = buffer->head;
+        taken = bytes;
+      } else if (bytes <= tail) {
+        *offset = 0;
+        taken = buffer->capacity - buffer->head + bytes;
+      } else {
+        return false;
+      }
+    } else if (bytes <= tail - buffer->head) {
+      *offset = buffer->head;
+      taken = bytes;
+    } else {
+      return false;
+    }
+    buffer->head = *offset + bytes;
+    buffer->used += taken;
+    segments_.push_back(Segment{buffer, taken, nullptr});
+    return true;
+  }
+
+  void Grow(size_t bytes) {
+    const size_t capacity = std::max(
+        std::min(current_->capacity * 2, max_capacity_), AlignUp(bytes));
+    Buffer *old = current_;
+    current_ = NewBuffer(capacity);
+    if (old->used == 0) Release(old);
+  }
+
+  // Frees a grown-out buffer; its last segment has completed.
+  void Release(Buffer *buffer) {
+    device_->HostFree(buffer->data);
+    auto owns = [buffer](const std::unique_ptr<Buffer> &b) {
+      return b.get() == buffer;
+    };
+    buffers_.erase(std::find_if(buffers_.begin(), buffers_.end(), owns));
+  }
+
+  StagingDevice::Event TakeEvent() {
+    if (free_events_.empty()) return device_->CreateEvent();
+    StagingDevice::Event event = free_events_.back();
+    free_events_.pop_back();
+    return event;
+  }
+
+  // Returns the space of the last acquired segment, whose copy was never
+  // enqueued.
+  void Abandon() {
+    Segment segment = segments_.back();
+    segments_.pop_back();
+    Buffer *buffer = segment.buffer;
+    buffer->used -= segment.bytes;
+    buffer->head = (buffer->head + buffer->capacity - segment.bytes) %
+                   buffer->capacity;
+  }
+
+  void Reclaim() {
+    while (!segments_.empty() &&
+           device_->EventDone(segments_.front().event)) {
+      Segment segment = segments_.front();
+      segments_.pop_front();
+      free_events_.push_back(segment.event);
+      segment.buffer->used -= segment.bytes;
+      if (segment.buffer != current_ && segment.buffer->used == 0) {
+        Release(segment.buffer);
+      }
+    }
+  }
+
+  std::unique_ptr<StagingDevice> device_;
+  const size_t max_capacity_;
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<Buffer>> buffers_;
+  Buffer *current_ = nullptr;
+  std::deque<Segment> segments_;
+  std::vector<StagingDevice::Event> free_events_;
+  size_t num_waits_ = 0;
+};
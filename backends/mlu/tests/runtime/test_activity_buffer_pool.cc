@@ -0,0 +1,301 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "runtime/activity_buffer_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+// Synthetic stand-in for a cnpapi activity record: a type tag followed by
+// the record's fields, packed back to back into the activity buffer.
+enum FakeActivityType : uint32_t {
+  kFakeKernel = 1,
+  kFakeMemcpy = 2,
+  kFakeIgnored = 3,
+};
+
+struct FakeActivity {
+  uint32_t type;
+  uint32_t producer;
+  uint64_t seq;
+  uint64_t start;
+  uint64_t end;
+  char name[32];
+};
+
+// Walks the records of a buffer like cnpapiActivityGetNextRecord: record
+// is null to start and each call advances it, false past the last one.
+bool GetNextRecord(const ActivityBuffer& buffer, const FakeActivity** record) {
+  const auto* first = reinterpret_cast<const FakeActivity*>(buffer.addr);
+  const FakeActivity* next = *record == nullptr ? first : *record + 1;
+  if (reinterpret_cast<const char*>(next + 1) >
+      reinterpret_cast<const char*>(buffer.addr) + buffer.valid_size) {
+    return false;
+  }
+  *record = next;
+  return true;
+}
+
+struct Decoded {
+  uint32_t producer;
+  uint64_t seq;
+  uint64_t duration;
+  const std::string* name;
+};
+
+// The decode side of the Tracer, over synthetic records.
+class FakeTracer {
+ public:
+  FakeTracer(size_t buffer_size, size_t num_prealloc, size_t max_cached)
+      : pool_(buffer_size, 8, num_prealloc, max_cached),
+        decoder_(&pool_,
+                 [this](const ActivityBuffer& buffer) { Decode(buffer); },
+                 std::chrono::milliseconds(5)) {}
+
+  ActivityBufferPool* pool() { return &pool_; }
+  ActivityDecoder* decoder() { return &decoder_; }
+
+  // Fills a pool buffer with records from producer, as cnpapi does, and
+  // hands it to the decoder. Returns the records written.
+  size_t ProduceRecords(uint32_t producer,
+                        uint64_t* seq,
+                        size_t count,
+                        const std::vector<std::string>& names) {
+    uint64_t* buffer = pool_.Acquire();
+    if (buffer == nullptr) return 0;
+    auto* records = reinterpret_cast<FakeActivity*>(buffer);
+    count = std::min(count, pool_.buffer_size() / sizeof(FakeActivity));
+    for (size_t i = 0; i < count; ++i) {
+      FakeActivity& record = records[i];
+      memset(&record, 0, sizeof(record));
+      record.type = (*seq % 5 == 4) ? kFakeIgnored
+                                    : (*seq % 2 ? kFakeMemcpy : kFakeKernel);
+      record.producer = producer;
+      record.seq = (*seq)++;
+      record.start = record.seq * 10;
+      record.end = record.start + producer + 1;
+      snprintf(record.name,
+               sizeof(record.name),
+               "%s",
+               names[record.seq % names.size()].c_str());
+    }
+    decoder_.Produce(buffer, count * sizeof(FakeActivity));
+    return count;
+  }
+
+  std::vector<Decoded> TakeRecords() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    std::vector<Decoded> out;
+    out.swap(records_);
+    return out;
+  }
+
+  size_t num_decoded() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return records_.size();
+  }
+
+  int overlapping_decodes() const { return overlapping_decodes_.load(); }
+  size_t num_names() const { return names_.size(); }
+
+ private:
+  void Decode(const ActivityBuffer& buffer) {
+    if (decoding_.exchange(true)) ++overlapping_decodes_;
+    const FakeActivity* record = nullptr;
+    std::vector<Decoded> decoded;
+    while (GetNextRecord(buffer, &record)) {
+      if (record->type == kFakeIgnored) continue;
+      decoded.push_back({record->producer,
+                         record->seq,
+                         record->end - record->start,
+                         names_.Intern(record->name)});
+    }
+    // The buffer is recycled once this returns; scribbling over it shows
+    // up as corrupt records if it was still handed out elsewhere.
+    memset(buffer.addr, 0xff, buffer.valid_size);
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      records_.insert(records_.end(), decoded.begin(), decoded.end());
+    }
+    decoding_ = false;
+  }
+
+  ActivityBufferPool pool_;
+  StringInterner names_;
+  std::atomic<bool> decoding_{false};
+  std::atomic<int> overlapping_decodes_{0};
+  std::mutex mutex_;
+  std::vector<Decoded> records_;
+  ActivityDecoder decoder_;
+};
+
+template <typename Pred>
+bool WaitFor(Pred pred) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (!pred()) {
+    if (std::chrono::steady_clock::now() > deadline) return false;
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  return true;
+}
+
+// Records of seq % 5 == 4 are ignored by the decoder.
+size_t NumReported(uint64_t num_records) {
+  return num_records - num_records / 5;
+}
+
+}  // namespace
+
+TEST(ActivityBufferPool, RecyclesBuffersUpToMaxCached) {
+  ActivityBufferPool pool(1 << 12, 64, 2, 3);
+  EXPECT_EQ(pool.num_allocated(), 2u);
+  std::vector<uint64_t*> held;
+  for (int i = 0; i < 5; ++i) held.push_back(pool.Acquire());
+  for (auto* buffer : held) {
+    ASSERT_NE(buffer, nullptr);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(buffer) % 64, 0u);
+  }
+  EXPECT_EQ(pool.num_allocated(), 5u);
+  // Three are cached for reuse and the other two freed.
+  for (auto* buffer : held) pool.Release(buffer);
+  std::set<uint64_t*> reused;
+  for (int i = 0; i < 3; ++i) reused.insert(pool.Acquire());
+  EXPECT_EQ(pool.num_allocated(), 5u);
+  for (auto* buffer : reused) {
+    EXPECT_NE(std::find(held.begin(), held.end(), buffer), held.end());
+  }
+  uint64_t* fresh = pool.Acquire();
+  EXPECT_EQ(pool.num_allocated(), 6u);
+  pool.Release(fresh);
+  for (auto* buffer : reused) pool.Release(buffer);
+}
+
+TEST(ActivityBufferPool, FreesUnconsumedBuffersOnDestruction) {
+  // Run under ASan: produced buffers nobody consumed are not leaked.
+  ActivityBufferPool pool(1 << 12, 8, 1, 1);
+  pool.Produce(pool.Acquire(), 16);
+  pool.Produce(pool.Acquire(), 0);
+}
+
+TEST(ActivityDecoder, DecodesSyntheticRecordsOnItsThread) {
+  FakeTracer tracer(64 * sizeof(FakeActivity), 2, 4);
+  tracer.decoder()->Start();
+  const std::vector<std::string> names = {"conv2d", "matmul", "HtoD"};
+  uint64_t seq = 0;
+  for (int i = 0; i < 20; ++i) {
+    tracer.ProduceRecords(0, &seq, 10, names);
+    // Decoded without anyone calling DecodePending.
+    ASSERT_TRUE(
+        WaitFor([&] { return tracer.num_decoded() == NumReported(seq); }));
+  }
+  tracer.decoder()->Stop();
+
+  auto records = tracer.TakeRecords();
+  uint64_t expect = 0;
+  std::set<const std::string*> interned;
+  for (const auto& record : records) {
+    if (expect % 5 == 4) ++expect;
+    ASSERT_EQ(record.seq, expect++);
+    EXPECT_EQ(record.duration, 1u);
+    EXPECT_EQ(*record.name, names[record.seq % names.size()]);
+    interned.insert(record.name);
+  }
+  EXPECT_EQ(interned.size(), names.size());
+  EXPECT_EQ(tracer.num_names(), names.size());
+  // One buffer in flight at a time: the preallocated ones are reused.
+  EXPECT_LE(tracer.pool()->num_allocated(), 2u);
+}
+
+TEST(ActivityDecoder, ManyProducersKeepTheirOrder) {
+  constexpr int kProducers = 4;
+  constexpr int kBuffers = 200;
+  FakeTracer tracer(32 * sizeof(FakeActivity), 2, 8);
+  tracer.decoder()->Start();
+  const std::vector<std::string> names = {"a", "bb", "ccc", "dddd"};
+  std::vector<uint64_t> seqs(kProducers, 0);
+  std::vector<std::thread> producers;
+  for (int p = 0; p < kProducers; ++p) {
+    producers.emplace_back([&, p] {
+      std::mt19937 rng(p);
+      for (int i = 0; i < kBuffers; ++i) {
+        tracer.ProduceRecords(p, &seqs[p], 1 + rng() % 40, names);
+        if (rng() % 8 == 0) std::this_thread::yield();
+      }
+    });
+  }
+  // A collection racing with the decoder thread, like ConsumeRecords
+  // during a step.
+  std::vector<Decoded> records;
+  while (records.size() < 1000) {
+    tracer.decoder()->DecodePending();
+    auto batch = tracer.TakeRecords();
+    records.insert(records.end(), batch.begin(), batch.end());
+  }
+  for (auto& producer : producers) producer.join();
+  tracer.decoder()->Stop();
+  // Whatever the stopped thread left behind is decoded by the caller.
+  tracer.decoder()->DecodePending();
+  auto rest = tracer.TakeRecords();
+  records.insert(records.end(), rest.begin(), rest.end());
+
+  size_t total = 0;
+  for (int p = 0; p < kProducers; ++p) total += NumReported(seqs[p]);
+  ASSERT_EQ(records.size(), total);
+  std::vector<uint64_t> next(kProducers, 0);
+  for (const auto& record : records) {
+    ASSERT_LT(record.producer, static_cast<uint32_t>(kProducers));
+    uint64_t& expect = next[record.producer];
+    if (expect % 5 == 4) ++expect;
+    ASSERT_EQ(record.seq, expect++) << "producer " << record.producer;
+    EXPECT_EQ(record.duration, record.producer + 1u);
+  }
+  EXPECT_EQ(tracer.overlapping_decodes(), 0);
+  EXPECT_EQ(tracer.num_names(), names.size());
+  EXPECT_LT(tracer.pool()->num_allocated(),
+            static_cast<size_t>(kProducers * kBuffers));
+}
+
+TEST(ActivityDecoder, RestartsAfterStop) {
+  FakeTracer tracer(16 * sizeof(FakeActivity), 1, 2);
+  const std::vector<std::string> names = {"kernel"};
+  uint64_t seq = 0;
+  for (int round = 0; round < 3; ++round) {
+    tracer.decoder()->Start();
+    tracer.decoder()->Start();
+    tracer.ProduceRecords(0, &seq, 16, names);
+    ASSERT_TRUE(
+        WaitFor([&] { return tracer.num_decoded() == NumReported(seq); }));
+    tracer.decoder()->Stop();
+    tracer.decoder()->Stop();
+  }
+  // Produced while stopped: waits for DecodePending.
+  tracer.ProduceRecords(0, &seq, 16, names);
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_LT(tracer.num_decoded(), NumReported(seq));
+  tracer.decoder()->DecodePending();
+  EXPECT_EQ(tracer.num_decoded(), NumReported(seq));
+  EXPECT_EQ(tracer.pool()->num_allocated(), 1u);
+}
@@ -0,0 +1,307 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "runtime/staging_ring.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+// Host-only stand-in for an MLU queue. A DMA thread runs the enqueued
+// copies in order, each after a short random delay, and an event is done
+// once the copies enqueued before its record have run. Host allocations
+// and events are tracked so leaks and double frees show up.
+class FakeQueue {
+ public:
+  struct Event {
+    uint64_t target = 0;
+  };
+
+  FakeQueue() : dma_([this] { Run(); }) {}
+
+  ~FakeQueue() {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      stop_ = true;
+    }
+    work_cv_.notify_one();
+    dma_.join();
+  }
+
+  void EnqueueCopy(void *dst, const void *src, size_t bytes) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    copies_.push_back(Copy{dst, src, bytes});
+    ++enqueued_;
+    work_cv_.notify_one();
+  }
+
+  void Record(Event *event) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    event->target = enqueued_;
+  }
+
+  bool Done(const Event *event) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return completed_ >= event->target;
+  }
+
+  void Wait(const Event *event) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [&] { return completed_ >= event->target; });
+  }
+
+  void Synchronize() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [&] { return completed_ == enqueued_; });
+  }
+
+  std::atomic<int> live_allocs{0};
+  std::atomic<int> live_events{0};
+  std::atomic<int> misuses{0};
+  std::mutex alloc_mutex;
+  std::set<void *> allocs;
+
+ private:
+  struct Copy {
+    void *dst;
+    const void *src;
+    size_t bytes;
+  };
+
+  void Run() {
+    std::mt19937 rng(7);
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      work_cv_.wait(lock, [&] { return stop_ || !copies_.empty(); });
+      if (copies_.empty()) return;
+      Copy copy = copies_.front();
+      copies_.pop_front();
+      lock.unlock();
+      if (rng() % 4 == 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(rng() % 50));
+      }
+      memcpy(copy.dst, copy.src, copy.bytes);
+      lock.lock();
+      ++completed_;
+      done_cv_.notify_all();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  std::deque<Copy> copies_;
+  uint64_t enqueued_ = 0;
+  uint64_t completed_ = 0;
+  bool stop_ = false;
+  std::thread dma_;
+};
+
+class FakeStagingDevice : public StagingDevice {
+ public:
+  explicit FakeStagingDevice(FakeQueue *queue) : queue_(queue) {}
+
+  void *HostAlloc(size_t size) override {
+    void *ptr = std::malloc(size);
+    std::lock_guard<std::mutex> guard(queue_->alloc_mutex);
+    queue_->allocs.insert(ptr);
+    ++queue_->live_allocs;
+    return ptr;
+  }
+
+  void HostFree(void *ptr) override {
+    {
+      std::lock_guard<std::mutex> guard(queue_->alloc_mutex);
+      if (queue_->allocs.erase(ptr) == 0) ++queue_->misuses;
+    }
+    --queue_->live_allocs;
+    std::free(ptr);
+  }
+
+  Event CreateEvent() override {
+    ++queue_->live_events;
+    return new FakeQueue::Event;
+  }
+
+  void DestroyEvent(Event event) override {
+    --queue_->live_events;
+    delete static_cast<FakeQueue::Event *>(event);
+  }
+
+  void RecordEvent(Event event) override {
+    queue_->Record(static_cast<FakeQueue::Event *>(event));
+  }
+
+  bool EventDone(Event event) override {
+    return queue_->Done(static_cast<FakeQueue::Event *>(event));
+  }
+
+  void WaitEvent(Event event) override {
+    queue_->Wait(static_cast<FakeQueue::Event *>(event));
+  }
+
+ private:
+  FakeQueue *queue_;
+};
+
+std::unique_ptr<StagingRing> MakeRing(FakeQueue *queue,
+                                      size_t initial_capacity,
+                                      size_t max_capacity) {
+  return std::unique_ptr<StagingRing>(
+      new StagingRing(std::unique_ptr<StagingDevice>(
+                          new FakeStagingDevice(queue)),
+                      initial_capacity,
+                      max_capacity));
+}
+
+// Stages copies of random sizes into dsts, overwriting each source as
+// soon as Stage returns, as callers may.
+void StageRandomCopies(StagingRing *ring,
+                       FakeQueue *queue,
+                       uint32_t seed,
+                       int num_copies,
+                       std::vector<std::vector<char>> *dsts,
+                       std::vector<std::vector<char>> *expected) {
+  std::mt19937 rng(seed);
+  std::vector<char> src;
+  for (int i = 0; i < num_copies; ++i) {
+    const size_t size = 1 + rng() % (rng() % 8 == 0 ? 20000 : 1500);
+    const size_t chunk = 64 + rng() % 4096;
+    src.resize(size);
+    for (auto &c : src) c = static_cast<char>(rng());
+    expected->push_back(src);
+    dsts->emplace_back(size, 0);
+    char *dst = dsts->back().data();
+    ring->Stage(src.data(),
+                size,
+                chunk,
+                [&](const char *staged, size_t offset, size_t bytes) {
+                  queue->EnqueueCopy(dst + offset, staged, bytes);
+                });
+    std::fill(src.begin(), src.end(), 0);
+  }
+}
+
+}  // namespace
+
+TEST(StagingRing, StressKeepsStagedDataUntilCopied) {
+  FakeQueue queue;
+  std::vector<std::vector<char>> dsts, expected;
+  // Pre-sized so the copies' destinations never move.
+  dsts.reserve(3000);
+  {
+    auto ring = MakeRing(&queue, 256, 16 << 10);
+    StageRandomCopies(ring.get(), &queue, 1, 3000, &dsts, &expected);
+    // Chunks are smaller than the ring, so it never outgrows its maximum.
+    EXPECT_EQ(ring->capacity(), static_cast<size_t>(16 << 10));
+    EXPECT_GT(ring->num_waits(), 0u);
+    queue.Synchronize();
+    for (size_t i = 0; i < dsts.size(); ++i) {
+      ASSERT_EQ(dsts[i], expected[i]) << "copy " << i;
+    }
+  }
+  EXPECT_EQ(queue.live_allocs.load(), 0);
+  EXPECT_EQ(queue.live_events.load(), 0);
+  EXPECT_EQ(queue.misuses.load(), 0);
+}
+
+TEST(StagingRing, GrowsAndFreesOutgrownBuffers) {
+  FakeQueue queue;
+  std::vector<std::vector<char>> dsts, expected;
+  dsts.reserve(200);
+  {
+    auto ring = MakeRing(&queue, 64, 1 << 20);
+    StageRandomCopies(ring.get(), &queue, 2, 200, &dsts, &expected);
+    EXPECT_GT(ring->capacity(), 64u);
+    EXPECT_LE(ring->capacity(), static_cast<size_t>(1 << 20));
+    queue.Synchronize();
+    // Staging more reclaims every completed copy, which releases the
+    // buffers the ring grew out of.
+    std::vector<char> src(64, 1), dst(64);
+    ring->Stage(
+        src.data(), src.size(), 64, [&](const char *s, size_t, size_t n) {
+          queue.EnqueueCopy(dst.data(), s, n);
+        });
+    EXPECT_EQ(queue.live_allocs.load(), 1);
+    queue.Synchronize();
+    EXPECT_EQ(dst, src);
+  }
+  for (size_t i = 0; i < dsts.size(); ++i) EXPECT_EQ(dsts[i], expected[i]);
+  EXPECT_EQ(queue.live_allocs.load(), 0);
+  EXPECT_EQ(queue.live_events.load(), 0);
+}
+
+TEST(StagingRing, ThreadsShareOneRing) {
+  constexpr int kThreads = 4;
+  constexpr int kCopies = 500;
+  FakeQueue queue;
+  std::vector<std::vector<std::vector<char>>> dsts(kThreads);
+  std::vector<std::vector<std::vector<char>>> expected(kThreads);
+  {
+    auto ring = MakeRing(&queue, 1024, 8 << 10);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+      dsts[t].reserve(kCopies);
+      threads.emplace_back([&, t] {
+        StageRandomCopies(
+            ring.get(), &queue, 10 + t, kCopies, &dsts[t], &expected[t]);
+      });
+    }
+    for (auto &thread : threads) thread.join();
+    queue.Synchronize();
+  }
+  for (int t = 0; t < kThreads; ++t) {
+    for (int i = 0; i < kCopies; ++i) {
+      ASSERT_EQ(dsts[t][i], expected[t][i]) << "thread " << t << ", copy " << i;
+    }
+  }
+  EXPECT_EQ(queue.live_allocs.load(), 0);
+  EXPECT_EQ(queue.live_events.load(), 0);
+}
+
+TEST(StagingRing, FailedEnqueueReturnsItsSpace) {
+  FakeQueue queue;
+  auto ring = MakeRing(&queue, 256, 256);
+  std::vector<char> src(200, 3), dst(200);
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_THROW(ring->Stage(src.data(),
+                             src.size(),
+                             256,
+                             [](const char *, size_t, size_t) {
+                               throw std::runtime_error("enqueue failed");
+                             }),
+                 std::runtime_error);
+    EXPECT_EQ(ring->outstanding(), 0u);
+  }
+  ring->Stage(
+      src.data(), src.size(), 256, [&](const char *s, size_t, size_t n) {
+        queue.EnqueueCopy(dst.data(), s, n);
+      });
+  queue.Synchronize();
+  EXPECT_EQ(dst, src);
+  EXPECT_EQ(ring->capacity(), 256u);
+  EXPECT_EQ(ring->num_waits(), 0u);
+}
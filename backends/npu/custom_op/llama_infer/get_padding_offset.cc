@@ -12,23 +12,78 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <vector>
+
+#include "kernels/funcs/npu_funcs.h"
+#include "kernels/funcs/npu_op_runner.h"
 #include "paddle/extension.h"
 
+// Packs input_ids with the GetPaddingOffset kernel of get_padding_offset_v2.
+// token_num stays on the device, so x_remove_padding and padding_offset keep
+// the padded size bsz * max_seq_len and only their first token_num entries
+// are valid. seq_len must lie in [0, max_seq_len]; the custom_cpu op of the
+// same name is the host reference.
 std::vector<paddle::Tensor> GetPaddingOffset(const paddle::Tensor& input_ids,
                                              const paddle::Tensor& cum_offsets,
                                              const paddle::Tensor& token_num,
                                              const paddle::Tensor& seq_len) {
+  auto dev_ctx = static_cast<const phi::CustomContext*>(
+      paddle::experimental::DeviceContextPool::Instance().Get(
+          input_ids.place()));
+  auto stream = static_cast<aclrtStream>(dev_ctx->stream());
   std::vector<int64_t> input_ids_shape = input_ids.shape();
-  auto cum_offsets_out = cum_offsets.copy_to(cum_offsets.place(), false);
-  auto cpu_token_num = token_num.copy_to(paddle::CPUPlace(), true);
-  const int token_num_data = cpu_token_num.data<int64_t>()[0];
-  auto x_remove_padding = paddle::full(
-      {token_num_data}, 0, paddle::DataType::INT64, input_ids.place());
-  auto padding_offset = paddle::full(
-      {token_num_data}, 0, paddle::DataType::INT32, input_ids.place());
-  return {x_remove_padding,
-          cum_offsets_out,
-          padding_offset};  // , enc_token_num, dec_token_num};
+  const int64_t bsz = input_ids_shape[0];
+  const int64_t max_seq_len = input_ids_shape[1];
+
+  auto input_ids_tensor =
+      static_cast<const phi::DenseTensor*>(input_ids.impl().get());
+  auto cum_offsets_tensor =
+      static_cast<const phi::DenseTensor*>(cum_offsets.impl().get());
+  auto seq_len_tensor =
+      static_cast<const phi::DenseTensor*>(seq_len.impl().get());
+  // The kernel reads token_num as [1, 1]; reshape a view, not the input.
+  phi::DenseTensor token_num_tensor(
+      *static_cast<const phi::DenseTensor*>(token_num.impl().get()));
+  token_num_tensor.Resize(phi::make_ddim({1, 1}));
+
+  std::shared_ptr<phi::DenseTensor> x_remove_padding_tensor =
+      std::make_shared<phi::DenseTensor>();
+  x_remove_padding_tensor->Resize(phi::make_ddim({bsz * max_seq_len}));
+  dev_ctx->Alloc(x_remove_padding_tensor.get(), input_ids.dtype());
+
+  std::shared_ptr<phi::DenseTensor> cum_offsets_out_tensor =
+      std::make_shared<phi::DenseTensor>();
+  cum_offsets_out_tensor->Resize(cum_offsets_tensor->dims());
+  dev_ctx->Alloc(cum_offsets_out_tensor.get(), cum_offsets_tensor->dtype());
+
+  std::shared_ptr<phi::DenseTensor> padding_offset_tensor =
+      std::make_shared<phi::DenseTensor>();
+  padding_offset_tensor->Resize(phi::make_ddim({bsz * max_seq_len}));
+  dev_ctx->Alloc(padding_offset_tensor.get(), paddle::DataType::INT32);
+
+  // The kernel also writes cu_seqlens, which this op does not return.
+  phi::DenseTensor cu_seqlens_q_tensor;
+  cu_seqlens_q_tensor.Resize(phi::make_ddim({bsz + 1}));
+  dev_ctx->Alloc(&cu_seqlens_q_tensor, paddle::DataType::INT32);
+  phi::DenseTensor cu_seqlens_k_tensor;
+  cu_seqlens_k_tensor.Resize(phi::make_ddim({bsz + 1}));
+  dev_ctx->Alloc(&cu_seqlens_k_tensor, paddle::DataType::INT32);
+
+  const auto& runner = NpuOpRunner("GetPaddingOffset",
+                                   {*input_ids_tensor,
+                                    *cum_offsets_tensor,
+                                    token_num_tensor,
+                                    *seq_len_tensor},
+                                   {*x_remove_padding_tensor,
+                                    *cum_offsets_out_tensor,
+                                    *padding_offset_tensor,
+                                    cu_seqlens_q_tensor,
+                                    cu_seqlens_k_tensor});
+  runner.Run(stream);
+
+  return {paddle::Tensor(x_remove_padding_tensor),
+          paddle::Tensor(cum_offsets_out_tensor),
+          paddle::Tensor(padding_offset_tensor)};
 }
 
 std::vector<std::vector<int64_t>> GetPaddingOffsetInferShape(
@@ -12,18 +12,83 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <vector>
+
+#include "kernels/funcs/npu_funcs.h"
+#include "kernels/funcs/npu_op_runner.h"
 #include "paddle/extension.h"
 
+// Picks the last token of every sequence out of the packed
+// [token_num, dim_embed] tmp_out with the RebuildPadding kernel of
+// rebuild_padding_v2, taking every sequence as a prefill. The cum_offsets it
+// needs are derived from seq_lens on the stream, so nothing is read back to
+// the host. seq_lens must lie in [0, max_seq_len]; the custom_cpu op of the
+// same name is the host reference.
 std::vector<paddle::Tensor> RebuildPadding(const paddle::Tensor& tmp_out,
                                            const paddle::Tensor& padding_offset,
                                            const paddle::Tensor& seq_lens,
                                            const paddle::Tensor& input_ids) {
-  std::vector<int64_t> tmp_out_shape = tmp_out.shape();
-  const int dim_embed = tmp_out_shape[1];
-  const int bsz = seq_lens.shape()[0];
-  auto out =
-      paddle::full({bsz, dim_embed}, 0, tmp_out.dtype(), tmp_out.place());
-  return {out};
+  PD_CHECK(seq_lens.dtype() == paddle::DataType::INT32,
+           "seq_lens must be int32.");
+  auto dev_ctx = static_cast<const phi::CustomContext*>(
+      paddle::experimental::DeviceContextPool::Instance().Get(tmp_out.place()));
+  auto stream = static_cast<aclrtStream>(dev_ctx->stream());
+  const int64_t dim_embed = tmp_out.shape().back();
+  const int64_t bsz = seq_lens.shape()[0];
+  const int max_seq_len = input_ids.shape()[1];
+
+  auto tmp_out_tensor =
+      static_cast<const phi::DenseTensor*>(tmp_out.impl().get());
+  phi::DenseTensor seq_lens_tensor(
+      *static_cast<const phi::DenseTensor*>(seq_lens.impl().get()));
+  seq_lens_tensor.Resize(phi::make_ddim({bsz}));
+
+  // cum_offsets[bi] is the padding before sequence bi, the exclusive prefix
+  // sum of max_seq_len - seq_lens.
+  phi::DenseTensor padding;
+  padding.Resize(phi::make_ddim({bsz}));
+  dev_ctx->Alloc(&padding, paddle::DataType::INT32);
+  NpuOpRunner sub_runner;
+  sub_runner.SetType("Sub")
+      .AddInput(*dev_ctx, std::vector<int32_t>{max_seq_len})
+      .AddInput(seq_lens_tensor)
+      .AddOutput(padding);
+  sub_runner.Run(stream);
+
+  phi::DenseTensor cum_offsets;
+  cum_offsets.Resize(phi::make_ddim({bsz}));
+  dev_ctx->Alloc(&cum_offsets, paddle::DataType::INT32);
+  const auto& cumsum_runner =
+      NpuOpRunner("CumsumD",
+                  {padding},
+                  {cum_offsets},
+                  {{"axis", 0}, {"exclusive", true}, {"reverse", false}});
+  cumsum_runner.Run(stream);
+
+  phi::DenseTensor seq_lens_decoder;
+  seq_lens_decoder.Resize(phi::make_ddim({bsz}));
+  dev_ctx->Alloc(&seq_lens_decoder, paddle::DataType::INT32);
+  ACL_CHECK(aclrtMemsetAsync(seq_lens_decoder.data(),
+                             bsz * sizeof(int32_t),
+                             0,
+                             bsz * sizeof(int32_t),
+                             stream));
+
+  // The kernel skips sequences without tokens, which keep a zero row.
+  std::shared_ptr<phi::DenseTensor> out = std::make_shared<phi::DenseTensor>();
+  out->Resize(phi::make_ddim({bsz, dim_embed}));
+  dev_ctx->Alloc(out.get(), tmp_out_tensor->dtype());
+  const size_t out_bytes = out->numel() * phi::SizeOf(out->dtype());
+  ACL_CHECK(aclrtMemsetAsync(out->data(), out_bytes, 0, out_bytes, stream));
+
+  const auto& runner = NpuOpRunner(
+      "RebuildPadding",
+      {*tmp_out_tensor, cum_offsets, seq_lens_decoder, seq_lens_tensor},
+      {*out},
+      {{"max_input_length", max_seq_len}});
+  runner.Run(stream);
+
+  return {paddle::Tensor(out)};
 }
 
 std::vector<std::vector<int64_t>> RebuildPaddingInferShape(
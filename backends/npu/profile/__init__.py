@@ -13,3 +13,5 @@
 # limitations under the License.
 
 from .cann_export import cann_parse_enabled as cann_parse_enabled
+from .trace_merge import IncrementalTraceMerger as IncrementalTraceMerger
+from .trace_merge import merge_trace_files as merge_trace_files
@@ -26,16 +26,22 @@
 
 
 import datetime
-import json
 import os
 import subprocess
 
 import paddle
 
+from .trace_merge import IncrementalTraceMerger
 
-def cann_parse_enabled(profiler_output_dir: str):
+
+def cann_parse_enabled(profiler_output_dir: str, merger=None, **merge_options):
     """
     Automatically parse profiling data for NPU devices using CANN tools.
+
+    Pass an IncrementalTraceMerger as ``merger`` to append every call (e.g.
+    one per profiling step) to the same merged trace instead of writing a
+    new one each time. Other keyword arguments are merge options, see
+    IncrementalTraceMerger.
     """
     prof_root_dir = os.getenv(
         "PROFILER_OUTPUT_DIR", os.path.join(os.getcwd(), "ascend_profiling")
@@ -51,7 +57,7 @@ def cann_parse_enabled(profiler_output_dir: str):
 
     latest_prof_path = os.path.join(prof_root_dir, latest_prof_dir)
     run_msprof_command(latest_prof_path)
-    merge_json_files(profiler_output_dir, latest_prof_path)
+    merge_json_files(profiler_output_dir, latest_prof_path, merger, **merge_options)
 
 
 def is_npu_device():
@@ -91,9 +97,14 @@ def run_msprof_command(prof_dir):
         print(f"Error running msprof command: {e!s}")
 
 
-def merge_json_files(profiler_output_dir: str, latest_prof_path: str):
+def merge_json_files(
+    profiler_output_dir: str, latest_prof_path: str, merger=None, **merge_options
+):
     """
     Merge the JSON files from msprof and paddle, adjusting sort_index to ensure correct event order.
+
+    The files are streamed rather than loaded, so traces of any length can be
+    merged; pass ``compress=True`` for a gzipped output.
     """
     try:
         msprof_json_path = find_latest_msprof_json(latest_prof_path)
@@ -108,31 +119,21 @@ def merge_json_files(profiler_output_dir: str, latest_prof_path: str):
             print(f"No Paddle JSON files found in {profiler_output_dir}.")
             return
 
-        msprof_data = load_json(msprof_json_path)
-        if not msprof_data:
-            print(f"msprof JSON file {msprof_json_path} is empty or invalid.")
-            return
-
-        paddle_data = load_json(paddle_json_path)
-        if not paddle_data:
-            print(f"Paddle JSON file {paddle_json_path} is empty or invalid.")
+        if merger is not None:
+            merger.merge_step(paddle_json_path, msprof_json_path)
+            print(f"Merged JSON files appended to {merger.output_path}")
             return
 
-        paddle_events = paddle_data.get("traceEvents", [])
-        msprof_events = msprof_data if isinstance(msprof_data, list) else []
-
-        adjust_paddle_sort_index(paddle_events, msprof_events)
-
-        merged_data = {"traceEvents": paddle_events + msprof_events}
-
         now = datetime.datetime.now()
-        file_name = f'trace_view_{now.strftime("%Y_%m_%d_%H_%M_%S")}.json'
+        suffix = ".json.gz" if merge_options.get("compress") else ".json"
+        file_name = f'trace_view_{now.strftime("%Y_%m_%d_%H_%M_%S")}{suffix}'
         msprof_output_dir = os.path.join(latest_prof_path, "mindstudio_profiler_output")
         output_json_path = os.path.join(msprof_output_dir, file_name)
 
         os.makedirs(msprof_output_dir, exist_ok=True)
 
-        save_json(merged_data, output_json_path)
+        with IncrementalTraceMerger(output_json_path, **merge_options) as step_merger:
+            step_merger.merge_step(paddle_json_path, msprof_json_path)
         print(f"Merged JSON file saved to {output_json_path}")
 
     except Exception as e:
@@ -186,58 +187,3 @@ def find_latest_paddle_json(profiler_output_dir: str) -> str:
     except (FileNotFoundError, PermissionError) as e:
         print(f"Error finding Paddle JSON files: {e!s}")
         return None
-
-
-def load_json(file_path):
-    """
-    Load a JSON file from the specified path.
-    """
-    try:
-        with open(file_path, "r") as f:
-            return json.load(f)
-    except json.JSONDecodeError as e:
-        print(f"Error loading JSON file {file_path}: {e!s}")
-        return None
-    except (FileNotFoundError, PermissionError) as e:
-        print(f"Error opening JSON file {file_path}: {e!s}")
-        return None
-
-
-def save_json(data, file_path):
-    """
-    Save the given data to a JSON file at the specified path.
-    """
-    try:
-        with open(file_path, "w") as f:
-            json.dump(data, f, indent=2)
-    except (OSError, PermissionError) as e:
-        print(f"Error saving JSON file {file_path}: {e!s}")
-
-
-def adjust_paddle_sort_index(paddle_events, msprof_events):
-    """
-    Adjust the sort_index of Paddle events to ensure they appear before MSProf events.
-    """
-    min_sort_index_msprof = min(
-        (
-            event.get("args", {}).get("sort_index", float("inf"))
-            for event in msprof_events
-            if "args" in event
-        ),
-        default=0,
-    )
-
-    min_sort_index_paddle = min(
-        (
-            event.get("args", {}).get("sort_index", float("inf"))
-            for event in paddle_events
-            if "args" in event
-        ),
-        default=0,
-    )
-
-    adjustment_value = min_sort_index_msprof - min_sort_index_paddle - 1
-
-    for event in paddle_events:
-        if "args" in event and "sort_index" in event["args"]:
-            event["args"]["sort_index"] += adjustment_value
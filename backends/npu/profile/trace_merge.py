@@ -0,0 +1,412 @@
+# Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""
+Streaming merge of Paddle and CANN (msprof) chrome trace files.
+
+Traces from long runs do not fit in memory, so nothing here loads a whole
+file: events are parsed one at a time, spilled to disk in sorted runs and
+k-way merged by timestamp into the output, which is written as it goes.
+Memory use is bounded by ``run_size`` events whatever the trace length.
+"""
+
+import gzip
+import heapq
+import json
+import os
+import shutil
+import tempfile
+
+DEFAULT_CHUNK_SIZE = 1 << 20
+DEFAULT_RUN_SIZE = 200000
+# Streams whose first timestamps are further apart than this use different
+# clock bases, not just different start times.
+CLOCK_BASE_THRESHOLD_US = 3600 * 1e6
+CLOCK_PROBE_EVENTS = 1000
+
+
+def _open_text(path, mode):
+    if path.endswith(".gz"):
+        return gzip.open(path, mode + "t", encoding="utf-8")
+    return open(path, mode, encoding="utf-8")
+
+
+class _JsonStreamReader:
+    """
+    Pull parser for the top level of a JSON document, reading the file in
+    chunks and decoding one array element at a time.
+    """
+
+    def __init__(self, f, chunk_size=DEFAULT_CHUNK_SIZE):
+        self._f = f
+        self._chunk_size = chunk_size
+        self._buf = ""
+        self._pos = 0
+        self._eof = False
+        self._decoder = json.JSONDecoder()
+
+    def _fill(self):
+        data = self._f.read(self._chunk_size)
+        if not data:
+            self._eof = True
+            return False
+        self._buf = self._buf[self._pos :] + data
+        self._pos = 0
+        return True
+
+    def peek(self):
+        while True:
+            while self._pos < len(self._buf) and self._buf[self._pos] in " \t\r\n":
+                self._pos += 1
+            if self._pos < len(self._buf):
+                return self._buf[self._pos]
+            if not self._fill():
+                return ""
+
+    def expect(self, ch):
+        if self.peek() != ch:
+            raise ValueError(f"expected '{ch}' at offset {self._pos} of the buffer")
+        self._pos += 1
+
+    def value(self):
+        self.peek()
+        while True:
+            try:
+                value, end = self._decoder.raw_decode(self._buf, self._pos)
+            except json.JSONDecodeError:
+                if self._fill():
+                    continue
+                raise
+            # A number or literal ending at the buffer end may continue in
+            # the next chunk.
+            if end == len(self._buf) and not self._eof and self._fill():
+                continue
+            self._pos = end
+            return value
+
+    def array_items(self):
+        self.expect("[")
+        while True:
+            ch = self.peek()
+            if ch == "]":
+                self._pos += 1
+                return
+            if ch == ",":
+                self._pos += 1
+                continue
+            if ch == "":
+                raise ValueError("unterminated JSON array")
+            yield self.value()
+
+
+def iter_trace_events(path, chunk_size=DEFAULT_CHUNK_SIZE):
+    """
+    Yield the events of a chrome trace file one by one, without loading the
+    file. Accepts both the object form ``{"traceEvents": [...]}`` written by
+    Paddle and the bare array form written by msprof, optionally gzipped.
+    """
+    with _open_text(path, "r") as f:
+        reader = _JsonStreamReader(f, chunk_size)
+        ch = reader.peek()
+        if ch == "[":
+            yield from reader.array_items()
+            return
+        reader.expect("{")
+        while True:
+            ch = reader.peek()
+            if ch == "}" or ch == "":
+                return
+            if ch == ",":
+                reader.expect(",")
+                continue
+            key = reader.value()
+            reader.expect(":")
+            if key == "traceEvents":
+                yield from reader.array_items()
+            else:
+                reader.value()
+
+
+def event_ts(event):
+    """
+    Timestamp of an event in microseconds, or None. msprof writes ``ts`` as
+    a string to keep its precision.
+    """
+    ts = event.get("ts")
+    if ts is None:
+        return None
+    try:
+        return float(ts)
+    except (TypeError, ValueError):
+        return None
+
+
+def estimate_clock_offset(paddle_path, msprof_path, probe_events=CLOCK_PROBE_EVENTS):
+    """
+    Offset to add to Paddle timestamps to put them on the msprof clock.
+
+    Both profilers normally share the host clock and need no shift; when the
+    earliest probed timestamps are hours apart the traces use different time
+    bases and are aligned on their first events.
+    """
+
+    def first_ts(path):
+        found = []
+        for event in iter_trace_events(path):
+            ts = event_ts(event)
+            if ts is not None and event.get("ph") != "M":
+                found.append(ts)
+                if len(found) >= probe_events:
+                    break
+        return min(found) if found else None
+
+    paddle_ts = first_ts(paddle_path)
+    msprof_ts = first_ts(msprof_path)
+    if paddle_ts is None or msprof_ts is None:
+        return 0.0
+    offset = msprof_ts - paddle_ts
+    return offset if abs(offset) > CLOCK_BASE_THRESHOLD_US else 0.0
+
+
+class TraceWriter:
+    """
+    Writes ``{"traceEvents": [...]}`` one event at a time, gzipped when the
+    path ends with ``.gz`` or ``compress`` is set.
+    """
+
+    def __init__(self, path, compress=None):
+        if compress is None:
+            compress = path.endswith(".gz")
+        if compress:
+            self._f = gzip.open(path, "wt", encoding="utf-8")
+        else:
+            self._f = open(path, "w", encoding="utf-8")
+        self._f.write('{"traceEvents": [\n')
+        self.path = path
+        self.num_events = 0
+
+    def write(self, event):
+        if self.num_events:
+            self._f.write(",\n")
+        self._f.write(json.dumps(event, separators=(",", ":")))
+        self.num_events += 1
+
+    def close(self):
+        if self._f is None:
+            return
+        self._f.write("\n]}\n")
+        self._f.close()
+        self._f = None
+
+
+class _SortedRuns:
+    """
+    External sort of (ts, seq, event) records: sorted runs of at most
+    run_size records are spilled to temp files and merged lazily.
+    """
+
+    def __init__(self, tmp_dir, run_size):
+        self._tmp_dir = tmp_dir
+        self._run_size = run_size
+        self._buffer = []
+        self._paths = []
+
+    def add(self, ts, seq, event):
+        self._buffer.append((ts, seq, event))
+        if len(self._buffer) >= self._run_size:
+            self._spill()
+
+    def _spill(self):
+        if not self._buffer:
+            return
+        self._buffer.sort(key=lambda r: (r[0], r[1]))
+        path = os.path.join(self._tmp_dir, f"run_{len(self._paths)}.jsonl")
+        with open(path, "w", encoding="utf-8") as f:
+            for record in self._buffer:
+                f.write(json.dumps(record, separators=(",", ":")))
+                f.write("\n")
+        self._paths.append(path)
+        self._buffer = []
+
+    @staticmethod
+    def _read_run(path):
+        with open(path, "r", encoding="utf-8") as f:
+            for line in f:
+                yield json.loads(line)
+
+    def merged(self):
+        # The last run stays in memory instead of a write/read round trip.
+        self._buffer.sort(key=lambda r: (r[0], r[1]))
+        runs = [self._read_run(p) for p in self._paths]
+        runs.append(iter(self._buffer))
+        return heapq.merge(*runs, key=lambda r: (r[0], r[1]))
+
+
+def _min_sort_index(events):
+    return min(
+        (
+            e["args"]["sort_index"]
+            for e in events
+            if isinstance(e.get("args"), dict) and "sort_index" in e["args"]
+        ),
+        default=0,
+    )
+
+
+class IncrementalTraceMerger:
+    """
+    Merges pairs of Paddle and msprof traces into a single output file.
+
+    Each ``merge_step`` streams one pair (typically one profiling step or
+    scheduler cycle) into the output, so a long run can be merged as it is
+    profiled instead of all at once at the end. Steps are expected in time
+    order; events within a step are sorted by timestamp.
+
+    Args:
+        output_path: merged trace; gzipped if it ends with ``.gz``.
+        clock_offset_us: shift added to Paddle timestamps. ``None`` estimates
+            it per step with ``estimate_clock_offset``.
+        start_us, end_us: keep only events overlapping this window, in msprof
+            clock microseconds. Metadata events are always kept.
+        categories: if given, keep only events whose ``cat`` is in it.
+        exclude_categories: drop events whose ``cat`` is in it.
+        run_size: events held in memory per sorted run.
+    """
+
+    def __init__(
+        self,
+        output_path,
+        clock_offset_us=None,
+        start_us=None,
+        end_us=None,
+        categories=None,
+        exclude_categories=None,
+        compress=None,
+        run_size=DEFAULT_RUN_SIZE,
+        chunk_size=DEFAULT_CHUNK_SIZE,
+    ):
+        self._writer = TraceWriter(output_path, compress)
+        self._clock_offset_us = clock_offset_us
+        self._start_us = start_us
+        self._end_us = end_us
+        self._categories = set(categories) if categories is not None else None
+        self._exclude_categories = set(exclude_categories or ())
+        self._run_size = run_size
+        self._chunk_size = chunk_size
+        self._written_metadata = set()
+
+    @property
+    def output_path(self):
+        return self._writer.path
+
+    @property
+    def num_events(self):
+        return self._writer.num_events
+
+    def _keep(self, event, ts):
+        cat = event.get("cat")
+        if self._categories is not None and cat not in self._categories:
+            return False
+        if cat in self._exclude_categories:
+            return False
+        if ts is None:
+            return True
+        end = ts + float(event.get("dur", 0) or 0)
+        if self._start_us is not None and end < self._start_us:
+            return False
+        if self._end_us is not None and ts > self._end_us:
+            return False
+        return True
+
+    def merge_step(self, paddle_path, msprof_path):
+        """
+        Stream one Paddle trace and one msprof trace into the output.
+        Either path may be None.
+        """
+        offset = self._clock_offset_us
+        if offset is None:
+            offset = (
+                estimate_clock_offset(paddle_path, msprof_path)
+                if paddle_path and msprof_path
+                else 0.0
+            )
+
+        tmp_dir = tempfile.mkdtemp(prefix="trace_merge_")
+        try:
+            runs = _SortedRuns(tmp_dir, self._run_size)
+            metadata = {"paddle": [], "msprof": []}
+            seq = 0
+            for source, path, shift in (
+                ("paddle", paddle_path, offset),
+                ("msprof", msprof_path, 0.0),
+            ):
+                if not path:
+                    continue
+                for event in iter_trace_events(path, self._chunk_size):
+                    if not isinstance(event, dict):
+                        continue
+                    if event.get("ph") == "M":
+                        metadata[source].append(event)
+                        continue
+                    ts = event_ts(event)
+                    if ts is not None and shift:
+                        ts += shift
+                        event["ts"] = ts
+                    if not self._keep(event, ts):
+                        continue
+                    runs.add(ts if ts is not None else float("-inf"), seq, event)
+                    seq += 1
+
+            # Paddle rows are placed above the CANN rows, as before.
+            if metadata["paddle"] and metadata["msprof"]:
+                adjustment = (
+                    _min_sort_index(metadata["msprof"])
+                    - _min_sort_index(metadata["paddle"])
+                    - 1
+                )
+                for event in metadata["paddle"]:
+                    args = event.get("args")
+                    if isinstance(args, dict) and "sort_index" in args:
+                        args["sort_index"] += adjustment
+            for event in metadata["paddle"] + metadata["msprof"]:
+                key = json.dumps(event, sort_keys=True)
+                if key not in self._written_metadata:
+                    self._written_metadata.add(key)
+                    self._writer.write(event)
+
+            for _, _, event in runs.merged():
+                self._writer.write(event)
+        finally:
+            shutil.rmtree(tmp_dir, ignore_errors=True)
+
+    def close(self):
+        self._writer.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+        return False
+
+
+def merge_trace_files(paddle_path, msprof_path, output_path, **options):
+    """
+    Merge one Paddle trace and one msprof trace into output_path. See
+    IncrementalTraceMerger for the options. Returns the number of events
+    written.
+    """
+    with IncrementalTraceMerger(output_path, **options) as merger:
+        merger.merge_step(paddle_path, msprof_path)
+    return merger.num_events
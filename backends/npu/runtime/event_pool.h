@@ -0,0 +1,375 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Event calls of the device runtime, as used by EventPool. The NPU runtime
+// implements it with acl; tests can drive the pool with a mock.
+class EventApi {
+ public:
+  using Event = void *;
+  using Stream = void *;
+
+  virtual ~EventApi() = default;
+
+  virtual Event Create() = 0;
+  virtual void Destroy(Event event) = 0;
+  virtual void Record(Event event, Stream stream) = 0;
+  // Makes an event recorded on stream recordable again.
+  virtual void Reset(Event event, Stream stream) = 0;
+  virtual bool Completed(Event event) = 0;
+  // True once every stream that waited on the event has passed the wait.
+  virtual bool WaitsCompleted(Event event) = 0;
+  virtual void StreamWait(Stream stream, Event event) = 0;
+  virtual void Synchronize(Event event) = 0;
+  virtual void SyncStream(Stream stream) = 0;
+};
+
+// Events of one device, recycled instead of created per dependency.
+//
+// Every record gets a sequence number from a device-wide counter, and each
+// stream keeps the highest sequence known to have completed on it. Streams
+// run in order, so once one event is seen complete every event recorded
+// before it on the same stream is complete too, without querying it. The
+// same numbers elide redundant waits: a stream that already waited for a
+// newer record of the producer, or whose producer is known to be done,
+// does not wait again.
+//
+// Released events go back to a lock-free free list as soon as they are
+// known idle; the others are parked and reclaimed when the free list runs
+// dry, querying at most one event per stream.
+class EventPool {
+ public:
+  using Event = EventApi::Event;
+  using Stream = EventApi::Stream;
+
+ private:
+  struct StreamState;
+
+  struct WaitRecord {
+    StreamState *stream;
+    // Events recorded on the waiting stream after the wait have a larger
+    // sequence number.
+    uint64_t seq;
+  };
+
+ public:
+  // Opaque to callers, who only pass it back to the pool.
+  struct PooledEvent {
+    Event handle = nullptr;
+    uint32_t index = 0;
+    std::atomic<uint32_t> next_free{0};
+    bool recorded = false;
+    StreamState *stream = nullptr;
+    uint64_t seq = 0;
+    std::vector<WaitRecord> waits;
+  };
+
+  struct Stats {
+    uint64_t created = 0;
+    uint64_t reused = 0;
+    uint64_t waits = 0;
+    uint64_t elided_waits = 0;
+    uint64_t queries = 0;
+  };
+
+  explicit EventPool(std::unique_ptr<EventApi> api) : api_(std::move(api)) {
+    for (auto &chunk : chunks_) chunk.store(nullptr);
+  }
+
+  ~EventPool() {
+    const uint32_t num_slots = num_slots_.load(std::memory_order_acquire);
+    for (uint32_t i = 0; i < num_slots; ++i) api_->Destroy(Slot(i)->handle);
+    for (auto &chunk : chunks_) delete[] chunk.load();
+  }
+
+  EventPool(const EventPool &) = delete;
+  EventPool &operator=(const EventPool &) = delete;
+
+  // Returns nullptr only if the device already has 1M events.
+  PooledEvent *Acquire() {
+    PooledEvent *event = PopFree();
+    if (event == nullptr) {
+      ReclaimParked();
+      event = PopFree();
+    }
+    if (event != nullptr) {
+      reused_.fetch_add(1, std::memory_order_relaxed);
+      return event;
+    }
+    return NewEvent();
+  }
+
+  // The caller is done with event; it is reused once its record and every
+  // wait on it have completed.
+  void Release(PooledEvent *event) {
+    if (event->recorded && !(Done(event) && WaitsPassed(event, false))) {
+      std::lock_guard<std::mutex> guard(parked_mutex_);
+      parked_.push_back(event);
+      return;
+    }
+    Recycle(event);
+  }
+
+  void Record(PooledEvent *event, Stream stream) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (event->recorded) {
+      // Re-recording must not break a wait that has yet to run.
+      if (!WaitsPassed(event, true)) {
+        for (auto &wait : event->waits) {
+          if (wait.stream->alive.load()) api_->SyncStream(wait.stream->stream);
+        }
+      }
+      if (event->stream->alive.load()) {
+        api_->Reset(event->handle, event->stream->stream);
+      }
+    }
+    api_->Record(event->handle, stream);
+    event->recorded = true;
+    event->stream = StateOf(stream);
+    event->seq = ++seq_;
+    event->waits.clear();
+  }
+
+  bool Query(PooledEvent *event) {
+    if (Done(event)) return true;
+    queries_.fetch_add(1, std::memory_order_relaxed);
+    if (!api_->Completed(event->handle)) return false;
+    MarkCompleted(event);
+    return true;
+  }
+
+  void Synchronize(PooledEvent *event) {
+    if (Done(event)) return;
+    api_->Synchronize(event->handle);
+    MarkCompleted(event);
+  }
+
+  // Makes stream wait for event. Returns false if event was never recorded.
+  bool Wait(Stream stream, PooledEvent *event) {
+    if (!event->recorded) return false;
+    std::lock_guard<std::mutex> guard(mutex_);
+    StreamState *consumer = StateOf(stream);
+    uint64_t &waited = consumer->waited[event->stream];
+    if (consumer == event->stream || waited >= event->seq || Done(event)) {
+      elided_waits_.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+    api_->StreamWait(stream, event->handle);
+    waits_.fetch_add(1, std::memory_order_relaxed);
+    waited = event->seq;
+    event->waits.push_back(WaitRecord{consumer, seq_});
+    return true;
+  }
+
+  // Makes consumer wait for the work enqueued on producer so far.
+  void Handoff(Stream producer, Stream consumer) {
+    PooledEvent *event = Acquire();
+    Record(event, producer);
+    Wait(consumer, event);
+    Release(event);
+  }
+
+  // Called after stream is destroyed: the events recorded on it are done.
+  void ForgetStream(Stream stream) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto it = streams_.find(stream);
+    if (it == streams_.end()) return;
+    it->second->alive.store(false);
+    // Events may still point at the state, so it is kept.
+    dead_streams_.push_back(std::move(it->second));
+    streams_.erase(it);
+  }
+
+  Stats stats() const {
+    Stats stats;
+    stats.created = num_slots_.load(std::memory_order_relaxed);
+    stats.reused = reused_.load(std::memory_order_relaxed);
+    stats.waits = waits_.load(std::memory_order_relaxed);
+    stats.elided_waits = elided_waits_.load(std::memory_order_relaxed);
+    stats.queries = queries_.load(std::memory_order_relaxed);
+    return stats;
+  }
+
+ private:
+  struct StreamState {
+    Stream stream = nullptr;
+    // Highest sequence number known complete on the stream.
+    std::atomic<uint64_t> completed{0};
+    std::atomic<bool> alive{true};
+    // Producer -> highest sequence of it this stream has waited for.
+    std::unordered_map<StreamState *, uint64_t> waited;
+  };
+
+  static constexpr uint32_t kChunkSize = 256;
+  static constexpr uint32_t kMaxChunks = 4096;
+  static constexpr uint64_t kIndexMask = 0xffffffffu;
+
+  PooledEvent *Slot(uint32_t index) const {
+    return &chunks_[index / kChunkSize].load(
+        std::memory_order_acquire)[index % kChunkSize];
+  }
+
+  StreamState *StateOf(Stream stream) {
+    auto &state = streams_[stream];
+    if (!state) {
+      state.reset(new StreamState);
+      state->stream = stream;
+    }
+    return state.get();
+  }
+
+  static bool Done(const PooledEvent *event) {
+    return !event->recorded || !event->stream->alive.load() ||
+           event->stream->completed.load(std::memory_order_acquire) >=
+               event->seq;
+  }
+
+  static void MarkCompleted(const PooledEvent *event) {
+    auto &completed = event->stream->completed;
+    uint64_t current = completed.load(std::memory_order_relaxed);
+    while (current < event->seq &&
+           !completed.compare_exchange_weak(current, event->seq)) {
+    }
+  }
+
+  bool WaitsPassed(PooledEvent *event, bool query) {
+    bool passed = true;
+    for (auto &wait : event->waits) {
+      if (wait.stream->alive.load() &&
+          wait.stream->completed.load(std::memory_order_acquire) <= wait.seq) {
+        passed = false;
+        break;
+      }
+    }
+    if (passed || !query) return passed;
+    queries_.fetch_add(1, std::memory_order_relaxed);
+    return api_->WaitsCompleted(event->handle);
+  }
+
+  void Recycle(PooledEvent *event) {
+    if (event->recorded && event->stream->alive.load()) {
+      api_->Reset(event->handle, event->stream->stream);
+    }
+    event->recorded = false;
+    event->stream = nullptr;
+    event->waits.clear();
+    PushFree(event);
+  }
+
+  void ReclaimParked() {
+    std::vector<PooledEvent *> parked;
+    {
+      std::lock_guard<std::mutex> guard(parked_mutex_);
+      parked.swap(parked_);
+    }
+    if (parked.empty()) return;
+    // The first incomplete sequence found on each stream; later records on
+    // the same stream are not queried.
+    std::unordered_map<StreamState *, uint64_t> pending;
+    std::vector<PooledEvent *> still_parked;
+    for (PooledEvent *event : parked) {
+      auto it = pending.find(event->stream);
+      bool idle = false;
+      if (it == pending.end() || event->seq < it->second) {
+        if (Query(event)) {
+          idle = WaitsPassed(event, true);
+        } else {
+          pending[event->stream] = event->seq;
+        }
+      }
+      if (idle) {
+        Recycle(event);
+      } else {
+        still_parked.push_back(event);
+      }
+    }
+    std::lock_guard<std::mutex> guard(parked_mutex_);
+    parked_.insert(parked_.end(), still_parked.begin(), still_parked.end());
+  }
+
+  PooledEvent *NewEvent() {
+    std::lock_guard<std::mutex> guard(grow_mutex_);
+    const uint32_t index = num_slots_.load(std::memory_order_relaxed);
+    if (index % kChunkSize == 0) {
+      if (index / kChunkSize >= kMaxChunks) return nullptr;
+      chunks_[index / kChunkSize].store(new PooledEvent[kChunkSize],
+                                        std::memory_order_release);
+    }
+    PooledEvent *event = Slot(index);
+    event->handle = api_->Create();
+    event->index = index;
+    num_slots_.store(index + 1, std::memory_order_release);
+    return event;
+  }
+
+  // Treiber stack of slot indices; the upper half of the head is a tag that
+  // changes on every update so a stale pop cannot succeed (ABA).
+  PooledEvent *PopFree() {
+    uint64_t head = free_head_.load(std::memory_order_acquire);
+    while ((head & kIndexMask) != 0) {
+      PooledEvent *event = Slot(static_cast<uint32_t>(head & kIndexMask) - 1);
+      const uint64_t next =
+          ((head >> 32) + 1) << 32 |
+          event->next_free.load(std::memory_order_relaxed);
+      if (free_head_.compare_exchange_weak(head,
+                                           next,
+                                           std::memory_order_acquire,
+                                           std::memory_order_acquire)) {
+        return event;
+      }
+    }
+    return nullptr;
+  }
+
+  void PushFree(PooledEvent *event) {
+    uint64_t head = free_head_.load(std::memory_order_relaxed);
+    uint64_t next = 0;
+    do {
+      event->next_free.store(static_cast<uint32_t>(head & kIndexMask),
+                             std::memory_order_relaxed);
+      next = ((head >> 32) + 1) << 32 | (event->index + 1);
+    } while (!free_head_.compare_exchange_weak(
+        head, next, std::memory_order_release, std::memory_order_relaxed));
+  }
+
+  std::unique_ptr<EventApi> api_;
+
+  std::atomic<PooledEvent *> chunks_[kMaxChunks];
+  std::atomic<uint32_t> num_slots_{0};
+  std::mutex grow_mutex_;
+  std::atomic<uint64_t> free_head_{0};
+
+  std::mutex parked_mutex_;
+  std::vector<PooledEvent *> parked_;
+
+  // Guards the stream states and the events' record and wait state.
+  std::mutex mutex_;
+  uint64_t seq_ = 0;
+  std::unordered_map<Stream, std::unique_ptr<StreamState>> streams_;
+  std::vector<std::unique_ptr<StreamState>> dead_streams_;
+
+  std::atomic<uint64_t> reused_{0};
+  std::atomic<uint64_t> waits_{0};
+  std::atomic<uint64_t> elided_waits_{0};
+  std::atomic<uint64_t> queries_{0};
+};
@@ -0,0 +1,234 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Stream-ordered markers, as used by HostCallbackExecutor. The NPU runtime
+// implements them with pooled events; tests can complete them on a timer.
+class CallbackMarkerApi {
+ public:
+  using Marker = void *;
+  using Stream = void *;
+
+  virtual ~CallbackMarkerApi() = default;
+
+  // Enqueues a marker after all work enqueued on stream so far.
+  virtual Marker Record(int device, Stream stream) = 0;
+  virtual bool Done(int device, Marker marker) = 0;
+  virtual void Release(int device, Marker marker) = 0;
+};
+
+// Runs host callbacks after the stream work enqueued before them, without
+// blocking the thread that enqueues them.
+//
+// Each callback is queued behind a marker recorded on its stream. A small
+// pool of workers polls the oldest marker of every stream and runs the
+// callback once it completes. Callbacks of one stream run one at a time in
+// enqueue order; different streams run in parallel. Workers back off from
+// 20 us to 1 ms between polls while nothing is ready and sleep while
+// nothing is queued.
+//
+// Polling a marker is a runtime call, so it happens outside mutex_, where
+// it does not hold up Enqueue or the workers finishing callbacks. One
+// worker polls at a time: only the poller takes head callbacks off their
+// lanes, so no marker it polls is released under it.
+class HostCallbackExecutor {
+ public:
+  using Stream = CallbackMarkerApi::Stream;
+
+  HostCallbackExecutor(std::unique_ptr<CallbackMarkerApi> api,
+                       size_t num_workers)
+      : api_(std::move(api)), num_workers_(std::max<size_t>(num_workers, 1)) {}
+
+  ~HostCallbackExecutor() { Shutdown(); }
+
+  HostCallbackExecutor(const HostCallbackExecutor &) = delete;
+  HostCallbackExecutor &operator=(const HostCallbackExecutor &) = delete;
+
+  void Enqueue(int device, Stream stream, std::function<void()> callback) {
+    auto marker = api_->Record(device, stream);
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (workers_.empty()) Start();
+    lanes_[stream].tasks.push_back(Task{device, marker, std::move(callback)});
+    ++num_queued_;
+    work_cv_.notify_one();
+  }
+
+  // Blocks until every callback enqueued on stream so far has run.
+  void WaitStream(Stream stream) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [&] {
+      auto it = lanes_.find(stream);
+      return it == lanes_.end() ||
+             (it->second.tasks.empty() && !it->second.running);
+    });
+  }
+
+  // Blocks until every callback enqueued so far has run.
+  void WaitAll() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [&] { return num_queued_ == 0 && num_running_ == 0; });
+  }
+
+  // Forgets stream after running its remaining callbacks.
+  void RemoveStream(Stream stream) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [&] {
+      auto it = lanes_.find(stream);
+      return it == lanes_.end() ||
+             (it->second.tasks.empty() && !it->second.running);
+    });
+    lanes_.erase(stream);
+  }
+
+  // Runs the remaining callbacks and stops the workers. Enqueue starts them
+  // again.
+  void Shutdown() {
+    WaitAll();
+    std::vector<std::thread> workers;
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      stop_ = true;
+      workers.swap(workers_);
+    }
+    work_cv_.notify_all();
+    for (auto &worker : workers) worker.join();
+    std::lock_guard<std::mutex> guard(mutex_);
+    stop_ = false;
+  }
+
+ private:
+  struct Task {
+    int device;
+    CallbackMarkerApi::Marker marker;
+    std::function<void()> callback;
+  };
+
+  struct Lane {
+    std::deque<Task> tasks;
+    // A worker is running this lane's head callback.
+    bool running = false;
+  };
+
+  void Start() {
+    for (size_t i = 0; i < num_workers_; ++i) {
+      workers_.emplace_back([this] { WorkerLoop(); });
+    }
+  }
+
+  struct Head {
+    Stream stream;
+    int device;
+    CallbackMarkerApi::Marker marker;
+  };
+
+  // Returns a lane whose head callback may run now, or nullptr. Unlocks
+  // lock while polling; the caller must be the poller.
+  Lane *FindReady(std::unique_lock<std::mutex> *lock) {
+    heads_.clear();
+    for (auto &entry : lanes_) {
+      const Lane &lane = entry.second;
+      if (lane.running || lane.tasks.empty()) continue;
+      const Task &head = lane.tasks.front();
+      heads_.push_back(Head{entry.first, head.device, head.marker});
+    }
+    if (heads_.empty()) return nullptr;
+    lock->unlock();
+    const Head *ready = nullptr;
+    for (const Head &head : heads_) {
+      if (api_->Done(head.device, head.marker)) {
+        ready = &head;
+        break;
+      }
+    }
+    lock->lock();
+    // Meanwhile other threads only appended tasks: only the poller takes
+    // heads, and a lane is not erased while it has tasks queued.
+    return ready == nullptr ? nullptr : &lanes_.at(ready->stream);
+  }
+
+  void WorkerLoop() {
+    constexpr auto kMinBackoff = std::chrono::microseconds(20);
+    constexpr auto kMaxBackoff = std::chrono::microseconds(1000);
+    auto backoff = kMinBackoff;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      if (stop_) return;
+      if (polling_) {
+        work_cv_.wait(lock);
+        continue;
+      }
+      polling_ = true;
+      Lane *lane = FindReady(&lock);
+      polling_ = false;
+      if (lane == nullptr) {
+        if (num_queued_ == 0) {
+          work_cv_.wait(lock);
+        } else {
+          work_cv_.wait_for(lock, backoff);
+          backoff = std::min(backoff * 2, kMaxBackoff);
+        }
+        continue;
+      }
+      backoff = kMinBackoff;
+      Task task = std::move(lane->tasks.front());
+      lane->tasks.pop_front();
+      lane->running = true;
+      --num_queued_;
+      ++num_running_;
+      // Another worker takes over polling while this one runs the callback.
+      work_cv_.notify_one();
+      lock.unlock();
+      api_->Release(task.device, task.marker);
+      task.callback();
+      lock.lock();
+      // lanes_ only rehashes on insert, which keeps Lane pointers valid,
+      // and a lane is not erased while running.
+      lane->running = false;
+      --num_running_;
+      done_cv_.notify_all();
+      // The lane's next callback may be ready already.
+      if (!lane->tasks.empty()) work_cv_.notify_one();
+    }
+  }
+
+  std::unique_ptr<CallbackMarkerApi> api_;
+  const size_t num_workers_;
+
+  std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  std::unordered_map<Stream, Lane> lanes_;
+  size_t num_queued_ = 0;
+  size_t num_running_ = 0;
+  bool stop_ = false;
+  // A worker is polling markers outside mutex_.
+  bool polling_ = false;
+  // The poller's snapshot of the lane heads.
+  std::vector<Head> heads_;
+  std::vector<std::thread> workers_;
+};
@@ -14,16 +14,18 @@
 
 #include "runtime/runtime.h"
 
+#include <atomic>
 #include <cstring>
 #include <iostream>
-#include <list>
 #include <mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 #include "glog/logging.h"
+#include "runtime/event_pool.h"
 #include "runtime/flags.h"
+#include "runtime/host_callback_executor.h"
 
 FLAGS_DEFINE_string(npu_profiling_dir,
                     "ascend_profiling",
@@ -43,261 +45,181 @@ FLAGS_DEFINE_bool(npu_runtime_debug, false, "runtime debug log");
 
 FLAGS_DEFINE_bool(npu_reuse_event, true, "reuse_event");
 
+FLAGS_DEFINE_bool(npu_async_host_callback,
+                  true,
+                  "run stream callbacks on worker threads once the stream "
+                  "work before them completes, instead of inline");
+FLAGS_DEFINE_uint32(npu_host_callback_threads,
+                    2,
+                    "worker threads running stream callbacks");
+
 DECLARE_bool(npu_blocking_run);
 
 thread_local int g_current_device_id(-1);
 
-class EventResourcePool {
+class AclEventApi : public EventApi {
  public:
-  static EventResourcePool *Instance() {
-    static EventResourcePool inst;
-    return &inst;
+  Event Create() override {
+    aclrtEvent event;
+    ACL_CHECK(aclrtCreateEvent(&event));
+    return event;
   }
 
-  void Release(int dev_id) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    for (auto &event : wait_event_list_[dev_id]) {
-      ACL_CHECK(aclrtDestroyEvent(event));
-    }
-    for (auto &event : busy_event_list_[dev_id]) {
-      ACL_CHECK(aclrtDestroyEvent(event));
-    }
-    for (auto &event : idle_event_list_[dev_id]) {
-      ACL_CHECK(aclrtDestroyEvent(event));
-    }
-    wait_event_list_[dev_id].clear();
-    busy_event_list_[dev_id].clear();
-    idle_event_list_[dev_id].clear();
-  }
+  void Destroy(Event event) override { ACL_CHECK(aclrtDestroyEvent(event)); }
 
-  aclrtEvent CreateEvent(int dev_id) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    aclrtEvent event;
-    // update idle_event_list_
-    for (auto iter = wait_event_list_[dev_id].begin();
-         iter != wait_event_list_[dev_id].end();) {
-      if (event_has_been_recorded_[dev_id][*iter]) {
-        if (!event_is_completed(*iter)) {
-          ++iter;
-        } else {
-          idle_event_list_[dev_id].push_back(*iter);
-          reset_event(recorded_event_stream_map_[*iter], *iter);
-          iter = wait_event_list_[dev_id].erase(iter);
-        }
-      } else {
-        idle_event_list_[dev_id].push_back(*iter);
-        iter = wait_event_list_[dev_id].erase(iter);
-      }
-    }
-    // create or get an idle event
-    if (idle_event_list_[dev_id].empty()) {
-      ACL_CHECK(aclrtCreateEvent(&event));
-    } else {
-      event = idle_event_list_[dev_id].front();
-      idle_event_list_[dev_id].pop_front();
-    }
-    busy_event_list_[dev_id].push_back(event);
-    event_has_been_recorded_[dev_id][event] = false;
-    recorded_event_stream_map_[event] = nullptr;
-    recorded_event_wait_stream_map_[event].clear();
-    return event;
+  void Record(Event event, Stream stream) override {
+    ACL_CHECK(aclrtRecordEvent(event, stream));
   }
 
-  void DestroyEvent(int dev_id, aclrtEvent event) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    // put the event into the wait_event_list_
-    wait_event_list_[dev_id].push_back(event);
-    auto it = std::find(busy_event_list_[dev_id].begin(),
-                        busy_event_list_[dev_id].end(),
-                        event);
-    LOG_IF(ERROR, it == busy_event_list_[dev_id].end())
-        << "[RUNTIME] DestroyEvent: the event dose not exist in the "
-           "busy_event_list["
-        << dev_id << "]. event=" << event;
-    busy_event_list_[dev_id].erase(it);
+  void Reset(Event event, Stream stream) override {
+    ACL_CHECK(aclrtResetEvent(event, stream));
   }
 
-  void RecordEvent(int dev_id, aclrtStream stream, aclrtEvent event) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (event_has_been_recorded_[dev_id][event]) {
-      LOG_IF(WARNING, FLAGS_npu_runtime_debug)
-          << "[RUNTIME] RecordEvent: event has already been recorded. event="
-          << event;
-      reset_event(recorded_event_stream_map_[event], event);
-    }
-    event_has_been_recorded_[dev_id][event] = true;
-    recorded_event_stream_map_[event] = stream;
-    record_evnt(stream, event);
+  bool Completed(Event event) override {
+    aclrtEventRecordedStatus status = ACL_EVENT_RECORDED_STATUS_COMPLETE;
+    ACL_CHECK(aclrtQueryEventStatus(event, &status));
+    return status == ACL_EVENT_RECORDED_STATUS_COMPLETE;
   }
 
-  bool QueryEvent(int dev_id, aclrtEvent event) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (event_has_been_recorded_[dev_id][event]) {
-      return event_is_completed(event);
-    }
-    return true;
+  bool WaitsCompleted(Event event) override {
+    aclrtEventWaitStatus status = ACL_EVENT_WAIT_STATUS_COMPLETE;
+    ACL_CHECK(aclrtQueryEventWaitStatus(event, &status));
+    return status == ACL_EVENT_WAIT_STATUS_COMPLETE;
   }
 
-  void WaitEvent(int dev_id, aclrtStream stream, aclrtEvent event) {
-    if (!event_has_been_recorded_[dev_id][event]) {
-      LOG(ERROR)
-          << "[RUNTIME] WaitEvent: the event has not been recorded. event="
-          << event;
-      exit(-1);
-    }
+  void StreamWait(Stream stream, Event event) override {
     ACL_CHECK(aclrtStreamWaitEvent(stream, event));
-    recorded_event_wait_stream_map_[event].push_back(stream);
   }
 
-  void PostDestroyStream(aclrtStream stream) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    for (auto iter = recorded_event_stream_map_.begin();
-         iter != recorded_event_stream_map_.end();) {
-      if (iter->second == stream) {
-        iter = recorded_event_stream_map_.erase(iter);
-      } else {
-        ++iter;
-      }
-    }
-
-    for (auto iter = recorded_event_wait_stream_map_.begin();
-         iter != recorded_event_wait_stream_map_.end();
-         ++iter) {
-      for (auto wait_stream_iter = iter->second.begin();
-           wait_stream_iter != iter->second.end();) {
-        if (*wait_stream_iter == stream) {
-          wait_stream_iter = iter->second.erase(wait_stream_iter);
-        } else {
-          ++wait_stream_iter;
-        }
-      }
-    }
+  void Synchronize(Event event) override {
+    ACL_CHECK(aclrtSynchronizeEvent(event));
   }
 
- private:
-  bool event_is_completed(aclrtEvent event) {
-    aclrtEventRecordedStatus status = ACL_EVENT_RECORDED_STATUS_COMPLETE;
-    ACL_CHECK(aclrtQueryEventStatus(event, &status));
-    return status == ACL_EVENT_RECORDED_STATUS_COMPLETE;
+  void SyncStream(Stream stream) override {
+    ACL_CHECK(aclrtSynchronizeStream(stream));
   }
+};
 
-  void synchronize_event(aclrtEvent event) {
-    ACL_CHECK(aclrtSynchronizeEvent(event));
+// One EventPool per device, created on first use. Lookups do not lock.
+class DeviceEventPools {
+ public:
+  static DeviceEventPools &Instance() {
+    static DeviceEventPools ins;
+    return ins;
   }
 
-  void reset_event(aclrtStream stream, aclrtEvent event) {
-    if (recorded_event_wait_stream_map_[event].size()) {
-      aclrtEventWaitStatus status = ACL_EVENT_WAIT_STATUS_COMPLETE;
-      ACL_CHECK(aclrtQueryEventWaitStatus(event, &status));
-      if (status != ACL_EVENT_WAIT_STATUS_COMPLETE) {
-        LOG_IF(INFO, FLAGS_npu_runtime_debug)
-            << "[RUNTIME] reset_event: stream has not been completed that wait "
-               "this event. event="
-            << event;
-        // blocking cpu
-        for (auto &wait_stream : recorded_event_wait_stream_map_[event]) {
-          LOG_IF(INFO, FLAGS_npu_runtime_debug)
-              << "[RUNTIME] reset_event: sychronize the waiting stream. stream="
-              << wait_stream;
-          ACL_CHECK(aclrtSynchronizeStream(wait_stream));
-        }
-      }
-      recorded_event_wait_stream_map_[event].clear();
-    }
-    if (stream) {
-      ACL_CHECK(aclrtResetEvent(event, stream));
+  EventPool &Get(int dev_id) {
+    RUN_CHECK(dev_id >= 0 && dev_id < kMaxDevices);
+    EventPool *pool = pools_[dev_id].load(std::memory_order_acquire);
+    if (pool != nullptr) return *pool;
+    std::lock_guard<std::mutex> lock(mutex_);
+    pool = pools_[dev_id].load(std::memory_order_relaxed);
+    if (pool == nullptr) {
+      pool = new EventPool(std::unique_ptr<EventApi>(new AclEventApi));
+      pools_[dev_id].store(pool, std::memory_order_release);
     }
+    return *pool;
   }
 
-  void record_evnt(aclrtStream stream, aclrtEvent event) {
-    ACL_CHECK(aclrtRecordEvent(event, stream));
+  // Destroys every event of the device.
+  void Release(int dev_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    EventPool *pool = pools_[dev_id].exchange(nullptr);
+    if (pool == nullptr) return;
+    auto stats = pool->stats();
+    LOG_IF(INFO, FLAGS_npu_runtime_debug)
+        << "[RUNTIME] EventPool: device=" << dev_id
+        << ", created=" << stats.created << ", reused=" << stats.reused
+        << ", waits=" << stats.waits
+        << ", elided_waits=" << stats.elided_waits
+        << ", queries=" << stats.queries;
+    delete pool;
   }
 
  private:
+  static constexpr int kMaxDevices = 64;
+
+  DeviceEventPools() {
+    for (auto &pool : pools_) pool.store(nullptr);
+  }
+
+  std::atomic<EventPool *> pools_[kMaxDevices];
   std::mutex mutex_;
-  std::unordered_map<int, std::list<aclrtEvent>> idle_event_list_;
-  std::unordered_map<int, std::list<aclrtEvent>> busy_event_list_;
-  std::unordered_map<int, std::list<aclrtEvent>> wait_event_list_;
-  std::unordered_map<aclrtEvent, aclrtStream> recorded_event_stream_map_;
-  std::unordered_map<aclrtEvent, std::list<aclrtStream>>
-      recorded_event_wait_stream_map_;
-  std::unordered_map<int, std::unordered_map<aclrtEvent, bool>>
-      event_has_been_recorded_;
 };
 
+inline EventPool::PooledEvent *ToPooledEvent(C_Event event) {
+  return reinterpret_cast<EventPool::PooledEvent *>(event);
+}
+
+// Callback markers are pooled events. Workers query them from their own
+// threads, so each query first binds the device context to the thread.
+class AclCallbackMarkerApi : public CallbackMarkerApi {
+ public:
+  Marker Record(int device, Stream stream) override {
+    auto &pool = DeviceEventPools::Instance().Get(device);
+    auto event = pool.Acquire();
+    RUN_CHECK(event != nullptr);
+    pool.Record(event, reinterpret_cast<aclrtStream>(stream));
+    return event;
+  }
+
+  bool Done(int device, Marker marker) override {
+    C_Device_st dev = {device};
+    SetDevice(&dev);
+    return DeviceEventPools::Instance().Get(device).Query(
+        reinterpret_cast<EventPool::PooledEvent *>(marker));
+  }
+
+  void Release(int device, Marker marker) override {
+    DeviceEventPools::Instance().Get(device).Release(
+        reinterpret_cast<EventPool::PooledEvent *>(marker));
+  }
+};
+
+// Never destroyed: Finalize stops the workers.
+HostCallbackExecutor &HostCallbacks() {
+  static auto *executor = new HostCallbackExecutor(
+      std::unique_ptr<CallbackMarkerApi>(new AclCallbackMarkerApi),
+      FLAGS_npu_host_callback_threads);
+  return *executor;
+}
+
 aclrtStream SecondaryStream::Get(aclrtStream aicore_stream) {
   RUN_CHECK(aicpu_streams.find(aicore_stream) != aicpu_streams.cend());
-  return aicpu_streams[aicore_stream];
+  return aicpu_streams[aicore_stream].stream;
 }
 
-void SecondaryStream::Create(aclrtStream aicore_stream) {
+void SecondaryStream::Create(int dev_id, aclrtStream aicore_stream) {
   RUN_CHECK(aicpu_streams.find(aicore_stream) == aicpu_streams.cend());
   aclrtStream aicpu_stream;
   ACL_CHECK(aclrtCreateStreamWithConfig(
       reinterpret_cast<aclrtStream *>(&aicpu_stream),
       0,
       (ACL_STREAM_FAST_LAUNCH | ACL_STREAM_FAST_SYNC)));
-  aicpu_streams[aicore_stream] = aicpu_stream;
+  aicpu_streams[aicore_stream] = {aicpu_stream, dev_id};
 }
 
 void SecondaryStream::Destroy(aclrtStream aicore_stream) {
   RUN_CHECK(aicpu_streams.find(aicore_stream) != aicpu_streams.cend());
-  HostCallbackManager::Instance().ReleaseProcessWorker(
-      aicpu_streams[aicore_stream]);
-  ACL_CHECK(aclrtDestroyStream(aicpu_streams[aicore_stream]));
+  auto aicpu = aicpu_streams[aicore_stream];
+  HostCallbackManager::Instance().ReleaseProcessWorker(aicpu.stream);
+  ACL_CHECK(aclrtDestroyStream(aicpu.stream));
+  DeviceEventPools::Instance().Get(aicpu.dev_id).ForgetStream(aicpu.stream);
   aicpu_streams.erase(aicore_stream);
 }
 
 void SecondaryStream::RecordBefore(aclrtStream aicore_stream) {
-  static std::list<aclrtEvent> events;
-
   RUN_CHECK(aicpu_streams.find(aicore_stream) != aicpu_streams.cend());
-  auto aicpu_stream = aicpu_streams[aicore_stream];
-
-  for (auto iter = events.begin(); iter != events.end();) {
-    auto event = *iter;
-    aclrtEventRecordedStatus status = ACL_EVENT_RECORDED_STATUS_COMPLETE;
-    ACL_CHECK(aclrtQueryEventStatus(event, &status));
-    if (status == ACL_EVENT_RECORDED_STATUS_COMPLETE) {
-      ACL_CHECK(aclrtDestroyEvent(event));
-      iter = events.erase(iter);
-    } else {
-      ++iter;
-    }
-  }
-  {
-    aclrtEvent event;
-    ACL_CHECK(aclrtCreateEvent(&event));
-    ACL_CHECK(aclrtRecordEvent(event, aicpu_stream));
-    ACL_CHECK(aclrtStreamWaitEvent(aicore_stream, event));
-    events.push_back(event);
-  }
+  auto aicpu = aicpu_streams[aicore_stream];
+  DeviceEventPools::Instance().Get(aicpu.dev_id).Handoff(aicpu.stream,
+                                                         aicore_stream);
 }
 
 void SecondaryStream::RecordAfter(aclrtStream aicore_stream) {
-  static std::list<aclrtEvent> events;
-
   RUN_CHECK(aicpu_streams.find(aicore_stream) != aicpu_streams.cend());
-  auto aicpu_stream = aicpu_streams[aicore_stream];
-
-  for (auto iter = events.begin(); iter != events.end();) {
-    auto event = *iter;
-    aclrtEventRecordedStatus status = ACL_EVENT_RECORDED_STATUS_COMPLETE;
-    ACL_CHECK(aclrtQueryEventStatus(event, &status));
-    if (status == ACL_EVENT_RECORDED_STATUS_COMPLETE) {
-      ACL_CHECK(aclrtDestroyEvent(event));
-      iter = events.erase(iter);
-    } else {
-      ++iter;
-    }
-  }
-  {
-    aclrtEvent event;
-    ACL_CHECK(aclrtCreateEvent(&event));
-    ACL_CHECK(aclrtRecordEvent(event, aicore_stream));
-    ACL_CHECK(aclrtStreamWaitEvent(aicpu_stream, event));
-    events.push_back(event);
-  }
+  auto aicpu = aicpu_streams[aicore_stream];
+  DeviceEventPools::Instance().Get(aicpu.dev_id).Handoff(aicore_stream,
+                                                         aicpu.stream);
 }
 
 class AlignnedAllocator {
@@ -442,7 +364,7 @@ C_Status GetDevice(const C_Device device) {
 
 C_Status ReleaseDevice(const C_Device device) {
   SetDevice(device);
-  EventResourcePool::Instance()->Release(device->id);
+  DeviceEventPools::Instance().Release(device->id);
   if (global_allocator_list) {
     // global_allocator_list->GetAllocator(device->id)->ClearEvent();
     global_allocator_list->Deinit(device->id);
@@ -452,6 +374,7 @@ C_Status ReleaseDevice(const C_Device device) {
 }
 
 C_Status Finalize() {
+  HostCallbacks().Shutdown();
   HostCallbackManager::Instance().ReleaseAllProcessWorkers();
   if (global_allocator_list) {
     delete global_allocator_list;
@@ -642,7 +565,8 @@ C_Status CreateStream(const C_Device device, C_Stream *stream) {
       << "[RUNTIME] CreateStream: device=" << device->id
       << ", stream=" << *stream;
 
-  SecondaryStream::Instance().Create(*reinterpret_cast<aclrtStream *>(stream));
+  SecondaryStream::Instance().Create(device->id,
+                                     *reinterpret_cast<aclrtStream *>(stream));
   return C_SUCCESS;
 }
 
@@ -651,21 +575,24 @@ C_Status DestroyStream(const C_Device device, C_Stream stream) {
       << "[RUNTIME] DestroyStream: device=" << device->id
       << ", stream=" << stream;
 
+  HostCallbacks().RemoveStream(stream);
   HostCallbackManager::Instance().ReleaseProcessWorker(stream);
   ACL_CHECK(aclrtDestroyStream(reinterpret_cast<aclrtStream>(stream)));
   SecondaryStream::Instance().Destroy(reinterpret_cast<aclrtStream>(stream));
-  EventResourcePool::Instance()->PostDestroyStream(stream);
+  DeviceEventPools::Instance().Get(device->id).ForgetStream(stream);
   return C_SUCCESS;
 }
 
 C_Status CreateEvent(const C_Device device, C_Event *event) {
-  aclrtEvent aclrt_event;
   if (FLAGS_npu_reuse_event) {
-    aclrt_event = EventResourcePool::Instance()->CreateEvent(device->id);
+    auto pooled = DeviceEventPools::Instance().Get(device->id).Acquire();
+    RUN_CHECK(pooled != nullptr);
+    *event = reinterpret_cast<C_Event>(pooled);
   } else {
+    aclrtEvent aclrt_event;
     ACL_CHECK(aclrtCreateEvent(&aclrt_event));
+    *event = reinterpret_cast<C_Event>(aclrt_event);
   }
-  *event = reinterpret_cast<C_Event>(aclrt_event);
   LOG_IF(INFO, FLAGS_npu_runtime_debug)
       << "[RUNTIME] CreateEvent: device=" << device->id << ", event=" << *event;
   return C_SUCCESS;
@@ -676,10 +603,8 @@ C_Status RecordEvent(const C_Device device, C_Stream stream, C_Event event) {
       << "[RUNTIME] RecordEvent: device=" << device->id << ", stream=" << stream
       << ", event=" << event;
   if (FLAGS_npu_reuse_event) {
-    EventResourcePool::Instance()->RecordEvent(
-        device->id,
-        reinterpret_cast<aclrtStream>(stream),
-        reinterpret_cast<aclrtEvent>(event));
+    DeviceEventPools::Instance().Get(device->id).Record(
+        ToPooledEvent(event), reinterpret_cast<aclrtStream>(stream));
   } else {
     ACL_CHECK(aclrtRecordEvent(reinterpret_cast<aclrtEvent>(event),
                                reinterpret_cast<aclrtStream>(stream)));
@@ -689,8 +614,8 @@ C_Status RecordEvent(const C_Device device, C_Stream stream, C_Event event) {
 
 C_Status QueryEvent(const C_Device device, C_Event event) {
   if (FLAGS_npu_reuse_event) {
-    return EventResourcePool::Instance()->QueryEvent(
-               device->id, reinterpret_cast<aclrtEvent>(event))
+    return DeviceEventPools::Instance().Get(device->id).Query(
+               ToPooledEvent(event))
                ? C_SUCCESS
                : C_FAILED;
   } else {
@@ -705,8 +630,7 @@ C_Status DestroyEvent(const C_Device device, C_Event event) {
   LOG_IF(INFO, FLAGS_npu_runtime_debug)
       << "[RUNTIME] DestroyEvent: device=" << device->id << ", event=" << event;
   if (FLAGS_npu_reuse_event) {
-    EventResourcePool::Instance()->DestroyEvent(
-        device->id, reinterpret_cast<aclrtEvent>(event));
+    DeviceEventPools::Instance().Get(device->id).Release(ToPooledEvent(event));
   } else {
     ACL_CHECK(aclrtDestroyEvent(reinterpret_cast<aclrtEvent>(event)));
   }
@@ -717,6 +641,7 @@ C_Status SyncDevice(const C_Device device) {
   LOG_IF(INFO, FLAGS_npu_runtime_debug)
       << "[RUNTIME] SyncDevice: device=" << device->id;
   ACL_CHECK(aclrtSynchronizeDevice());
+  HostCallbacks().WaitAll();
   return C_SUCCESS;
 }
 
@@ -724,13 +649,19 @@ C_Status SyncStream(const C_Device device, C_Stream stream) {
   LOG_IF(INFO, FLAGS_npu_runtime_debug)
       << "[RUNTIME] SyncStream: device=" << device->id << " stream=" << stream;
   ACL_CHECK(aclrtSynchronizeStream(reinterpret_cast<aclrtStream>(stream)));
+  HostCallbacks().WaitStream(stream);
   return C_SUCCESS;
 }
 
 C_Status SyncEvent(const C_Device device, C_Event event) {
   LOG_IF(INFO, FLAGS_npu_runtime_debug)
       << "[RUNTIME] SyncEvent: device=" << device->id << " event=" << event;
-  ACL_CHECK(aclrtSynchronizeEvent(reinterpret_cast<aclrtEvent>(event)));
+  if (FLAGS_npu_reuse_event) {
+    DeviceEventPools::Instance().Get(device->id).Synchronize(
+        ToPooledEvent(event));
+  } else {
+    ACL_CHECK(aclrtSynchronizeEvent(reinterpret_cast<aclrtEvent>(event)));
+  }
   return C_SUCCESS;
 }
 
@@ -741,10 +672,13 @@ C_Status StreamWaitEvent(const C_Device device,
       << "[RUNTIME] StreamWaitEvent: device=" << device->id
       << ", stream=" << stream << ", event=" << event;
   if (FLAGS_npu_reuse_event) {
-    EventResourcePool::Instance()->WaitEvent(
-        device->id,
-        reinterpret_cast<aclrtStream>(stream),
-        reinterpret_cast<aclrtEvent>(event));
+    if (!DeviceEventPools::Instance().Get(device->id).Wait(
+            reinterpret_cast<aclrtStream>(stream), ToPooledEvent(event))) {
+      LOG(ERROR)
+          << "[RUNTIME] WaitEvent: the event has not been recorded. event="
+          << event;
+      exit(-1);
+    }
   } else {
     ACL_CHECK(aclrtStreamWaitEvent(reinterpret_cast<aclrtStream>(stream),
                                    reinterpret_cast<aclrtEvent>(event)));
@@ -756,9 +690,24 @@ C_Status AddCallback(const C_Device device,
                      C_Stream stream,
                      C_Callback callback,
                      void *user_data) {
-  C_Status ret = C_SUCCESS;
-  callback(device, stream, user_data, &ret);
-  return ret;
+  LOG_IF(INFO, FLAGS_npu_runtime_debug)
+      << "[RUNTIME] AddCallback: device=" << device->id
+      << ", stream=" << stream;
+  if (!FLAGS_npu_async_host_callback || FLAGS_npu_blocking_run) {
+    C_Status ret = C_SUCCESS;
+    callback(device, stream, user_data, &ret);
+    return ret;
+  }
+  // The caller's device may not outlive the callback.
+  C_Device_st dev = *device;
+  HostCallbacks().Enqueue(device->id, stream, [=]() mutable {
+    C_Status ret = C_SUCCESS;
+    callback(&dev, stream, user_data, &ret);
+    LOG_IF(ERROR, ret != C_SUCCESS)
+        << "[RUNTIME] stream callback failed: device=" << dev.id
+        << ", stream=" << stream;
+  });
+  return C_SUCCESS;
 }
 
 C_Status DeviceMemStats(const C_Device device,
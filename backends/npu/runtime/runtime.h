@@ -203,7 +203,7 @@ struct SecondaryStream {
 
   aclrtStream Get(aclrtStream aicore_stream);
 
-  void Create(aclrtStream aicore_stream);
+  void Create(int dev_id, aclrtStream aicore_stream);
 
   void Destroy(aclrtStream aicore_stream);
 
@@ -218,8 +218,13 @@ struct SecondaryStream {
   void RecordAfter(aclrtStream aicore_stream);
 
  private:
+  struct AicpuStream {
+    aclrtStream stream;
+    int dev_id;
+  };
+
   SecondaryStream() = default;
-  std::unordered_map<aclrtStream, aclrtStream> aicpu_streams;
+  std::unordered_map<aclrtStream, AicpuStream> aicpu_streams;
 };
 
 struct HostCallbackManager {
@@ -0,0 +1,316 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "runtime/event_pool.h"
+
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+// Host-only stand-in for an NPU stream: records and waits take positions
+// in its queue, which completes up to where the test advances it.
+struct MockStream {
+  uint64_t pushed = 0;
+  uint64_t completed = 0;
+
+  void Complete() { completed = pushed; }
+};
+
+struct MockEvent {
+  MockStream *stream = nullptr;
+  uint64_t position = 0;
+  // Streams waiting on the record, and where in their queue.
+  std::vector<std::pair<MockStream *, uint64_t>> waits;
+};
+
+// Mock of the acl event calls, counting them. Not thread safe; the tests
+// drive the pool from one thread.
+class MockEventApi : public EventApi {
+ public:
+  struct Calls {
+    int created = 0;
+    int destroyed = 0;
+    int records = 0;
+    int resets = 0;
+    int queries = 0;
+    int stream_waits = 0;
+    int stream_syncs = 0;
+  };
+
+  explicit MockEventApi(Calls *calls) : calls_(calls) {}
+
+  Event Create() override {
+    ++calls_->created;
+    events_.emplace_back(new MockEvent);
+    return events_.back().get();
+  }
+
+  void Destroy(Event event) override { ++calls_->destroyed; }
+
+  void Record(Event event, Stream stream) override {
+    ++calls_->records;
+    auto mock = static_cast<MockEvent *>(event);
+    auto mock_stream = static_cast<MockStream *>(stream);
+    mock->stream = mock_stream;
+    mock->position = ++mock_stream->pushed;
+    mock->waits.clear();
+  }
+
+  void Reset(Event event, Stream stream) override {
+    ++calls_->resets;
+    EXPECT_EQ(static_cast<MockEvent *>(event)->stream, stream);
+  }
+
+  bool Completed(Event event) override {
+    ++calls_->queries;
+    auto mock = static_cast<MockEvent *>(event);
+    return mock->stream->completed >= mock->position;
+  }
+
+  bool WaitsCompleted(Event event) override {
+    ++calls_->queries;
+    for (auto &wait : static_cast<MockEvent *>(event)->waits) {
+      if (wait.first->completed < wait.second) return false;
+    }
+    return true;
+  }
+
+  void StreamWait(Stream stream, Event event) override {
+    ++calls_->stream_waits;
+    auto mock_stream = static_cast<MockStream *>(stream);
+    static_cast<MockEvent *>(event)->waits.emplace_back(mock_stream,
+                                                        ++mock_stream->pushed);
+  }
+
+  void Synchronize(Event event) override {
+    auto mock = static_cast<MockEvent *>(event);
+    mock->stream->completed =
+        std::max(mock->stream->completed, mock->position);
+  }
+
+  void SyncStream(Stream stream) override {
+    ++calls_->stream_syncs;
+    static_cast<MockStream *>(stream)->Complete();
+  }
+
+ private:
+  Calls *calls_;
+  std::vector<std::unique_ptr<MockEvent>> events_;
+};
+
+std::unique_ptr<EventApi> MakeApi(MockEventApi::Calls *calls) {
+  return std::unique_ptr<EventApi>(new MockEventApi(calls));
+}
+
+}  // namespace
+
+TEST(EventPool, ReusesIdleEvents) {
+  MockEventApi::Calls calls;
+  {
+    EventPool pool(MakeApi(&calls));
+    MockStream stream;
+    for (int i = 0; i < 10; ++i) {
+      auto event = pool.Acquire();
+      ASSERT_NE(event, nullptr);
+      pool.Record(event, &stream);
+      stream.Complete();
+      EXPECT_TRUE(pool.Query(event));
+      pool.Release(event);
+    }
+    EXPECT_EQ(calls.created, 1);
+    EXPECT_EQ(pool.stats().reused, 9u);
+
+    // An event still pending is parked, so the next Acquire creates one.
+    auto pending = pool.Acquire();
+    pool.Record(pending, &stream);
+    pool.Release(pending);
+    auto other = pool.Acquire();
+    EXPECT_NE(other, pending);
+    EXPECT_EQ(calls.created, 2);
+    pool.Release(other);
+
+    // Once its record completes it is reclaimed instead.
+    stream.Complete();
+    auto first = pool.Acquire();
+    auto second = pool.Acquire();
+    EXPECT_TRUE((first == pending) != (second == pending));
+    EXPECT_EQ(calls.created, 2);
+    pool.Release(first);
+    pool.Release(second);
+  }
+  EXPECT_EQ(calls.destroyed, calls.created);
+}
+
+TEST(EventPool, SequenceCompletionSkipsQueries) {
+  MockEventApi::Calls calls;
+  EventPool pool(MakeApi(&calls));
+  MockStream stream;
+  std::vector<EventPool::PooledEvent *> events;
+  for (int i = 0; i < 4; ++i) {
+    events.push_back(pool.Acquire());
+    pool.Record(events.back(), &stream);
+  }
+  EXPECT_FALSE(pool.Query(events[0]));
+  EXPECT_EQ(calls.queries, 1);
+
+  // The last record completing implies every one before it did.
+  stream.Complete();
+  EXPECT_TRUE(pool.Query(events[3]));
+  EXPECT_EQ(calls.queries, 2);
+  for (int i = 0; i < 3; ++i) EXPECT_TRUE(pool.Query(events[i]));
+  EXPECT_EQ(calls.queries, 2);
+  pool.Synchronize(events[1]);
+  EXPECT_EQ(pool.stats().queries, 2u);
+
+  // Streams are independent: another stream's progress says nothing.
+  MockStream other;
+  auto later = pool.Acquire();
+  pool.Record(later, &other);
+  EXPECT_FALSE(pool.Query(later));
+  pool.Synchronize(later);
+  EXPECT_TRUE(pool.Query(later));
+
+  // All are known complete, so releasing them frees them at once.
+  for (auto event : events) pool.Release(event);
+  pool.Release(later);
+  EXPECT_EQ(pool.Acquire(), later);
+  EXPECT_EQ(calls.created, 5);
+}
+
+TEST(EventPool, HandoffBetweenStreams) {
+  MockEventApi::Calls calls;
+  EventPool pool(MakeApi(&calls));
+  MockStream aicore, aicpu;
+
+  // Each handoff waits once; a second wait on the same record is elided.
+  pool.Handoff(&aicore, &aicpu);
+  EXPECT_EQ(calls.stream_waits, 1);
+  auto event = pool.Acquire();
+  pool.Record(event, &aicore);
+  EXPECT_TRUE(pool.Wait(&aicpu, event));
+  EXPECT_TRUE(pool.Wait(&aicpu, event));
+  EXPECT_EQ(calls.stream_waits, 2);
+  // Waiting on the stream's own record, or on a finished one, is elided.
+  EXPECT_TRUE(pool.Wait(&aicore, event));
+  aicore.Complete();
+  pool.Handoff(&aicpu, &aicore);
+  EXPECT_EQ(calls.stream_waits, 3);
+  auto done = pool.Acquire();
+  pool.Record(done, &aicore);
+  aicore.Complete();
+  EXPECT_TRUE(pool.Query(done));
+  EXPECT_TRUE(pool.Wait(&aicpu, done));
+  EXPECT_EQ(calls.stream_waits, 3);
+  EXPECT_EQ(pool.stats().elided_waits, 3u);
+
+  // A never recorded event cannot be waited on.
+  auto fresh = pool.Acquire();
+  EXPECT_FALSE(pool.Wait(&aicpu, fresh));
+  pool.Release(fresh);
+  pool.Release(done);
+
+  // An event whose wait has not run is not reused until it has.
+  pool.Release(event);
+  auto next = pool.Acquire();
+  EXPECT_NE(next, event);
+  pool.Release(next);
+  aicpu.Complete();
+  auto a = pool.Acquire();
+  auto b = pool.Acquire();
+  auto c = pool.Acquire();
+  EXPECT_TRUE(a == event || b == event || c == event);
+  EXPECT_EQ(calls.stream_syncs, 0);
+
+  // Re-recording an event whose wait has not run syncs the waiter first.
+  pool.Record(a, &aicore);
+  EXPECT_TRUE(pool.Wait(&aicpu, a));
+  pool.Record(a, &aicore);
+  EXPECT_EQ(calls.stream_syncs, 1);
+  pool.Release(a);
+  pool.Release(b);
+  pool.Release(c);
+}
+
+TEST(EventPool, ForgottenStreamsAreDone) {
+  MockEventApi::Calls calls;
+  EventPool pool(MakeApi(&calls));
+  MockStream *stream = new MockStream;
+  MockStream consumer;
+  auto event = pool.Acquire();
+  pool.Record(event, stream);
+  EXPECT_FALSE(pool.Query(event));
+  pool.ForgetStream(stream);
+  delete stream;
+  EXPECT_TRUE(pool.Query(event));
+  EXPECT_TRUE(pool.Wait(&consumer, event));
+  EXPECT_EQ(calls.stream_waits, 0);
+  const int resets = calls.resets;
+  pool.Release(event);
+  // The stream is gone, so the event is not reset on it.
+  EXPECT_EQ(calls.resets, resets);
+  EXPECT_EQ(pool.Acquire(), event);
+}
+
+TEST(EventPool, DevicesHaveSeparatePools) {
+  MockEventApi::Calls calls0, calls1;
+  EventPool pool0(MakeApi(&calls0));
+  EventPool pool1(MakeApi(&calls1));
+  MockStream stream0, stream1;
+  auto event0 = pool0.Acquire();
+  auto event1 = pool1.Acquire();
+  pool0.Record(event0, &stream0);
+  pool1.Record(event1, &stream1);
+  stream0.Complete();
+  EXPECT_TRUE(pool0.Query(event0));
+  EXPECT_FALSE(pool1.Query(event1));
+  pool0.Release(event0);
+  pool1.Release(event1);
+  EXPECT_EQ(pool0.Acquire(), event0);
+  EXPECT_NE(pool1.Acquire(), event1);
+  EXPECT_EQ(calls0.created, 1);
+  EXPECT_EQ(calls1.created, 2);
+}
+
+TEST(EventPool, ConcurrentAcquireRelease) {
+  // Events that are never recorded are idle at once, so threads hammer the
+  // lock-free free list.
+  MockEventApi::Calls calls;
+  EventPool pool(MakeApi(&calls));
+  constexpr int kThreads = 8;
+  constexpr int kIters = 20000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&] {
+      std::vector<EventPool::PooledEvent *> held;
+      for (int i = 0; i < kIters; ++i) {
+        held.push_back(pool.Acquire());
+        if (held.size() == 4) {
+          std::sort(held.begin(), held.end());
+          EXPECT_EQ(std::unique(held.begin(), held.end()), held.end());
+          for (auto event : held) pool.Release(event);
+          held.clear();
+        }
+      }
+      for (auto event : held) pool.Release(event);
+    });
+  }
+  for (auto &thread : threads) thread.join();
+  EXPECT_LE(pool.stats().created, static_cast<uint64_t>(kThreads * 4));
+}
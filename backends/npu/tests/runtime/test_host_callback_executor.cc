@@ -0,0 +1,247 @@
+// Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "runtime/host_callback_executor.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+// Host-only stand-in for an NPU stream: the work enqueued on it completes
+// when the test advances it, in order.
+class FakeStream {
+ public:
+  // Enqueues one unit of work and returns its position.
+  uint64_t Push() { return ++enqueued_; }
+
+  void Advance(uint64_t n = 1) { completed_ += n; }
+  void AdvanceAll() { completed_ = enqueued_.load(); }
+
+  bool Completed(uint64_t position) const { return completed_ >= position; }
+
+ private:
+  std::atomic<uint64_t> enqueued_{0};
+  std::atomic<uint64_t> completed_{0};
+};
+
+struct FakeMarker {
+  FakeStream *stream;
+  uint64_t position;
+  std::atomic<bool> released{false};
+};
+
+// Markers are positions on a FakeStream. Polling a released marker, or
+// releasing one twice, counts as a misuse.
+class FakeMarkerApi : public CallbackMarkerApi {
+ public:
+  struct Counters {
+    std::atomic<int> recorded{0};
+    std::atomic<int> released{0};
+    std::atomic<int> misuses{0};
+    // Called from Done, outside the executor's lock.
+    std::function<void()> on_done;
+  };
+
+  explicit FakeMarkerApi(Counters *counters) : counters_(counters) {}
+
+  Marker Record(int device, Stream stream) override {
+    auto fake = static_cast<FakeStream *>(stream);
+    ++counters_->recorded;
+    std::lock_guard<std::mutex> guard(mutex_);
+    markers_.emplace_back(new FakeMarker{fake, fake->Push()});
+    return markers_.back().get();
+  }
+
+  bool Done(int device, Marker marker) override {
+    auto fake = static_cast<FakeMarker *>(marker);
+    if (fake->released) ++counters_->misuses;
+    if (counters_->on_done) counters_->on_done();
+    return fake->stream->Completed(fake->position);
+  }
+
+  void Release(int device, Marker marker) override {
+    auto fake = static_cast<FakeMarker *>(marker);
+    if (fake->released.exchange(true)) ++counters_->misuses;
+    ++counters_->released;
+  }
+
+ private:
+  Counters *counters_;
+  // Kept until the executor is gone, so a late poll is detected rather
+  // than a crash.
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<FakeMarker>> markers_;
+};
+
+template <typename Pred>
+bool WaitFor(Pred pred) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (!pred()) {
+    if (std::chrono::steady_clock::now() > deadline) return false;
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  return true;
+}
+
+}  // namespace
+
+TEST(HostCallbackExecutor, RunsCallbacksAfterTheirStreamWork) {
+  FakeMarkerApi::Counters counters;
+  HostCallbackExecutor executor(
+      std::unique_ptr<CallbackMarkerApi>(new FakeMarkerApi(&counters)), 2);
+  FakeStream stream;
+  std::mutex mutex;
+  std::vector<int> order;
+  for (int i = 0; i < 3; ++i) {
+    executor.Enqueue(0, &stream, [&, i] {
+      std::lock_guard<std::mutex> guard(mutex);
+      order.push_back(i);
+    });
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    EXPECT_TRUE(order.empty());
+  }
+
+  stream.Advance();
+  ASSERT_TRUE(WaitFor([&] {
+    std::lock_guard<std::mutex> guard(mutex);
+    return order.size() == 1;
+  }));
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    EXPECT_EQ(order.size(), 1u);
+  }
+
+  stream.AdvanceAll();
+  executor.WaitStream(&stream);
+  EXPECT_EQ(order, (std::vector<int>{0, 1, 2}));
+  EXPECT_EQ(counters.released.load(), 3);
+  EXPECT_EQ(counters.misuses.load(), 0);
+}
+
+TEST(HostCallbackExecutor, BlockedStreamDoesNotHoldUpOthers) {
+  FakeMarkerApi::Counters counters;
+  HostCallbackExecutor executor(
+      std::unique_ptr<CallbackMarkerApi>(new FakeMarkerApi(&counters)), 2);
+  FakeStream blocked, ready;
+  std::atomic<bool> blocked_ran{false};
+  std::atomic<int> ready_ran{0};
+  executor.Enqueue(0, &blocked, [&] { blocked_ran = true; });
+  for (int i = 0; i < 10; ++i) {
+    executor.Enqueue(0, &ready, [&] { ++ready_ran; });
+  }
+  ready.AdvanceAll();
+  executor.WaitStream(&ready);
+  EXPECT_EQ(ready_ran.load(), 10);
+  EXPECT_FALSE(blocked_ran);
+
+  blocked.AdvanceAll();
+  executor.RemoveStream(&blocked);
+  EXPECT_TRUE(blocked_ran);
+}
+
+TEST(HostCallbackExecutor, PollsOutsideTheLock) {
+  // Done blocks until a callback is enqueued from another thread, which
+  // would deadlock if markers were polled under the executor's lock.
+  FakeMarkerApi::Counters counters;
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool enqueued = false;
+  std::atomic<bool> timed_out{false};
+  counters.on_done = [&] {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto wait = std::chrono::seconds(5);
+    if (!cv.wait_for(lock, wait, [&] { return enqueued; })) timed_out = true;
+  };
+  HostCallbackExecutor executor(
+      std::unique_ptr<CallbackMarkerApi>(new FakeMarkerApi(&counters)), 1);
+  FakeStream first, second;
+  std::atomic<int> ran{0};
+  executor.Enqueue(0, &first, [&] { ++ran; });
+  // Let the worker start polling the first marker.
+  ASSERT_TRUE(WaitFor([&] { return counters.recorded == 1; }));
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  executor.Enqueue(0, &second, [&] { ++ran; });
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    enqueued = true;
+  }
+  cv.notify_all();
+  first.AdvanceAll();
+  second.AdvanceAll();
+  executor.WaitAll();
+  EXPECT_FALSE(timed_out);
+  EXPECT_EQ(ran.load(), 2);
+}
+
+TEST(HostCallbackExecutor, ManyStreamsManyWorkers) {
+  constexpr int kStreams = 8;
+  constexpr int kCallbacks = 500;
+  FakeMarkerApi::Counters counters;
+  HostCallbackExecutor executor(
+      std::unique_ptr<CallbackMarkerApi>(new FakeMarkerApi(&counters)), 4);
+  std::vector<FakeStream> streams(kStreams);
+  std::vector<std::vector<int>> orders(kStreams);
+  std::atomic<bool> stop{false};
+  // The device side: completes the streams' work round robin.
+  std::thread device([&] {
+    uint64_t i = 0;
+    while (!stop) {
+      streams[i++ * 7 % kStreams].Advance();
+      std::this_thread::yield();
+    }
+  });
+  std::vector<std::thread> producers;
+  for (int s = 0; s < kStreams; ++s) {
+    producers.emplace_back([&, s] {
+      for (int i = 0; i < kCallbacks; ++i) {
+        // Each lane's callbacks run one at a time, so orders[s] is only
+        // touched by one worker at once.
+        executor.Enqueue(
+            0, &streams[s], [&, s, i] { orders[s].push_back(i); });
+      }
+    });
+  }
+  for (auto &producer : producers) producer.join();
+  executor.WaitAll();
+  stop = true;
+  device.join();
+
+  for (int s = 0; s < kStreams; ++s) {
+    ASSERT_EQ(orders[s].size(), static_cast<size_t>(kCallbacks));
+    for (int i = 0; i < kCallbacks; ++i) EXPECT_EQ(orders[s][i], i);
+  }
+  EXPECT_EQ(counters.released.load(), kStreams * kCallbacks);
+  EXPECT_EQ(counters.misuses.load(), 0);
+
+  // Shutdown stops the workers and Enqueue starts them again.
+  executor.Shutdown();
+  std::atomic<bool> ran{false};
+  executor.Enqueue(0, &streams[0], [&] { ran = true; });
+  streams[0].AdvanceAll();
+  executor.WaitAll();
+  EXPECT_TRUE(ran);
+}
@@ -0,0 +1,152 @@
+# Copyright (c) 2024 PaddlePaddle Authors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import gzip
+import json
+import os
+import random
+import tempfile
+import unittest
+
+from paddle_custom_device.npu.profile import trace_merge
+
+
+def paddle_trace(events):
+    return {
+        "schemaVersion": 1,
+        "displayTimeUnit": "ms",
+        "traceEvents": events,
+        "ExtraInfo": {"note": "x" * 100},
+    }
+
+
+def x_event(name, ts, dur=1.0, cat="Operator", ts_as_str=False):
+    return {
+        "name": name,
+        "ph": "X",
+        "cat": cat,
+        "pid": 1,
+        "tid": 1,
+        "ts": f"{ts:.3f}" if ts_as_str else ts,
+        "dur": dur,
+    }
+
+
+def meta_event(pid, sort_index):
+    return {
+        "name": "process_sort_index",
+        "ph": "M",
+        "pid": pid,
+        "args": {"sort_index": sort_index},
+    }
+
+
+def load_output(path):
+    opener = gzip.open if path.endswith(".gz") else open
+    with opener(path, "rt") as f:
+        return json.load(f)["traceEvents"]
+
+
+class TestCannTraceMerge(unittest.TestCase):
+    def setUp(self):
+        random.seed(2024)
+        self.temp_dir = tempfile.TemporaryDirectory()
+
+    def tearDown(self):
+        self.temp_dir.cleanup()
+
+    def write(self, name, data):
+        path = os.path.join(self.temp_dir.name, name)
+        with open(path, "w") as f:
+            json.dump(data, f, indent=2)
+        return path
+
+    def make_traces(self, num_events, base=1.7e15, prefix=""):
+        paddle_events = [x_event(f"p{i}", base + i * 10.0) for i in range(num_events)]
+        msprof_events = [
+            x_event(f"m{i}", base + i * 10.0 + 5, cat="AscendCL", ts_as_str=True)
+            for i in range(num_events)
+        ]
+        # Neither profiler writes its events in time order.
+        random.shuffle(paddle_events)
+        random.shuffle(msprof_events)
+        paddle_path = self.write(
+            prefix + "a.paddle_trace.json",
+            paddle_trace([meta_event(1, 0)] + paddle_events),
+        )
+        msprof_path = self.write(
+            prefix + "msprof_1.json", [meta_event(2, 5)] + msprof_events
+        )
+        return paddle_path, msprof_path
+
+    def test_iter_trace_events_small_chunks(self):
+        paddle_path, msprof_path = self.make_traces(50)
+        # Chunks smaller than one event exercise every buffer boundary.
+        events = list(trace_merge.iter_trace_events(paddle_path, chunk_size=7))
+        self.assertEqual(len(events), 51)
+        events = list(trace_merge.iter_trace_events(msprof_path, chunk_size=7))
+        self.assertEqual(len(events), 51)
+
+    def test_merge_is_time_sorted(self):
+        paddle_path, msprof_path = self.make_traces(1000)
+        out = os.path.join(self.temp_dir.name, "merged.json")
+        # A small run size forces several spilled runs.
+        count = trace_merge.merge_trace_files(
+            paddle_path, msprof_path, out, run_size=64, chunk_size=512
+        )
+        events = load_output(out)
+        self.assertEqual(count, 2002)
+        self.assertEqual(len(events), 2002)
+        self.assertEqual([e["ph"] for e in events[:2]], ["M", "M"])
+        ts = [float(e["ts"]) for e in events[2:]]
+        self.assertEqual(ts, sorted(ts))
+        # Paddle rows are sorted above the CANN rows.
+        self.assertEqual(events[0]["args"]["sort_index"], 4)
+        self.assertEqual(events[1]["args"]["sort_index"], 5)
+
+    def test_clock_offset_and_filters(self):
+        paddle_path, _ = self.make_traces(100, base=1000.0, prefix="p_")
+        _, msprof_path = self.make_traces(100, base=1.7e15, prefix="m_")
+        out = os.path.join(self.temp_dir.name, "merged.json.gz")
+        trace_merge.merge_trace_files(
+            paddle_path,
+            msprof_path,
+            out,
+            start_us=1.7e15 + 100,
+            end_us=1.7e15 + 199,
+            exclude_categories=["AscendCL"],
+        )
+        events = [e for e in load_output(out) if e["ph"] != "M"]
+        # Paddle events were moved onto the msprof clock, then windowed.
+        self.assertEqual(len(events), 10)
+        for e in events:
+            self.assertEqual(e["cat"], "Operator")
+            self.assertTrue(1.7e15 + 99 <= e["ts"] <= 1.7e15 + 199)
+
+    def test_incremental_steps(self):
+        out = os.path.join(self.temp_dir.name, "steps.json")
+        with trace_merge.IncrementalTraceMerger(out, clock_offset_us=0.0) as merger:
+            for step in range(3):
+                paddle_path, msprof_path = self.make_traces(20, base=1e6 * (step + 1))
+                merger.merge_step(paddle_path, msprof_path)
+        events = load_output(out)
+        # Identical metadata is written once.
+        self.assertEqual(len([e for e in events if e["ph"] == "M"]), 2)
+        ts = [float(e["ts"]) for e in events if e["ph"] != "M"]
+        self.assertEqual(len(ts), 120)
+        self.assertEqual(ts, sorted(ts))
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -29,6 +29,11 @@
 #include "paddle/phi/extension.h"
 namespace custom_kernel {
 
+static const int kSoftmaxWithCrossEntropyOpId =
+    RegisterHighPrecisionOp("softmax_with_cross_entropy");
+static const int kSoftmaxWithCrossEntropyGradOpId =
+    RegisterHighPrecisionOp("softmax_with_cross_entropy_grad");
+
 static inline int CanonicalAxis(const int axis, const int rank) {
   if (axis < 0) {
     return axis + rank;
@@ -274,7 +279,7 @@ void CrossEntropyWithSoftmaxKernel(const Context& dev_ctx,
   dev_ctx.template Alloc<T>(softmax);
 
   bool high_precision = false;
-  if (is_in_high_precision_op_list("softmax_with_cross_entropy"))
+  if (is_in_high_precision_op_list(kSoftmaxWithCrossEntropyOpId))
     high_precision = true;
 
   sdaa_ops::doSoftmaxForward(dev_ctx, logits, axis, high_precision, softmax);
@@ -333,7 +338,7 @@ void CrossEntropyWithSoftmaxGradKernel(const Context& dev_ctx,
 
   bool high_precision = false;
 
-  if (is_in_high_precision_op_list("softmax_with_cross_entropy_grad"))
+  if (is_in_high_precision_op_list(kSoftmaxWithCrossEntropyGradOpId))
     high_precision = true;
 
   sdaa_ops::doSoftmaxBackward(
@@ -26,65 +26,18 @@
 
 #include "kernels/funcs/high_precision_op_list.h"
 
-#include <mutex>
-#include <string>
-#include <unordered_set>
-
-#include "kernels/funcs/sdaa_funcs.h"
 #include "paddle/phi/extension.h"
 
 namespace custom_kernel {
 
-static void tokenize(const std::string& ops,
-                     char delim,
-                     std::unordered_set<std::string>* op_set) {
-  std::string::size_type beg = 0;
-  for (uint64_t end = 0; (end = ops.find(delim, end)) != std::string::npos;
-       ++end) {
-    op_set->insert(ops.substr(beg, end - beg));
-    beg = end + 1;
-  }
-  op_set->insert(ops.substr(beg));
-}
-
-static void check_support(const std::unordered_set<std::string>& ops) {
-  std::unordered_set<std::string> support_high_precision_ops{
-      "softmax",
-      "softmax_grad",
-      "softmax_with_cross_entropy",
-      "softmax_with_cross_entropy_grad"};
-  for (const auto& item : ops) {
-    if (support_high_precision_ops.find(item) ==
-        support_high_precision_ops.end()) {
-      PADDLE_THROW(phi::errors::InvalidArgument(
-          "Teco-Paddle does not support the high precision mode for %s, please "
-          "reset it.",
-          item));
-    }
-  }
-}
-
-std::unordered_set<std::string> get_op_list() {
-  std::unordered_set<std::string> op_list;
-
-  if (std::getenv("HIGH_PRECISION_OP_LIST") != nullptr) {
-    std::string ops(std::getenv("HIGH_PRECISION_OP_LIST"));
-
-    tokenize(ops, ',', &op_list);
-
-    check_support(op_list);
-  }
-
-  return op_list;
-}
-
-bool is_in_high_precision_op_list(const std::string& op_name) {
-  static std::unordered_set<std::string> high_precision_op_list = get_op_list();
-
-  if (high_precision_op_list.find(op_name) != high_precision_op_list.end()) {
-    return true;
-  }
-  return false;
+OpPolicy& HighPrecisionOpPolicy() {
+  static OpPolicy policy("HIGH_PRECISION_OP_LIST", [](const std::string& op) {
+    PADDLE_THROW(phi::errors::InvalidArgument(
+        "Teco-Paddle does not support the high precision mode for %s, please "
+        "reset it.",
+        op));
+  });
+  return policy;
 }
 
 }  // namespace custom_kernel
@@ -27,11 +27,22 @@
 #pragma once
 
 #include <string>
-#include <unordered_map>
-#include <unordered_set>
+
+#include "kernels/funcs/op_policy.h"
 
 namespace custom_kernel {
 
-bool is_in_high_precision_op_list(const std::string& op_name);
+// Ops listed in HIGH_PRECISION_OP_LIST run their high precision path.
+OpPolicy& HighPrecisionOpPolicy();
+
+// Declares that op_name has a high precision mode; call once at static-init
+// time and keep the id for is_in_high_precision_op_list.
+inline int RegisterHighPrecisionOp(const std::string& op_name) {
+  return HighPrecisionOpPolicy().Declare(op_name);
+}
+
+inline bool is_in_high_precision_op_list(int op_id) {
+  return HighPrecisionOpPolicy().Enabled(op_id);
+}
 
 }  // namespace custom_kernel
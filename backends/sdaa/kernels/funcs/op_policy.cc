@@ -0,0 +1,119 @@
+// BSD 3- Clause License Copyright (c) 2023, Tecorigin Co., Ltd. All rights
+// reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+// Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software
+// without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY,OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)  ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+// OF SUCH DAMAGE.
+
+#include "kernels/funcs/op_policy.h"
+
+#include <cstdlib>
+#include <stdexcept>
+#include <utility>
+
+namespace custom_kernel {
+
+OpIdRegistry& OpIdRegistry::Instance() {
+  static OpIdRegistry registry;
+  return registry;
+}
+
+int OpIdRegistry::Register(const std::string& op_name) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto it = ids_.find(op_name);
+  if (it != ids_.end()) return it->second;
+  if (ids_.size() >= kMaxPolicyOps) {
+    throw std::length_error("too many ops registered for per-op policies: " +
+                            op_name);
+  }
+  int id = static_cast<int>(ids_.size());
+  ids_.emplace(op_name, id);
+  return id;
+}
+
+int OpIdRegistry::Find(const std::string& op_name) const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto it = ids_.find(op_name);
+  return it == ids_.end() ? -1 : it->second;
+}
+
+size_t OpIdRegistry::size() const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  return ids_.size();
+}
+
+std::vector<std::string> SplitOpList(const std::string& ops) {
+  std::vector<std::string> names;
+  std::string::size_type beg = 0;
+  while (beg <= ops.size()) {
+    std::string::size_type end = ops.find(',', beg);
+    if (end == std::string::npos) end = ops.size();
+    std::string::size_type first = ops.find_first_not_of(" \t", beg);
+    if (first != std::string::npos && first < end) {
+      std::string::size_type last = ops.find_last_not_of(" \t", end - 1);
+      names.push_back(ops.substr(first, last - first + 1));
+    }
+    beg = end + 1;
+  }
+  return names;
+}
+
+OpPolicy::OpPolicy(std::string env_name, UnsupportedHandler on_unsupported)
+    : env_name_(std::move(env_name)),
+      on_unsupported_(std::move(on_unsupported)) {}
+
+int OpPolicy::Declare(const std::string& op_name) {
+  int id = OpIdRegistry::Instance().Register(op_name);
+  std::lock_guard<std::mutex> guard(mutex_);
+  declared_.set(id);
+  return id;
+}
+
+void OpPolicy::ResolveFrom(const std::string& ops) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  ResolveLocked(ops);
+}
+
+void OpPolicy::Resolve() {
+  std::lock_guard<std::mutex> guard(mutex_);
+  // Threads racing on the first query all get here; only the first one
+  // resolves, the others find the list resolved once they hold the lock.
+  if (resolved_.load(std::memory_order_relaxed)) return;
+  const char* ops = std::getenv(env_name_.c_str());
+  ResolveLocked(ops == nullptr ? "" : ops);
+}
+
+void OpPolicy::ResolveLocked(const std::string& ops) {
+  std::bitset<kMaxPolicyOps> enabled;
+  for (const auto& name : SplitOpList(ops)) {
+    int id = OpIdRegistry::Instance().Find(name);
+    if (id < 0 || !declared_.test(id)) {
+      if (on_unsupported_) on_unsupported_(name);
+      continue;
+    }
+    enabled.set(id);
+  }
+  enabled_ = enabled;
+  resolved_.store(true, std::memory_order_release);
+}
+
+}  // namespace custom_kernel
@@ -0,0 +1,112 @@
+// BSD 3- Clause License Copyright (c) 2023, Tecorigin Co., Ltd. All rights
+// reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+// Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software
+// without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY,OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)  ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+// OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <bitset>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace custom_kernel {
+
+// Upper bound on the number of ops any policy can name.
+constexpr size_t kMaxPolicyOps = 256;
+
+// Maps op names to small integer ids. Kernels register the names they query
+// at static-init time and keep the id, so policy checks never hash a string.
+class OpIdRegistry {
+ public:
+  static OpIdRegistry& Instance();
+
+  // Returns the id of op_name, assigning the next free one the first time.
+  int Register(const std::string& op_name);
+
+  // Returns the id of op_name, or -1 if it was never registered.
+  int Find(const std::string& op_name) const;
+
+  size_t size() const;
+
+ private:
+  OpIdRegistry() = default;
+
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, int> ids_;
+};
+
+// A per-op switch read from a comma separated list of op names in an
+// environment variable, e.g. HIGH_PRECISION_OP_LIST=softmax,softmax_grad.
+//
+// Ops that honour the policy declare it at static-init time. The list is
+// resolved into a bitset on the first query; after that Enabled is a flag
+// load and a bit test. Names in the list that no op declared are passed to
+// on_unsupported during resolution.
+class OpPolicy {
+ public:
+  using UnsupportedHandler = std::function<void(const std::string& op_name)>;
+
+  OpPolicy(std::string env_name, UnsupportedHandler on_unsupported);
+
+  OpPolicy(const OpPolicy&) = delete;
+  OpPolicy& operator=(const OpPolicy&) = delete;
+
+  // Registers op_name and marks it as honouring this policy. Returns its id.
+  int Declare(const std::string& op_name);
+
+  bool Enabled(int op_id) {
+    if (!resolved_.load(std::memory_order_acquire)) Resolve();
+    return enabled_[op_id];
+  }
+
+  // Resolves the policy from ops instead of the environment. Used by tests
+  // and by callers that read the list from elsewhere, before any query:
+  // replacing a resolved list races with threads querying it.
+  void ResolveFrom(const std::string& ops);
+
+  const std::string& env_name() const { return env_name_; }
+
+ private:
+  // Resolves from the environment unless another thread already has.
+  void Resolve();
+  void ResolveLocked(const std::string& ops);
+
+  const std::string env_name_;
+  UnsupportedHandler on_unsupported_;
+  std::mutex mutex_;
+  std::bitset<kMaxPolicyOps> declared_;
+  std::bitset<kMaxPolicyOps> enabled_;
+  std::atomic<bool> resolved_{false};
+};
+
+// Splits a comma separated op list, dropping blanks around names and empty
+// entries.
+std::vector<std::string> SplitOpList(const std::string& ops);
+
+}  // namespace custom_kernel
@@ -29,6 +29,7 @@
 #include <sys/syscall.h>
 
 #include <cassert>
+#include <chrono>
 #include <cstdio>
 #include <cstring>
 #include <thread>
@@ -36,8 +37,9 @@
 #include "kernels/profiler/sdaa_wrapper.h"
 #include "paddle/phi/extension.h"
 
-constexpr size_t kBufSize = 1 << 23;  // 8 MB
-constexpr size_t kBufAlign = 8;       // 8 B
+constexpr size_t kBufSize = 1 << 23;            // 8 MB
+constexpr size_t kBufAlign = 8;                 // 8 B
+constexpr uint64_t kMinAnchorSpanNs = 1000000;  // 1 ms
 
 pid_t gettid() { return syscall(SYS_gettid); }
 
@@ -55,18 +57,26 @@ std::unordered_map<uint32_t, uint64_t> CreateThreadIdMapping() {
 void RecordEvent::BufferRequested() {}
 
 void RecordEvent::BufferCompleted() {
-  for (size_t i = 0; i < records_num; ++i) {
-    auto &&record = trace_events.front();
-    ProcessKernelRecord(record.get());
-    trace_events.pop_front();
+  uint64_t end_ticks = 0, end_ns = 0;
+  HostEventClock::Anchor(&end_ticks, &end_ns);
+  if (HostEventClock::UseTsc() &&
+      end_ns - tracing_start_anchor_ns < kMinAnchorSpanNs) {
+    // Too short a session to measure the TSC rate precisely.
+    std::this_thread::sleep_for(std::chrono::nanoseconds(kMinAnchorSpanNs));
+    HostEventClock::Anchor(&end_ticks, &end_ns);
+  }
+  HostEventTimeline timeline(
+      tracing_start_ticks, tracing_start_anchor_ns, end_ticks, end_ns);
+
+  uint64_t dropped = HostEventRecorder::Instance().Drain(
+      [&](uint64_t thread_id, const HostEvent &record, const std::string *msg) {
+        ProcessHostRecord(thread_id, record, msg, timeline);
+      });
+  if (dropped > 0) {
+    LOG(WARNING) << dropped << " host events were dropped because a thread "
+                 << "recorded more than FLAGS_sdaa_host_event_capacity events "
+                 << "in one profiling session.";
   }
-  records_num = 0;
-}
-
-void RecordEvent::init(const TraceEvent &event) {
-  std::lock_guard<std::mutex> lock(mutex_);
-  EmplaceEvent(std::move(event));
-  records_num++;
 }
 
 void RecordEvent::AllocateSdptiBuffer(uint8_t **buffer, size_t *size) {
@@ -113,20 +123,26 @@ void RecordEvent::ProcessActivityRecord(
   }
 }
 
-void RecordEvent::ProcessKernelRecord(const TraceEvent *record) {
-  if (record->start_ns < tracing_start_ns) {
+void RecordEvent::ProcessHostRecord(uint64_t thread_id,
+                                    const HostEvent &record,
+                                    const std::string *msg,
+                                    const HostEventTimeline &timeline) {
+  uint64_t start_ns = timeline.ToNs(record.start_ticks);
+  if (start_ns < tracing_start_ns) {
     return;
   }
   phi::RuntimeTraceEvent event;
-  size_t pos = record->name.find('(');
-  event.name = record->name.substr(0, pos);
-  event.start_ns = record->start_ns;
-  event.end_ns = record->end_ns;
+  // record.name is the stringified call, keep the callee only.
+  const char *paren = strchr(record.name, '(');
+  event.name = paren == nullptr ? std::string(record.name)
+                                : std::string(record.name, paren);
+  event.start_ns = start_ns;
+  event.end_ns = timeline.ToNs(record.end_ticks);
   event.process_id = GetProcessId();
-  event.correlation_id = record->correlation_id;
-  event.thread_id = record->thread_id;
-  if (GetAttributeDumpMode()) {
-    event.msg = record->msg;
+  event.correlation_id = 0;
+  event.thread_id = thread_id;
+  if (GetAttributeDumpMode() && msg != nullptr) {
+    event.msg = *msg;
   }
   profiler_add_runtime_trace_event(prof, &event);
 }
@@ -293,21 +309,20 @@ void RecordEvent::AddApiRecord(
 
 void RecordEvent::AttributeDumpEnable() { should_dump_info_ = true; }
 
-bool RecordEvent::GetAttributeDumpMode() { return should_dump_info_; }
-
 void RecordEvent::ActivityEnable() { mode_ = true; }
 
 void RecordEvent::ActivityDisable() { mode_ = false; }
 
-bool RecordEvent::GetProfilerMode() { return mode_; }
-
-bool RecordEvent::GetSdptiMode() { return sdpti_mode; }
-
 void RecordEvent::SetSdptiMode(bool mode) { sdpti_mode = mode; }
 
 void RecordEvent::SetProfPara(C_Profiler p, uint64_t tracing_start_ns_) {
   prof = p;
+  uint64_t anchor_ns = 0;
+  HostEventClock::Anchor(&tracing_start_ticks, &anchor_ns);
+  // Host events are filtered against the paddle start time, but
+  // interpolated from the anchor read together with the ticks.
   tracing_start_ns = tracing_start_ns_;
+  tracing_start_anchor_ns = anchor_ns;
 }
 
 RecordEvent::~RecordEvent() {}
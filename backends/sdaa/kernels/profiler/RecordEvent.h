@@ -26,7 +26,7 @@
 
 #pragma once
 
-#include <deque>
+#include <atomic>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -37,6 +37,7 @@
 
 #include "dynload/sdpti.h"
 #include "glog/logging.h"
+#include "kernels/profiler/host_event_recorder.h"
 #include "kernels/profiler/os_info.h"
 #include "paddle/phi/api/profiler/trace_event.h"
 #include "paddle/phi/backends/device_ext.h"
@@ -50,31 +51,6 @@ struct ActivityBuffer {
   size_t valid_size;
 };
 
-struct TraceEvent {
-  TraceEvent() = default;
-  TraceEvent(const std::string &name,
-             uint64_t start_ns,
-             uint64_t end_ns,
-             uint64_t device_id,
-             uint64_t thread_id,
-             uint32_t correlation_id = 0,
-             const std::string &msg = "")
-      : name(name),
-        start_ns(start_ns),
-        end_ns(end_ns),
-        device_id(device_id),
-        thread_id(thread_id),
-        correlation_id(correlation_id),
-        msg(msg) {}
-  std::string name;
-  uint64_t start_ns;
-  uint64_t end_ns;
-  uint64_t device_id;
-  uint64_t thread_id;
-  uint32_t correlation_id;
-  std::string msg;
-};
-
 std::unordered_map<uint32_t, uint64_t> CreateThreadIdMapping();
 
 class RecordEvent {
@@ -85,17 +61,16 @@ class RecordEvent {
   }
 
   RecordEvent()
-      : records_num(0),
-        mode_(false),
+      : mode_(false),
         should_dump_info_(false),
         sdpti_mode(true),
         correlation_id(0),
         tracing_start_ns(-1),
+        tracing_start_ticks(0),
+        tracing_start_anchor_ns(0),
         buffer{nullptr},
         prof{nullptr} {}
 
-  void init(const TraceEvent &event);
-
   void AllocateSdptiBuffer(uint8_t **buffer, size_t *size);
 
   void ReleaseSdptiBuffer(uint8_t *buffer);
@@ -110,13 +85,14 @@ class RecordEvent {
 
   void BufferCompleted();
 
-  bool ActivityGetNextRecord(uint8_t *buffer, TraceEvent *record);
-
   void ProcessActivityRecord(
       const SDpti_Activity *record,
       const std::unordered_map<uint32_t, uint64_t> &tid_mapping);
 
-  void ProcessKernelRecord(const TraceEvent *record);
+  void ProcessHostRecord(uint64_t thread_id,
+                         const HostEvent &record,
+                         const std::string *msg,
+                         const HostEventTimeline &timeline);
 
   void AddKernelRecord(const SDpti_ActivityKernel *record);
 
@@ -137,35 +113,34 @@ class RecordEvent {
 
   void AttributeDumpEnable();
 
-  bool GetAttributeDumpMode();
+  bool GetAttributeDumpMode() const {
+    return should_dump_info_.load(std::memory_order_relaxed);
+  }
 
   void SetProfPara(C_Profiler p, uint64_t tracing_start_ns_);
 
-  bool GetProfilerMode();
+  // Read by RECORD_FUNCTION around every launch, so kept inline: a
+  // disabled profiler costs one relaxed load.
+  bool GetProfilerMode() const { return mode_.load(std::memory_order_relaxed); }
 
-  bool GetSdptiMode();
+  bool GetSdptiMode() const {
+    return sdpti_mode.load(std::memory_order_relaxed);
+  }
 
   void SetSdptiMode(bool mode);
 
   ~RecordEvent();
 
  private:
-  std::mutex mutex_;
   uint8_t *buffer;
-  size_t records_num;
-  bool mode_;
-  bool sdpti_mode;
-  bool should_dump_info_;
+  std::atomic<bool> mode_;
+  std::atomic<bool> sdpti_mode;
+  std::atomic<bool> should_dump_info_;
   uint32_t correlation_id;
   std::vector<std::string> namelist;
   std::unordered_map<std::string, int> name_index;
-  std::deque<std::unique_ptr<TraceEvent>> trace_events;
   C_Profiler prof;
   uint64_t tracing_start_ns;
-
-  template <class... Args>
-  void EmplaceEvent(Args &&...args) {
-    trace_events.emplace_back(
-        std::make_unique<TraceEvent>(std::forward<Args>(args)...));
-  }
+  uint64_t tracing_start_ticks;
+  uint64_t tracing_start_anchor_ns;
 };
@@ -0,0 +1,127 @@
+// BSD 3- Clause License Copyright (c) 2023, Tecorigin Co., Ltd. All rights
+// reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+// Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software
+// without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY,OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)  ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+// OF SUCH DAMAGE.
+
+#include "kernels/profiler/host_event_recorder.h"
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+namespace {
+
+bool HasInvariantTsc() {
+#if defined(__x86_64__)
+  unsigned int eax, ebx, ecx, edx;
+  if (__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) == 0 ||
+      eax < 0x80000007) {
+    return false;
+  }
+  __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+  // EDX bit 8: the TSC runs at a constant rate in every P/C state.
+  return (edx & (1u << 8)) != 0;
+#else
+  return false;
+#endif
+}
+
+uint64_t RealtimeNs() {
+  struct timespec tp;
+  clock_gettime(CLOCK_REALTIME, &tp);
+  return static_cast<uint64_t>(tp.tv_sec) * 1000000000ULL + tp.tv_nsec;
+}
+
+}  // namespace
+
+const bool HostEventClock::use_tsc_ = HasInvariantTsc();
+
+void HostEventClock::Anchor(uint64_t *ticks, uint64_t *real_ns) {
+  // Keep the read with the tightest tick bracket out of a few tries.
+  uint64_t best_span = UINT64_MAX;
+  for (int i = 0; i < 5; ++i) {
+    uint64_t before = Now();
+    uint64_t ns = RealtimeNs();
+    uint64_t after = Now();
+    if (after - before < best_span) {
+      best_span = after - before;
+      *ticks = before + (after - before) / 2;
+      *real_ns = ns;
+    }
+  }
+}
+
+HostEventTimeline::HostEventTimeline(uint64_t begin_ticks,
+                                     uint64_t begin_ns,
+                                     uint64_t end_ticks,
+                                     uint64_t end_ns)
+    : ticks_(begin_ticks), ns_(begin_ns) {
+  if (end_ticks > begin_ticks && end_ns > begin_ns) {
+    ns_per_tick_ = static_cast<double>(end_ns - begin_ns) /
+                   static_cast<double>(end_ticks - begin_ticks);
+  }
+}
+
+HostEventRing::HostEventRing(size_t capacity, uint64_t thread_id, bool with_msg)
+    : capacity_(capacity),
+      mask_(capacity - 1),
+      thread_id_(thread_id),
+      events_(capacity),
+      msgs_(with_msg ? capacity : 0) {}
+
+HostEventRecorder &HostEventRecorder::Instance() {
+  static HostEventRecorder recorder;
+  return recorder;
+}
+
+void HostEventRecorder::Configure(size_t capacity, bool with_msg) {
+  size_t rounded = 1;
+  while (rounded < std::max<size_t>(capacity, 1)) rounded <<= 1;
+  std::lock_guard<std::mutex> guard(mutex_);
+  capacity_ = rounded;
+  with_msg_ = with_msg;
+}
+
+std::shared_ptr<HostEventRing> HostEventRecorder::CreateRing() {
+  uint64_t tid = static_cast<uint64_t>(syscall(SYS_gettid));
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto ring = std::make_shared<HostEventRing>(capacity_, tid, with_msg_);
+  rings_.push_back(ring);
+  return ring;
+}
+
+void HostEventRecorder::ReleaseExitedRings() {
+  std::lock_guard<std::mutex> guard(mutex_);
+  rings_.erase(std::remove_if(rings_.begin(),
+                              rings_.end(),
+                              [](const std::shared_ptr<HostEventRing> &ring) {
+                                return ring->Exited() && ring->Empty();
+                              }),
+               rings_.end());
+}
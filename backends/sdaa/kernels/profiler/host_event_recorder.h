@@ -0,0 +1,233 @@
+// BSD 3- Clause License Copyright (c) 2023, Tecorigin Co., Ltd. All rights
+// reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+// Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software
+// without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY,OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)  ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+// OF SUCH DAMAGE.
+
+#pragma once
+
+#include <time.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+// Host side timestamps for RECORD_FUNCTION. Reading the TSC (or
+// CLOCK_MONOTONIC_RAW where there is no invariant TSC) costs a few
+// nanoseconds; ticks are mapped to CLOCK_REALTIME nanoseconds only when
+// events are collected.
+class HostEventClock {
+ public:
+  static uint64_t Now() {
+#if defined(__x86_64__)
+    if (use_tsc_) return __rdtsc();
+#endif
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &tp);
+    return static_cast<uint64_t>(tp.tv_sec) * 1000000000ULL + tp.tv_nsec;
+  }
+
+  // Takes an anchor (ticks, realtime ns) pair. The first anchor of a session
+  // is taken at ProfilerStart and the second at collection, and events are
+  // interpolated between the two.
+  static void Anchor(uint64_t *ticks, uint64_t *real_ns);
+
+  static bool UseTsc() { return use_tsc_; }
+
+ private:
+  static const bool use_tsc_;
+};
+
+// Maps ticks to realtime nanoseconds with two anchors.
+class HostEventTimeline {
+ public:
+  HostEventTimeline() = default;
+  HostEventTimeline(uint64_t begin_ticks,
+                    uint64_t begin_ns,
+                    uint64_t end_ticks,
+                    uint64_t end_ns);
+
+  uint64_t ToNs(uint64_t ticks) const {
+    double delta = static_cast<double>(static_cast<int64_t>(ticks - ticks_));
+    return ns_ + static_cast<int64_t>(delta * ns_per_tick_);
+  }
+
+ private:
+  uint64_t ticks_ = 0;
+  uint64_t ns_ = 0;
+  double ns_per_tick_ = 1.0;
+};
+
+// Fixed size event, no heap data. name points at the string literal of the
+// recorded call, so the compiler has already interned it.
+struct HostEvent {
+  const char *name;
+  uint64_t start_ticks;
+  uint64_t end_ticks;
+};
+
+// Single producer, single consumer ring owned by one recording thread. When
+// it is full new events are dropped and counted rather than overwriting
+// unread ones, so the collector never races the producer on a slot.
+class HostEventRing {
+ public:
+  HostEventRing(size_t capacity, uint64_t thread_id, bool with_msg);
+
+  HostEventRing(const HostEventRing &) = delete;
+  HostEventRing &operator=(const HostEventRing &) = delete;
+
+  void Push(const char *name,
+            uint64_t start_ticks,
+            uint64_t end_ticks,
+            const std::string *msg) {
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) >= capacity_) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    size_t slot = head & mask_;
+    events_[slot] = HostEvent{name, start_ticks, end_ticks};
+    // Assigning into the slot reuses its capacity after warm up.
+    if (!msgs_.empty()) {
+      if (msg != nullptr) {
+        msgs_[slot].assign(*msg);
+      } else {
+        msgs_[slot].clear();
+      }
+    }
+    head_.store(head + 1, std::memory_order_release);
+  }
+
+  // Calls fn(const HostEvent &, const std::string *msg) for every event
+  // pushed so far, oldest first, and frees their slots.
+  template <typename Fn>
+  size_t Drain(Fn &&fn) {
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    uint64_t head = head_.load(std::memory_order_acquire);
+    for (uint64_t i = tail; i < head; ++i) {
+      size_t slot = i & mask_;
+      fn(events_[slot], msgs_.empty() ? nullptr : &msgs_[slot]);
+    }
+    tail_.store(head, std::memory_order_release);
+    return head - tail;
+  }
+
+  bool Empty() const {
+    return head_.load(std::memory_order_acquire) ==
+           tail_.load(std::memory_order_relaxed);
+  }
+
+  // Set by the owning thread when it exits; no more events follow.
+  void MarkExited() { exited_.store(true, std::memory_order_release); }
+
+  bool Exited() const { return exited_.load(std::memory_order_acquire); }
+
+  uint64_t thread_id() const { return thread_id_; }
+
+  uint64_t TakeDropped() {
+    return dropped_.exchange(0, std::memory_order_relaxed);
+  }
+
+ private:
+  const size_t capacity_;
+  const size_t mask_;
+  const uint64_t thread_id_;
+  std::vector<HostEvent> events_;
+  std::vector<std::string> msgs_;
+  alignas(64) std::atomic<uint64_t> head_{0};
+  alignas(64) std::atomic<uint64_t> tail_{0};
+  std::atomic<uint64_t> dropped_{0};
+  std::atomic<bool> exited_{false};
+};
+
+// Owns one ring per recording thread. A thread takes the registry lock once,
+// on its first event; after that recording touches only its own ring. Rings
+// of exited threads are kept until their events have been drained.
+class HostEventRecorder {
+ public:
+  static HostEventRecorder &Instance();
+
+  // Ring capacity in events, rounded up to a power of two, and whether
+  // rings keep a message per event. Applies to rings created afterwards.
+  void Configure(size_t capacity, bool with_msg);
+
+  void Record(const char *name,
+              uint64_t start_ticks,
+              uint64_t end_ticks,
+              const std::string *msg = nullptr) {
+    LocalRing()->Push(name, start_ticks, end_ticks, msg);
+  }
+
+  // Drains every ring, calling fn(thread_id, event, msg). Returns the number
+  // of events dropped because a ring was full.
+  template <typename Fn>
+  uint64_t Drain(Fn &&fn) {
+    std::vector<std::shared_ptr<HostEventRing>> rings;
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      rings = rings_;
+    }
+    uint64_t dropped = 0;
+    for (auto &ring : rings) {
+      uint64_t tid = ring->thread_id();
+      ring->Drain([&](const HostEvent &event, const std::string *msg) {
+        fn(tid, event, msg);
+      });
+      dropped += ring->TakeDropped();
+    }
+    ReleaseExitedRings();
+    return dropped;
+  }
+
+ private:
+  HostEventRecorder() = default;
+
+  struct LocalRingHolder {
+    ~LocalRingHolder() {
+      if (ring) ring->MarkExited();
+    }
+    std::shared_ptr<HostEventRing> ring;
+  };
+
+  HostEventRing *LocalRing() {
+    static thread_local LocalRingHolder holder;
+    if (!holder.ring) holder.ring = CreateRing();
+    return holder.ring.get();
+  }
+
+  std::shared_ptr<HostEventRing> CreateRing();
+
+  void ReleaseExitedRings();
+
+  std::mutex mutex_;
+  std::vector<std::shared_ptr<HostEventRing>> rings_;
+  size_t capacity_ = 1 << 16;
+  bool with_msg_ = false;
+};
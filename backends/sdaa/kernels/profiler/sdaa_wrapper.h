@@ -48,15 +48,15 @@ DECLARE_bool(sdaa_error_check);
     }                                                                        \
   })
 
-#define RECORD_FUNCTION_SYNC(SDAA_OP)                             \
-  ({                                                              \
-    uint64_t cpu_begin = PosixInNsec();                           \
-    auto&& sdaa_result = SDAA_OP;                                 \
-    uint64_t cpu_end = PosixInNsec();                             \
-    auto thread_id = RecordEvent::Instance().getThread();         \
-    TraceEvent event(#SDAA_OP, cpu_begin, cpu_end, 0, thread_id); \
-    RecordEvent::Instance().init(event);                          \
-    sdaa_result;                                                  \
+// NOTE: the event goes to the calling thread's ring; the stringified call
+// is a literal, so recording it copies a pointer and two timestamps.
+#define RECORD_FUNCTION_SYNC(SDAA_OP)                                   \
+  ({                                                                    \
+    uint64_t cpu_begin = HostEventClock::Now();                         \
+    auto&& sdaa_result = SDAA_OP;                                       \
+    uint64_t cpu_end = HostEventClock::Now();                           \
+    HostEventRecorder::Instance().Record(#SDAA_OP, cpu_begin, cpu_end); \
+    sdaa_result;                                                        \
   })
 
 #define RECORD_FUNCTION(SDAA_OP)                                             \
@@ -72,12 +72,16 @@ DECLARE_bool(sdaa_error_check);
 
 #define RECORD_FUNCTION_SYNC_WITH_MSG(SDAA_OP, MSG)                       \
   ({                                                                      \
-    uint64_t cpu_begin = PosixInNsec();                                   \
+    uint64_t cpu_begin = HostEventClock::Now();                           \
     auto&& sdaa_result = SDAA_OP;                                         \
-    uint64_t cpu_end = PosixInNsec();                                     \
-    auto thread_id = RecordEvent::Instance().getThread();                 \
-    TraceEvent event(#SDAA_OP, cpu_begin, cpu_end, 0, thread_id, 0, MSG); \
-    RecordEvent::Instance().init(event);                                  \
+    uint64_t cpu_end = HostEventClock::Now();                             \
+    if (RecordEvent::Instance().GetAttributeDumpMode()) {                 \
+      const std::string& sdaa_msg = MSG;                                  \
+      HostEventRecorder::Instance().Record(                               \
+          #SDAA_OP, cpu_begin, cpu_end, &sdaa_msg);                       \
+    } else {                                                              \
+      HostEventRecorder::Instance().Record(#SDAA_OP, cpu_begin, cpu_end); \
+    }                                                                     \
     sdaa_result;                                                          \
   })
 
@@ -19,6 +19,9 @@
 #include "paddle/phi/extension.h"
 namespace custom_kernel {
 
+static const int kSoftmaxOpId = RegisterHighPrecisionOp("softmax");
+static const int kSoftmaxGradOpId = RegisterHighPrecisionOp("softmax_grad");
+
 template <typename T, typename Context>
 void SoftmaxKernel(const Context& dev_ctx,
                    const phi::DenseTensor& x,
@@ -40,7 +43,7 @@ void SoftmaxKernel(const Context& dev_ctx,
   }
 
   bool high_precision = false;
-  if (is_in_high_precision_op_list("softmax")) high_precision = true;
+  if (is_in_high_precision_op_list(kSoftmaxOpId)) high_precision = true;
 
   if (axis < 0) {
     axis += x.dims().size();
@@ -106,7 +109,7 @@ void SoftmaxGradKernel(const Context& dev_ctx,
   }
 
   bool high_precision = false;
-  if (is_in_high_precision_op_list("softmax_grad")) high_precision = true;
+  if (is_in_high_precision_op_list(kSoftmaxGradOpId)) high_precision = true;
 
   if (axis != out.dims().size() - 1) {
     phi::DenseTensor out_temp;
@@ -39,6 +39,9 @@
 FLAGS_DEFINE_bool(sdaa_reuse_event, true, "enable event reuse.");
 FLAGS_DEFINE_bool(sdaa_runtime_debug, false, "runtime debug log");
 FLAGS_DEFINE_bool(sdaa_error_check, false, "enable error check for runtime");
+FLAGS_DEFINE_uint64(sdaa_host_event_capacity,
+                    1 << 16,
+                    "host events each thread can record per profiling session");
 
 PHI_DECLARE_double(fraction_of_gpu_memory_to_use);
 PHI_DECLARE_uint64(initial_gpu_memory_in_mb);
@@ -810,6 +813,9 @@ C_Status ProfilerInitialize(C_Profiler prof, void **user_data) {
   if (isEnvEnable("USE_ATTRIBUTE_INFO_DUMP")) {
     RecordEvent::Instance().AttributeDumpEnable();
   }
+  HostEventRecorder::Instance().Configure(
+      FLAGS_sdaa_host_event_capacity,
+      RecordEvent::Instance().GetAttributeDumpMode());
   return C_SUCCESS;
 }
 
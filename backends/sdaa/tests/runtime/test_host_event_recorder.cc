@@ -0,0 +1,227 @@
+// BSD 3- Clause License Copyright (c) 2023, Tecorigin Co., Ltd. All rights
+// reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+// Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software
+// without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY,OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)  ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+// OF SUCH DAMAGE.
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "kernels/profiler/host_event_recorder.h"
+
+namespace {
+
+const char *const kNames[] = {"a", "b", "c", "d", "e", "f", "g"};
+
+std::vector<uint64_t> DrainStarts(HostEventRing *ring) {
+  std::vector<uint64_t> starts;
+  ring->Drain([&](const HostEvent &event, const std::string *) {
+    starts.push_back(event.start_ticks);
+  });
+  return starts;
+}
+
+}  // namespace
+
+TEST(HostEventRing, WrapsAroundInOrder) {
+  HostEventRing ring(4, 7, false);
+  uint64_t next = 0;
+  // Uneven batches so the head and tail cross the end of the slots at
+  // different offsets.
+  for (int batch : {3, 4, 1, 3, 2, 4}) {
+    uint64_t first = next;
+    for (int i = 0; i < batch; ++i, ++next) {
+      ring.Push(kNames[next % 7], next, next + 1, nullptr);
+    }
+    std::vector<std::string> names;
+    std::vector<uint64_t> starts;
+    size_t drained = ring.Drain([&](const HostEvent &event,
+                                    const std::string *msg) {
+      EXPECT_EQ(msg, nullptr);
+      EXPECT_EQ(event.end_ticks, event.start_ticks + 1);
+      names.push_back(event.name);
+      starts.push_back(event.start_ticks);
+    });
+    ASSERT_EQ(drained, static_cast<size_t>(batch));
+    for (int i = 0; i < batch; ++i) {
+      EXPECT_EQ(starts[i], first + i);
+      EXPECT_EQ(names[i], kNames[(first + i) % 7]);
+    }
+    EXPECT_TRUE(ring.Empty());
+  }
+  EXPECT_EQ(ring.TakeDropped(), 0u);
+  EXPECT_EQ(ring.thread_id(), 7u);
+}
+
+TEST(HostEventRing, DropsAndCountsWhenFull) {
+  HostEventRing ring(4, 0, false);
+  for (uint64_t i = 0; i < 7; ++i) ring.Push("full", i, i, nullptr);
+  // The unread events are kept, the newest three are lost.
+  EXPECT_EQ(DrainStarts(&ring), (std::vector<uint64_t>{0, 1, 2, 3}));
+  EXPECT_EQ(ring.TakeDropped(), 3u);
+  EXPECT_EQ(ring.TakeDropped(), 0u);
+
+  // Draining frees the slots again.
+  for (uint64_t i = 10; i < 14; ++i) ring.Push("full", i, i, nullptr);
+  EXPECT_EQ(DrainStarts(&ring), (std::vector<uint64_t>{10, 11, 12, 13}));
+  EXPECT_EQ(ring.TakeDropped(), 0u);
+}
+
+TEST(HostEventRing, KeepsMessagesPerSlot) {
+  HostEventRing ring(2, 0, true);
+  std::string msg = "first";
+  std::vector<std::string> msgs;
+  auto collect = [&](const HostEvent &, const std::string *m) {
+    ASSERT_NE(m, nullptr);
+    msgs.push_back(*m);
+  };
+  ring.Push("m", 0, 0, &msg);
+  ring.Push("m", 1, 1, nullptr);
+  ring.Drain(collect);
+  // The next push reuses the slot of "first" and must not leak it.
+  ring.Push("m", 2, 2, nullptr);
+  msg = "third";
+  ring.Push("m", 3, 3, &msg);
+  ring.Drain(collect);
+  EXPECT_EQ(msgs, (std::vector<std::string>{"first", "", "", "third"}));
+}
+
+TEST(HostEventRing, ProducerRacesDrainer) {
+  constexpr uint64_t kEvents = 200000;
+  HostEventRing ring(64, 0, true);
+  std::atomic<bool> done{false};
+  std::thread producer([&] {
+    std::string msg;
+    for (uint64_t i = 0; i < kEvents; ++i) {
+      msg = std::to_string(i);
+      ring.Push("race", i, i + 1, &msg);
+    }
+    ring.MarkExited();
+    done.store(true, std::memory_order_release);
+  });
+
+  uint64_t drained = 0;
+  uint64_t last = 0;
+  bool ordered = true;
+  bool consistent = true;
+  auto check = [&](const HostEvent &event, const std::string *msg) {
+    if (drained > 0 && event.start_ticks <= last) ordered = false;
+    if (event.end_ticks != event.start_ticks + 1 ||
+        *msg != std::to_string(event.start_ticks)) {
+      consistent = false;
+    }
+    last = event.start_ticks;
+    ++drained;
+  };
+  while (!done.load(std::memory_order_acquire)) ring.Drain(check);
+  producer.join();
+  ring.Drain(check);
+
+  EXPECT_TRUE(ordered);
+  EXPECT_TRUE(consistent);
+  EXPECT_TRUE(ring.Exited());
+  EXPECT_TRUE(ring.Empty());
+  EXPECT_EQ(drained + ring.TakeDropped(), kEvents);
+}
+
+TEST(HostEventRecorder, DrainsRingsOfExitedThreads) {
+  auto &recorder = HostEventRecorder::Instance();
+  // Rounded up to 4 for the rings created below.
+  recorder.Configure(3, false);
+
+  std::vector<std::thread> threads;
+  for (uint64_t t = 0; t < 2; ++t) {
+    threads.emplace_back([&recorder, t] {
+      for (uint64_t i = 0; i < 6; ++i) {
+        recorder.Record("thread", t * 100 + i, t * 100 + i);
+      }
+    });
+  }
+  for (auto &thread : threads) thread.join();
+
+  std::vector<std::vector<uint64_t>> starts(2);
+  std::vector<uint64_t> tids(2, 0);
+  uint64_t dropped =
+      recorder.Drain([&](uint64_t tid, const HostEvent &event,
+                         const std::string *msg) {
+        EXPECT_EQ(msg, nullptr);
+        size_t t = event.start_ticks / 100;
+        ASSERT_LT(t, 2u);
+        EXPECT_TRUE(tids[t] == 0 || tids[t] == tid);
+        tids[t] = tid;
+        starts[t].push_back(event.start_ticks);
+      });
+  EXPECT_EQ(dropped, 4u);
+  EXPECT_EQ(starts[0], (std::vector<uint64_t>{0, 1, 2, 3}));
+  EXPECT_EQ(starts[1], (std::vector<uint64_t>{100, 101, 102, 103}));
+  EXPECT_NE(tids[0], tids[1]);
+
+  // The drained rings of the exited threads are gone.
+  size_t events = 0;
+  EXPECT_EQ(recorder.Drain([&](uint64_t, const HostEvent &,
+                               const std::string *) { ++events; }),
+            0u);
+  EXPECT_EQ(events, 0u);
+}
+
+TEST(HostEventTimeline, InterpolatesBetweenAnchors) {
+  HostEventTimeline timeline(1000, 5000, 3000, 9000);
+  EXPECT_EQ(timeline.ToNs(1000), 5000u);
+  EXPECT_EQ(timeline.ToNs(2000), 7000u);
+  EXPECT_EQ(timeline.ToNs(3000), 9000u);
+  // Ticks read just before the first anchor map before it.
+  EXPECT_EQ(timeline.ToNs(500), 4000u);
+
+  // Without a usable second anchor ticks are taken as nanoseconds.
+  HostEventTimeline flat(1000, 5000, 1000, 5000);
+  EXPECT_EQ(flat.ToNs(1500), 5500u);
+  EXPECT_EQ(HostEventTimeline().ToNs(42), 42u);
+}
+
+TEST(HostEventTimeline, KeepsClockOrder) {
+  uint64_t begin_ticks, begin_ns;
+  HostEventClock::Anchor(&begin_ticks, &begin_ns);
+  std::vector<uint64_t> ticks;
+  for (int i = 0; i < 1000; ++i) ticks.push_back(HostEventClock::Now());
+  std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  uint64_t end_ticks, end_ns;
+  HostEventClock::Anchor(&end_ticks, &end_ns);
+  ASSERT_GT(end_ticks, begin_ticks);
+  ASSERT_GT(end_ns, begin_ns);
+
+  HostEventTimeline timeline(begin_ticks, begin_ns, end_ticks, end_ns);
+  uint64_t last_ns = timeline.ToNs(begin_ticks);
+  for (uint64_t t : ticks) {
+    uint64_t ns = timeline.ToNs(t);
+    EXPECT_GE(ns, last_ns);
+    last_ns = ns;
+  }
+  EXPECT_LE(last_ns, end_ns);
+  EXPECT_NEAR(static_cast<double>(timeline.ToNs(end_ticks)),
+              static_cast<double>(end_ns),
+              1.0);
+}
@@ -0,0 +1,114 @@
+// BSD 3- Clause License Copyright (c) 2023, Tecorigin Co., Ltd. All rights
+// reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+// Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software
+// without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY,OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)  ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+// OF SUCH DAMAGE.
+
+#include <stdlib.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "kernels/funcs/op_policy.h"
+
+using custom_kernel::OpIdRegistry;
+using custom_kernel::OpPolicy;
+using custom_kernel::SplitOpList;
+
+TEST(OpPolicy, SplitOpList) {
+  EXPECT_EQ(SplitOpList(""), std::vector<std::string>{});
+  EXPECT_EQ(SplitOpList(" softmax , ,softmax_grad,"),
+            (std::vector<std::string>{"softmax", "softmax_grad"}));
+}
+
+TEST(OpPolicy, RegistryIdsAreStable) {
+  int a = OpIdRegistry::Instance().Register("registry_op_a");
+  int b = OpIdRegistry::Instance().Register("registry_op_b");
+  EXPECT_NE(a, b);
+  EXPECT_EQ(OpIdRegistry::Instance().Register("registry_op_a"), a);
+  EXPECT_EQ(OpIdRegistry::Instance().Find("registry_op_b"), b);
+  EXPECT_EQ(OpIdRegistry::Instance().Find("never_registered"), -1);
+}
+
+TEST(OpPolicy, ResolveFromList) {
+  std::vector<std::string> unsupported;
+  OpPolicy policy("SDAA_TEST_UNUSED_OP_LIST",
+                  [&](const std::string& op) { unsupported.push_back(op); });
+  int matmul = policy.Declare("test_matmul");
+  int conv = policy.Declare("test_conv");
+  // Registered for another policy only.
+  OpIdRegistry::Instance().Register("test_other");
+
+  policy.ResolveFrom("test_conv,test_other,test_unknown");
+  EXPECT_FALSE(policy.Enabled(matmul));
+  EXPECT_TRUE(policy.Enabled(conv));
+  EXPECT_EQ(unsupported,
+            (std::vector<std::string>{"test_other", "test_unknown"}));
+
+  policy.ResolveFrom("test_matmul");
+  EXPECT_TRUE(policy.Enabled(matmul));
+  EXPECT_FALSE(policy.Enabled(conv));
+}
+
+TEST(OpPolicy, ResolvesFromEnvOnFirstQuery) {
+  setenv("SDAA_TEST_OP_LIST", "test_env_op", 1);
+  OpPolicy policy("SDAA_TEST_OP_LIST", nullptr);
+  int id = policy.Declare("test_env_op");
+  int other = policy.Declare("test_env_other");
+  EXPECT_TRUE(policy.Enabled(id));
+  EXPECT_FALSE(policy.Enabled(other));
+  // The list is read once.
+  setenv("SDAA_TEST_OP_LIST", "test_env_other", 1);
+  EXPECT_FALSE(policy.Enabled(other));
+  unsetenv("SDAA_TEST_OP_LIST");
+}
+
+TEST(OpPolicy, ConcurrentFirstQueriesResolveOnce) {
+  setenv("SDAA_TEST_RACE_OP_LIST", "test_race_op,test_race_unknown", 1);
+  std::atomic<int> unsupported{0};
+  OpPolicy policy("SDAA_TEST_RACE_OP_LIST",
+                  [&](const std::string&) { ++unsupported; });
+  int id = policy.Declare("test_race_op");
+  int other = policy.Declare("test_race_other");
+  std::atomic<int> wrong{0};
+  std::atomic<int> waiting{8};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&] {
+      // Released together, so their first queries race.
+      --waiting;
+      while (waiting.load() > 0) {
+      }
+      for (int i = 0; i < 1000; ++i) {
+        if (!policy.Enabled(id) || policy.Enabled(other)) ++wrong;
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  EXPECT_EQ(wrong.load(), 0);
+  EXPECT_EQ(unsupported.load(), 1);
+  unsetenv("SDAA_TEST_RACE_OP_LIST");
+}